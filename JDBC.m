@@ -31,12 +31,15 @@
 #import	<Foundation/NSData.h>
 #import	<Foundation/NSDate.h>
 #import	<Foundation/NSDictionary.h>
+#import	<Foundation/NSEnumerator.h>
 #import	<Foundation/NSException.h>
+#import	<Foundation/NSFileManager.h>
 #import	<Foundation/NSLock.h>
 #import	<Foundation/NSMapTable.h>
 #import	<Foundation/NSNotification.h>
 #import	<Foundation/NSNotification.h>
 #import	<Foundation/NSNull.h>
+#import	<Foundation/NSPathUtilities.h>
 #import	<Foundation/NSProcessInfo.h>
 #import	<Foundation/NSString.h>
 #import	<Foundation/NSThread.h>
@@ -72,8 +75,14 @@ typedef struct {
   jmethodID	addBatch;
   jmethodID	clearBatch;
   jmethodID	executeBatch;
+  NSMapTable	*prepared;	// PreparedStatement by statement text
+  NSMutableArray	*preparedOrder;	// Statement text, least recent first
 } JInfo;
 
+/* The maximum number of PreparedStatement objects cached per connection.
+ */
+#define	PREPARED_CACHE	32
+
 
 /* SQLClientJVM shamelessly stolen from JIGS ... written by Nicola Pero
  * and copyright the Free Software Foundation.
@@ -247,9 +256,41 @@ JNIEnv *SQLClientJNIEnv ()
 
 + (NSString *) defaultClassPath
 {
-  NSDictionary *environment = [[NSProcessInfo processInfo] environment];
+  NSDictionary		*environment = [[NSProcessInfo processInfo] environment];
+  NSString		*classPath = [environment objectForKey: @"CLASSPATH"];
+  NSMutableArray	*paths = [NSMutableArray arrayWithCapacity: 4];
 
-  return [environment objectForKey: @"CLASSPATH"];
+  if ([classPath length] > 0)
+    {
+      [paths addObject: classPath];
+    }
+#if	defined(GNUSTEP_BASE_LIBRARY)
+  {
+    NSFileManager	*mgr = [NSFileManager defaultManager];
+    NSEnumerator	*e;
+    NSString		*dir;
+
+    /* Our helper classes (eg SQLClientFetch) are installed in the GNUstep
+     * Java directories, which are not normally on the class path.
+     */
+    e = [NSSearchPathForDirectoriesInDomains(GSLibrariesDirectory,
+      NSAllDomainsMask, YES) objectEnumerator];
+    while (nil != (dir = [e nextObject]))
+      {
+	dir = [dir stringByAppendingPathComponent: @"Java"];
+	if (NO == [paths containsObject: dir]
+	  && YES == [mgr fileExistsAtPath: dir])
+	  {
+	    [paths addObject: dir];
+	  }
+      }
+  }
+#endif
+  if (0 == [paths count])
+    {
+      return nil;
+    }
+  return [paths componentsJoinedByString: @":"];
 }
 
 + (NSString *) defaultLibraryPath
@@ -731,7 +772,149 @@ static NSDate* NSDateFromNSString (NSString *s)
     }
 }
 
+/* Classes and method IDs looked up once when the JVM is started rather
+ * than for each statement.  The classes are held as global references so
+ * that they (and therefore the method IDs) remain valid.
+ */
+static jclass		jcStatement = 0;
+static jclass		jcPreparedStatement = 0;
+static jclass		jcResultSet = 0;
+static jclass		jcResultSetMetaData = 0;
+
+static jmethodID	jmClose = 0;
+static jmethodID	jmSetBytes = 0;
+static jmethodID	jmExecuteUpdate = 0;
+static jmethodID	jmExecuteQuery = 0;
+static jmethodID	jmAddBatch = 0;
+static jmethodID	jmClearBatch = 0;
+static jmethodID	jmExecuteBatch = 0;
+static jmethodID	jmGetMetaData = 0;
+static jmethodID	jmNext = 0;
+static jmethodID	jmWasNull = 0;
+static jmethodID	jmGetBoolean = 0;
+static jmethodID	jmGetBytes = 0;
+static jmethodID	jmGetString = 0;
+static jmethodID	jmResultClose = 0;
+static jmethodID	jmGetColumnCount = 0;
+static jmethodID	jmGetColumnName = 0;
+static jmethodID	jmGetColumnType = 0;
+
+/* The optional helper class (shipped with the bundle) used to fetch query
+ * results in batches, and the number of rows to fetch in each batch.
+ * If the class can't be loaded, we fetch results one value at a time.
+ */
+static jclass		jcFetch = 0;
+static jmethodID	jmFetch = 0;
+
+#define	FETCH_ROWS	256
+
+static jclass
+JGlobalClass(JNIEnv *env, const char *name)
+{
+  jclass	jc = (*env)->FindClass(env, name);
+
+  JException (env);
+  jc = (*env)->NewGlobalRef(env, jc);
+  JException (env);
+  return jc;
+}
+
+static jmethodID
+JMethod(JNIEnv *env, jclass jc, const char *name, const char *sig)
+{
+  jmethodID	jm = (*env)->GetMethodID(env, jc, name, sig);
+
+  JException (env);
+  return jm;
+}
+
+static void
+JClosePrepared(JNIEnv *env, jobject js)
+{
+  (*env)->CallVoidMethod (env, js, jmClose);
+  JExceptionClear (env);
+  (*env)->DeleteGlobalRef (env, js);
+}
+
+/* Returns a PreparedStatement for the statement text (in which any
+ * out-of-line arguments are marked as usual), from the connection's cache
+ * of recently used statements if possible.  The least recently used
+ * statement is closed to make room when the cache is full.
+ */
+static jobject
+JPrepared(JNIEnv *env, JInfo *ji, NSString *stmt)
+{
+  jobject	js = (jobject)NSMapGet(ji->prepared, stmt);
+
+  if (0 == js)
+    {
+      NSString	*sql;
+      jobject	jo;
+
+      sql = [stmt stringByReplacingString: @"'?'''?'" withString: @"?"];
+      jo = (*env)->CallObjectMethod (env, ji->connection, ji->prepare,
+	JStringFromNSString(env, sql));
+      JException (env);
+      js = (*env)->NewGlobalRef(env, jo);
+      JException (env);
+      (*env)->DeleteLocalRef(env, jo);
+
+      if ([ji->preparedOrder count] >= PREPARED_CACHE)
+	{
+	  NSString	*old = [ji->preparedOrder objectAtIndex: 0];
+
+	  JClosePrepared(env, (jobject)NSMapGet(ji->prepared, old));
+	  NSMapRemove(ji->prepared, old);
+	  [ji->preparedOrder removeObjectAtIndex: 0];
+	}
+      stmt = [stmt copy];
+      NSMapInsert(ji->prepared, stmt, js);
+      [ji->preparedOrder addObject: stmt];
+      [stmt release];
+    }
+  else if (NO == [[ji->preparedOrder lastObject] isEqual: stmt])
+    {
+      NSUInteger	index = [ji->preparedOrder indexOfObject: stmt];
+
+      stmt = [[ji->preparedOrder objectAtIndex: index] retain];
+      [ji->preparedOrder removeObjectAtIndex: index];
+      [ji->preparedOrder addObject: stmt];
+      [stmt release];
+    }
+  return js;
+}
+
+/* Sets the out-of-line (BLOB) arguments of a prepared statement.
+ */
+static void
+JSetBytes(JNIEnv *env, jobject js, NSArray *info)
+{
+  unsigned	c = [info count];
+  unsigned	i;
+
+  for (i = 1; i < c; i++)
+    {
+      jbyteArray	ja;
+
+      ja = ByteArrayFromNSData(env, [info objectAtIndex: i]);
+      JException (env);
+      (*env)->CallVoidMethod (env, js, jmSetBytes, i, ja);
+      JException (env);
+      (*env)->DeleteLocalRef (env, ja);
+    }
+}
+
 @interface SQLClientJDBC : SQLClient
+- (NSMutableArray*) _query: (NSString*)stmt
+		      info: (NSArray*)info
+		recordType: (id)rType
+		  listType: (id)lType;
+- (void) _fetch: (jobject)result
+	  count: (int)fieldCount
+	  types: (int*)types
+	   keys: (NSString**)keys
+     recordType: (id)rType
+	   into: (NSMutableArray*)records;
 @end
 
 static NSDate	*future = nil;
@@ -814,6 +997,54 @@ static	int	JDBCVARCHAR = 0;
       JDBCVARCHAR = (*env)->GetStaticIntField(env, jc, jf);
       JException (env);
 
+      jcStatement = JGlobalClass(env, "java/sql/Statement");
+      jmClose = JMethod(env, jcStatement, "close", "()V");
+      jmClearBatch = JMethod(env, jcStatement, "clearBatch", "()V");
+      jmExecuteBatch = JMethod(env, jcStatement, "executeBatch", "()[I");
+
+      jcPreparedStatement = JGlobalClass(env, "java/sql/PreparedStatement");
+      jmSetBytes = JMethod(env, jcPreparedStatement,
+	"setBytes", "(I[B)V");
+      jmExecuteUpdate = JMethod(env, jcPreparedStatement,
+	"executeUpdate", "()I");
+      jmExecuteQuery = JMethod(env, jcPreparedStatement,
+	"executeQuery", "()Ljava/sql/ResultSet;");
+      jmAddBatch = JMethod(env, jcPreparedStatement, "addBatch", "()V");
+
+      jcResultSet = JGlobalClass(env, "java/sql/ResultSet");
+      jmGetMetaData = JMethod(env, jcResultSet,
+	"getMetaData", "()Ljava/sql/ResultSetMetaData;");
+      jmNext = JMethod(env, jcResultSet, "next", "()Z");
+      jmWasNull = JMethod(env, jcResultSet, "wasNull", "()Z");
+      jmGetBoolean = JMethod(env, jcResultSet, "getBoolean", "(I)Z");
+      jmGetBytes = JMethod(env, jcResultSet, "getBytes", "(I)[B");
+      jmGetString = JMethod(env, jcResultSet,
+	"getString", "(I)Ljava/lang/String;");
+      jmResultClose = JMethod(env, jcResultSet, "close", "()V");
+
+      jcResultSetMetaData = JGlobalClass(env, "java/sql/ResultSetMetaData");
+      jmGetColumnCount = JMethod(env, jcResultSetMetaData,
+	"getColumnCount", "()I");
+      jmGetColumnName = JMethod(env, jcResultSetMetaData,
+	"getColumnName", "(I)Ljava/lang/String;");
+      jmGetColumnType = JMethod(env, jcResultSetMetaData,
+	"getColumnType", "(I)I");
+
+      jc = (*env)->FindClass(env, "gnu/gnustep/SQLClient/SQLClientFetch");
+      if (jc == 0)
+	{
+	  JExceptionClear (env);	// Not installed ... fetch by value.
+	  NSLog(@"SQLClientJDBC: SQLClientFetch class not found on the class"
+	    @" path, so query results will be fetched value by value");
+	}
+      else
+	{
+	  jcFetch = (*env)->NewGlobalRef(env, jc);
+	  JException (env);
+	  jmFetch = (*env)->GetStaticMethodID(env, jcFetch, "fetch",
+	    "(Ljava/sql/ResultSet;[II)[Ljava/lang/Object;");
+	  JException (env);
+	}
     }
 }
 
@@ -831,15 +1062,27 @@ static	int	JDBCVARCHAR = 0;
 
       if ((*env)->PushLocalFrame (env, 16) >= 0)
 	{
+	  if (ji->prepared != 0)
+	    {
+	      NSMapEnumerator	e = NSEnumerateMapTable(ji->prepared);
+	      NSString		*k;
+	      jobject		js;
+
+	      while (NSNextMapEnumeratorPair(&e, (void**)&k, (void**)&js))
+		{
+		  JClosePrepared(env, js);
+		}
+	      NSEndMapTableEnumeration(&e);
+	      NSFreeMapTable(ji->prepared);
+	      ji->prepared = 0;
+	    }
+	  DESTROY(ji->preparedOrder);
 	  if (ji->statement != 0)
 	    {
-	      jc = (*env)->GetObjectClass(env, ji->statement);
-	      jm = (*env)->GetMethodID (env, jc, "close", "()V");
-	      if (jm == 0) JExceptionClear(env);
-	      else (*env)->CallVoidMethod (env, ji->statement, jm);
-	      if (jm == 0) JExceptionClear(env);
+	      (*env)->CallVoidMethod (env, ji->statement, jmClose);
+	      JExceptionClear(env);
 	      (*env)->DeleteGlobalRef (env, ji->statement);
-	      if (jm == 0) JExceptionClear(env);
+	      JExceptionClear(env);
 	    }
 	  if (ji->connection != 0)
 	    {
@@ -983,6 +1226,10 @@ static	int	JDBCVARCHAR = 0;
 
 		  ji = NSZoneMalloc(NSDefaultMallocZone(), sizeof(JInfo));
 		  memset(ji, '\0', sizeof(*ji));
+		  ji->prepared = NSCreateMapTable(NSObjectMapKeyCallBacks,
+		    NSNonOwnedPointerMapValueCallBacks, PREPARED_CACHE);
+		  ji->preparedOrder
+		    = [[NSMutableArray alloc] initWithCapacity: PREPARED_CACHE];
 		  extra = ji;
 
 		  NS_DURING
@@ -1133,10 +1380,12 @@ static	int	JDBCVARCHAR = 0;
 - (NSInteger) backendExecute: (NSArray*)info
 {
   NSAutoreleasePool     *arp = [NSAutoreleasePool new];
-  NSString	*stmt = [info objectAtIndex: 0];
+  NSString	*stmt;
   JNIEnv	*env = SQLClientJNIEnv();
   JInfo		*ji;
 
+  info = [self inlineBoundArrays: info];
+  stmt = [info objectAtIndex: 0];
   if ([stmt length] == 0)
     {
       [arp release];
@@ -1154,7 +1403,6 @@ static	int	JDBCVARCHAR = 0;
 
   NS_DURING
     {
-      jmethodID	jm;
       jobject	js;
 
       /*
@@ -1171,30 +1419,9 @@ static	int	JDBCVARCHAR = 0;
 
       if ([info count] > 1)
         {
-	  unsigned	i;
-	  jclass	jc;
-
-	  stmt = [stmt stringByReplacingString: @"'?'''?'" withString: @"?"];
-
-	  js = (*env)->CallObjectMethod (env, ji->connection, ji->prepare,
-	    JStringFromNSString(env, stmt));
-	  JException(env);
-
-          jc = (*env)->GetObjectClass(env, js);
-	  JException(env);
-	  jm = (*env)->GetMethodID (env, jc, "setBytes", "(I[B)V");
-	  JException(env);
-
-	  for (i = 1; i < [info count]; i++)
-	    {
-	      (*env)->CallIntMethod (env, js, jm, i,
-	        ByteArrayFromNSData(env, [info objectAtIndex: i]));
-	      JException(env);
-	    }
-
-	  jm = (*env)->GetMethodID (env, jc, "executeUpdate", "()I");
-	  JException(env);
-	  (*env)->CallIntMethod (env, js, jm);
+	  js = JPrepared(env, ji, stmt);
+	  JSetBytes(env, js, info);
+	  (*env)->CallIntMethod (env, js, jmExecuteUpdate);
 	}
       else
 	{
@@ -1238,9 +1465,83 @@ static	int	JDBCVARCHAR = 0;
   return -1;
 }
 
+/* Oracle (among others) does not accept 'SELECT 1', so we ask the
+ * driver to check the connection using Connection.isValid(), waiting
+ * for at most the statement timeout (or five seconds if there is none).
+ */
+- (BOOL) backendIsValid
+{
+  JNIEnv	*env = SQLClientJNIEnv();
+  NSTimeInterval	t = [self statementTimeout];
+  jboolean	ok = JNI_FALSE;
+
+  if (t <= 0.0)
+    {
+      t = 5.0;
+    }
+  [lock lock];
+  if (NO == connected || 0 == extra)
+    {
+      [lock unlock];
+      return NO;
+    }
+  if ((*env)->PushLocalFrame (env, 8) < 0)
+    {
+      JExceptionClear(env);
+      [lock unlock];
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"No java memory for validation"];
+    }
+  NS_DURING
+    {
+      JInfo	*ji = (JInfo*)extra;
+      jclass	jc;
+      jmethodID	jm;
+
+      jc = (*env)->GetObjectClass(env, ji->connection);
+      jm = (*env)->GetMethodID(env, jc, "isValid", "(I)Z");
+      JException(env);
+      ok = (*env)->CallBooleanMethod(env, ji->connection, jm,
+	(jint)(t + 0.999));
+      JException(env);
+      (*env)->PopLocalFrame (env, NULL);
+    }
+  NS_HANDLER
+    {
+      (*env)->PopLocalFrame (env, NULL);
+      [lock unlock];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+  [lock unlock];
+  return (JNI_TRUE == ok) ? YES : NO;
+}
+
 - (NSMutableArray*) backendQuery: (NSString*)stmt
 		      recordType: (id)rType
 		        listType: (id)lType
+{
+  return [self _query: stmt info: nil recordType: rType listType: lType];
+}
+
+- (NSMutableArray*) backendQueryPrepared: (NSArray*)info
+			      recordType: (id)rType
+			        listType: (id)lType
+{
+  info = [self inlineBoundArrays: info];
+  return [self _query: [info objectAtIndex: 0]
+		 info: info
+	   recordType: rType
+	     listType: lType];
+}
+
+/* Runs a query, using a cached PreparedStatement if there are out-of-line
+ * arguments in info.
+ */
+- (NSMutableArray*) _query: (NSString*)stmt
+		      info: (NSArray*)info
+		recordType: (id)rType
+		  listType: (id)lType
 {
   NSMutableArray	*records = nil;
   NSAutoreleasePool     *arp = [NSAutoreleasePool new];
@@ -1265,11 +1566,8 @@ static	int	JDBCVARCHAR = 0;
   NS_DURING
     {
       int	fieldCount;
-      jclass	resultClass;
       jobject	result;
-      jclass	metaDatlType;
       jobject	metaData;
-      jmethodID	jm;
 
       /*
        * Ensure we have a working connection.
@@ -1283,22 +1581,22 @@ static	int	JDBCVARCHAR = 0;
 
       ji = (JInfo*)extra;
 
-      result = (*env)->CallObjectMethod (env, ji->statement, ji->executeQuery,
-        JStringFromNSString(env, stmt));
-      JException (env);
-      resultClass = (*env)->GetObjectClass(env, result);
-      JException (env);
-      jm = (*env)->GetMethodID (env, resultClass,
-        "getMetaData", "()Ljava/sql/ResultSetMetaData;");
-      JException (env);
-      metaData = (*env)->CallObjectMethod (env, result, jm);
-      JException (env);
-      metaDatlType = (*env)->GetObjectClass(env, metaData);
+      if ([info count] > 1)
+	{
+	  jobject	js = JPrepared(env, ji, stmt);
+
+	  JSetBytes(env, js, info);
+	  result = (*env)->CallObjectMethod (env, js, jmExecuteQuery);
+	}
+      else
+	{
+	  result = (*env)->CallObjectMethod (env, ji->statement,
+	    ji->executeQuery, JStringFromNSString(env, stmt));
+	}
       JException (env);
-      jm = (*env)->GetMethodID (env, metaDatlType,
-        "getColumnCount", "()I");
+      metaData = (*env)->CallObjectMethod (env, result, jmGetMetaData);
       JException (env);
-      fieldCount = (*env)->CallIntMethod (env, metaData, jm);
+      fieldCount = (*env)->CallIntMethod (env, metaData, jmGetColumnCount);
       JException (env);
 
       if (fieldCount > 0)
@@ -1306,21 +1604,13 @@ static	int	JDBCVARCHAR = 0;
 	  NSString	*keys[fieldCount];
 	  int		types[fieldCount];
 	  unsigned	i;
-	  jmethodID	next;
-	  jmethodID	wasNull;
-	  jmethodID	getBinaryStream;
-	  jmethodID	getBoolean;
-	  jmethodID	getBytes;
-	  jmethodID	getString;
 
 	  /* Get the names of each field
 	   */
-	  jm = (*env)->GetMethodID (env, metaDatlType,
-	    "getColumnName", "(I)Ljava/lang/String;");
-	  JException (env);
 	  for (i = 0; i < fieldCount; i++)
 	    {
-	      jstring	js = (*env)->CallObjectMethod (env, metaData, jm, i+1);
+	      jstring	js = (*env)->CallObjectMethod (env, metaData,
+		jmGetColumnName, i+1);
 
 	      JException (env);
 	      keys[i] = NSStringFromJString (env, js);
@@ -1329,12 +1619,10 @@ static	int	JDBCVARCHAR = 0;
 	  /* Get the types of each field.
 	   * We treat most as strings.
 	   */
-	  jm = (*env)->GetMethodID (env, metaDatlType,
-	    "getColumnType", "(I)I");
-	  JException (env);
 	  for (i = 0; i < fieldCount; i++)
 	    {
-	      int	v = (*env)->CallIntMethod (env, metaData, jm, i+1);
+	      int	v = (*env)->CallIntMethod (env, metaData,
+		jmGetColumnType, i+1);
 
 	      if (v == JDBCDATE || v == JDBCTIME || v == JDBCTIMESTAMP)
 	        {
@@ -1357,27 +1645,18 @@ static	int	JDBCVARCHAR = 0;
 
           /* Iterate through the result set
 	   */
-	  wasNull = (*env)->GetMethodID (env, resultClass,
-	    "wasNull", "()Z");
-	  JException (env);
-	  getBinaryStream = (*env)->GetMethodID (env, resultClass,
-	    "getBinaryStream", "(I)Ljava/io/InputStream;");
-	  JException (env);
-	  getBoolean = (*env)->GetMethodID (env, resultClass,
-	    "getBoolean", "(I)Z");
-	  JException (env);
-	  getBytes = (*env)->GetMethodID (env, resultClass,
-	    "getBytes", "(I)[B");
-	  JException (env);
-	  getString = (*env)->GetMethodID (env, resultClass,
-	    "getString", "(I)Ljava/lang/String;");
-	  JException (env);
-
-	  next = (*env)->GetMethodID (env, resultClass,
-	    "next", "()Z");
-	  JException (env);
 	  records = [[lType alloc] initWithCapacity: 2];
-	  while ((*env)->CallBooleanMethod (env, result, next) == JNI_TRUE)
+	  if (0 != jcFetch)
+	    {
+	      [self _fetch: result
+		     count: fieldCount
+		     types: types
+		      keys: keys
+		recordType: rType
+		      into: records];
+	    }
+	  while (0 == jcFetch
+	    && (*env)->CallBooleanMethod (env, result, jmNext) == JNI_TRUE)
 	    {
 	      SQLRecord	*record;
 	      id	values[fieldCount];
@@ -1401,13 +1680,13 @@ static	int	JDBCVARCHAR = 0;
 			  BOOL	b = NO;
 
 			  if ((*env)->CallBooleanMethod (env, result,
-			    getBoolean, j+1) == JNI_TRUE)
+			    jmGetBoolean, j+1) == JNI_TRUE)
 			    {
 			      b = YES;
 			    }
 			  JException (env);
 			  if ((*env)->CallBooleanMethod (env, result,
-			    wasNull) == JNI_FALSE)
+			    jmWasNull) == JNI_FALSE)
 			    {
 			      if (b == YES)
 				{
@@ -1425,10 +1704,10 @@ static	int	JDBCVARCHAR = 0;
 			  jobject	jo;
 
 			  jo = (*env)->CallObjectMethod (env, result,
-			    getString, j+1);
+			    jmGetString, j+1);
 			  JException (env);
 			  if ((*env)->CallBooleanMethod (env, result,
-			    wasNull) == JNI_FALSE)
+			    jmWasNull) == JNI_FALSE)
 			    {
 			      v = NSStringFromJString(env, jo);
 			      v = NSDateFromNSString(v);
@@ -1440,10 +1719,10 @@ static	int	JDBCVARCHAR = 0;
 			  jbyteArray	jo;
 
 			  jo = (*env)->CallObjectMethod (env, result,
-			    getBytes, j+1);
+			    jmGetBytes, j+1);
 			  JException (env);
 			  if ((*env)->CallBooleanMethod (env, result,
-			    wasNull) == JNI_FALSE)
+			    jmWasNull) == JNI_FALSE)
 			    {
 			      v = NSDataFromByteArray(env, jo);
 			    }
@@ -1454,10 +1733,10 @@ static	int	JDBCVARCHAR = 0;
 			  jobject	jo;
 
 			  jo = (*env)->CallObjectMethod (env, result,
-			    getString, j+1);
+			    jmGetString, j+1);
 			  JException (env);
 			  if ((*env)->CallBooleanMethod (env, result,
-			    wasNull) == JNI_FALSE)
+			    jmWasNull) == JNI_FALSE)
 			    {
 			      v = NSStringFromJString(env, jo);
 			    }
@@ -1484,6 +1763,8 @@ static	int	JDBCVARCHAR = 0;
 	{
 	  records = [[lType alloc] initWithCapacity: 0];
 	}
+      (*env)->CallVoidMethod (env, result, jmResultClose);
+      JException (env);
       (*env)->PopLocalFrame (env, NULL);
     }
   NS_HANDLER
@@ -1515,6 +1796,139 @@ static	int	JDBCVARCHAR = 0;
   return [records autorelease];
 }
 
+/* Fetches all the remaining rows of the result set in batches using the
+ * helper class, so that each batch costs a handful of JNI calls rather
+ * than several calls for every value, and adds a record for each row.
+ */
+- (void) _fetch: (jobject)result
+	  count: (int)fieldCount
+	  types: (int*)types
+	   keys: (NSString**)keys
+     recordType: (id)rType
+	   into: (NSMutableArray*)records
+{
+  JNIEnv	*env = SQLClientJNIEnv();
+  jint		kinds[fieldCount];
+  jintArray	jk;
+  int		i;
+
+  for (i = 0; i < fieldCount; i++)
+    {
+      if (types[i] == JDBCBLOB)
+	{
+	  kinds[i] = 2;		// SQLClientFetch.BINARY
+	}
+      else if (types[i] == JDBCBOOLEAN)
+	{
+	  kinds[i] = 1;		// SQLClientFetch.BOOLEAN
+	}
+      else
+	{
+	  kinds[i] = 0;		// SQLClientFetch.TEXT
+	}
+    }
+  jk = (*env)->NewIntArray(env, fieldCount);
+  JException (env);
+  (*env)->SetIntArrayRegion(env, jk, 0, fieldCount, kinds);
+  JException (env);
+
+  for (;;)
+    {
+      NSAutoreleasePool	*arp;
+      jobjectArray	batch;
+      jintArray		jl;
+      jcharArray	jt;
+      jbyteArray	jd;
+      jint		*lengths;
+      jchar		*text;
+      jbyte		*data;
+      const jchar	*tp;
+      const jbyte	*dp;
+      jsize		rows;
+      jsize		r;
+
+      if ((*env)->PushLocalFrame (env, 8) < 0)
+	{
+	  JExceptionClear(env);
+	  [NSException raise: NSInternalInconsistencyException
+		      format: @"No java memory for query"];
+	}
+      batch = (*env)->CallStaticObjectMethod (env, jcFetch, jmFetch,
+	result, jk, (jint)FETCH_ROWS);
+      if ((*env)->ExceptionCheck (env))
+	{
+	  NSString	*msg = JExceptionClear (env);
+
+	  (*env)->PopLocalFrame (env, NULL);
+	  [NSException raise: JDBCException format: @"%@", msg];
+	}
+      jl = (*env)->GetObjectArrayElement (env, batch, 0);
+      jt = (*env)->GetObjectArrayElement (env, batch, 1);
+      jd = (*env)->GetObjectArrayElement (env, batch, 2);
+      rows = (*env)->GetArrayLength (env, jl) / fieldCount;
+      lengths = (*env)->GetIntArrayElements (env, jl, 0);
+      text = (*env)->GetCharArrayElements (env, jt, 0);
+      data = (*env)->GetByteArrayElements (env, jd, 0);
+      if (0 == lengths || 0 == text || 0 == data)
+	{
+	  JExceptionClear (env);
+	  (*env)->PopLocalFrame (env, NULL);
+	  [NSException raise: NSInternalInconsistencyException
+		      format: @"No java memory for query"];
+	}
+
+      arp = [NSAutoreleasePool new];
+      tp = text;
+      dp = data;
+      for (r = 0; r < rows; r++)
+	{
+	  jint		*l = lengths + r * fieldCount;
+	  id		values[fieldCount];
+	  SQLRecord	*record;
+
+	  for (i = 0; i < fieldCount; i++)
+	    {
+	      id	v = null;
+
+	      if (l[i] >= 0)
+		{
+		  if (2 == kinds[i])
+		    {
+		      v = [NSData dataWithBytes: dp length: l[i]];
+		      dp += l[i];
+		    }
+		  else
+		    {
+		      v = [NSString stringWithCharacters: tp length: l[i]];
+		      tp += l[i];
+		      if (types[i] == JDBCTIMESTAMP)
+			{
+			  v = NSDateFromNSString(v);
+			}
+		    }
+		}
+	      values[i] = v;
+	    }
+	  record = [rType newWithValues: values
+				   keys: keys
+				  count: fieldCount];
+	  [records addObject: record];
+	  [record release];
+	}
+      [arp release];
+
+      (*env)->ReleaseIntArrayElements (env, jl, lengths, JNI_ABORT);
+      (*env)->ReleaseCharArrayElements (env, jt, text, JNI_ABORT);
+      (*env)->ReleaseByteArrayElements (env, jd, data, JNI_ABORT);
+      (*env)->PopLocalFrame (env, NULL);
+      if (rows < FETCH_ROWS)
+	{
+	  break;
+	}
+    }
+  (*env)->DeleteLocalRef (env, jk);
+}
+
 - (SQLTransaction*) batch: (BOOL)stopOnFailure
 {
   _JDBCTransaction	*transaction;
@@ -1689,21 +2103,6 @@ static	int	JDBCVARCHAR = 0;
 
 @implementation	_JDBCTransaction
 
-- (BOOL) _batchable: (NSArray*)a
-{
-  unsigned      c = [a count];
-  unsigned      i;
-
-  for (i = 0; i < c; i++)
-    {
-      if ([[a objectAtIndex: i] count] > 1)
-        {
-          return NO;
-        }
-    }
-  return YES;
-}
-
 - (void) _merge: (NSMutableArray*)a
 {
   unsigned      c = [_info count];
@@ -1732,7 +2131,7 @@ static	int	JDBCVARCHAR = 0;
       SQLClientPool     *pool;
       SQLClient         *db;
       BOOL	wrapped = NO;
-      BOOL	batched = NO;
+      jobject	batched = 0;
       JNIEnv	*env;
       JInfo	*ji;
 
@@ -1761,6 +2160,9 @@ static	int	JDBCVARCHAR = 0;
       NS_DURING
 	{
 	  NSMutableArray	*statements;
+	  NSMutableArray	*updates;
+	  NSMutableData		*md;
+	  jint			*counts;
 	  unsigned		numberOfStatements;
 	  unsigned		statement;
 	  NSTimeInterval	_duration;
@@ -1781,6 +2183,12 @@ static	int	JDBCVARCHAR = 0;
           [self _merge: statements];
 	  numberOfStatements = [statements count];
 
+	  /* The update count of each statement, kept on the heap since
+	   * a transaction may be arbitrarily large.
+	   */
+	  md = [NSMutableData dataWithLength: numberOfStatements * sizeof(jint)];
+	  counts = (jint*)[md mutableBytes];
+
 	  if (_duration >= 0)
 	    {
 	      start = GSTickerTimeNow();
@@ -1791,46 +2199,115 @@ static	int	JDBCVARCHAR = 0;
 	      wrapped = YES;
 	    }
 
-	  if (numberOfStatements > 1 && ji->addBatch != 0
-	    && [self _batchable: statements] == YES)
+	  for (statement = 0; statement < numberOfStatements; statement++)
 	    {
-	      jintArray	ja;
-	      jint	*array;
-	      int	status = 0;
+	      [statements replaceObjectAtIndex: statement withObject:
+		[db inlineBoundArrays: [statements objectAtIndex: statement]]];
+	    }
 
-	      for (statement = 0; statement < numberOfStatements; statement++)
+	  if (numberOfStatements > 1 && ji->addBatch != 0)
+	    {
+	      /* Each run of consecutive statements without BLOB arguments
+	       * is batched using the plain statement, and each run of
+	       * statements with the same text and BLOB arguments is batched
+	       * using a single PreparedStatement, so the statements are
+	       * still executed in order.
+	       */
+	      statement = 0;
+	      while (statement < numberOfStatements)
 		{
-		  NSString	*stmt = [statements objectAtIndex: statement];
-		  jobject	js;
+		  NSArray	*info = [statements objectAtIndex: statement];
+		  NSString	*stmt = [info objectAtIndex: 0];
+		  unsigned	first = statement;
+		  jintArray	ja;
+		  jint		*array;
+		  jsize		n;
+		  jsize		i;
+
+		  if ([info count] > 1)
+		    {
+		      batched = JPrepared(env, ji, stmt);
+		      do
+			{
+			  JSetBytes(env, batched, info);
+			  (*env)->CallVoidMethod(env, batched, jmAddBatch);
+			  JException(env);
+			  if (++statement == numberOfStatements)
+			    {
+			      break;
+			    }
+			  info = [statements objectAtIndex: statement];
+			}
+		      while ([info count] > 1
+			&& [[info objectAtIndex: 0] isEqual: stmt]);
+		    }
+		  else
+		    {
+		      batched = ji->statement;
+		      do
+			{
+			  jstring	js = JStringFromNSString(env, stmt);
 
-		  js = (*env)->CallObjectMethod(env, ji->statement,
-		    ji->addBatch, JStringFromNSString(env, stmt));
+			  (*env)->CallVoidMethod(env, batched,
+			    ji->addBatch, js);
+			  JException(env);
+			  (*env)->DeleteLocalRef(env, js);
+			  if (++statement == numberOfStatements)
+			    {
+			      break;
+			    }
+			  info = [statements objectAtIndex: statement];
+			  stmt = [info objectAtIndex: 0];
+			}
+		      while ([info count] == 1);
+		    }
+
+		  ja = (*env)->CallObjectMethod(env, batched, jmExecuteBatch);
 		  JException(env);
-		  batched = YES;
-		}
-	      ja = (*env)->CallObjectMethod(env, ji->statement,
-		ji->executeBatch);
-	      JException(env);
-	      array = (*env)->GetIntArrayElements(env, ja, 0);
-	      for (statement = 0; statement < numberOfStatements; statement++)
-		{
-		  status = array[statement];
-		  if (status < 0 && status != -2)
+		  n = (*env)->GetArrayLength(env, ja);
+		  array = (*env)->GetIntArrayElements(env, ja, 0);
+		  for (i = 0; i < n && first + i < statement; i++)
 		    {
-		      break;
+		      counts[first + i] = array[i];
+		    }
+		  (*env)->ReleaseIntArrayElements(env, ja, array, JNI_ABORT);
+		  (*env)->DeleteLocalRef(env, ja);
+
+		  (*env)->CallVoidMethod(env, batched, jmClearBatch);
+		  batched = 0;
+		  JException(env);
+
+		  /* A driver may stop at the first failure, returning fewer
+		   * counts than there were statements.  A count of -2 is
+		   * success with the number of rows unknown.
+		   */
+		  for (i = 0; first + i < statement; i++)
+		    {
+		      if (i >= n)
+			{
+			  counts[first + i] = -3;
+			}
+		      if (counts[first + i] < 0 && counts[first + i] != -2)
+			{
+			  [NSException raise: NSGenericException
+			    format: @"Statement %u error %d in batch with %@",
+			    first + i, counts[first + i],
+			    [statements objectAtIndex: first + i]];
+			}
 		    }
 		}
-	      (*env)->ReleaseIntArrayElements(env, ja, array, 0);
 
-	      batched = NO;
-	      (*env)->CallVoidMethod(env, ji->statement, ji->clearBatch);
-	      JException(env);
+	      if ([db debugging] > 1)
+		{
+		  NSMutableString	*m;
 
-	      if (statement != numberOfStatements)
-	        {
-		  [NSException raise: NSGenericException
-		    format: @"Statement %d error %d in batch with %@",
-		    statement, status, [statements objectAtIndex: statement]];
+		  m = [NSMutableString stringWithCapacity: 8 * statement];
+		  for (statement = 0; statement < numberOfStatements;
+		    statement++)
+		    {
+		      [m appendFormat: @" %d", counts[statement]];
+		    }
+		  [db debug: @"Update counts for batch:%@", m];
 		}
 	    }
 	  else
@@ -1842,48 +2319,20 @@ static	int	JDBCVARCHAR = 0;
 		{
                   NSArray       *info = [statements objectAtIndex: statement];
 		  NSString	*stmt = [info objectAtIndex: 0];
-                  unsigned      c = [info count];
-		  jmethodID	jm;
 		  jobject	js;
 
-		  if (c == 1)
+		  if ([info count] == 1)
 		    {
-		      (*env)->CallIntMethod (env, ji->statement,
-			ji->executeUpdate, JStringFromNSString(env, stmt));
+		      counts[statement] = (*env)->CallIntMethod (env,
+			ji->statement, ji->executeUpdate,
+			JStringFromNSString(env, stmt));
 		    }
 		  else
 		    {
-		      unsigned	i;
-		      jclass	jc;
-
-		      stmt = [stmt stringByReplacingString: @"'?'''?'"
-						withString: @"?"];
-
-		      js = (*env)->CallObjectMethod
-			(env, ji->connection, ji->prepare,
-			JStringFromNSString(env, stmt));
-		      JException(env);
-
-		      jc = (*env)->GetObjectClass(env, js);
-		      JException(env);
-		      jm = (*env)->GetMethodID (env, jc, "setBytes", "(I[B)V");
-		      JException(env);
-
-		      /* Get data arguments for statement.
-		       */
-                      for (i = 1; i < c; i++)
-                        {
-                          NSData	*data;
-
-                          data = [info objectAtIndex: i];
-			  (*env)->CallIntMethod (env, js, jm, i,
-			    ByteArrayFromNSData(env, data));
-			  JException(env);
-			}
-
-		      jm = (*env)->GetMethodID(env, jc, "executeUpdate", "()I");
-		      JException(env);
-		      (*env)->CallIntMethod (env, js, jm);
+		      js = JPrepared(env, ji, stmt);
+		      JSetBytes(env, js, info);
+		      counts[statement] = (*env)->CallIntMethod (env, js,
+			jmExecuteUpdate);
 		    }
 		  JException(env);
 		}
@@ -1898,6 +2347,15 @@ static	int	JDBCVARCHAR = 0;
 
 	  (*env)->PopLocalFrame (env, NULL);
 
+	  updates = [NSMutableArray arrayWithCapacity: numberOfStatements];
+	  for (statement = 0; statement < numberOfStatements; statement++)
+	    {
+	      [updates addObject: [NSNumber numberWithInt: counts[statement]]];
+	    }
+	  [_lock lock];
+	  ASSIGNCOPY(_updateCounts, updates);
+	  [_lock unlock];
+
 	  db->_lastOperation = GSTickerTimeNow();
 	  if (_duration >= 0)
 	    {
@@ -1918,10 +2376,10 @@ static	int	JDBCVARCHAR = 0;
 	      (*env)->CallVoidMethod (env, ji->connection, ji->rollback);
 	      JException(env);
 	    }
-	  if (batched == YES)
+	  if (batched != 0)
 	    {
-	      (*env)->CallVoidMethod(env, ji->statement, ji->clearBatch);
-	      JException(env);
+	      (*env)->CallVoidMethod(env, batched, jmClearBatch);
+	      JExceptionClear(env);
 	    }
 	  (*env)->PopLocalFrame (env, NULL);
 	  [localException raise];
@@ -57,6 +57,33 @@
 
 static NSDate	*future = nil;
 static NSNull	*null = nil;
+static NSTimeZone	*gmt = nil;
+
+/* Protects the connection pointer of each client, which may be used
+ * by the watchdog thread while the client is locked by another thread.
+ */
+static NSLock	*cancelLock = nil;
+
+/* Split a database specification of the form 'name@host:port'.
+ */
+static void
+splitDatabase(NSString **dbase, NSString **host, NSString **port)
+{
+  NSRange	r;
+
+  r = [*dbase rangeOfString: @"@"];
+  if (r.length > 0)
+    {
+      *host = [*dbase substringFromIndex: NSMaxRange(r)];
+      *dbase = [*dbase substringToIndex: r.location];
+      r = [*host rangeOfString: @":"];
+      if (r.length > 0)
+	{
+	  *port = [*host substringFromIndex: NSMaxRange(r)];
+	  *host = [*host substringToIndex: r.location];
+	}
+    }
+}
 
 + (void) initialize
 {
@@ -68,6 +95,56 @@ static NSNull	*null = nil;
       [future retain];
       null = [NSNull null];
       [null retain];
+      gmt = [[NSTimeZone timeZoneForSecondsFromGMT: 0] retain];
+      cancelLock = [NSLock new];
+    }
+}
+
+/* MySQL has no out of band cancellation, so we make a separate
+ * connection to kill the statement running in our server thread.
+ */
+- (void) backendCancel
+{
+  unsigned long	tid = 0;
+
+  [cancelLock lock];
+  if (connected == YES && connection != 0)
+    {
+      tid = mysql_thread_id(connection);
+    }
+  [cancelLock unlock];
+  if (tid > 0)
+    {
+      NSString	*host = nil;
+      NSString	*port = nil;
+      NSString	*dbase = [self database];
+      MYSQL	*killer;
+      char	buf[64];
+
+      splitDatabase(&dbase, &host, &port);
+      killer = mysql_init(0);
+      if (mysql_real_connect(killer,
+	[host UTF8String],
+	[[self user] UTF8String],
+	[[self password] UTF8String],
+	[dbase UTF8String],
+	[port intValue],
+	NULL,
+	0) == 0)
+	{
+	  [self debug: @"Error connecting to '%@' (%@) to cancel - %s",
+	    [self name], [self database], mysql_error(killer)];
+	}
+      else
+	{
+	  snprintf(buf, sizeof(buf), "KILL QUERY %lu", tid);
+	  if (mysql_query(killer, buf) != 0)
+	    {
+	      [self debug: @"Error cancelling statement on '%@' - %s",
+		[self name], mysql_error(killer)];
+	    }
+	}
+      mysql_close(killer);
     }
 }
 
@@ -82,22 +159,10 @@ static NSNull	*null = nil;
 	  NSString		*host = nil;
 	  NSString		*port = nil;
 	  NSString		*dbase = [self database];
-	  NSRange		r;
 
 	  [[self class] purgeConnections: nil];
 
-	  r = [dbase rangeOfString: @"@"];
-	  if (r.length > 0)
-	    {
-	      host = [dbase substringFromIndex: NSMaxRange(r)];
-	      dbase = [dbase substringToIndex: r.location];
-	      r = [host rangeOfString: @":"];
-	      if (r.length > 0)
-		{
-		  port = [host substringFromIndex: NSMaxRange(r)];
-		  host = [host substringToIndex: r.location];
-		}
-	    }
+	  splitDatabase(&dbase, &host, &port);
 
 	  if ([self debugging] > 0)
 	    {
@@ -117,8 +182,10 @@ static NSNull	*null = nil;
 	    {
 	      [self debug: @"Error connecting to '%@' (%@) - %s",
 		[self name], [self database], mysql_error(connection)];
+	      [cancelLock lock];
 	      mysql_close(connection);
 	      extra = 0;
+	      [cancelLock unlock];
 	    }
 	  else
 	    {
@@ -155,8 +222,10 @@ static NSNull	*null = nil;
 	    {
 	      [self debug: @"Disconnecting client %@", [self clientName]];
 	    }
+	  [cancelLock lock];
           mysql_close(connection);
           extra = 0;
+	  [cancelLock unlock];
 	  if ([self debugging] > 0)
 	    {
 	      [self debug: @"Disconnected client %@", [self clientName]];
@@ -179,6 +248,7 @@ static NSNull	*null = nil;
   NSInteger             rowCount = 0;
   NSAutoreleasePool     *arp = [NSAutoreleasePool new];
 
+  info = [self inlineBoundArrays: info];
   stmt = [info objectAtIndex: 0];
   if ([stmt length] == 0)
     {
@@ -325,13 +395,20 @@ static unsigned int trim(char *str)
 	  int	recordCount = mysql_num_rows(result);
 	  int	fieldCount = mysql_num_fields(result);
 	  MYSQL_FIELD	*fields = mysql_fetch_fields(result);
+	  const char	*names[fieldCount];
 	  NSString	*keys[fieldCount];
+	  SQLRecordKeys	*k = nil;
 	  int	i;
 
 	  for (i = 0; i < fieldCount; i++)
 	    {
-	      keys[i] = [NSString stringWithUTF8String: (char*)fields[i].name];
+	      names[i] = (const char*)fields[i].name;
 	    }
+	  /* Use the shared keys for this set of columns so that we don't
+	   * need to create new key strings for every query.
+	   */
+	  [[[SQLRecordKeys keysWithUTF8Names: names count: fieldCount] order]
+	    getObjects: keys];
 
 	  records = [[ltype alloc] initWithCapacity: recordCount];
 	  for (i = 0; i < recordCount; i++)
@@ -360,6 +437,40 @@ static unsigned int trim(char *str)
 		      switch (fields[j].type)
 			{
 			  case FIELD_TYPE_TIMESTAMP:
+			    if (size >= 19 || 14 == size)
+			      {
+				char	b[20];
+
+				/* Standard format timestamp (or the older
+				 * YYYYMMDDHHMMSS format, which we convert)
+				 * in GMT ... use the fast parser.
+				 */
+				if (14 == size)
+				  {
+				    memcpy(b, p, 4);
+				    b[4] = '-';
+				    memcpy(b + 5, p + 4, 2);
+				    b[7] = '-';
+				    memcpy(b + 8, p + 6, 2);
+				    b[10] = ' ';
+				    memcpy(b + 11, p + 8, 2);
+				    b[13] = ':';
+				    memcpy(b + 14, p + 10, 2);
+				    b[16] = ':';
+				    memcpy(b + 17, p + 12, 2);
+				  }
+				else
+				  {
+				    memcpy(b, p, 19);
+				  }
+				b[19] = '\0';
+				v = SQLClientNewDateFromBuffer(b, 19, gmt);
+				[v autorelease];
+				if (nil != v)
+				  {
+				    break;
+				  }
+			      }
 			    {
 			      char	b[32];
 			      NSString	*f;
@@ -444,9 +555,25 @@ static unsigned int trim(char *str)
 		    }
 		  values[j] = v;
 		}
-	      record = [rtype newWithValues: values
-				       keys: keys
-				      count: fieldCount];
+	      if (nil == k)
+		{
+		  /* We don't have keys information, so use the
+		   * constructor where we list keys and, if the
+		   * resulting record provides keys information
+		   * on the first record, we save it for later.
+		   */
+		  record = [rtype newWithValues: values
+					   keys: keys
+					  count: fieldCount];
+		  if (0 == i && [record respondsToSelector: @selector(keys)])
+		    {
+		      k = [record keys];
+		    }
+		}
+	      else
+		{
+		  record = [rtype newWithValues: values keys: k];
+		}
 	      [records addObject: record];
 	      [record release];
 	    }
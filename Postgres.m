@@ -26,6 +26,7 @@
    */ 
 
 #import	<Foundation/NSAutoreleasePool.h>
+#import	<Foundation/NSByteOrder.h>
 #import	<Foundation/NSCalendarDate.h>
 #import	<Foundation/NSCharacterSet.h>
 #import	<Foundation/NSData.h>
@@ -33,6 +34,7 @@
 #import	<Foundation/NSDictionary.h>
 #import	<Foundation/NSException.h>
 #import	<Foundation/NSFileHandle.h>
+#import	<Foundation/NSHashTable.h>
 #import	<Foundation/NSLock.h>
 #import	<Foundation/NSMapTable.h>
 #import	<Foundation/NSNotification.h>
@@ -40,6 +42,7 @@
 #import	<Foundation/NSNull.h>
 #import	<Foundation/NSProcessInfo.h>
 #import	<Foundation/NSRunLoop.h>
+#import	<Foundation/NSSet.h>
 #import	<Foundation/NSString.h>
 #import	<Foundation/NSThread.h>
 #import	<Foundation/NSTimeZone.h>
@@ -54,6 +57,21 @@
 
 #include	<libpq-fe.h>
 
+/* On linux we can use a dedicated thread (using epoll) to handle the
+ * connections of all the clients which are configured to use it for
+ * LISTEN, rather than having each client watched by a run loop, and
+ * another to handle the connections of clients performing asynchronous
+ * queries.
+ */
+#if	defined(__linux__) && defined(GNUSTEP_BASE_LIBRARY)
+#define	USE_LISTENER_THREAD	1
+#define	USE_REACTOR_THREAD	1
+#include	<sys/epoll.h>
+#include	<errno.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#endif
+
 @interface SQLClientPostgres : SQLClient
 {
   NSDictionary	*options;
@@ -80,6 +98,10 @@ typedef struct	{
   int           _descriptor;    // For monitoring in run loop
   NSRunLoop     *_runLoop;      // For listen/unlisten monitoring
   NSDictionary	*_options;
+  BOOL		_packedArrays;	// Pack numeric arrays
+  NSMapTable	*_channels;	// Notification policies by channel
+  BOOL		_useListener;	// Listen using the listener thread
+  PGcancel	*_cancel;	// For cancelling from the watchdog
 } ConnectionInfo;
 
 #define	cInfo			((ConnectionInfo*)(self->extra))
@@ -87,9 +109,108 @@ typedef struct	{
 #define	connection		(cInfo->_connection)
 #define	options			(cInfo->_options)
 
+@interface	SQLClientPostgres (Private)
+- (NSMutableString*) _connectBegin: (NSRange*)pwRange;
+- (BOOL) _connectEnd: (NSString*)m range: (NSRange)pwRange;
+- (NSMutableString*) _connectString: (NSRange*)pwRange;
+- (NSMutableArray*) _newNotifications: (PGnotify**)batch
+				count: (NSUInteger)count
+				async: (BOOL)async;
+- (NSMutableArray*) _newRecordsFromResult: (PGresult*)result
+			       recordType: (id)rtype
+				 listType: (id)ltype;
+- (void) _checkNotifications: (BOOL)async;
+- (PGresult*) _execute: (NSArray*)info statement: (NSString*)stmt;
+- (void) _postNotifications: (NSArray*)notifications;
+- (NSMutableArray*) _query: (NSString*)stmt
+		      info: (NSArray*)info
+		recordType: (id)rtype
+		  listType: (id)ltype;
+@end
+
+#if	defined(USE_REACTOR_THREAD)
+@interface	SQLClient (Private)
+- (void) _startDeadline;
+- (BOOL) _stopDeadline;
+@end
+
+@interface	_PGAsync : NSObject
+{
+@public
+  SQLAsyncOperation	*op;		// The operation being performed
+  SQLClientPostgres	*client;	// The client (retained by op)
+  NSMutableArray	*records;	// Result of query
+  NSException		*error;		// Problem encountered
+  NSInteger		count;		// Result of statement
+  NSTimeInterval	start;		// When the operation started
+  int			fd;		// Socket being watched
+}
+@end
+
+/* The reactor owns a thread which sends the statements of asynchronous
+ * operations and waits for the results of all of them.
+ */
+@interface	_PGReactor : NSObject
+{
+  NSLock		*lock;
+  NSMutableArray	*waiting;	// Operations waiting to be sent
+  NSMutableArray	*active;	// _PGAsync objects in progress
+  NSHashTable		*busy;		// Clients in use by the reactor
+  int			epfd;
+  int			wake[2];
+}
++ (_PGReactor*) sharedReactor;
+- (void) start: (SQLAsyncOperation*)op;
+@end
+#endif
+
+#if	defined(USE_LISTENER_THREAD)
+@interface	_PGListening : NSObject
+{
+@public
+  SQLClientPostgres	*client;	// The client being listened for (unretained)
+  NSString		*conninfo;	// Connection string for client
+  NSDictionary		*options;	// Client configuration options
+  NSThread		*thread;	// Thread to deliver notifications to
+  NSMutableSet		*channels;	// Names listened to
+  NSMutableArray	*pending;	// Statements to send to the server
+  NSMapTable		*policies;	// Notification policies by channel
+  PGconn		*conn;		// Dedicated connection
+  PGconn		*ready;		// New connection to be used
+  int			fd;		// Socket for connection
+  BOOL			removed;	// No longer in use
+  BOOL			connecting;	// Connection attempt in progress
+  BOOL			failed;		// Connection attempt failed
+  NSTimeInterval	retry;		// When to try reconnecting
+}
+@end
+
+/* The listener owns the dedicated connections and a thread which waits
+ * for input on all of them.
+ */
+@interface	_PGListener : NSObject
+{
+  NSLock		*lock;
+  NSMapTable		*clients;	// _PGListening objects by client
+  NSMutableArray	*closing;	// Removed _PGListening objects
+  int			epfd;
+  int			wake[2];
+}
++ (_PGListener*) sharedListener;
+- (void) listen: (NSString*)name for: (SQLClientPostgres*)client;
+- (void) removeClient: (SQLClientPostgres*)client;
+- (void) unlisten: (NSString*)name for: (SQLClientPostgres*)client;
+@end
+#endif
+
 static NSDate	*future = nil;
 static NSNull	*null = nil;
 
+/* Protects the _cancel field of each connection, which may be used
+ * by the watchdog thread while the client is locked by another thread.
+ */
+static NSLock	*cancelLock = nil;
+
 #if	defined(GNUSTEP)
 static NSString	*placeholder = nil;
 #else
@@ -100,8 +221,6 @@ static IMP	allocStringImp = 0;
 static SEL	initStringSel = 0;
 static IMP	initStringImp = 0;
 
-static NSTimeZone	*zones[47];	// For -23 to +23 hours
-
 static inline NSString*
 newString(const char *b, int l, NSStringEncoding e)
 {
@@ -113,185 +232,6 @@ newString(const char *b, int l, NSStringEncoding e)
 #endif
 }
 
-static NSDate*
-newDateFromBuffer(const char *b, int l)
-{
-  NSCalendarDate	*d;
-  NSTimeZone 		*zone = nil;
-  int		        milliseconds = 0;
-  int			day;
-  int			month;
-  int			year;
-  int			hour;
-  int			minute;
-  int			second;
-  int		        i;
-
-  i = 0;
-
-  if (i >= l || !isdigit(b[i])) return nil;
-  year = b[i++] - '0';
-  if (i >= l || !isdigit(b[i])) return nil;
-  year = year * 10 + b[i++] - '0';
-  if (i >= l || !isdigit(b[i])) return nil;
-  year = year * 10 + b[i++] - '0';
-  if (i >= l || !isdigit(b[i])) return nil;
-  year = year * 10 + b[i++] - '0';
-
-  if (i >= l || b[i++] != '-') return nil;
-
-  if (i >= l || !isdigit(b[i])) return nil;
-  month = b[i++] - '0';
-  if (i >= l || !isdigit(b[i])) return nil;
-  month = month * 10 + b[i++] - '0';
-  if (month < 1 || month > 12) return nil;
-
-  if (i >= l || b[i++] != '-') return nil;
-
-  if (i >= l || !isdigit(b[i])) return nil;
-  day = b[i++] - '0';
-  if (i >= l || !isdigit(b[i])) return nil;
-  day = day * 10 + b[i++] - '0';
-  if (day < 1 || day > 31) return nil;
-
-  if (i == l)
-    {
-      hour = 0;
-      minute = 0;
-      second = 0;
-      zone = [NSTimeZone localTimeZone];
-    }
-  else
-    {
-      if (i >= l || b[i++] != ' ') return nil;
-
-      if (i >= l || !isdigit(b[i])) return nil;
-      hour = b[i++] - '0';
-      if (i >= l || !isdigit(b[i])) return nil;
-      hour = hour * 10 + b[i++] - '0';
-      if (hour < 0 || hour > 23) return nil;
-
-      if (i >= l || b[i++] != ':') return nil;
-
-      if (i >= l || !isdigit(b[i])) return nil;
-      minute = b[i++] - '0';
-      if (i >= l || !isdigit(b[i])) return nil;
-      minute = minute * 10 + b[i++] - '0';
-      if (minute < 0 || minute > 59) return nil;
-
-      if (i >= l || b[i++] != ':') return nil;
-
-      if (i >= l || !isdigit(b[i])) return nil;
-      second = b[i++] - '0';
-      if (i >= l || !isdigit(b[i])) return nil;
-      second = second * 10 + b[i++] - '0';
-      if (second < 0 || second > 60) return nil;
-
-      if (i < l && '.' == b[i])
-	{
-	  i++;
-	  if (i >= l || !isdigit(b[i])) return nil;
-	  milliseconds = b[i++] - '0';
-	  milliseconds *=- 10;
-	  if (i < l && isdigit(b[i]))
-	    milliseconds += b[i++] - '0';
-	  milliseconds *=- 10;
-	  if (i < l && isdigit(b[i]))
-	    milliseconds += b[i++] - '0';
-	  while (i < l && isdigit(b[i]))
-	    i++;
-	}
-
-      if (i < l && ('+' == b[i] || '-' == b[i]))
-	{
-	  char	sign = b[i++];
-          int   timezone;
-
-	  if (i >= l || !isdigit(b[i])) return nil;
-	  timezone = b[i++] - '0';
-	  if (i >= l || !isdigit(b[i])) return nil;
-	  timezone = timezone * 10 + b[i++] - '0';
-	  if (timezone < 0 || timezone > 23) return nil;
-	  timezone *= 60;	// Convert to minutes
-	  if (i < l && ':' == b[i])
-	    {
-	      int	tzmin;
-
-              i++;
-	      if (i >= l || !isdigit(b[i])) return nil;
-	      tzmin = b[i++] - '0';
-	      if (i >= l || !isdigit(b[i])) return nil;
-	      tzmin = tzmin * 10 + b[i++] - '0';
-	      if (tzmin < 0 || tzmin > 59) return nil;
-
-	      timezone += tzmin;
-	    }
-	  if ('-' == sign)
-	    timezone = -timezone;
-          if (timezone % 60 == 0)
-            {
-              zone = zones[23 + timezone / 60];
-            }
-          else
-            {
-              zone = [NSTimeZone timeZoneForSecondsFromGMT: timezone * 60];
-            }
-	}
-      else
-        {
-          zone = [NSTimeZone localTimeZone];
-        }
-    }
-
-
-  d = [NSCalendarDate alloc];
-  if (year <= 1)
-    {
-      static NSTimeInterval     p = 0.0;
-
-      if (0.0 == p)
-        {
-          p = [[NSDate distantPast] timeIntervalSinceReferenceDate];
-        }
-      d = [d initWithTimeIntervalSinceReferenceDate: p];
-      [d setTimeZone: zone];
-    }
-  else if (year > 4000)
-    {
-      static NSTimeInterval     f = 0.0;
-
-      if (0.0 == f)
-        {
-          f = [[NSDate distantFuture] timeIntervalSinceReferenceDate];
-        }
-      d = [d initWithTimeIntervalSinceReferenceDate: f];
-      [d setTimeZone: zone];
-    }
-  else
-    {
-      d = [d initWithYear: year
-                    month: month
-                      day: day
-                     hour: hour
-                   minute: minute
-                   second: second
-                 timeZone: zone];
-
-      if (milliseconds > 0)
-        {
-          NSTimeInterval	ti;
-
-          ti = milliseconds;
-          ti /= 1000.0;
-          ti += [d timeIntervalSinceReferenceDate];
-          d = [d initWithTimeIntervalSinceReferenceDate: ti];
-          [d setTimeZone: zone];
-        }
-    }
-  [d setCalendarFormat: @"%Y-%m-%d %H:%M:%S %z"];
-  return d;
-}
-
 static inline NSString *
 sanitize(NSString *str, NSRange range)
 {
@@ -309,8 +249,6 @@ sanitize(NSString *str, NSRange range)
 {
   if (future == nil)
     {
-      int       i;
-
       initStringSel = @selector(initWithBytes:length:encoding:);
 #if	defined(GNUSTEP)
       placeholder = [NSString alloc];
@@ -329,11 +267,7 @@ sanitize(NSString *str, NSRange range)
       [future retain];
       null = [NSNull null];
       [null retain];
-      for (i = -23; i <= 23; i++)
-	{
-	  zones[i + 23]
-	    = [[NSTimeZone timeZoneForSecondsFromGMT: i * 60 * 60] retain];
-	}
+      cancelLock = [NSLock new];
     }
 }
 
@@ -357,6 +291,14 @@ connectQuote(NSString *str)
 {
   if (extra != 0 && connection != 0)
     {
+#if	defined(USE_LISTENER_THREAD)
+      if (YES == cInfo->_useListener)
+	{
+	  /* The listener connection implicitly unlistens just like ours.
+	   */
+	  [[_PGListener sharedListener] removeClient: self];
+	}
+#endif
 #if     defined(GNUSTEP_BASE_LIBRARY) && !defined(__MINGW__)
       if (cInfo->_runLoop != nil)
         {
@@ -371,194 +313,312 @@ connectQuote(NSString *str)
           DESTROY(cInfo->_runLoop);
         }
 #endif
+      if (cInfo->_cancel != 0)
+	{
+	  [cancelLock lock];
+	  PQfreeCancel(cInfo->_cancel);
+	  cInfo->_cancel = 0;
+	  [cancelLock unlock];
+	}
       PQfinish(connection);
       connection = 0;
       connected = NO;
     }
 }
 
-- (BOOL) backendConnect
+/* Build the libpq connection string for the receiver's configuration,
+ * setting *pwRange to the location of the password within it (so that
+ * the password can be removed when the string is logged).
+ */
+- (NSMutableString*) _connectString: (NSRange*)pwRange
+{
+  NSString		*host = nil;
+  NSString		*port = nil;
+  NSString		*dbase = [self database];
+  NSString		*sslmode = [options objectForKey: @"sslmode"];
+  NSString		*str;
+  NSRange		r;
+  NSMutableString	*m;
+
+  r = [dbase rangeOfString: @"@"];
+  if (r.length > 0)
+    {
+      host = [dbase substringFromIndex: NSMaxRange(r)];
+      dbase = [dbase substringToIndex: r.location];
+      r = [host rangeOfString: @":"];
+      if (r.length > 0)
+	{
+	  port = [host substringFromIndex: NSMaxRange(r)];
+	  host = [host substringToIndex: r.location];
+	}
+    }
+
+  m = [NSMutableString stringWithCapacity: 156];
+  [m appendString: @"dbname="];
+  [m appendString: connectQuote(dbase)];
+  str = connectQuote(host);
+  if (str != nil)
+    {
+      unichar	c = [str characterAtIndex: 1];
+
+      if (c >= '0' && c <= '9')
+	{
+	  [m appendString: @" hostaddr="];	// Numeric IP
+	}
+      else
+	{
+	  [m appendString: @" host="];		// Domain name
+	}
+      [m appendString: str];
+    }
+  str = connectQuote(port);
+  if (str != nil)
+    {
+      [m appendString: @" port="];
+      [m appendString: str];
+    }
+  str = connectQuote([self user]);
+  if (str != nil)
+    {
+      [m appendString: @" user="];
+      [m appendString: str];
+    }
+  str = connectQuote([self password]);
+  if (str != nil)
+    {
+      [m appendString: @" password="];
+      *pwRange = NSMakeRange([m length], [str length]);
+      [m appendString: str];
+    }
+  str = connectQuote([self clientName]);
+  if (str != nil)
+    {
+      [m appendString: @" application_name="];
+      [m appendString: str];
+    }
+  if ([sslmode isEqual: @"require"])
+    {
+      str = connectQuote(@"require");
+      if (str != nil)
+	{
+	  [m appendString: @" sslmode="];
+	  [m appendString: str];
+	}
+    }
+  return m;
+}
+
+/* Prepares to establish a new connection, returning the libpq connection
+ * string to use, or nil if there is no database configured.
+ */
+- (NSMutableString*) _connectBegin: (NSRange*)pwRange
 {
+  NSMutableString	*m;
+
   if (extra == 0)
     {
       extra = NSZoneMalloc(NSDefaultMallocZone(), sizeof(ConnectionInfo));
       memset(extra, '\0', sizeof(ConnectionInfo));
       cInfo->_descriptor = -1;
     }
-  if (connection == 0)
+  connected = NO;
+  if ([self database] == nil)
     {
-      connected = NO;
-      if ([self database] != nil)
-	{
-	  NSString		*host = nil;
-	  NSString		*port = nil;
-	  NSString		*dbase = [self database];
-	  NSString		*sslmode = [options objectForKey: @"sslmode"];
-	  NSString		*str;
-	  NSRange		r;
-	  NSRange		pwRange = NSMakeRange(NSNotFound, 0);
-	  NSMutableString	*m;
+      [self debug:
+	@"Connect to '%@' with no user/password/database configured",
+	[self name]];
+      return nil;
+    }
+  [[self class] purgeConnections: nil];
+  m = [self _connectString: pwRange];
+  if ([self debugging] > 0)
+    {
+      [self debug: @"Connect to '%@' as %@ (%@)",
+	sanitize(m, *pwRange), [self name], [self clientName]];
+    }
+  return m;
+}
 
-	  [[self class] purgeConnections: nil];
+/* Completes the setup of a new connection once libpq has finished
+ * establishing it (successfully or not), setting the connected flag.
+ */
+- (BOOL) _connectEnd: (NSString*)m range: (NSRange)pwRange
+{
+  if (PQstatus(connection) != CONNECTION_OK)
+    {
+      [self debug: @"Error connecting to '%@' (%@) - %s",
+	[self name], sanitize(m, pwRange), PQerrorMessage(connection)];
+      [self _backendDisconnected];
+    }
+  else if (PQsetClientEncoding(connection, "UTF-8") < 0)
+    {
+      [self debug: @"Error setting UTF-8 with '%@' (%@) - %s",
+	[self name], sanitize(m, pwRange), PQerrorMessage(connection)];
+      [self _backendDisconnected];
+    }
+  else
+    {
+      const char	*p;
 
-	  r = [dbase rangeOfString: @"@"];
-	  if (r.length > 0)
-	    {
-	      host = [dbase substringFromIndex: NSMaxRange(r)];
-	      dbase = [dbase substringToIndex: r.location];
-	      r = [host rangeOfString: @":"];
-	      if (r.length > 0)
-		{
-		  port = [host substringFromIndex: NSMaxRange(r)];
-		  host = [host substringToIndex: r.location];
-		}
-	    }
+      backendPID = PQbackendPID(connection);
+      [cancelLock lock];
+      cInfo->_cancel = PQgetCancel(connection);
+      [cancelLock unlock];
 
-	  m = [NSMutableString stringWithCapacity: 156];
-	  [m appendString: @"dbname="];
-	  [m appendString: connectQuote(dbase)];
-	  str = connectQuote(host);
-	  if (str != nil)
-	    {
-	      unichar	c = [str characterAtIndex: 1];
+      connected = YES;
 
-	      if (c >= '0' && c <= '9')
-		{
-		  [m appendString: @" hostaddr="];	// Numeric IP
-		}
-	      else
-		{
-		  [m appendString: @" host="];		// Domain name
-		}
-	      [m appendString: str];
-	    }
-	  str = connectQuote(port);
-	  if (str != nil)
-	    {
-	      [m appendString: @" port="];
-	      [m appendString: str];
-	    }
-	  str = connectQuote([self user]);
-	  if (str != nil)
-	    {
-	      [m appendString: @" user="];
-	      [m appendString: str];
-	    }
-	  str = connectQuote([self password]);
-	  if (str != nil)
+      p = PQparameterStatus(connection, "standard_conforming_strings");
+      if (p != 0)
+	{
+	  PGresult	*result;
+
+	  /* If the escape_string_warning setting is on,
+	   * the server will warn about backslashes even
+	   * in properly quoted strings, so turn it off.
+	   */
+	  if (strcmp(p, "on") == 0)
 	    {
-	      [m appendString: @" password="];
-	      pwRange = NSMakeRange([m length], [str length]);
-	      [m appendString: str];
+	      result = PQexec(connection,
+		"SET escape_string_warning=off");
 	    }
-	  str = connectQuote([self clientName]);
-	  if (str != nil)
+	  else
 	    {
-	      [m appendString: @" application_name="];
-	      [m appendString: str];
+	      result = PQexec(connection,
+		"SET standard_conforming_strings=on;"
+		"SET escape_string_warning=off");
 	    }
-	  if ([sslmode isEqual: @"require"])
+	  if (0 == result
+	    || PQresultStatus(result) != PGRES_COMMAND_OK)
 	    {
-	      str = connectQuote(@"require");
-	      if (str != nil)
+	      [self debug: @"Error setting string handling"
+		@" with '%@' (%@) - %s",
+		[self name], sanitize(m, pwRange),
+		PQerrorMessage(connection)];
+	      if (result != 0)
 		{
-		  [m appendString: @" sslmode="];
-		  [m appendString: str];
+		  PQclear(result);
+		  result = 0;
 		}
+	      [self _backendDisconnected];
 	    }
-
-	  if ([self debugging] > 0)
-	    {
-	      [self debug: @"Connect to '%@' as %@ (%@)",
-                sanitize(m, pwRange), [self name], [self clientName]];
-	    }
-	  connection = PQconnectdb([m UTF8String]);
-	  if (PQstatus(connection) != CONNECTION_OK)
+	  if (result != 0)
 	    {
-	      [self debug: @"Error connecting to '%@' (%@) - %s",
-		[self name], sanitize(m, pwRange), PQerrorMessage(connection)];
-	      [self _backendDisconnected];
+	      PQclear(result);
 	    }
-	  else if (PQsetClientEncoding(connection, "UTF-8") < 0)
+	}
+      else
+	{
+	  [self _backendDisconnected];
+	  [self debug: @"Postgres without standard conforming strings"];
+	}
+
+      if ([self debugging] > 0)
+	{
+	  if (YES == connected)
 	    {
-	      [self debug: @"Error setting UTF-8 with '%@' (%@) - %s",
-		[self name], sanitize(m, pwRange), PQerrorMessage(connection)];
-	      [self _backendDisconnected];
+	      [self debug: @"Connected to '%@'", [self name]];
 	    }
 	  else
 	    {
-	      const char	*p;
+	      [self debug: @"Disconnected '%@'", [self name]];
+	    }
+	}
+    }
+  return connected;
+}
 
-              backendPID = PQbackendPID(connection);
+- (void) backendCancel
+{
+  if (extra != 0)
+    {
+      char	buf[256];
 
-	      connected = YES;
+      [cancelLock lock];
+      if (cInfo->_cancel != 0
+	&& 0 == PQcancel(cInfo->_cancel, buf, sizeof(buf)))
+	{
+	  [self debug: @"Error cancelling statement on '%@' - %s",
+	    [self name], buf];
+	}
+      [cancelLock unlock];
+    }
+}
 
-	      p = PQparameterStatus(connection, "standard_conforming_strings");
-              if (p != 0)
-                {
-                  PGresult	*result;
+- (BOOL) backendConnect
+{
+  if (0 == extra || 0 == connection)
+    {
+      NSRange		pwRange = NSMakeRange(NSNotFound, 0);
+      NSMutableString	*m = [self _connectBegin: &pwRange];
 
-                  /* If the escape_string_warning setting is on,
-                   * the server will warn about backslashes even
-                   * in properly quoted strings, so turn it off.
-                   */
-                  if (strcmp(p, "on") == 0)
-                    {
-                      result = PQexec(connection,
-                        "SET escape_string_warning=off");
-                    }
-                  else
-                    {
-                      result = PQexec(connection,
-                        "SET standard_conforming_strings=on;"
-                        "SET escape_string_warning=off");
-                    }
-                  if (0 == result
-                    || PQresultStatus(result) != PGRES_COMMAND_OK)
-                    {
-                      [self debug: @"Error setting string handling"
-                        @" with '%@' (%@) - %s",
-                        [self name], sanitize(m, pwRange),
-                        PQerrorMessage(connection)];
-                      if (result != 0)
-                        {
-                          PQclear(result);
-                          result = 0;
-                        }
-                      [self _backendDisconnected];
-                    }
-                  if (result != 0)
-                    {
-                      PQclear(result);
-                    }
-                }
-              else
-                {
-                  [self _backendDisconnected];
-		  [self debug: @"Postgres without standard conforming strings"];
-                }
+      if (nil != m)
+	{
+	  connection = PQconnectdb([m UTF8String]);
+	  [self _connectEnd: m range: pwRange];
+	}
+    }
+  return connected;
+}
 
-	      if ([self debugging] > 0)
-		{
-                  if (YES == connected)
-                    {
-                      [self debug: @"Connected to '%@'", [self name]];
-                    }
-                  else
-                    {
-                      [self debug: @"Disconnected '%@'", [self name]];
-                    }
-		}
-	    }
+- (SQLClientConnectState) backendConnectPoll: (int*)descriptor
+{
+  NSRange	pwRange = NSMakeRange(NSNotFound, 0);
+
+  switch (PQconnectPoll(connection))
+    {
+      case PGRES_POLLING_READING:
+	*descriptor = PQsocket(connection);
+	return SQLClientConnectReading;
+
+      case PGRES_POLLING_WRITING:
+	*descriptor = PQsocket(connection);
+	return SQLClientConnectWriting;
+
+      default:
+	/* The handshake is over (successfully or not), so we can finish
+	 * off just as for a blocking connection.
+	 */
+	[self _connectEnd: [self _connectString: &pwRange] range: pwRange];
+	if (YES == connected)
+	  {
+	    return SQLClientConnectDone;
+	  }
+	return SQLClientConnectFailed;
+    }
+}
+
+- (SQLClientConnectState) backendConnectStart: (int*)descriptor
+{
+  if (0 == extra || 0 == connection)
+    {
+      NSRange		pwRange = NSMakeRange(NSNotFound, 0);
+      NSMutableString	*m = [self _connectBegin: &pwRange];
+
+      if (nil == m)
+	{
+	  return SQLClientConnectFailed;
 	}
-      else
+      connection = PQconnectStart([m UTF8String]);
+      if (0 == connection)
+	{
+	  [self debug: @"Error starting connection to '%@' (%@)",
+	    [self name], sanitize(m, pwRange)];
+	  return SQLClientConnectFailed;
+	}
+      if (PQstatus(connection) == CONNECTION_BAD)
 	{
-	  [self debug:
-	    @"Connect to '%@' with no user/password/database configured",
-	    [self name]];
+	  [self debug: @"Error starting connection to '%@' (%@) - %s",
+	    [self name], sanitize(m, pwRange), PQerrorMessage(connection)];
+	  [self _backendDisconnected];
+	  return SQLClientConnectFailed;
 	}
+      /* As documented for libpq, we must wait for the socket to be
+       * writable before the first call to PQconnectPoll().
+       */
+      *descriptor = PQsocket(connection);
+      return SQLClientConnectWriting;
     }
-  return connected;
+  return (YES == connected) ? SQLClientConnectDone : SQLClientConnectFailed;
 }
 
 /* Called by the -disconnect method aftert it has updated ivars/locks.
@@ -673,37 +733,326 @@ connectQuote(NSString *str)
     }
 }
 
-/* This method must only be called when the receiver is locked.
+/* Notifications read from the database are de-duplicated on the channel
+ * name, payload and sending process ID.  The hash tables used work directly
+ * on the data from libpq so that we don't need to create any objects for
+ * a notification until we know it is going to be delivered.
  */
-- (void) _checkNotifications: (BOOL)async
+static NSUInteger
+notifyHash(const char *channel, const char *payload, int pid)
 {
-  NSMutableArray	*notifications = nil;
-  PGnotify      	*notify;
+  NSUInteger	h = 2166136261U;
 
-  /* While postgres sometimes de-duplicates notifications it is not guaranteed
-   * that it will do so, and it is therefore possible for the database server
-   * to send many duplicate notifications.
-   * So we read the notifications and add them to an array only if they are not
-   * already present, flushing the buffer when it gets large.
-   */
-  while ((notify = PQnotifies(connection)) != 0)
+  while (*channel)
     {
-      NS_DURING
-        {
-	  static NSNumber   	*nY = nil;
-	  static NSNumber   	*nN = nil;
-          NSNotification        *n;
-          NSMutableDictionary   *userInfo;
-          NSString              *name;
+      h = (h ^ (unsigned char)*channel++) * 16777619U;
+    }
+  h = (h ^ 0xff) * 16777619U;
+  if (0 != payload)
+    {
+      while (*payload)
+	{
+	  h = (h ^ (unsigned char)*payload++) * 16777619U;
+	}
+    }
+  return h ^ (NSUInteger)pid;
+}
 
-	  if (nil == nN)
-	    {
-	      ASSIGN(nN, [NSNumber numberWithBool: NO]);
-	    }
-	  if (nil == nY)
-	    {
-	      ASSIGN(nY, [NSNumber numberWithBool: YES]);
+static inline BOOL
+samePayload(const char *p1, const char *p2)
+{
+  return strcmp(p1 ? p1 : "", p2 ? p2 : "") == 0 ? YES : NO;
+}
+
+/* Callbacks for a table of the PGnotify structures received in one batch.
+ */
+static NSUInteger
+pgnHash(NSHashTable *t, const void *o)
+{
+  const PGnotify	*n = (const PGnotify*)o;
+
+  return notifyHash(n->relname, n->extra, n->be_pid);
+}
+
+static BOOL
+pgnEqual(NSHashTable *t, const void *o1, const void *o2)
+{
+  const PGnotify	*n1 = (const PGnotify*)o1;
+  const PGnotify	*n2 = (const PGnotify*)o2;
+
+  if (n1->be_pid == n2->be_pid && strcmp(n1->relname, n2->relname) == 0
+    && YES == samePayload(n1->extra, n2->extra))
+    {
+      return YES;
+    }
+  return NO;
+}
+
+static const NSHashTableCallBacks pgnCallBacks = {
+  pgnHash,
+  pgnEqual,
+  0,
+  0,
+  0
+};
+
+/* Callbacks for a table of the notifications delivered on a channel in
+ * the current coalescing window.  Each key is a single block of memory
+ * holding a copy of the payload, and the channel is implicit.
+ */
+typedef struct {
+  NSUInteger	hash;
+  int		pid;
+  const char	*payload;
+} RecentKey;
+
+static NSUInteger
+recentHash(NSHashTable *t, const void *o)
+{
+  return ((const RecentKey*)o)->hash;
+}
+
+static BOOL
+recentEqual(NSHashTable *t, const void *o1, const void *o2)
+{
+  const RecentKey	*k1 = (const RecentKey*)o1;
+  const RecentKey	*k2 = (const RecentKey*)o2;
+
+  if (k1->hash == k2->hash && k1->pid == k2->pid
+    && YES == samePayload(k1->payload, k2->payload))
+    {
+      return YES;
+    }
+  return NO;
+}
+
+static void
+recentRelease(NSHashTable *t, void *o)
+{
+  NSZoneFree(NSDefaultMallocZone(), o);
+}
+
+static const NSHashTableCallBacks recentCallBacks = {
+  recentHash,
+  recentEqual,
+  0,
+  recentRelease,
+  0
+};
+
+/* The delivery policy for a channel, configured by the NotifyCoalesce and
+ * NotifyRateLimit options.
+ */
+typedef struct {
+  char		*channel;	// Name of the channel (map key)
+  NSTimeInterval	window;		// Length of coalescing window
+  NSTimeInterval	windowStart;	// Start of current window
+  NSHashTable	*recent;	// Delivered in current window
+  NSUInteger	limit;		// Maximum deliveries per second
+  NSTimeInterval	rateStart;	// Start of current second
+  NSUInteger	rateCount;	// Deliveries in current second
+  NSUInteger	dropped;	// Notifications dropped by rate limit
+} ChannelPolicy;
+
+static NSUInteger
+channelHash(NSMapTable *t, const void *k)
+{
+  const char	*s = (const char*)k;
+  NSUInteger	h = 2166136261U;
+
+  while (*s)
+    {
+      h = (h ^ (unsigned char)*s++) * 16777619U;
+    }
+  return h;
+}
+
+static BOOL
+channelEqual(NSMapTable *t, const void *k1, const void *k2)
+{
+  return strcmp((const char*)k1, (const char*)k2) == 0 ? YES : NO;
+}
+
+static const NSMapTableKeyCallBacks channelCallBacks = {
+  channelHash,
+  channelEqual,
+  0,
+  0,
+  0,
+  NSNotAPointerMapKey
+};
+
+/* Reads a per-channel option, which may be a single value for all
+ * channels or a dictionary of values keyed on channel name (with an
+ * optional '*' entry for any other channel).
+ */
+static id
+channelOption(NSDictionary *o, NSString *key, NSString *channel)
+{
+  id	v = [o objectForKey: key];
+
+  if ([v isKindOfClass: [NSDictionary class]])
+    {
+      id	c = [v objectForKey: channel];
+
+      v = (nil == c) ? [v objectForKey: @"*"] : c;
+    }
+  return v;
+}
+
+static ChannelPolicy *
+channelPolicy(NSMapTable **table, NSDictionary *o, const char *channel)
+{
+  ChannelPolicy	*p;
+
+  if (0 == *table)
+    {
+      *table = NSCreateMapTable(channelCallBacks,
+	NSNonOwnedPointerMapValueCallBacks, 0);
+    }
+  p = (ChannelPolicy*)NSMapGet(*table, channel);
+  if (0 == p)
+    {
+      NSString	*name = [NSString stringWithUTF8String: channel];
+      id	v;
+
+      p = (ChannelPolicy*)NSZoneCalloc(NSDefaultMallocZone(),
+	1, sizeof(ChannelPolicy));
+      p->channel = (char*)NSZoneMalloc(NSDefaultMallocZone(),
+	strlen(channel) + 1);
+      strcpy(p->channel, channel);
+      v = channelOption(o, @"NotifyCoalesce", name);
+      if ([v respondsToSelector: @selector(doubleValue)]
+	&& [v doubleValue] > 0.0)
+	{
+	  p->window = [v doubleValue];
+	  p->recent = NSCreateHashTable(recentCallBacks, 0);
+	}
+      v = channelOption(o, @"NotifyRateLimit", name);
+      if ([v respondsToSelector: @selector(intValue)] && [v intValue] > 0)
+	{
+	  p->limit = (NSUInteger)[v intValue];
+	}
+      NSMapInsert(*table, p->channel, p);
+    }
+  return p;
+}
+
+static void
+freeChannelPolicies(NSMapTable **table)
+{
+  if (0 != *table)
+    {
+      NSMapEnumerator	e = NSEnumerateMapTable(*table);
+      void		*k;
+      ChannelPolicy	*p;
+
+      while (NSNextMapEnumeratorPair(&e, &k, (void**)&p))
+	{
+	  if (0 != p->recent)
+	    {
+	      NSFreeHashTable(p->recent);
 	    }
+	  NSZoneFree(NSDefaultMallocZone(), p->channel);
+	  NSZoneFree(NSDefaultMallocZone(), p);
+	}
+      NSEndMapTableEnumeration(&e);
+      NSFreeMapTable(*table);
+      *table = 0;
+    }
+}
+
+/* Returns YES if the notification should be delivered according to the
+ * policy for its channel, NO if it should be dropped because an identical
+ * notification was already delivered in the current coalescing window or
+ * because the channel has exceeded its rate limit.
+ */
+static BOOL
+channelAdmits(ChannelPolicy *p, PGnotify *n, NSTimeInterval now)
+{
+  if (0 != p->recent)
+    {
+      RecentKey		probe;
+      RecentKey		*k;
+      unsigned		len;
+
+      if (now - p->windowStart >= p->window || now < p->windowStart)
+	{
+	  NSResetHashTable(p->recent);
+	  p->windowStart = now;
+	}
+      probe.hash = notifyHash("", n->extra, n->be_pid);
+      probe.pid = n->be_pid;
+      probe.payload = n->extra;
+      if (0 != NSHashGet(p->recent, &probe))
+	{
+	  return NO;
+	}
+      len = (0 == n->extra) ? 0 : strlen(n->extra) + 1;
+      k = (RecentKey*)NSZoneMalloc(NSDefaultMallocZone(),
+	sizeof(RecentKey) + len);
+      *k = probe;
+      if (len > 0)
+	{
+	  memcpy(&k[1], n->extra, len);
+	  k->payload = (const char*)&k[1];
+	}
+      NSHashInsert(p->recent, k);
+    }
+  if (p->limit > 0)
+    {
+      if (now - p->rateStart >= 1.0 || now < p->rateStart)
+	{
+	  if (p->dropped > 0)
+	    {
+	      NSLog(@"WARNING ... dropped %lu notifications on '%s'"
+		@" (rate limit %lu per second)", (unsigned long)p->dropped,
+		p->channel, (unsigned long)p->limit);
+	      p->dropped = 0;
+	    }
+	  p->rateStart = now;
+	  p->rateCount = 0;
+	}
+      if (p->rateCount >= p->limit)
+	{
+	  p->dropped++;
+	  return NO;
+	}
+      p->rateCount++;
+    }
+  return YES;
+}
+
+/* Create (retained) notifications for the batch of unique PGnotify
+ * structures.
+ */
+- (NSMutableArray*) _newNotifications: (PGnotify**)batch
+				count: (NSUInteger)count
+				async: (BOOL)async
+{
+  static NSNumber   	*nY = nil;
+  static NSNumber   	*nN = nil;
+  NSMutableArray	*notifications;
+  NSUInteger		index;
+
+  if (nil == nN)
+    {
+      ASSIGN(nN, [NSNumber numberWithBool: NO]);
+    }
+  if (nil == nY)
+    {
+      ASSIGN(nY, [NSNumber numberWithBool: YES]);
+    }
+  notifications = [[NSMutableArray alloc] initWithCapacity: count];
+  for (index = 0; index < count; index++)
+    {
+      PGnotify	*notify = batch[index];
+
+      NS_DURING
+        {
+          NSNotification        *n;
+          NSMutableDictionary   *userInfo;
+          NSString              *name;
 
           name = [[NSString alloc] initWithUTF8String: notify->relname];
           userInfo = [[NSMutableDictionary alloc] initWithCapacity: 3];
@@ -737,14 +1086,7 @@ connectQuote(NSString *str)
           n = [NSNotification notificationWithName: name
                                             object: self
                                           userInfo: (NSDictionary*)userInfo];
-	  if (nil == notifications)
- 	    {
-	      notifications = [[NSMutableArray alloc] initWithCapacity: 10];
-	    }
-	  if (NO == [notifications containsObject: n])
-	    {
-	      [notifications addObject: n];
-	    }
+	  [notifications addObject: n];
           RELEASE(name);
           RELEASE(userInfo);
         }
@@ -754,11 +1096,88 @@ connectQuote(NSString *str)
             (async ? @"asynchronous" : @"query/execute"), localException);
         }
       NS_ENDHANDLER
-      PQfreemem(notify);
-      if ([notifications count] >= 1000)
+    }
+  return notifications;
+}
+
+/* Create notifications for the batch of unique PGnotify structures and
+ * post them, then release the structures.
+ */
+- (void) _postBatch: (PGnotify**)batch
+	      count: (NSUInteger)count
+	      async: (BOOL)async
+	       seen: (NSHashTable*)seen
+{
+  NSMutableArray	*notifications;
+  NSUInteger		index;
+
+  if (0 == count)
+    {
+      return;
+    }
+  notifications = [self _newNotifications: batch count: count async: async];
+  NSResetHashTable(seen);
+  for (index = 0; index < count; index++)
+    {
+      PQfreemem(batch[index]);
+    }
+  [self _post: notifications];
+  RELEASE(notifications);
+}
+
+/* This method must only be called when the receiver is locked.
+ */
+- (void) _checkNotifications: (BOOL)async
+{
+  PGnotify      	*notify;
+  PGnotify		**batch = 0;
+  NSHashTable		*seen = 0;
+  NSUInteger		count = 0;
+  NSUInteger		duplicates = 0;
+  NSTimeInterval	now = 0.0;
+  BOOL			policies;
+
+  /* While postgres sometimes de-duplicates notifications it is not guaranteed
+   * that it will do so, and it is therefore possible for the database server
+   * to send many duplicate notifications.
+   * So we read the notifications and keep them only if they are not already
+   * present in the batch (or delivered in the coalescing window for their
+   * channel), flushing the batch when it gets large.
+   */
+  policies = (nil != [options objectForKey: @"NotifyCoalesce"]
+    || nil != [options objectForKey: @"NotifyRateLimit"]) ? YES : NO;
+  while ((notify = PQnotifies(connection)) != 0)
+    {
+      if (0 == seen)
+	{
+	  seen = NSCreateHashTable(pgnCallBacks, 32);
+	  batch = (PGnotify**)NSZoneMalloc(NSDefaultMallocZone(),
+	    1000 * sizeof(PGnotify*));
+	  if (YES == policies)
+	    {
+	      now = [NSDate timeIntervalSinceReferenceDate];
+	    }
+	}
+      if (0 != NSHashGet(seen, notify))
+	{
+	  duplicates++;
+	  PQfreemem(notify);
+	  continue;
+	}
+      if (YES == policies
+	&& NO == channelAdmits(channelPolicy(&cInfo->_channels, options,
+	  notify->relname), notify, now))
+	{
+	  PQfreemem(notify);
+	  continue;
+	}
+      NSHashInsert(seen, notify);
+      batch[count++] = notify;
+      if (count >= 1000)
 	{
           NSLog(@"WARNING ... 1000 dbase notifications in buffer (flushing)");
-	  [self _post: notifications];
+	  [self _postBatch: batch count: count async: async seen: seen];
+	  count = 0;
 	}
     }
 
@@ -766,8 +1185,232 @@ connectQuote(NSString *str)
    * we post them locally in the current thread (if its run loop is active)
    * or the main thread.
    */
-  [self _post: notifications];
-  RELEASE(notifications);
+  if (0 != seen)
+    {
+      [self _postBatch: batch count: count async: async seen: seen];
+      NSFreeHashTable(seen);
+      NSZoneFree(NSDefaultMallocZone(), batch);
+      if (duplicates > 0 && [self debugging] > 0)
+	{
+	  [self debug: @"Discarded %lu duplicate notifications",
+	    (unsigned long)duplicates];
+	}
+    }
+}
+
+/* Returns a binary format int8[] parameter holding the values of the
+ * array, or nil if any of the values is not an integer.
+ */
+static NSData *
+newInt8Array(NSArray *a)
+{
+  NSUInteger	count = [a count];
+  NSMutableData	*d;
+  uint32_t	*h;
+  uint8_t	*p;
+  NSUInteger	i;
+
+  for (i = 0; i < count; i++)
+    {
+      id	o = [a objectAtIndex: i];
+      char	t;
+
+      if (NO == [o isKindOfClass: [NSNumber class]])
+	{
+	  return nil;
+	}
+      t = *[o objCType];
+      if ('f' == t || 'd' == t)
+	{
+	  return nil;
+	}
+    }
+
+  /* The header is the number of dimensions, a has-nulls flag and the
+   * element type, then the size and lower bound of each dimension.
+   * Each element is a four byte length followed by its data.
+   * Everything is in network byte order.
+   */
+  d = [[NSMutableData alloc] initWithLength:
+    (count > 0 ? 20 : 12) + count * 12];
+  h = (uint32_t*)[d mutableBytes];
+  h[0] = NSSwapHostIntToBig(count > 0 ? 1 : 0);
+  h[1] = 0;
+  h[2] = NSSwapHostIntToBig(20);	// INT8OID
+  if (count > 0)
+    {
+      h[3] = NSSwapHostIntToBig((unsigned)count);
+      h[4] = NSSwapHostIntToBig(1);
+      p = (uint8_t*)(h + 5);
+      for (i = 0; i < count; i++)
+	{
+	  uint32_t		l = NSSwapHostIntToBig(8);
+	  unsigned long long	v;
+
+	  v = NSSwapHostLongLongToBig(
+	    (unsigned long long)[[a objectAtIndex: i] longLongValue]);
+	  memcpy(p, &l, 4);
+	  memcpy(p + 4, &v, 8);
+	  p += 12;
+	}
+    }
+  return d;
+}
+
+/* Returns a nul terminated text format array parameter holding the
+ * values of the array.  The element type is left for the server to infer.
+ */
+static NSData *
+newTextArray(NSArray *a)
+{
+  NSMutableString	*m = [NSMutableString stringWithCapacity: 256];
+  NSUInteger		count = [a count];
+  NSUInteger		i;
+  const char		*u;
+
+  [m appendString: @"{"];
+  for (i = 0; i < count; i++)
+    {
+      id	o = [a objectAtIndex: i];
+      NSString	*s;
+
+      if (i > 0)
+	{
+	  [m appendString: @","];
+	}
+      if (o == null)
+	{
+	  [m appendString: @"NULL"];
+	  continue;
+	}
+      if ([o isKindOfClass: [NSDate class]])
+	{
+	  s = [o descriptionWithCalendarFormat: @"%Y-%m-%d %H:%M:%S.%F %z"
+				      timeZone: nil
+					locale: nil];
+	}
+      else
+	{
+	  s = [o description];
+	}
+      if ([s rangeOfString: @"\\"].length > 0
+	|| [s rangeOfString: @"\""].length > 0)
+	{
+	  NSMutableString	*e = [[s mutableCopy] autorelease];
+
+	  [e replaceString: @"\\" withString: @"\\\\"];
+	  [e replaceString: @"\"" withString: @"\\\""];
+	  s = e;
+	}
+      [m appendString: @"\""];
+      [m appendString: s];
+      [m appendString: @"\""];
+    }
+  [m appendString: @"}"];
+  u = [m UTF8String];
+  return [[NSData alloc] initWithBytes: u length: strlen(u) + 1];
+}
+
+/* Executes the statement whose out-of-line arguments (if any) are in info.
+ * Where none of those arguments is a bound array we insert any BLOBs into
+ * the text of the statement as usual, otherwise the markers are replaced
+ * by $1, $2 ... and all the arguments are sent as parameters so that each
+ * bound array is a single value however many elements it has.
+ */
+- (PGresult*) _execute: (NSArray*)info statement: (NSString*)stmt
+{
+  NSUInteger	count = [info count];
+  NSUInteger	i;
+
+  for (i = 1; i < count; i++)
+    {
+      if ([[info objectAtIndex: i] isKindOfClass: [SQLBoundArray class]])
+	{
+	  break;
+	}
+    }
+  if (i >= count)
+    {
+      const char	*statement;
+      unsigned		length;
+
+      statement = [stmt UTF8String];
+      if (count > 1)
+	{
+	  length = strlen(statement);
+	  statement = [self insertBLOBs: info
+			  intoStatement: statement
+				 length: length
+			     withMarker: "'?'''?'"
+				 length: 7
+				 giving: &length];
+	}
+      return PQexec(connection, statement);
+    }
+  else
+    {
+      NSMutableString	*m = [NSMutableString stringWithString: stmt];
+      int		n = (int)(count - 1);
+      NSMutableData	*buf;
+      const char	**values;
+      Oid		*types;
+      int		*lengths;
+      int		*formats;
+      NSUInteger	pos = 0;
+
+      buf = [NSMutableData dataWithLength:
+	n * (sizeof(char*) + sizeof(Oid) + 2 * sizeof(int))];
+      values = (const char**)[buf mutableBytes];
+      types = (Oid*)(values + n);
+      lengths = (int*)(types + n);
+      formats = lengths + n;
+
+      for (i = 1; i < count; i++)
+	{
+	  id		o = [info objectAtIndex: i];
+	  NSString	*param = [NSString stringWithFormat: @"$%u", (unsigned)i];
+	  NSData	*d;
+	  NSRange	r;
+
+	  r = [m rangeOfString: @"'?'''?'"
+		       options: NSLiteralSearch
+			 range: NSMakeRange(pos, [m length] - pos)];
+	  if (0 == r.length)
+	    {
+	      [NSException raise: NSInvalidArgumentException
+			  format: @"parameter marker missing in %@", stmt];
+	    }
+	  [m replaceCharactersInRange: r withString: param];
+	  pos = r.location + [param length];
+
+	  if ([o isKindOfClass: [SQLBoundArray class]])
+	    {
+	      d = newInt8Array([o values]);
+	      if (nil == d)
+		{
+		  d = newTextArray([o values]);
+		  types[i - 1] = 0;
+		  formats[i - 1] = 0;
+		}
+	      else
+		{
+		  types[i - 1] = 1016;	// INT8ARRAYOID
+		  formats[i - 1] = 1;
+		}
+	      [d autorelease];
+	    }
+	  else
+	    {
+	      d = (NSData*)o;
+	      types[i - 1] = 17;	// BYTEAOID
+	      formats[i - 1] = 1;
+	    }
+	  values[i - 1] = (const char*)[d bytes];
+	  lengths[i - 1] = (int)[d length];
+	}
+      return PQexecParams(connection, [m UTF8String], n,
+	types, values, lengths, formats, 0);
+    }
 }
 
 - (NSInteger) backendExecute: (NSArray*)info
@@ -786,20 +1429,9 @@ connectQuote(NSString *str)
 
   NS_DURING
     {
-      const char	*statement;
       const char        *tuples;
-      unsigned		length;
 
-      statement = (char*)[stmt UTF8String];
-      length = strlen(statement);
-      statement = [self insertBLOBs: info
-		      intoStatement: statement
-			     length: length
-			 withMarker: "'?'''?'"
-			     length: 7
-			     giving: &length];
-
-      result = PQexec(connection, statement);
+      result = [self _execute: info statement: stmt];
       if (0 == result
         || (PQresultStatus(result) != PGRES_COMMAND_OK
           && PQresultStatus(result) != PGRES_TUPLES_OK))
@@ -870,6 +1502,18 @@ connectQuote(NSString *str)
 
 - (void) backendListen: (NSString*)name
 {
+#if	defined(USE_LISTENER_THREAD)
+  if (extra != 0 && YES == cInfo->_useListener)
+    {
+      _PGListener	*l = [_PGListener sharedListener];
+
+      if (nil != l)
+	{
+	  [l listen: name for: self];
+	  return;
+	}
+    }
+#endif
   [self execute: @"LISTEN ", name, nil];
 #if     defined(GNUSTEP_BASE_LIBRARY) && !defined(__MINGW__)
   if (extra != 0 && connection != 0)
@@ -929,10 +1573,26 @@ static inline unsigned int trim(char *str, unsigned len)
   return len;
 }
 
+/* Postgres does not permit arrays of more than six dimensions.
+ */
+#define	MAX_ARRAY_DIMENSIONS	6
+
+/* Parse the text form of an array into a (possibly nested) array of
+ * objects.  Nested arrays are handled using an explicit stack rather
+ * than recursion, and quoted elements containing escapes are unescaped
+ * into a single scratch buffer shared by all the elements of the array
+ * rather than into a buffer allocated for each element.
+ */
 - (char*) parseIntoArray: (NSMutableArray *)a type: (int)t from: (char*)p
 {
+  NSMutableArray	*stack[MAX_ARRAY_DIMENSIONS + 1];
+  int			depth = 0;
+  char			*arena = 0;
+  unsigned		arenaSize = 0;
+
+  stack[0] = a;
   p++;  /* Step past '{' */
-  while (*p && *p != '}')
+  while (*p)
     {
       id        v = nil;
 
@@ -942,12 +1602,42 @@ static inline unsigned int trim(char *str, unsigned len)
         {
           p++;
         }
+      if ('}' == *p)
+        {
+          /* End of the current array ... if it's the outermost one
+           * we have finished.
+           */
+          p++;
+          if (0 == depth--)
+            {
+              break;
+            }
+          while (isspace(*p))
+            {
+              p++;
+            }
+          if (',' == *p)
+            {
+              p++;
+            }
+          continue;
+        }
       if ('{' == *p)
         {
           /* Found a nested array.
            */
+          if (depth >= MAX_ARRAY_DIMENSIONS)
+            {
+              free(arena);
+              [NSException raise: SQLException
+                          format: @"Array nested too deeply"];
+            }
           v = [[NSMutableArray alloc] initWithCapacity: 10];
-          p = [self parseIntoArray: v type: t from: p]; 
+          [stack[depth++] addObject: v];
+          [v release];
+          stack[depth] = v;
+          p++;
+          continue;
         }
       else if ('\"' == *p)
         {
@@ -969,65 +1659,45 @@ static inline unsigned int trim(char *str, unsigned len)
             {
               *p = '\0';
             }
-          if (len == (p - start))
+          if (len != (p - start))
             {
-	      if ('T' == t)
-		{
-                  /* This is expected to be a timestamp
-                   */
-		  v = newDateFromBuffer(start, p - start);
-		}
-              else if ('D' == t)
+              char      *ptr = start;
+              int       i = 0;
+
+              /* Unescape into the shared buffer.
+               */
+              if ((unsigned)len >= arenaSize)
                 {
-                  /* This is expected to be bytea data
-                   */
-                  v = [[self dataFromBLOB: start] retain];
+                  arenaSize = (len + 1 > 256) ? len + 1 : 256;
+                  free(arena);
+                  arena = malloc(arenaSize);
                 }
-	      else
-		{
-                  v = newString(start, p - start, NSUTF8StringEncoding);
-		}
-            }
-          else
-            {
-              char      *buf;
-              char      *ptr;
-              int       i;
-
-              buf = malloc(len+1);
-              ptr = start;
-              i  = 0;
               while (*ptr != '\0')
                 {
                   if ('\\' == *ptr)
                     {
                       ptr++;
                     }
-                  buf[i++] = *ptr++;
-                }
-              buf[len] = '\0';
-	      if ('T' == t)
-		{
-                  /* This is expected to be a timestamp
-                   */
-		  v = newDateFromBuffer(buf, len);
-                  free(buf);
-		}
-              else if ('D' == t)
-                {
-                  /* This is expected to be bytea data
-                   */
-                  v = [[self dataFromBLOB: buf] retain];
-                  free(buf);
-                }
-              else
-                {
-                  v = [NSString alloc];
-                  v = [v initWithBytesNoCopy: buf
-                                      length: len
-                                    encoding: NSUTF8StringEncoding
-                                freeWhenDone: YES];
+                  arena[i++] = *ptr++;
                 }
+              arena[len] = '\0';
+              start = arena;
+            }
+          if ('T' == t)
+            {
+              /* This is expected to be a timestamp
+               */
+              v = SQLClientNewDateFromBuffer(start, len, nil);
+            }
+          else if ('D' == t)
+            {
+              /* This is expected to be bytea data
+               */
+              v = [[self dataFromBLOB: start] retain];
+            }
+          else
+            {
+              v = newString(start, len, NSUTF8StringEncoding);
             }
           *p++ = '\"';
         }
@@ -1053,7 +1723,7 @@ static inline unsigned int trim(char *str, unsigned len)
             }
           else if ('T' == t)
             {
-              v = newDateFromBuffer(start, len);
+              v = SQLClientNewDateFromBuffer(start, len, nil);
             }
           else if ('D' == t)
             {
@@ -1078,7 +1748,7 @@ static inline unsigned int trim(char *str, unsigned len)
         }
       if (nil != v)
         {
-          [a addObject: v];
+          [stack[depth] addObject: v];
           [v release];
         }
       if (',' == *p)
@@ -1086,57 +1756,311 @@ static inline unsigned int trim(char *str, unsigned len)
           p++;
         }
     }
-  if ('}' == *p)
+  free(arena);
+  return p;
+}
+
+/* Parse the text form of an integer ('I') or float ('F') array into a
+ * packed array, in a single pass and without creating an object for each
+ * element.  Returns nil if the array contains a NULL (which can't be
+ * represented in packed form) or anything else unexpected, in which case
+ * the caller should fall back to parsing into an array of objects.
+ */
+static SQLPackedArray *
+newPackedArray(char *p, char t)
+{
+  NSUInteger		sizes[MAX_ARRAY_DIMENSIONS];
+  NSUInteger		counts[MAX_ARRAY_DIMENSIONS];
+  NSUInteger		total = 1;
+  NSUInteger		used = 0;
+  NSUInteger		capacity = 16;
+  int			dims = 0;
+  int			depth = -1;
+  size_t		width;
+  char			*buf;
+  NSData		*d;
+  SQLPackedArray	*a;
+  int			i;
+
+  width = ('F' == t) ? sizeof(double) : sizeof(long long);
+  buf = malloc(capacity * width);
+  while (*p)
+    {
+      if ('{' == *p)
+        {
+          if (++depth >= MAX_ARRAY_DIMENSIONS)
+            {
+              break;
+            }
+          if (depth == dims)
+            {
+              sizes[dims++] = 0;
+            }
+          counts[depth] = 0;
+          p++;
+        }
+      else if ('}' == *p)
+        {
+          /* All sub-arrays at the same depth must be the same size.
+           */
+          if (counts[depth] == 0 && depth < dims - 1)
+            {
+              break;
+            }
+          if (0 == sizes[depth])
+            {
+              sizes[depth] = counts[depth];
+            }
+          else if (sizes[depth] != counts[depth])
+            {
+              break;
+            }
+          p++;
+          if (0 == depth--)
+            {
+              break;
+            }
+          counts[depth]++;
+        }
+      else if (',' == *p || isspace(*p))
+        {
+          p++;
+        }
+      else
+        {
+          char	*end;
+
+          /* A value may only appear in the innermost dimension.
+           */
+          if (depth < 0 || depth != dims - 1 || '"' == *p
+            || ('N' == *p && 'U' == p[1]))
+            {
+              break;
+            }
+          if (used == capacity)
+            {
+              capacity *= 2;
+              buf = realloc(buf, capacity * width);
+            }
+          if ('F' == t)
+            {
+              ((double*)buf)[used] = strtod(p, &end);
+            }
+          else
+            {
+              ((long long*)buf)[used] = strtoll(p, &end, 10);
+            }
+          if (end == p)
+            {
+              break;
+            }
+          used++;
+          counts[depth]++;
+          p = end;
+          while (isspace(*p))
+            {
+              p++;
+            }
+          if (*p != ',' && *p != '}')
+            {
+              break;
+            }
+        }
+    }
+  if (depth >= 0 || 0 == dims)
     {
-      p++;
+      free(buf);
+      return nil;       // Not completely parsed.
     }
-  return p;
+  for (i = 0; i < dims; i++)
+    {
+      total *= sizes[i];
+    }
+  if (total != used)
+    {
+      free(buf);
+      return nil;
+    }
+  d = [[NSData alloc] initWithBytesNoCopy: buf
+                                   length: used * width
+                             freeWhenDone: YES];
+  a = [[SQLPackedArray alloc] initWithData: d
+                                  objCType: ('F' == t)
+                                    ? @encode(double) : @encode(long long)
+                                dimensions: dims
+                                     sizes: sizes];
+  [d release];
+  return a;
 }
 
-- (id) newParseField: (char *)p type: (int)t size: (int)s
+/* Each column in a query result is decoded by a function chosen once
+ * (based on the column type) when the result is received, rather than
+ * by examining the type of every field.
+ */
+typedef struct _PGColumn PGColumn;
+
+typedef id (*PGDecoder)(SQLClientPostgres *db, PGColumn *col, char *p, int s);
+
+struct _PGColumn {
+  PGDecoder		decode;		// Function to decode column values
+  PGDecoder		wrapped;	// Decoder used by the debug logger
+  SQLClientDecoder	custom;		// Decoder registered by application
+  NSString		*key;		// Column name (for debug)
+  int			type;		// Column type OID
+  int			mod;		// Column type modifier
+  int			debug;		// Debug level for the query
+  char			arrayType;	// Element type for array columns
+};
+
+static id
+decodeText(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  if (YES == db->_shouldTrim)
+    {
+      s = trim(p, s);
+    }
+  return newString(p, s, NSUTF8StringEncoding);
+}
+
+static id
+decodeChar(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  return newString(p, s, NSUTF8StringEncoding);
+}
+
+static id
+decodeASCII(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  return newString(p, trim(p, s), NSASCIIStringEncoding);
+}
+
+static id
+decodeTimestamp(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  return SQLClientNewDateFromBuffer(p, trim(p, s), nil);
+}
+
+static id
+decodeBool(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  return ('t' == *p) ? @"YES" : @"NO";
+}
+
+static id
+decodeBytea(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  return [[db dataFromBLOB: p] retain];
+}
+
+static id
+decodeNumber(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  return SQLClientNewLiteral(p, trim(p, s));
+}
+
+static id
+decodeArray(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  NSMutableArray	*a;
+
+  if ('{' != *p)
+    {
+      return decodeText(db, col, p, s);
+    }
+  a = [[NSMutableArray alloc] initWithCapacity: 10];
+  [db parseIntoArray: a type: col->arrayType from: p];
+  if (col->debug > 2)
+    {
+      NSLog(@"Parsed array is %@", a);
+    }
+  return a;
+}
+
+static id
+decodePackedArray(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  SQLPackedArray	*a;
+
+  if ('{' != *p || nil == (a = newPackedArray(p, col->arrayType)))
+    {
+      return decodeArray(db, col, p, s);
+    }
+  if (col->debug > 2)
+    {
+      NSLog(@"Parsed array is %@", a);
+    }
+  return a;
+}
+
+static id
+decodeCustom(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  id	v = (*col->custom)(p, (unsigned)s, (unsigned)col->type);
+
+  if (nil == v)
+    {
+      v = [null retain];
+    }
+  return v;
+}
+
+static id
+decodeLogged(SQLClientPostgres *db, PGColumn *col, char *p, int s)
+{
+  [db debug: @"%@ type:%d mod:%d size: %d\n",
+    col->key, col->type, col->mod, s];
+  return (*col->wrapped)(db, col, p, s);
+}
+
+/* Set up the column to use the appropriate decoder for its type.
+ */
+static void
+resolveColumn(PGColumn *col, int type, int mod, NSString *key, int debug,
+  BOOL packed)
 {
   char  arrayType = 0;
 
-  switch (t)
+  memset(col, '\0', sizeof(*col));
+  col->type = type;
+  col->mod = mod;
+  col->key = key;
+  col->debug = debug;
+  col->custom = SQLClientGetDecoder(@"Postgres", (unsigned)type);
+  if (0 != col->custom)
+    {
+      col->decode = decodeCustom;
+    }
+  else switch (type)
     {
       case 1082:	// Date (treat as string)
-	s = trim(p, s);
-        return newString(p, s, NSASCIIStringEncoding);
-
       case 1083:	// Time (treat as string)
-	s = trim(p, s);
-        return newString(p, s, NSASCIIStringEncoding);
+        col->decode = decodeASCII;
+        break;
 
       case 1114:	// Timestamp without time zone.
       case 1184:	// Timestamp with time zone.
-        return newDateFromBuffer(p, trim(p, s));
+        col->decode = decodeTimestamp;
+        break;
 
       case 16:		// BOOL
-        if (*p == 't')
-          {
-            return @"YES";
-          }
-        else
-          {
-            return @"NO";
-          }
+        col->decode = decodeBool;
+        break;
 
       case 17:		// BYTEA
-        return [[self dataFromBLOB: p] retain];
+        col->decode = decodeBytea;
+        break;
 
       case 18:          // "char"
-        return newString(p, s, NSUTF8StringEncoding);
+        col->decode = decodeChar;
+        break;
 
       case 20:          // INT8
       case 21:          // INT2
       case 23:          // INT4
-	s = trim(p, s);
-        return SQLClientNewLiteral(p, s);
-
-      case 700:          // FLOAT4
-      case 701:          // FLOAT8
-	s = trim(p, s);
-        return SQLClientNewLiteral(p, s);
+      case 700:         // FLOAT4
+      case 701:         // FLOAT8
+        col->decode = decodeNumber;
+        break;
 
       case 1115:	// TS without TZ ARRAY
       case 1185:	// TS with TZ ARRAY
@@ -1159,32 +2083,182 @@ static inline unsigned int trim(char *str, unsigned len)
       case 1182:	// DATE ARRAY
       case 1183:	// TIME ARRAY
       case 1263:        // CSTRING ARRAY
-        if ('{' == *p)
+        col->arrayType = arrayType;
+        if (YES == packed && ('I' == arrayType || 'F' == arrayType))
+          {
+            col->decode = decodePackedArray;
+          }
+        else
           {
-            NSMutableArray      *a;
-
-            a = [[NSMutableArray alloc] initWithCapacity: 10];
-            p = [self parseIntoArray: a type: arrayType from: p];
-            if ([self debugging] > 2)
-              {
-                NSLog(@"Parsed array is %@", a);
-              }
-            return a;
+            col->decode = decodeArray;
           }
+        break;
 
       case 25:          // TEXT
       default:
-        if (YES == _shouldTrim)
-          {
-            s = trim(p, s);
-          }
-        return newString(p, s, NSUTF8StringEncoding);
+        col->decode = decodeText;
+        break;
+    }
+  if (debug > 1)
+    {
+      col->wrapped = col->decode;
+      col->decode = decodeLogged;
+    }
+}
+
+- (id) newParseField: (char *)p type: (int)t size: (int)s
+{
+  PGColumn	col;
+
+  resolveColumn(&col, t, -1, nil, 0, cInfo->_packedArrays);
+  col.debug = [self debugging];
+  return (*col.decode)(self, &col, p, s);
+}
+
+/* Build the records (retained) for a query result with tuples.
+ */
+- (NSMutableArray*) _newRecordsFromResult: (PGresult*)result
+			       recordType: (id)rtype
+				 listType: (id)ltype
+{
+  NSMutableArray	*records = nil;
+  int			recordCount = PQntuples(result);
+  int			fieldCount = PQnfields(result);
+  const char		*names[fieldCount];
+  NSString		*keys[fieldCount];
+  PGColumn		cols[fieldCount];
+  int			fformat[fieldCount];
+  SQLRecordKeys		*k = nil;
+  int			d = [self debugging];
+  int			i;
+
+  for (i = 0; i < fieldCount; i++)
+    {
+      names[i] = PQfname(result, i);
+      fformat[i] = PQfformat(result, i);
+    }
+  /* Use the shared keys for this set of columns so that we don't
+   * need to create new key strings for every query.
+   */
+  [[[SQLRecordKeys keysWithUTF8Names: names count: fieldCount] order]
+    getObjects: keys];
+  for (i = 0; i < fieldCount; i++)
+    {
+      resolveColumn(&cols[i], PQftype(result, i), PQfmod(result, i),
+	keys[i], d, cInfo->_packedArrays);
+    }
+
+  records = [[ltype alloc] initWithCapacity: recordCount];
+
+  /* Create buffers to store the previous row from the
+   * database and the previous objc values.
+   */
+  int		len[fieldCount];
+  const char	*ptr[fieldCount];
+  id		obj[fieldCount];
+
+  for (i = 0; i < fieldCount; i++)
+    {
+      len[i] = -1;
+      obj[i] = nil;
+    }
+
+  for (i = 0; i < recordCount; i++)
+    {
+      SQLRecord	*record;
+      id	values[fieldCount];
+      int	j;
+
+      for (j = 0; j < fieldCount; j++)
+	{
+	  id	v = null;
+
+	  if (PQgetisnull(result, i, j) == 0)
+	    {
+	      char	*p = PQgetvalue(result, i, j);
+	      int	size = PQgetlength(result, i, j);
+
+	      /* Often many rows will contain the same data in
+	       * one or more columns, so we check to see if the
+	       * value we have just read is small and identical
+	       * to the value in the same column of the previous
+	       * row.  Only if it isn't do we create a new object.
+	       */
+	      if (size == len[j] && size <= 20
+		&& memcmp(p, ptr[j], (size_t)size) == 0)
+		{
+		  v = obj[j];
+		}
+	      else
+		{
+		  [obj[j] release];
+		  if (fformat[j] == 0)	// Text
+		    {
+		      v = (*cols[j].decode)(self, &cols[j], p, size);
+		      obj[j] = v;
+		      len[j] = size;
+		      ptr[j] = p;
+		    }
+		  else			// Binary
+		    {
+		      NSLog(@"Binary data treated as NSNull "
+			@"in %@ type:%d mod:%d size:%d\n",
+			keys[j], cols[j].type, cols[j].mod, size);
+		    }
+		}
+	    }
+	  values[j] = v;
+	}
+      if (nil == k)
+	{
+	  /* We don't have keys information, so use the
+	   * constructor where we list keys and, if the
+	   * resulting record provides keys information
+	   * on the first record, we save it for later.
+	   */
+	  record = [rtype newWithValues: values
+				   keys: keys
+				  count: fieldCount];
+	  if (0 == i && [record respondsToSelector: @selector(keys)])
+	    {
+	      k = [record keys];
+	    }
+	}
+      else
+	{
+	  record = [rtype newWithValues: values keys: k];
+	}
+      [records addObject: record];
+      [record release];
     }
+  for (i = 0; i < fieldCount; i++)
+    {
+      [obj[i] release];
+    }
+  return records;
 }
 
 - (NSMutableArray*) backendQuery: (NSString*)stmt
 		      recordType: (id)rtype
 		        listType: (id)ltype
+{
+  return [self _query: stmt info: nil recordType: rtype listType: ltype];
+}
+
+- (NSMutableArray*) backendQueryPrepared: (NSArray*)info
+			      recordType: (id)rtype
+			        listType: (id)ltype
+{
+  return [self _query: [info objectAtIndex: 0]
+		 info: info
+	   recordType: rtype
+	     listType: ltype];
+}
+
+- (NSMutableArray*) _query: (NSString*)stmt
+		      info: (NSArray*)info
+		recordType: (id)rtype
+		  listType: (id)ltype
 {
   NSAutoreleasePool     *arp = [NSAutoreleasePool new];
   PGresult		*result = 0;
@@ -1200,10 +2274,7 @@ static inline unsigned int trim(char *str, unsigned len)
 
   NS_DURING
     {
-      char	*statement;
-
-      statement = (char*)[stmt UTF8String];
-      result = PQexec(connection, statement);
+      result = [self _execute: info statement: stmt];
       if (0 == result
         || (PQresultStatus(result) != PGRES_COMMAND_OK
           && PQresultStatus(result) != PGRES_TUPLES_OK))
@@ -1243,118 +2314,9 @@ static inline unsigned int trim(char *str, unsigned len)
 	}
       if (PQresultStatus(result) == PGRES_TUPLES_OK)
 	{
-	  int		recordCount = PQntuples(result);
-	  int		fieldCount = PQnfields(result);
-	  NSString	*keys[fieldCount];
-	  int		ftype[fieldCount];
-	  int		fmod[fieldCount];
-	  int		fformat[fieldCount];
-          SQLRecordKeys *k = nil;
-	  int		d = [self debugging];
-	  int		i;
-
-	  for (i = 0; i < fieldCount; i++)
-	    {
-	      keys[i] = [NSString stringWithUTF8String: PQfname(result, i)];
-	      ftype[i] = PQftype(result, i);
-	      fmod[i] = PQfmod(result, i);
-	      fformat[i] = PQfformat(result, i);
-	    }
-
-	  records = [[ltype alloc] initWithCapacity: recordCount];
-
-	  /* Create buffers to store the previous row from the
-	   * database and the previous objc values.
-	   */
-	  int		len[fieldCount];
-	  const char	*ptr[fieldCount];
-	  id		obj[fieldCount];
-
-	  for (i = 0; i < fieldCount; i++)
-	    {
-	      len[i] = -1;
-	      obj[i] = nil;
-	    }	
-
-	  for (i = 0; i < recordCount; i++)
-	    {
-	      SQLRecord	*record;
-	      id	values[fieldCount];
-	      int	j;
-
-	      for (j = 0; j < fieldCount; j++)
-		{
-		  id	v = null;
-
-		  if (PQgetisnull(result, i, j) == 0)
-		    {
-		      char	*p = PQgetvalue(result, i, j);
-		      int	size = PQgetlength(result, i, j);
-
-		      if (d > 1)
-			{ 
-			  [self debug: @"%@ type:%d mod:%d size: %d\n",
-			    keys[j], ftype[j], fmod[j], size];
-			}
-		      /* Often many rows will contain the same data in
-		       * one or more columns, so we check to see if the
-		       * value we have just read is small and identical
-		       * to the value in the same column of the previous
-		       * row.  Only if it isn't do we create a new object.
-		       */
-		      if (size == len[j] && size <= 20
-		        && memcmp(p, ptr[j], (size_t)size) == 0)
-                        {
-                          v = obj[j];
-                        }
-                      else
-			{
-			  [obj[j] release];
-			  if (fformat[j] == 0)	// Text
-			    {
-			      v = [self newParseField: p
-						 type: ftype[j]
-						 size: size];
-			      obj[j] = v;
-                              len[j] = size;
-                              ptr[j] = p;
-			    }
-			  else			// Binary
-			    {
-			      NSLog(@"Binary data treated as NSNull "
-				@"in %@ type:%d mod:%d size:%d\n",
-				keys[j], ftype[j], fmod[j], size);
-			    }
-			}
-		    }
-		  values[j] = v;
-		}
-              if (nil == k)
-                {
-                  /* We don't have keys information, so use the
-                   * constructor where we list keys and, if the
-                   * resulting record provides keys information
-                   * on the first record, we save it for later.
-                   */
-                  record = [rtype newWithValues: values
-                                           keys: keys
-                                          count: fieldCount];
-                  if (0 == i && [record respondsToSelector: @selector(keys)])
-                    {
-                      k = [record keys];
-                    }
-                }
-              else
-                {
-                  record = [rtype newWithValues: values keys: k];
-                }
-	      [records addObject: record];
-	      [record release];
-	    }
-	  for (i = 0; i < fieldCount; i++)
-	    {
-	      [obj[i] release];
-	    }
+	  records = [self _newRecordsFromResult: result
+				     recordType: rtype
+				       listType: ltype];
 	}
       else
 	{
@@ -1390,8 +2352,34 @@ static inline unsigned int trim(char *str, unsigned len)
   return [records autorelease];
 }
 
+- (BOOL) backendStartAsync: (SQLAsyncOperation*)op
+{
+#if	defined(USE_REACTOR_THREAD)
+  _PGReactor	*r = [_PGReactor sharedReactor];
+
+  if (nil != r)
+    {
+      [r start: op];
+      return YES;
+    }
+#endif
+  return NO;
+}
+
 - (void) backendUnlisten: (NSString*)name
 {
+#if	defined(USE_LISTENER_THREAD)
+  if (extra != 0 && YES == cInfo->_useListener)
+    {
+      _PGListener	*l = [_PGListener sharedListener];
+
+      if (nil != l)
+	{
+	  [l unlisten: name for: self];
+	  return;
+	}
+    }
+#endif
 #if     defined(GNUSTEP_BASE_LIBRARY) && !defined(__MINGW__)
   if (extra != 0 && cInfo->_runLoop != nil && cInfo->_descriptor >= 0)
     {
@@ -1574,6 +2562,18 @@ static inline unsigned int trim(char *str, unsigned len)
     }
   b[l] = '\0';
 
+  /* Try the fast parser first, only falling back to the more lenient
+   * format based parsing if that fails.
+   */
+  if (l > 10)
+    {
+      d = (NSCalendarDate*)SQLClientNewDateFromBuffer(b, l, nil);
+      if (nil != d)
+        {
+          return [d autorelease];
+        }
+    }
+
   if (l == 10)
     {
       s = [NSString stringWithUTF8String: b];
@@ -1733,7 +2733,17 @@ static inline unsigned int trim(char *str, unsigned len)
         {
           [self disconnect];
         }
+#if	defined(USE_LISTENER_THREAD)
+      if (YES == cInfo->_useListener)
+	{
+	  /* The listener does not retain us, so make sure it has forgotten
+	   * us even if our connection was already gone.
+	   */
+	  [[_PGListener sharedListener] removeClient: self];
+	}
+#endif
       RELEASE(options);
+      freeChannelPolicies(&cInfo->_channels);
       NSZoneFree(NSDefaultMallocZone(), extra);
     }
   [super dealloc];
@@ -1808,6 +2818,9 @@ static inline unsigned int trim(char *str, unsigned len)
       cInfo->_descriptor = -1;
     }
   ASSIGNCOPY(options, o);
+  freeChannelPolicies(&cInfo->_channels);
+  cInfo->_packedArrays = [[options objectForKey: @"PackedArrays"] boolValue];
+  cInfo->_useListener = [[options objectForKey: @"ListenerThread"] boolValue];
 }
 @end
 
@@ -1870,3 +2883,1034 @@ static inline unsigned int trim(char *str, unsigned len)
 }
 @end
 #endif
+
+#if	defined(USE_LISTENER_THREAD)
+
+/* Each client using the listener thread has a dedicated LISTEN-only
+ * connection to the database, managed by one of these objects.
+ * The conn, fd and retry ivars are only used by the listener thread,
+ * the others are protected by the listener lock (the ready, connecting
+ * and failed ivars pass the result of a connection attempt made in a
+ * separate thread back to the listener thread).  The client is not
+ * retained (it removes itself from the listener when it is disconnected
+ * or deallocated), so it may only be used with the lock held.
+ */
+@implementation	_PGListening
+- (void) dealloc
+{
+  if (0 != conn)
+    {
+      PQfinish(conn);
+      conn = 0;
+    }
+  if (0 != ready)
+    {
+      PQfinish(ready);
+      ready = 0;
+    }
+  freeChannelPolicies(&policies);
+  RELEASE(conninfo);
+  RELEASE(channels);
+  RELEASE(pending);
+  RELEASE(options);
+  RELEASE(thread);
+  [super dealloc];
+}
+@end
+
+static _PGListener	*listener = nil;
+static NSLock		*listenerLock = nil;
+
+@implementation	_PGListener
+
+/* The runtime calls this before any other use of the class, and never
+ * in more than one thread at once, so it can safely create the lock
+ * protecting the creation of the shared instance.
+ */
++ (void) initialize
+{
+  if (nil == listenerLock)
+    {
+      listenerLock = [NSLock new];
+    }
+}
+
++ (_PGListener*) sharedListener
+{
+  if (nil == listener)
+    {
+      [listenerLock lock];
+      if (nil == listener)
+	{
+	  listener = [self new];
+	}
+      [listenerLock unlock];
+    }
+  return listener;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      struct epoll_event	ev;
+
+      epfd = epoll_create1(EPOLL_CLOEXEC);
+      if (epfd < 0 || pipe(wake) < 0)
+	{
+	  NSLog(@"Unable to create postgres listener: %s", strerror(errno));
+	  if (epfd >= 0)
+	    {
+	      close(epfd);
+	    }
+	  DESTROY(self);
+	  return nil;
+	}
+      fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+      fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL) | O_NONBLOCK);
+      memset(&ev, '\0', sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = 0;
+      epoll_ctl(epfd, EPOLL_CTL_ADD, wake[0], &ev);
+      lock = [NSLock new];
+      clients = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+	NSObjectMapValueCallBacks, 0);
+      closing = [NSMutableArray new];
+      [NSThread detachNewThreadSelector: @selector(_run)
+			       toTarget: self
+			     withObject: nil];
+    }
+  return self;
+}
+
+/* Wake the listener thread so that it handles pending work.
+ */
+- (void) _wake
+{
+  char	c = 0;
+
+  if (write(wake[1], &c, 1) < 0 && EAGAIN != errno)
+    {
+      NSLog(@"Problem waking postgres listener: %s", strerror(errno));
+    }
+}
+
+- (void) listen: (NSString*)name for: (SQLClientPostgres*)client
+{
+  _PGListening	*l;
+
+  [lock lock];
+  l = (_PGListening*)NSMapGet(clients, client);
+  if (nil == l)
+    {
+      NSRange	pwRange;
+
+      l = [_PGListening new];
+      l->client = client;
+      l->fd = -1;
+      l->conninfo = [[client _connectString: &pwRange] copy];
+      l->options = [((ConnectionInfo*)client->extra)->_options retain];
+      l->channels = [NSMutableSet new];
+      l->pending = [NSMutableArray new];
+      NSMapInsert(clients, client, l);
+      [l release];
+    }
+  /* Notifications are delivered to the thread which set up the most
+   * recent observation.
+   */
+  ASSIGN(l->thread, [NSThread currentThread]);
+  if (nil == [l->channels member: name])
+    {
+      [l->channels addObject: name];
+      [l->pending addObject: [@"LISTEN " stringByAppendingString: name]];
+    }
+  [lock unlock];
+  [self _wake];
+}
+
+- (void) removeClient: (SQLClientPostgres*)client
+{
+  _PGListening	*l;
+
+  [lock lock];
+  l = (_PGListening*)NSMapGet(clients, client);
+  if (nil != l)
+    {
+      /* The listener thread closes the connection and releases the
+       * object, so it remains valid for any events already received.
+       */
+      l->removed = YES;
+      [closing addObject: l];
+      NSMapRemove(clients, client);
+    }
+  [lock unlock];
+  if (nil != l)
+    {
+      [self _wake];
+    }
+}
+
+- (void) unlisten: (NSString*)name for: (SQLClientPostgres*)client
+{
+  _PGListening	*l;
+
+  [lock lock];
+  l = (_PGListening*)NSMapGet(clients, client);
+  if (nil != l && nil != [l->channels member: name])
+    {
+      [l->pending addObject: [@"UNLISTEN " stringByAppendingString: name]];
+      [l->channels removeObject: name];
+    }
+  if (nil != l && 0 == [l->channels count])
+    {
+      l->removed = YES;
+      [closing addObject: l];
+      NSMapRemove(clients, client);
+    }
+  [lock unlock];
+  [self _wake];
+}
+
+/* Drop the dedicated connection of l (if any) and arrange to retry after
+ * a short delay.  Only called in the listener thread.
+ */
+- (void) _drop: (_PGListening*)l
+{
+  if (0 != l->conn)
+    {
+      if (l->fd >= 0)
+	{
+	  epoll_ctl(epfd, EPOLL_CTL_DEL, l->fd, 0);
+	  l->fd = -1;
+	}
+      PQfinish(l->conn);
+      l->conn = 0;
+    }
+  l->retry = [NSDate timeIntervalSinceReferenceDate] + 1.0;
+}
+
+/* Connect for l in a thread of its own, so that an unreachable server
+ * does not hold up the delivery of notifications for other clients.
+ * The new connection is handed to the listener thread in l->ready.
+ */
+- (void) _connect: (_PGListening*)l
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  PGconn		*conn;
+  NSString		*name = nil;
+  BOOL			ok;
+
+  conn = PQconnectdb([l->conninfo UTF8String]);
+  ok = (PQstatus(conn) == CONNECTION_OK
+    && PQsetClientEncoding(conn, "UTF-8") >= 0
+    && PQsocket(conn) >= 0) ? YES : NO;
+  [lock lock];
+  if (NO == l->removed)
+    {
+      if (YES == ok)
+	{
+	  l->ready = conn;
+	  conn = 0;
+	}
+      else
+	{
+	  l->failed = YES;
+	  name = [[l->client name] retain];
+	}
+    }
+  l->connecting = NO;
+  [lock unlock];
+  if (NO == ok)
+    {
+      NSLog(@"Postgres listener unable to connect for '%@' - %s",
+	name, PQerrorMessage(conn));
+      [name release];
+    }
+  if (0 != conn)
+    {
+      PQfinish(conn);
+    }
+  [self _wake];
+  [arp release];
+}
+
+/* Make sure l has a connection and has sent any pending LISTEN/UNLISTEN
+ * commands.  Only called in the listener thread, and with the lock not
+ * held, since sending commands may block for some time.
+ */
+- (void) _service: (_PGListening*)l now: (NSTimeInterval)now
+{
+  NSArray	*commands;
+  NSString	*name;
+  NSUInteger	count;
+  NSUInteger	index;
+
+  [lock lock];
+  if (YES == l->removed)
+    {
+      [lock unlock];
+      return;
+    }
+  if (0 == l->conn)
+    {
+      NSEnumerator	*e;
+
+      if (YES == l->failed)
+	{
+	  l->failed = NO;
+	  l->retry = now + 1.0;
+	}
+      if (0 == l->ready)
+	{
+	  if (NO == l->connecting && now >= l->retry)
+	    {
+	      l->connecting = YES;
+	      [NSThread detachNewThreadSelector: @selector(_connect:)
+				       toTarget: self
+				     withObject: l];
+	    }
+	  [lock unlock];
+	  return;
+	}
+      l->conn = l->ready;
+      l->ready = 0;
+
+      /* A new connection must listen to all the channels.
+       */
+      [l->pending removeAllObjects];
+      e = [l->channels objectEnumerator];
+      while (nil != (name = [e nextObject]))
+	{
+	  [l->pending addObject: [@"LISTEN " stringByAppendingString: name]];
+	}
+    }
+  commands = [l->pending copy];
+  name = [[l->client name] retain];
+  [lock unlock];
+
+  if (l->fd < 0)
+    {
+      struct epoll_event	ev;
+
+      l->fd = PQsocket(l->conn);
+      memset(&ev, '\0', sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = (void*)l;
+      epoll_ctl(epfd, EPOLL_CTL_ADD, l->fd, &ev);
+    }
+
+  count = [commands count];
+  for (index = 0; index < count; index++)
+    {
+      NSString	*command = [commands objectAtIndex: index];
+      PGresult	*result;
+
+      result = PQexec(l->conn, [command UTF8String]);
+      if (0 == result || PQresultStatus(result) != PGRES_COMMAND_OK)
+	{
+	  NSLog(@"Postgres listener error for '%@' (%@) - %s",
+	    name, command, PQerrorMessage(l->conn));
+	  if (0 != result)
+	    {
+	      PQclear(result);
+	    }
+	  [self _drop: l];
+	  break;
+	}
+      PQclear(result);
+    }
+  [commands release];
+  [name release];
+
+  /* Other threads only ever append to the pending commands, so the ones
+   * we have sent are still at the start of the array.
+   */
+  if (index > 0 && 0 != l->conn)
+    {
+      [lock lock];
+      [l->pending removeObjectsInRange: NSMakeRange(0, index)];
+      [lock unlock];
+    }
+}
+
+/* Read all available notifications for l and build them into batches
+ * of up to 256 notifications, returning an array of the batches.
+ * Must be called with the lock held.
+ */
+- (NSMutableArray*) _read: (_PGListening*)l
+{
+  NSMutableArray	*batches = nil;
+  NSMutableArray	*notifications;
+  NSHashTable		*seen = 0;
+  PGnotify		*batch[256];
+  NSUInteger		count = 0;
+  NSUInteger		index;
+  NSTimeInterval	now = 0.0;
+  PGnotify		*notify;
+  BOOL			policies;
+
+  if (0 == PQconsumeInput(l->conn))
+    {
+      NSLog(@"Postgres listener error consuming input for '%@' - %s",
+	[l->client name], PQerrorMessage(l->conn));
+      [self _drop: l];
+      return nil;
+    }
+  policies = (nil != [l->options objectForKey: @"NotifyCoalesce"]
+    || nil != [l->options objectForKey: @"NotifyRateLimit"]) ? YES : NO;
+  for (;;)
+    {
+      notify = PQnotifies(l->conn);
+      if (0 != notify)
+	{
+	  if (0 == seen)
+	    {
+	      seen = NSCreateHashTable(pgnCallBacks, 32);
+	      if (YES == policies)
+		{
+		  now = [NSDate timeIntervalSinceReferenceDate];
+		}
+	    }
+	  if (0 != NSHashGet(seen, notify)
+	    || (YES == policies
+	      && NO == channelAdmits(channelPolicy(&l->policies, l->options,
+		notify->relname), notify, now)))
+	    {
+	      PQfreemem(notify);
+	      continue;
+	    }
+	  NSHashInsert(seen, notify);
+	  batch[count++] = notify;
+	}
+      if (count > 0 && (0 == notify || 256 == count))
+	{
+	  notifications = [l->client _newNotifications: batch
+						 count: count
+						 async: YES];
+	  NSResetHashTable(seen);
+	  for (index = 0; index < count; index++)
+	    {
+	      PQfreemem(batch[index]);
+	    }
+	  count = 0;
+	  if (nil == batches)
+	    {
+	      batches = [NSMutableArray arrayWithCapacity: 1];
+	    }
+	  [batches addObject: notifications];
+	  [notifications release];
+	}
+      if (0 == notify)
+	{
+	  break;
+	}
+    }
+  if (0 != seen)
+    {
+      NSFreeHashTable(seen);
+    }
+  return batches;
+}
+
+- (void) _run
+{
+  struct epoll_event	events[64];
+  NSMutableArray	*dead = [NSMutableArray new];
+
+  while (YES)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+      NSArray		*all;
+      NSUInteger	index;
+      _PGListening	*l;
+      BOOL		waiting = NO;
+      int		count;
+      int		i;
+
+      [lock lock];
+      [dead addObjectsFromArray: closing];
+      [closing removeAllObjects];
+      all = NSAllMapTableValues(clients);
+      [lock unlock];
+
+      /* Connections are closed and (re)established with the lock not
+       * held, so that a slow server does not block other threads.
+       */
+      for (index = 0; index < [dead count]; index++)
+	{
+	  [self _drop: [dead objectAtIndex: index]];
+	}
+      [dead removeAllObjects];
+      for (index = 0; index < [all count]; index++)
+	{
+	  l = [all objectAtIndex: index];
+	  [self _service: l now: now];
+	  if (0 == l->conn && NO == l->removed)
+	    {
+	      waiting = YES;
+	    }
+	}
+
+      count = epoll_wait(epfd, events, 64, (YES == waiting) ? 1000 : -1);
+      for (i = 0; i < count; i++)
+	{
+	  NSMutableArray	*batches = nil;
+	  SQLClientPostgres	*client = nil;
+	  NSThread		*thread = nil;
+
+	  l = (_PGListening*)events[i].data.ptr;
+	  if (0 == l)
+	    {
+	      char	buf[64];
+
+	      while (read(wake[0], buf, sizeof(buf)) > 0)
+		;
+	      continue;
+	    }
+	  [lock lock];
+	  if (NO == l->removed && 0 != l->conn)
+	    {
+	      /* The listener does not retain clients, so we use the client
+	       * registry to obtain a reference, which fails once the client
+	       * has begun deallocation.
+	       */
+	      client = [SQLClient registeredClient: l->client];
+	      if (nil != client)
+		{
+		  batches = [self _read: l];
+		  thread = [[l->thread retain] autorelease];
+		}
+	    }
+	  [lock unlock];
+
+	  /* Hand the notifications to the thread which set up the
+	   * observation (or the main thread if that thread has gone).
+	   */
+	  for (index = 0; index < [batches count]; index++)
+	    {
+	      NSMutableArray	*notifications = [batches objectAtIndex: index];
+
+	      if ([client debugging] > 0)
+		{
+		  [client debug: @"Notifying (listener): %@", notifications];
+		}
+	      NS_DURING
+		{
+		  if (nil == thread || YES == [thread isFinished])
+		    {
+		      [client performSelectorOnMainThread:
+			@selector(_postNotifications:)
+			withObject: notifications
+			waitUntilDone: NO];
+		    }
+		  else
+		    {
+		      [client performSelector: @selector(_postNotifications:)
+				     onThread: thread
+				   withObject: notifications
+				waitUntilDone: NO];
+		    }
+		}
+	      NS_HANDLER
+		{
+		  NSLog(@"Problem posting from listener: %@ %@",
+		    notifications, localException);
+		}
+	      NS_ENDHANDLER
+	    }
+	}
+      if (count < 0 && EINTR != errno)
+	{
+	  NSLog(@"Postgres listener wait failed: %s", strerror(errno));
+	}
+      [arp release];
+    }
+}
+@end
+
+#endif	/* USE_LISTENER_THREAD */
+
+#if	defined(USE_REACTOR_THREAD)
+
+/* The state of an asynchronous operation in progress.  These are only
+ * used by the reactor thread once they have been started.
+ */
+@implementation	_PGAsync
+- (void) dealloc
+{
+  RELEASE(op);
+  RELEASE(records);
+  RELEASE(error);
+  [super dealloc];
+}
+@end
+
+static _PGReactor	*reactor = nil;
+static NSLock		*reactorLock = nil;
+
+@implementation	_PGReactor
+
+/* As for the listener, the lock protecting creation of the shared
+ * instance must exist before any thread can ask for that instance.
+ */
++ (void) initialize
+{
+  if (nil == reactorLock)
+    {
+      reactorLock = [NSLock new];
+    }
+}
+
++ (_PGReactor*) sharedReactor
+{
+  if (nil == reactor)
+    {
+      [reactorLock lock];
+      if (nil == reactor)
+	{
+	  reactor = [self new];
+	}
+      [reactorLock unlock];
+    }
+  return reactor;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      struct epoll_event	ev;
+
+      epfd = epoll_create1(EPOLL_CLOEXEC);
+      if (epfd < 0 || pipe(wake) < 0)
+	{
+	  NSLog(@"Unable to create postgres reactor: %s", strerror(errno));
+	  if (epfd >= 0)
+	    {
+	      close(epfd);
+	    }
+	  DESTROY(self);
+	  return nil;
+	}
+      fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+      fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL) | O_NONBLOCK);
+      memset(&ev, '\0', sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.ptr = 0;
+      epoll_ctl(epfd, EPOLL_CTL_ADD, wake[0], &ev);
+      lock = [NSLock new];
+      waiting = [NSMutableArray new];
+      active = [NSMutableArray new];
+      busy = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
+      [NSThread detachNewThreadSelector: @selector(_run)
+			       toTarget: self
+			     withObject: nil];
+    }
+  return self;
+}
+
+- (void) _wake
+{
+  char	c = 0;
+
+  if (write(wake[1], &c, 1) < 0 && EAGAIN != errno)
+    {
+      NSLog(@"Problem waking postgres reactor: %s", strerror(errno));
+    }
+}
+
+- (void) start: (SQLAsyncOperation*)op
+{
+  [lock lock];
+  [waiting addObject: op];
+  [lock unlock];
+  [self _wake];
+}
+
+/* Connect the client of an operation in a separate thread so that the
+ * reactor thread never blocks waiting for a server.  On success the
+ * operation goes back to the head of the queue to be sent, otherwise
+ * it is completed with the connection error.
+ */
+- (void) _connect: (SQLAsyncOperation*)op
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  SQLClientPostgres	*db = (SQLClientPostgres*)[op client];
+  NSException		*error = nil;
+
+  NS_DURING
+    {
+      if (NO == [db connect])
+	{
+	  [NSException raise: SQLConnectionException
+	    format: @"Unable to connect to '%@' to run statement %@",
+	    [db name], [op statement]];
+	}
+    }
+  NS_HANDLER
+    {
+      error = [localException retain];
+    }
+  NS_ENDHANDLER
+  [lock lock];
+  NSHashRemove(busy, db);
+  if (nil == error)
+    {
+      [waiting insertObject: op atIndex: 0];
+    }
+  [lock unlock];
+  if (nil != error)
+    {
+      [op completeWithRecords: nil count: -1 error: error];
+      [error release];
+    }
+  [self _wake];
+  [arp release];
+}
+
+/* Wait in a separate thread for another thread to finish using the
+ * client of an operation, then put the operation back at the head of
+ * the queue and wake the reactor to send it.  This avoids the reactor
+ * having to poll for the client to become free.
+ */
+- (void) _await: (SQLAsyncOperation*)op
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  SQLClientPostgres	*db = (SQLClientPostgres*)[op client];
+
+  [db->lock lock];
+  [db->lock unlock];
+  [lock lock];
+  NSHashRemove(busy, db);
+  [waiting insertObject: op atIndex: 0];
+  [lock unlock];
+  [self _wake];
+  [arp release];
+}
+
+/* Complete the operation a, unlocking its client and removing it from
+ * the list of those in progress.  If the statement was cancelled because
+ * it ran past its deadline, the error reports the timeout.
+ */
+- (void) _finish: (_PGAsync*)a
+{
+  SQLClientPostgres	*db = a->client;
+  PGconn		*conn = ((ConnectionInfo*)db->extra)->_connection;
+
+  if (a->fd >= 0)
+    {
+      epoll_ctl(epfd, EPOLL_CTL_DEL, a->fd, 0);
+      a->fd = -1;
+    }
+  if (YES == [db _stopDeadline] && nil != a->error)
+    {
+      NSException	*e;
+
+      e = [[NSException alloc] initWithName: SQLTimeoutException
+	reason: [NSString stringWithFormat:
+	@"Timed out after %g running statement %@ (%@)",
+	[NSDate timeIntervalSinceReferenceDate] - a->start,
+	[a->op statement], [a->error reason]] userInfo: nil];
+      [a->error release];
+      a->error = e;
+    }
+  NS_DURING
+    {
+      if (0 != conn)
+	{
+	  PQsetnonblocking(conn, 0);
+	  if (PQstatus(conn) != CONNECTION_OK)
+	    {
+	      [db disconnect];
+	    }
+	  else
+	    {
+	      [db _checkNotifications: NO];
+	    }
+	}
+      if (nil == a->error)
+	{
+	  NSTimeInterval	d;
+
+	  db->_lastOperation = [NSDate timeIntervalSinceReferenceDate];
+	  d = db->_lastOperation - a->start;
+	  if (db->_duration >= 0 && d >= db->_duration)
+	    {
+	      [db debug: @"Duration %g for asynchronous %@",
+		d, [a->op statement]];
+	    }
+	}
+    }
+  NS_HANDLER
+    {
+      NSLog(@"Problem finishing %@: %@", a->op, localException);
+    }
+  NS_ENDHANDLER
+  [lock lock];
+  NSHashRemove(busy, db);
+  [lock unlock];
+  [db->lock unlock];
+  [a retain];
+  [active removeObjectIdenticalTo: a];
+  [a->op completeWithRecords: a->records count: a->count error: a->error];
+  [a release];
+}
+
+- (void) _fail: (_PGAsync*)a message: (const char*)msg
+{
+  NSString	*str = [NSString stringWithUTF8String: msg];
+  PGconn	*conn = ((ConnectionInfo*)a->client->extra)->_connection;
+  NSString	*name = SQLException;
+
+  if (nil == str)
+    {
+      str = [NSString stringWithCString: msg];
+    }
+  if (0 == conn || PQstatus(conn) != CONNECTION_OK)
+    {
+      name = SQLConnectionException;
+    }
+  if (nil == a->error)
+    {
+      a->error = [[NSException alloc] initWithName: name
+	reason: [NSString stringWithFormat: @"Error executing %@: %@",
+	[a->op statement], str] userInfo: nil];
+    }
+}
+
+/* Try to send the statement of an operation to the server.  Returns NO
+ * if the client is busy in the reactor, so the operation must wait.<br />
+ * The client lock is recursive and the reactor thread holds it for every
+ * operation in progress, so we keep track of the clients we are using
+ * rather than relying on the lock to tell us whether a client is free.
+ */
+- (BOOL) _send: (SQLAsyncOperation*)op
+{
+  SQLClientPostgres	*db = (SQLClientPostgres*)[op client];
+  _PGAsync		*a;
+  PGconn		*conn;
+  struct epoll_event	ev;
+  int			r;
+
+  [lock lock];
+  if (0 != NSHashGet(busy, db))
+    {
+      [lock unlock];
+      return NO;
+    }
+  NSHashInsert(busy, db);
+  [lock unlock];
+  if (NO == [db->lock tryLock])
+    {
+      [NSThread detachNewThreadSelector: @selector(_await:)
+			       toTarget: self
+			     withObject: op];
+      return YES;			// Client stays busy while waiting
+    }
+  if (NO == db->connected)
+    {
+      [db->lock unlock];
+      [NSThread detachNewThreadSelector: @selector(_connect:)
+			       toTarget: self
+			     withObject: op];
+      return YES;			// Client stays busy while connecting
+    }
+  a = [_PGAsync new];
+  a->op = [op retain];
+  a->client = db;
+  a->fd = -1;
+  a->count = -1;
+  a->start = [NSDate timeIntervalSinceReferenceDate];
+  [active addObject: a];
+  [a release];
+  db->_lastStart = a->start;
+  [db _startDeadline];
+  conn = ((ConnectionInfo*)db->extra)->_connection;
+  PQsetnonblocking(conn, 1);
+  if (0 == PQsendQuery(conn, [SQLClientUnProxyLiteral([op statement])
+    UTF8String]))
+    {
+      [self _fail: a message: PQerrorMessage(conn)];
+      [self _finish: a];
+      return YES;
+    }
+  r = PQflush(conn);
+  if (r < 0)
+    {
+      [self _fail: a message: PQerrorMessage(conn)];
+      [self _finish: a];
+      return YES;
+    }
+  a->fd = PQsocket(conn);
+  memset(&ev, '\0', sizeof(ev));
+  ev.events = EPOLLIN | ((1 == r) ? EPOLLOUT : 0);
+  ev.data.ptr = (void*)a;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, a->fd, &ev);
+  return YES;
+}
+
+/* Handle input (or the ability to send more output) for an operation.
+ */
+- (void) _input: (_PGAsync*)a events: (uint32_t)events
+{
+  PGconn	*conn = ((ConnectionInfo*)a->client->extra)->_connection;
+  PGresult	*result;
+
+  if (events & EPOLLOUT)
+    {
+      int	r = PQflush(conn);
+
+      if (r < 0)
+	{
+	  [self _fail: a message: PQerrorMessage(conn)];
+	  [self _finish: a];
+	  return;
+	}
+      if (0 == r)
+	{
+	  struct epoll_event	ev;
+
+	  memset(&ev, '\0', sizeof(ev));
+	  ev.events = EPOLLIN;
+	  ev.data.ptr = (void*)a;
+	  epoll_ctl(epfd, EPOLL_CTL_MOD, a->fd, &ev);
+	}
+    }
+  if (0 == PQconsumeInput(conn))
+    {
+      [self _fail: a message: PQerrorMessage(conn)];
+      [self _finish: a];
+      return;
+    }
+  while (0 == PQisBusy(conn))
+    {
+      ExecStatusType	status;
+
+      if (0 == (result = PQgetResult(conn)))
+	{
+	  [self _finish: a];	// All results have been read
+	  return;
+	}
+      status = PQresultStatus(result);
+      if (PGRES_COMMAND_OK != status && PGRES_TUPLES_OK != status)
+	{
+	  [self _fail: a message: PQresultErrorMessage(result)];
+	}
+      else if (nil == a->error)
+	{
+	  NS_DURING
+	    {
+	      if (YES == [a->op isQuery])
+		{
+		  if (PGRES_TUPLES_OK == status)
+		    {
+		      [a->records release];
+		      a->records = [a->client
+			_newRecordsFromResult: result
+				   recordType: [SQLRecord class]
+				     listType: [NSMutableArray class]];
+		    }
+		  else
+		    {
+		      [self _fail: a message: "query produced no result"];
+		    }
+		}
+	      else
+		{
+		  const char	*tuples = PQcmdTuples(result);
+
+		  if (0 != tuples)
+		    {
+		      a->count = atol(tuples);
+		    }
+		}
+	    }
+	  NS_HANDLER
+	    {
+	      ASSIGN(a->error, localException);
+	    }
+	  NS_ENDHANDLER
+	}
+      PQclear(result);
+    }
+}
+
+- (void) _run
+{
+  struct epoll_event	events[64];
+
+  while (YES)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      NSMutableArray	*ops;
+      NSMutableArray	*later;
+      NSHashTable	*deferred;
+      NSUInteger	index;
+      int		count;
+      int		i;
+
+      /* Start any operations whose clients are not in use.  Once one
+       * operation for a client has to wait, any later ones for the same
+       * client must wait too, so that they are performed in order.
+       */
+      [lock lock];
+      ops = [waiting copy];
+      [waiting removeAllObjects];
+      [lock unlock];
+      later = [NSMutableArray new];
+      deferred = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
+      for (index = 0; index < [ops count]; index++)
+	{
+	  SQLAsyncOperation	*op = [ops objectAtIndex: index];
+	  SQLClient		*db = [op client];
+
+	  if (0 != NSHashGet(deferred, db) || NO == [self _send: op])
+	    {
+	      NSHashInsert(deferred, db);
+	      [later addObject: op];
+	    }
+	}
+      NSFreeHashTable(deferred);
+      [ops release];
+      if ([later count] > 0)
+	{
+	  [lock lock];
+	  [waiting replaceObjectsInRange: NSMakeRange(0, 0)
+		    withObjectsFromArray: later];
+	  [lock unlock];
+	}
+      [later release];
+
+      /* Operations still waiting are for clients in use by the reactor,
+       * which become available when an operation finishes (handled in
+       * this thread) or when a connection or another thread's use of the
+       * client ends (and the reactor is woken), so we need not poll.
+       */
+      count = epoll_wait(epfd, events, 64, -1);
+      for (i = 0; i < count; i++)
+	{
+	  _PGAsync	*a = (_PGAsync*)events[i].data.ptr;
+
+	  if (0 == a)
+	    {
+	      char	buf[64];
+
+	      while (read(wake[0], buf, sizeof(buf)) > 0)
+		;
+	    }
+	  else if (NSNotFound != [active indexOfObjectIdenticalTo: a])
+	    {
+	      [self _input: a events: events[i].events];
+	    }
+	}
+      if (count < 0 && EINTR != errno)
+	{
+	  NSLog(@"Postgres reactor wait failed: %s", strerror(errno));
+	}
+      [arp release];
+    }
+}
+@end
+
+#endif	/* USE_REACTOR_THREAD */
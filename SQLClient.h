@@ -185,13 +185,19 @@
 @class	NSConditionLock;
 @class	NSCountedSet;
 @class	NSMapTable;
+@class	NSMutableIndexSet;
 @class	NSMutableDictionary;
 @class	NSMutableSet;
 @class	NSRecursiveLock;
 @class	NSThread;
+@class	NSTimeZone;
 
 @class	GSCache;
+@class	NSException;
+@class	SQLAsyncOperation;
 @class	SQLClient;
+@class	SQLClientPool;
+@class	SQLClientRouter;
 @class	SQLLiteral;
 @class	SQLTransaction;
 
@@ -206,6 +212,33 @@
 #define SQLLitArg  NSString
 #endif
 
+/* GNUstep provides macros to declare and call blocks in a way which
+ * compiles even where the compiler does not support blocks.
+ */
+#if	!defined(DEFINE_BLOCK_TYPE)
+#define	DEFINE_BLOCK_TYPE(name, retTy, argTys, ...) \
+  typedef retTy(^name)(argTys, ## __VA_ARGS__)
+#define	CALL_BLOCK(block, args, ...) block(args, ## __VA_ARGS__)
+#endif
+
+/** The type of block called on completion of an asynchronous query.<br />
+ * On success the records argument is the query result and the error
+ * argument is nil, on failure the records argument is nil and the error
+ * argument is the exception which would have been raised by a
+ * synchronous query.
+ */
+DEFINE_BLOCK_TYPE(SQLClientQueryCompletion, void,
+  NSMutableArray*, NSException*);
+
+/** The type of block called on completion of an asynchronous statement.<br />
+ * On success the count argument is the number of rows affected by the
+ * statement and the error argument is nil, on failure the count argument
+ * is -1 and the error argument is the exception which would have been
+ * raised by a synchronous execution.
+ */
+DEFINE_BLOCK_TYPE(SQLClientExecuteCompletion, void,
+  NSInteger, NSException*);
+
 /**
  * Notification sent when an instance becomes connected to the database
  * server.  The notification object is the instance connected.
@@ -294,17 +327,33 @@ extern NSString * const SQLClientDidDisconnectNotification;
 {
   NSUInteger    count;  // Number of keys
   NSArray       *order; // Keys in order
-  NSMapTable    *map;   // Key to index
-  NSMapTable    *low;   // lowercase map
+  void          *index; // Case insensitive lookup index
   NSUInteger    bytes;  // Size in bytes
 }
 
+/** Returns a keys object for the specified names.<br />
+ * Keys objects are interned (in a process-wide, thread-safe table),
+ * so that repeated queries producing the same columns will share the
+ * same keys object rather than creating a new one for each query.
+ */
++ (SQLRecordKeys*) keysWithNames: (NSString**)names count: (NSUInteger)c;
+
+/** Returns a keys object for the specified names (nul terminated UTF-8
+ * strings) as returned by a database library.<br />
+ * This is like +keysWithNames:count: but, when the keys have already
+ * been interned, avoids the overhead of creating string objects.
+ */
++ (SQLRecordKeys*) keysWithUTF8Names: (const char**)names
+                               count: (NSUInteger)c;
+
 /** Returns the number of keys in the receiver.
  */
 - (NSUInteger) count;
 
 /** Returns the index of the object with the specified key,
- * or NSNotFound if there is no such key.
+ * or NSNotFound if there is no such key.<br />
+ * The lookup is case insensitive (though an exact match is preferred
+ * if keys differ only in case) and does not allocate memory.
  */
 - (NSUInteger) indexForKey: (NSString*)key;
 
@@ -435,6 +484,7 @@ extern NSString	*SQLException;
 extern NSString	*SQLConnectionException;
 extern NSString	*SQLEmptyException;
 extern NSString	*SQLUniqueException;
+extern NSString	*SQLTimeoutException;
 
 /**
  * Returns the timestamp of the most recent call to SQLClientTimeNow().
@@ -469,6 +519,24 @@ extern NSTimeInterval	SQLClientTimeStart();
  */
 extern unsigned	SQLClientTimeTick();
 
+/**
+ * Parses a timestamp in the format commonly returned by database servers
+ * (YYYY-MM-DD or YYYY-MM-DD HH:MM:SS with optional fractional seconds
+ * and an optional offset from GMT of the form +HH, +HHMM or +HH:MM)
+ * and returns a new date (owned by the caller) or nil if the buffer
+ * does not contain a valid timestamp.<br />
+ * The time is calculated arithmetically rather than using the calendar
+ * date methods, and time zones are cached by offset, so this is much
+ * faster than parsing the value using a date format.<br />
+ * If the timestamp does not contain an offset from GMT, it is taken to be
+ * in the supplied zone (or the local time zone if zone is nil).<br />
+ * The returned object is an NSCalendarDate whose time zone is set from
+ * the timestamp (or the supplied zone) and whose calendar format is
+ * %Y-%m-%d %H:%M:%S %z
+ */
+extern NSDate *SQLClientNewDateFromBuffer(const char *b, unsigned length,
+  NSTimeZone *zone);
+
 @class SQLClientPool;
 
 /**
@@ -510,7 +578,7 @@ SQLCLIENT_PRIVATE
   NSString		*_database;	/** The configured database name/host */
   NSString		*_password;	/** The configured password */
   NSString		*_user;		/** The configured user */
-  NSMutableArray	*_statements;	/** Uncommitted statements */
+  id			_statements;	/** Transaction statement history */
   /**
    * Timestamp of completion of last operation.<br />
    * Maintained by -simpleExecute: -simpleQuery:recordType:listType:
@@ -551,6 +619,20 @@ SQLCLIENT_PRIVATE
 + (SQLClient*) clientWithConfiguration: (NSDictionary*)config
 				  name: (NSString*)reference;
 
+/**
+ * Establishes connections for all the unconnected clients in the array
+ * concurrently, returning the number of clients connected on return.<br />
+ * Where the backend supports it (see -backendConnectStart:) the
+ * connections are started without blocking and the handshakes with the
+ * server are all performed together in the calling thread, otherwise
+ * each client is connected in turn using -tryConnect.<br />
+ * Connection attempts still in progress after thirty seconds (or the
+ * period set by +setAbandonFailedConnectionsAfter: if that is longer)
+ * are abandoned.<br />
+ * The clients must not be in use elsewhere while this is happening.
+ */
++ (NSUInteger) connectClients: (NSArray*)clients;
+
 /**
  * Return an existing SQLClient instance for the specified name
  * if one exists, otherwise returns nil.
@@ -590,6 +672,27 @@ SQLCLIENT_PRIVATE
  */
 + (void) setAbandonFailedConnectionsAfter: (NSTimeInterval)delay;
 
+/**
+ * <p>Configures the circuit breaker shared by all clients (including
+ * those in pools) which connect to the same database.
+ * </p>
+ * <p>Once there have been <em>failures</em> consecutive failed connection
+ * attempts to a database, the breaker opens and further attempts to
+ * connect to that database fail immediately (without contacting the
+ * server) for a backoff period.  The period doubles each time the breaker
+ * opens (up to <em>maxDelay</em> seconds) and is randomly shortened by up
+ * to half so that many processes do not all retry at the same moment.<br />
+ * When the period has passed a single client is allowed to make a probe
+ * attempt while others continue to fail fast; if the probe succeeds the
+ * breaker closes, otherwise it opens again for a longer period.
+ * </p>
+ * <p>The defaults are three failures and a maximum delay of thirty seconds.
+ * Setting <em>failures</em> to zero disables the breaker.
+ * </p>
+ */
++ (void) setCircuitBreaker: (unsigned int)failures
+		  maxDelay: (NSTimeInterval)maxDelay;
+
 /**
  * <p>Set the maximum number of simultaneous database connections
  * permitted (defaults to 8 and may not be set less than 1).
@@ -684,6 +787,12 @@ SQLCLIENT_PRIVATE
  */
 - (SQLLiteral*) buildQuery: (NSString*)stmt with: (NSDictionary*)values;
 
+/**
+ * Returns a description of the state of the circuit breaker for the
+ * database used by the receiver (see +setCircuitBreaker:maxDelay:).
+ */
+- (NSString*) circuitBreaker;
+
 /**
  * Return the client name for this instance.<br />
  * Normally this is useful only for debugging/reporting purposes, but
@@ -723,7 +832,10 @@ SQLCLIENT_PRIVATE
  * the application can reconnect reasonably quickly.<br />
  * If the connection attempt fails it is repeated until it succeds or until
  * the time interval specified by +setAbandonFailedConnectionsAfter: has
- * passed.
+ * passed.<br />
+ * While the circuit breaker for the database is open (see
+ * +setCircuitBreaker:maxDelay:) this waits for the breaker to allow
+ * another attempt rather than repeatedly trying to connect.
  */
 - (BOOL) connect;
 
@@ -822,6 +934,29 @@ SQLCLIENT_PRIVATE
  * ServerType ... is the name of the backend server to be used ... by
  * convention the name of a bundle containing the interface to that backend.
  * If this is missing then 'Postgres' is used.<br />
+ * PackedArrays ... for the Postgres backend, if this is set to YES then
+ * integer and floating point array columns are returned as (immutable)
+ * [SQLPackedArray] instances rather than as mutable arrays of literal
+ * strings.<br />
+ * NotifyCoalesce ... for the Postgres backend, the length (in seconds)
+ * of the coalescing window for asynchronous notifications: within each
+ * window, only the first notification with a particular payload from a
+ * particular process is delivered.  This may be a number to be used for
+ * all channels, or a dictionary keyed on channel name (with '*' matching
+ * any channel not otherwise listed).<br />
+ * NotifyRateLimit ... for the Postgres backend, the maximum number of
+ * notifications per second to be delivered on a channel (excess ones are
+ * discarded and a warning is logged).  This may be a number or a
+ * dictionary in the same way as NotifyCoalesce.<br />
+ * ListenerThread ... for the Postgres backend on linux, if this is set
+ * to YES then the client uses a separate connection, managed by a single
+ * thread shared by all such clients, to listen for notifications.
+ * This means that receiving notifications does not require a run loop
+ * or contend for the client lock with normal queries.  Notifications are
+ * delivered in the thread which most recently added an observer.<br />
+ * StatementTimeout ... the default maximum time (in seconds) for which
+ * a statement may run before it is cancelled
+ * (see the -setStatementTimeout: method).<br />
  * The database name may be of the format 'name@host:port' when you wish to
  * connect to a database on a different host over the network.
  */
@@ -888,8 +1023,9 @@ SQLCLIENT_PRIVATE
  * according to the autoquote setting, and concatenating the resulting
  * strings in a nil terminated list.<br />
  * Returns an array containing the statement as the first object and
- * any NSData objects following.  The NSData objects appear in the
- * statement strings as the marker sequence - <code>'?'''?'</code><br />
+ * any NSData (or [SQLBoundArray]) objects following.  These objects appear
+ * in the statement strings as the marker sequence -
+ * <code>'?'''?'</code><br />
  * If the returned array contains a single object, that object is a
  * simple SQL query/statement.
  */
@@ -1122,6 +1258,16 @@ SQLCLIENT_PRIVATE
  */
 - (void) setShouldTrim: (BOOL)aFlag;
 
+/** Sets the default maximum time (in seconds) for which a statement or
+ * query run by the receiver may execute.  A value less than or equal to
+ * zero (the default) means that there is no limit.<br />
+ * When a statement runs for longer than this, a watchdog thread asks the
+ * backend to cancel it on the server, and the method running the statement
+ * raises an SQLTimeoutException.<br />
+ * This may also be configured using the StatementTimeout configuration key.
+ */
+- (void) setStatementTimeout: (NSTimeInterval)seconds;
+
 /**
  * Set the database user for this object.<br />
  * This is called automatically to configure the connection ...
@@ -1139,6 +1285,13 @@ SQLCLIENT_PRIVATE
  */
 - (NSInteger) simpleExecute: (id)info;
 
+/**
+ * As for -simpleExecute: but using the specified timeout (in seconds)
+ * instead of the default set by -setStatementTimeout: (a value less than
+ * or equal to zero means that there is no limit).
+ */
+- (NSInteger) simpleExecute: (id)info timeout: (NSTimeInterval)seconds;
+
 /**
  * Calls -simpleQuery:recordType:listType: with the default record class
  * and default array class.
@@ -1149,6 +1302,9 @@ SQLCLIENT_PRIVATE
  * Calls -backendQuery:recordType:listType: in a safe manner.<br />
  * Handles locking.<br />
  * Maintains -lastOperation date.<br />
+ * As well as a simple SQL query (a string), this accepts an array as
+ * produced by the prepare methods, in which case any out-of-line
+ * arguments are passed to -backendQueryPrepared:recordType:listType:<br />
  * The value of rtype must respond to the
  * [SQLRecord+newWithValues:keys:count:] method.<br />
  * If rtype is nil then the [SQLRecord] class is used.<br />
@@ -1164,9 +1320,22 @@ SQLCLIENT_PRIVATE
 		     recordType: (id)rtype
 		       listType: (id)ltype;
 
+/**
+ * As for -simpleQuery: but using the specified timeout (in seconds)
+ * instead of the default set by -setStatementTimeout: (a value less than
+ * or equal to zero means that there is no limit).
+ */
+- (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
+			timeout: (NSTimeInterval)seconds;
+
+/**
+ * Returns the default statement timeout set by -setStatementTimeout:
+ */
+- (NSTimeInterval) statementTimeout;
 
 /** If there is no database connection, attempts to establish one.<br />
- * This does not do automatic retries on connection failure.<br />
+ * This does not do automatic retries on connection failure, and fails
+ * immediately while the circuit breaker for the database is open.<br />
  * Returns the current connection status.
  */
 - (BOOL) tryConnect;
@@ -1188,6 +1357,17 @@ SQLCLIENT_PRIVATE
 - (SQLClientPool*) pool;
 @end
 
+/** The states of a non-blocking connection attempt (see
+ * [SQLClient(Subclass)-backendConnectStart:]).
+ */
+typedef enum {
+  SQLClientConnectBlocking = -2,/** Not supported; use -backendConnect */
+  SQLClientConnectFailed = -1,	/** The attempt failed */
+  SQLClientConnectDone = 0,	/** The connection is established */
+  SQLClientConnectReading = 1,	/** Waiting for the socket to be readable */
+  SQLClientConnectWriting = 2	/** Waiting for the socket to be writable */
+} SQLClientConnectState;
+
 /**
  * This category contains the methods which a subclass <em>must</em>
  * override to provide a working instance, and helper methods for the
@@ -1202,6 +1382,30 @@ SQLCLIENT_PRIVATE
  */
 @interface	SQLClient(Subclass)
 
+/** For use by backends which hold unretained references to clients
+ * from other threads (eg. a listener thread).<br />
+ * Looks up client in the registry of all clients (entries are
+ * removed by -dealloc) and, if it is still present and not being
+ * deallocated, returns it retained and autoreleased.  Otherwise
+ * returns nil.  The argument may be a dangling pointer; it is only
+ * compared, never messaged, unless it is found in the registry.
+ */
++ (SQLClient*) registeredClient: (void*)client;
+
+/** <override-subclass />
+ * Called from the watchdog thread when the statement currently being
+ * executed by the receiver has run past its deadline (see the
+ * -setStatementTimeout: method).  The receiver is locked by the thread
+ * running the statement, so this method must <em>not</em> lock it, but
+ * should ask the server to abandon the statement as quickly as it can
+ * (the backend will then raise an exception in the thread running the
+ * statement, and that is converted to an SQLTimeoutException).<br />
+ * There is a default implementation which does nothing ... for backends
+ * which can't cancel a statement in progress.  With those backends the
+ * statement runs to completion, but a deadline miss is still counted.
+ */
+- (void) backendCancel;
+
 /** <override-subclass />
  * Attempts to establish a connection to the database server.<br />
  * Returns a flag to indicate whether the connection has been established.<br />
@@ -1223,6 +1427,33 @@ SQLCLIENT_PRIVATE
  */
 - (BOOL) backendConnect;
 
+/** <override-subclass />
+ * Continues a connection attempt begun by -backendConnectStart: once
+ * the socket is ready for the operation it was waiting for, setting
+ * *descriptor to the socket to wait on next.<br />
+ * On completion this must set the <em>connected</em> instance variable
+ * just as -backendConnect does and return SQLClientConnectDone or
+ * SQLClientConnectFailed.<br />
+ * The default implementation returns SQLClientConnectFailed.
+ */
+- (SQLClientConnectState) backendConnectPoll: (int*)descriptor;
+
+/** <override-subclass />
+ * Starts establishing a connection to the database server without
+ * waiting for the handshake to complete, so that many connections can
+ * be established concurrently by +connectClients:.<br />
+ * Returns SQLClientConnectReading or SQLClientConnectWriting (after
+ * setting *descriptor to the socket to wait on) if the attempt is under
+ * way, SQLClientConnectDone if the receiver was already connected, or
+ * SQLClientConnectFailed if the attempt failed.<br />
+ * The default implementation returns SQLClientConnectBlocking to say
+ * that the backend does not support this, and -backendConnect should be
+ * used instead.<br />
+ * Like -backendConnect, this method must call +purgeConnections: to
+ * ensure that there is a free slot for the new connection.
+ */
+- (SQLClientConnectState) backendConnectStart: (int*)descriptor;
+
 /** <override-subclass />
  * Disconnect from the database unless already disconnected.<br />
  * <p>This method is called automatically when the receiver is deallocated
@@ -1276,6 +1507,17 @@ SQLCLIENT_PRIVATE
  */
 - (NSInteger) backendExecute: (NSArray*)info;
 
+/** <override-subclass />
+ * Called by the health check of a connection pool (see
+ * [SQLClientPool-setHealthCheck:]) for a connected client which the pool
+ * has reserved, to find out whether its connection to the server is
+ * still usable.  Returns NO or raises an exception if it is not.<br />
+ * The default implementation performs the query <code>SELECT 1</code>,
+ * so a backend should override it if its server does not accept that
+ * query, or if it has a cheaper way of checking the connection.
+ */
+- (BOOL) backendIsValid;
+
 /** <override-subclass />
  * <p>Perform arbitrary query <em>which returns values.</em>
  * </p>
@@ -1365,6 +1607,34 @@ SQLCLIENT_PRIVATE
  */
 - (void) backendUnlisten: (NSString*)name;
 
+/** <override-subclass />
+ * Called (with the client unlocked) to start an asynchronous operation
+ * using the receiver.  A backend which supports asynchronous operation
+ * should lock the receiver, send the statement to the server and return
+ * YES without waiting for the result.  When the result is received the
+ * backend should unlock the receiver, and then call the
+ * [SQLAsyncOperation-completeWithRecords:count:error:] method.<br />
+ * The default implementation returns NO, in which case the operation is
+ * performed synchronously by one of a small set of worker threads.
+ */
+- (BOOL) backendStartAsync: (SQLAsyncOperation*)op;
+
+/** <override-subclass />
+ * Called by -simpleQuery:recordType:listType: to perform a query which
+ * was prepared with out-of-line arguments ([NSData] or [SQLBoundArray]
+ * instances).  The info array contains the statement followed by those
+ * arguments, whose positions in the statement are marked in the same
+ * way as for -backendExecute:<br />
+ * The default implementation inserts the arguments into the statement
+ * (see -inlineBoundArrays: and
+ * -insertBLOBs:intoStatement:length:withMarker:length:giving:) and
+ * calls -backendQuery:recordType:listType: so backends which can send
+ * the arguments as parameters should override it.
+ */
+- (NSMutableArray*) backendQueryPrepared: (NSArray*)info
+			      recordType: (id)rtype
+				listType: (id)ltype;
+
 /** <override-subclass />
  * This method is <em>only</em> for the use of the
  * -insertBLOBs:intoStatement:length:withMarker:length:giving:
@@ -1402,6 +1672,17 @@ SQLCLIENT_PRIVATE
 		     length: (unsigned)mLength
 		     giving: (unsigned*)result;
 
+/**
+ * This method is a convenience method provided for subclasses which can't
+ * pass [SQLBoundArray] arguments to the server as parameters.<br />
+ * Returns info (an array containing a statement and its out-of-line
+ * arguments, as produced by the prepare methods) if it contains no
+ * bound arrays, otherwise returns a copy in which the bound arrays are
+ * inserted into the statement as lists of quoted values
+ * (see [SQLClient(Quote)-quoteSet:]).
+ */
+- (NSArray*) inlineBoundArrays: (NSArray*)info;
+
 /** <override-subclass />
  * This method is <em>only</em> for the use of the
  * -insertBLOBs:intoStatement:length:withMarker:length:giving:
@@ -1414,6 +1695,95 @@ SQLCLIENT_PRIVATE
 
 @end
 
+/**
+ * This category contains methods for performing queries and statements
+ * without blocking the calling thread.<br />
+ * Backends which support it (currently only PostgreSQL on linux) send the
+ * request to the server and a single internal thread handles the results
+ * of all the requests in progress, so a small number of threads may have
+ * many requests in progress at once.  Other backends run each request in
+ * a separate thread.<br />
+ * The client is locked for the duration of the request, so any synchronous
+ * use of the client in the meantime will wait for it to complete.<br />
+ * The completion block is called in the specified thread (if that thread
+ * is running its run loop) or in the calling thread for the methods which
+ * do not specify a thread.  If a nil thread is specified, the block is
+ * called in whatever thread completes the request, and should therefore
+ * return quickly.
+ */
+@interface	SQLClient (Asynchronous)
+
+/** Executes the statement (which must be complete and correctly quoted)
+ * asynchronously, calling the completion block in the current thread.
+ */
+- (void) execute: (SQLLitArg*)stmt
+      completion: (SQLClientExecuteCompletion)completion;
+
+/** Executes the statement (which must be complete and correctly quoted)
+ * asynchronously, calling the completion block in the specified thread.
+ */
+- (void) execute: (SQLLitArg*)stmt
+	  thread: (NSThread*)thread
+      completion: (SQLClientExecuteCompletion)completion;
+
+/** Performs the query (which must be complete and correctly quoted)
+ * asynchronously, calling the completion block in the current thread.
+ */
+- (void) query: (SQLLitArg*)stmt
+    completion: (SQLClientQueryCompletion)completion;
+
+/** Performs the query (which must be complete and correctly quoted)
+ * asynchronously, calling the completion block in the specified thread.
+ */
+- (void) query: (SQLLitArg*)stmt
+	thread: (NSThread*)thread
+    completion: (SQLClientQueryCompletion)completion;
+@end
+
+/** An instance of this class represents an asynchronous query or statement
+ * in progress.  Application code does not normally need to use it; it
+ * is provided for backends implementing [SQLClient-backendStartAsync:].
+ */
+@interface	SQLAsyncOperation : NSObject
+{
+SQLCLIENT_PRIVATE
+  SQLClient		*_client;	/** The client performing the request */
+  SQLClientPool		*_pool;		/** Pool to return the client to */
+  SQLLiteral		*_statement;	/** The query or statement */
+  NSThread		*_thread;	/** Thread to run completion in */
+  id			_completion;	/** The completion block */
+  NSMutableArray	*_records;	/** Result of a query */
+  NSInteger		_count;		/** Result of a statement */
+  NSException		*_error;	/** Exception on failure */
+  BOOL			_query;		/** Is this a query? */
+}
+
+/** Returns the client used to perform the operation.
+ */
+- (SQLClient*) client;
+
+/** Called by the backend when the operation has completed (the client
+ * must not be locked by the calling thread).  For a successful query the
+ * records argument is the result, for a successful statement the count
+ * argument is the number of rows affected, and on failure the error
+ * argument is the exception describing the problem.<br />
+ * This returns a pooled client to its pool, then arranges for the
+ * completion block to be called.
+ */
+- (void) completeWithRecords: (NSMutableArray*)records
+		       count: (NSInteger)count
+		       error: (NSException*)error;
+
+/** Returns YES if the operation is a query (producing records), NO if it
+ * is a statement (producing a count of rows affected).
+ */
+- (BOOL) isQuery;
+
+/** Returns the query or statement to be performed.
+ */
+- (SQLLiteral*) statement;
+@end
+
 /**
  * This category contains methods for asynchronous notification of 
  * events via the database (for those database backends which support
@@ -1509,6 +1879,24 @@ SQLCLIENT_PRIVATE
  */
 - (NSMutableArray*) columns: (NSMutableArray*)records;
 
+/**
+ * Inserts the rows (arrays of values in the same order as the columns)
+ * into the table using multi-row INSERT ... VALUES (...),(...) statements
+ * each holding as many rows as fit within a size budget (see
+ * [SQLTransaction-addInsert:into:columns:]).<br />
+ * If a statement fails it is split in half and each half retried, until
+ * the rows which fail have been found, and the index of each of those
+ * rows in the input array is added to failures (if it is not nil).<br />
+ * Failures can only be isolated this way when the receiver is not in
+ * a transaction; otherwise (or if the connection is lost or a statement
+ * times out) the exception is raised.<br />
+ * Returns the number of rows inserted.
+ */
+- (NSUInteger) insert: (NSArray*)rows
+		 into: (NSString*)table
+	      columns: (NSArray*)columns
+	     failures: (NSMutableIndexSet*)failures;
+
 /**
  * Executes a query (like the -query:,... method) and checks the result
  * (raising an exception if the query did not contain a single record)
@@ -1547,6 +1935,19 @@ SQLCLIENT_PRIVATE
  */
 + (unsigned int) debugging;
 
+/**
+ * Returns the capacity of the buffer used for asynchronous duration
+ * logging, or zero if duration logging is synchronous
+ * (see +setDurationLogBuffer:).
+ */
++ (NSUInteger) durationLogBuffer;
+
+/**
+ * Returns the total number of duration log records which have been
+ * dropped because the asynchronous logging buffer was full.
+ */
++ (uint64_t) durationLogDropped;
+
 /**
  * Return the class-wide duration logging threshold, which is inherited by all
  * newly created instances.
@@ -1560,6 +1961,32 @@ SQLCLIENT_PRIVATE
  */
 + (void) setDebugging: (unsigned int)level;
 
+/**
+ * <p>Turns on asynchronous logging of the durations of statements and
+ * queries (see -setDurationLogging:) if capacity is greater than zero,
+ * or turns it off (the default) otherwise.
+ * </p>
+ * <p>Normally the message for a slow statement is built while the client
+ * is locked and is then logged synchronously using -debug:, so under load
+ * the logging itself slows the database operations down.  With
+ * asynchronous logging, a compact record of each slow operation (the
+ * time, client name, statement fingerprint, duration and row count) is
+ * added to a ring buffer without locking, and a background thread
+ * formats the records and logs them using NSLog().
+ * </p>
+ * <p>When the buffer is full, records are dropped rather than making
+ * database operations wait.  The writer thread logs the number of records
+ * dropped, and the total is returned by +durationLogDropped.
+ * </p>
+ * <p>The buffer holds capacity records (rounded up to a power of two) and
+ * is created the first time asynchronous logging is turned on; its size
+ * does not change after that.<br />
+ * NB. Asynchronous logging does not use -debug: so it bypasses any
+ * override of that method.
+ * </p>
+ */
++ (void) setDurationLogBuffer: (NSUInteger)capacity;
+
 /**
  * Set the duration logging threshold to be inherited by new instances.<br />
  * See [SQLClient(Logging)-setDurationLogging:]
@@ -1567,6 +1994,20 @@ SQLCLIENT_PRIVATE
  */
 + (void) setDurationLogging: (NSTimeInterval)threshold;
 
+/**
+ * Set the depth of statement history to be inherited by new
+ * instances (defaults to 100).<br />
+ * See [SQLClient(Logging)-setStatementHistory:]
+ * for controlling an individual instance of the class.
+ */
++ (void) setStatementHistory: (NSUInteger)depth;
+
+/**
+ * Return the class-wide depth of statement history, which is inherited
+ * by all newly created instances.
+ */
++ (NSUInteger) statementHistory;
+
 /**
  * The default implementation calls NSLogv to log a debug message.<br />
  * Override this in a category to provide more sophisticated logging.<br />
@@ -1605,6 +2046,24 @@ SQLCLIENT_PRIVATE
  * this logging.  A value of zero logs all statements.
  */
 - (void) setDurationLogging: (NSTimeInterval)threshold;
+
+/**
+ * Sets the number of statements in a transaction whose details are kept
+ * for logging when the commit or rollback of the transaction is slow
+ * (see -setDurationLogging:).<br />
+ * While duration logging is turned on, the fingerprint, duration and
+ * number of records affected are kept for the most recent statements
+ * (up to depth of them) along with the number and total duration of all
+ * the statements and the text of the slowest one.  This means the memory
+ * used does not grow however long a transaction is.<br />
+ * Changing the depth discards the history of any transaction in progress.
+ */
+- (void) setStatementHistory: (NSUInteger)depth;
+
+/**
+ * Returns the depth of statement history set by -setStatementHistory:
+ */
+- (NSUInteger) statementHistory;
 @end
 
 /**
@@ -1710,6 +2169,23 @@ SQLCLIENT_PRIVATE
 @end
 
 typedef struct _SQLClientPoolItem SQLClientPoolItem;
+typedef struct _SQLClientPoolClass SQLClientPoolClass;
+typedef struct _SQLClientPoolWaiter SQLClientPoolWaiter;
+
+/** The priority classes of requests for clients from a pool (see
+ * [SQLClientPool-setReserve:share:forPriority:]).  When clients are
+ * scarce, waiting requests are served in order of priority and then of
+ * the dates by which they need a client.
+ */
+typedef enum {
+  SQLClientPriorityHigh = 0,	/** Interactive (user facing) work */
+  SQLClientPriorityNormal = 1,	/** The default */
+  SQLClientPriorityLow = 2	/** Batch and other background work */
+} SQLClientPriority;
+
+/** The number of priority classes.
+ */
+#define	SQLClientPriorityCount	3
 
 /** <p>An SQLClientPool instance may be used to create/control a pool of
  * client objects.  Code may obtain autoreleased proxies to the clients
@@ -1756,8 +2232,35 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
   NSTimeInterval        _failWaits;     /** Time waiting for timewouts */
   NSTimeInterval        _purgeAll;      /** Age to purge all connections */
   NSTimeInterval        _purgeMin;      /** Age to purge excess connections */
+  NSMutableArray        *_asyncPending; /** Operations awaiting a client */
+  uint64_t              _timeouts;      /** Count of statement timeouts */
+  int                   _size;          /** Effective (adaptive) size */
+  NSTimeInterval        _adaptTarget;   /** Adaptive sizing wait target */
+  NSTimeInterval        _adaptWhen;     /** Start of adaptive sample */
+  uint64_t              _adaptImmediate;/** Immediate count at sample start */
+  uint64_t              _adaptDelayed;  /** Delayed count at sample start */
+  uint64_t              _adaptFailed;   /** Failed count at sample start */
+  NSTimeInterval        _adaptWaits;    /** Delay waits at sample start */
+  int                   _adaptPeak;     /** Most clients in use in sample */
+  uint64_t              _grown;         /** Count of adaptive increases */
+  uint64_t              _shrunk;        /** Count of adaptive decreases */
+  NSTimeInterval        _healthInterval;/** Interval between health checks */
+  BOOL                  _healthRunning; /** Health check thread is running */
+  uint64_t              _unhealthy;     /** Count of failed health checks */
+  NSString              *_leaseKey;     /** Key for leases in threads */
+  SQLClientPoolClass    *_classes;      /** Per priority class settings */
+  SQLClientPoolWaiter   *_waiters;      /** Queue of waiting provisions */
+  int                   _waiting;       /** Count of waiting provisions */
+  int                   _waitersSize;   /** Capacity of waiters queue */
+  NSInteger             _ticket;        /** Last ticket issued to a waiter */
+  NSString              *_priorityKey;  /** Key for priorities in threads */
 }
 
+/** Returns the target wait time set by -setAdaptiveTarget: or zero if
+ * adaptive sizing of the pool is not in use.
+ */
+- (NSTimeInterval) adaptiveTarget;
+
 /** Returns the count of currently available connections in the pool.
  */
 - (int) availableConnections;
@@ -1777,6 +2280,18 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (uint64_t) committed;
 
+/** Returns the number of clients the pool will currently provide.<br />
+ * This is the same as -maxConnections unless adaptive sizing is in use
+ * (see -setAdaptiveTarget:), in which case it lies between the minimum
+ * and maximum number of connections.
+ */
+- (int) effectiveConnections;
+
+/** Returns the interval set by -setHealthCheck: (or zero if there is
+ * no health checking).
+ */
+- (NSTimeInterval) healthCheck;
+
 /**
  * Creates a pool of clients using a single client configuration.<br />
  * Calls -initWithConfiguration:name:pool: (passing NO to say the client
@@ -1793,6 +2308,28 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
                          max: (int)maxConnections
                          min: (int)minConnections;
 
+/** Leases a client from the pool to the current thread until the
+ * current autorelease pool is emptied, and returns that client.<br />
+ * While the lease lasts, the convenience methods of the pool (-query:,
+ * -execute:, -cache:query: etc) called in the current thread use the
+ * leased client directly (unless it is in a transaction) rather than
+ * taking a client from the pool and returning it for each call, so a
+ * series of small operations avoids locking the pool each time.<br />
+ * If the current thread already has a lease, its client is returned
+ * and the lease is not extended.<br />
+ * Since the client is unavailable to other threads for the duration of
+ * the lease, you should only lease a client in an autorelease pool
+ * which will be emptied soon (eg the one used to handle one request).
+ * <example>
+ *   NSAutoreleasePool *arp = [NSAutoreleasePool new];
+ *
+ *   [pool lease];
+ *   ... many calls to [pool query: ...] ...
+ *   [arp release];  // The client goes back to the pool.
+ * </example>
+ */
+- (SQLClient*) lease;
+
 /** Returns a long description of the pool including statistics, status,
  * and the description of a sample client.
  */
@@ -1811,6 +2348,16 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (NSString*) name;
 
+/** Returns the number of clients reserved for the priority class by
+ * -setReserve:share:forPriority:
+ */
+- (int) priorityReserve: (SQLClientPriority)priority;
+
+/** Returns the maximum share (percentage) of the pool which the priority
+ * class may use, as set by -setReserve:share:forPriority:
+ */
+- (int) priorityShare: (SQLClientPriority)priority;
+
 /** Fetches an (autoreleased) client from the pool.<br />
  * This method blocks indefinitely waiting for a client to become
  * available in the pool.<br />
@@ -1841,6 +2388,23 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (SQLClient*) provideClientBeforeDate: (NSDate*)when exclusive: (BOOL)isLocal;
 
+/** Fetches an (autoreleased) client from the pool as for
+ * -provideClientBeforeDate:exclusive: but for a request in the specified
+ * priority class rather than that of the current thread (see
+ * -setThreadPriority:).<br />
+ * A request is only given a client if doing so leaves enough clients
+ * for the reservations of the other priority classes and does not take
+ * its class beyond its maximum share of the pool (see
+ * -setReserve:share:forPriority:).<br />
+ * Requests which have to wait are queued, and as clients are returned
+ * to the pool they are given to the waiting requests in order of
+ * priority and (within a priority class) of the dates by which the
+ * requests need a client.
+ */
+- (SQLClient*) provideClientBeforeDate: (NSDate*)when
+			     exclusive: (BOOL)isLocal
+			      priority: (SQLClientPriority)priority;
+
 /** Fetches an (autoreleased) client from the pool.<br />
  * This method blocks indefinitely waiting for a client to become
  * available in the pool.<br />
@@ -1853,10 +2417,28 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  * Disconnects the least recently active unused database clients in the
  * pool, but only while there are more than the minimum number of clients
  * currently connected to the database, and only if the client has been
- * idle for at least ten seconds.
+ * idle for at least ten seconds.<br />
+ * When adaptive sizing is in use, idle connections beyond the current
+ * effective size of the pool are also closed.
  */
 - (void) purge;
 
+/** Turns on adaptive sizing of the pool if seconds is greater than zero,
+ * or turns it off otherwise.<br />
+ * In adaptive mode the pool only provides up to -effectiveConnections
+ * clients at a time.  Every ten seconds it looks at the provisions made
+ * since the last check: if the average delay in providing a client
+ * exceeded seconds, or more than one in twenty provisions were delayed
+ * or timed out, the effective size grows by a quarter (at least one).
+ * If there were no delays and fewer clients were in use at the busiest
+ * point than the effective size allows, it shrinks by one.<br />
+ * The effective size never goes outside the limits set by
+ * -setMax:min: and each change is logged.  The -purge method closes
+ * idle connections which lie beyond the effective size.<br />
+ * Adaptive sizing starts from the minimum number of connections.
+ */
+- (void) setAdaptiveTarget: (NSTimeInterval)seconds;
+
 /**
  * Sets the cache for all the clients in the pool.
  */
@@ -1884,6 +2466,35 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (void) setDurationLogging: (NSTimeInterval)threshold;
 
+/** Starts (if interval is greater than zero) or stops background health
+ * checking of the pool.<br />
+ * A thread wakes at the specified interval to call -purge, to validate
+ * each connected client which has been idle in the pool for at least
+ * the interval (see [SQLClient-backendIsValid]), disconnecting any which
+ * fail, and then to call -warmUp to restore the minimum number of
+ * connections.  The first check is performed as soon as health checking
+ * is started, so starting it when the pool is created warms the pool
+ * up in the background.<br />
+ * Validated clients count as recently used, so while health checking
+ * is active the minimum number of connections are kept open rather
+ * than being closed after the age set by -setPurgeAll:min:.<br />
+ * NB. The thread retains the pool, so health checking must be stopped
+ * for the pool to be deallocated.
+ */
+- (void) setHealthCheck: (NSTimeInterval)interval;
+
+/** Set the statement timeout for all clients in the pool.
+ * See [SQLClient-setStatementTimeout:]
+ */
+- (void) setStatementTimeout: (NSTimeInterval)seconds;
+
+/** Sets the priority class of the requests for clients made by the
+ * current thread (including those made by the convenience methods of
+ * the pool) for which no priority is specified explicitly.<br />
+ * Threads use SQLClientPriorityNormal unless this is called.
+ */
+- (void) setThreadPriority: (SQLClientPriority)priority;
+
 /** Sets the pool size limits (number of connections we try to maintain).<br />
  * The value of maxConnections is the size of the pool (ie the number of
  * clients created) and thus the maximum number of concurrent connections
@@ -1898,6 +2509,23 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (void) setMax: (int)maxConnections min: (int)minConnections;
 
+/** Sets the admission control for a priority class.<br />
+ * The value of reserve is the number of clients kept for requests in the
+ * class: requests in other classes are not given a client if that would
+ * leave fewer unused clients than are needed to make up the reservations
+ * of the classes using fewer than their reserved number.<br />
+ * The value of percent is the maximum share of the clients in the pool
+ * (as a percentage of -effectiveConnections, but always at least one
+ * client) which requests in the class may be using at any time.<br />
+ * By default no clients are reserved and each class may use the whole
+ * pool, so eg. to stop batch jobs from starving interactive work you
+ * might reserve a couple of clients for SQLClientPriorityHigh and limit
+ * SQLClientPriorityLow to half of the pool.
+ */
+- (void) setReserve: (int)reserve
+	      share: (int)percent
+	forPriority: (SQLClientPriority)priority;
+
 /** Sets the ages (in seconds) after which idle connections are closed in
  * the -purge method. Where there are excess connections (more than the
  * minimum configured connection count) in the pool, minSeconds is used,
@@ -1905,7 +2533,8 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (void) setPurgeAll: (int)allSeconds min: (int)minSeconds;
 
-/** Returns a string describing the usage of the pool.
+/** Returns a string describing the usage of the pool, including the
+ * provisions and waits for each priority class which has been used.
  */
 - (NSString*) statistics;
 
@@ -1920,11 +2549,45 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
  */
 - (BOOL) swallowClient: (SQLClient*)client;
 
+/** Returns the priority class of requests made by the current thread
+ * (see -setThreadPriority:).
+ */
+- (SQLClientPriority) threadPriority;
+
 /** Creates and returns an autoreleased SQLTransaction instance  which will
  * use the receiver as the database connection to perform transactions.
  */
 - (SQLTransaction*) transaction;
 
+/** Connects unused clients in the pool until there are at least the
+ * minimum number of connections (see -setMax:min:), establishing the
+ * connections concurrently using +[SQLClient connectClients:].<br />
+ * Returns the number of new connections made.<br />
+ * The pool normally connects its clients only when they are needed, so
+ * calling this when the pool is created avoids the first requests having
+ * to wait for connections to be established one at a time.
+ */
+- (int) warmUp;
+
+@end
+
+/** This category provides asynchronous operations using the clients in a
+ * pool.  Each operation uses a client from the pool for as long as it
+ * is in progress, and if no client is available the operation is queued
+ * until one is returned to the pool (so the calling thread never waits).
+ * See [SQLClient(Asynchronous)] for details.
+ */
+@interface	SQLClientPool (Asynchronous)
+- (void) execute: (SQLLitArg*)stmt
+      completion: (SQLClientExecuteCompletion)completion;
+- (void) execute: (SQLLitArg*)stmt
+	  thread: (NSThread*)thread
+      completion: (SQLClientExecuteCompletion)completion;
+- (void) query: (SQLLitArg*)stmt
+    completion: (SQLClientQueryCompletion)completion;
+- (void) query: (SQLLitArg*)stmt
+	thread: (NSThread*)thread
+    completion: (SQLClientQueryCompletion)completion;
 @end
 
 /** This category lists the convenience methods provided by a pool instance
@@ -1949,6 +2612,10 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
 - (NSMutableArray*) columns: (NSMutableArray*)records;
 - (NSInteger) execute: (NSString*)stmt,...;
 - (NSInteger) execute: (NSString*)stmt with: (NSDictionary*)values;
+- (NSUInteger) insert: (NSArray*)rows
+		 into: (NSString*)table
+	      columns: (NSArray*)columns
+	     failures: (NSMutableIndexSet*)failures;
 - (SQLClientPool*) pool;
 - (NSMutableArray*) prepare: (NSString*)stmt, ...;
 - (NSMutableArray*) prepare: (NSString*)stmt args: (va_list)args;
@@ -1973,11 +2640,145 @@ typedef struct _SQLClientPoolItem SQLClientPoolItem;
 - (SQLLiteral*) quoteSet: (id)obj;
 - (SQLLiteral*) quoteString: (NSString *)s;
 - (NSInteger) simpleExecute: (NSArray*)info;
+- (NSInteger) simpleExecute: (NSArray*)info timeout: (NSTimeInterval)seconds;
 - (void) singletons: (NSMutableArray*)records;
 - (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt;
 - (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
 		     recordType: (id)rtype
 		       listType: (id)ltype;
+- (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
+			timeout: (NSTimeInterval)seconds;
+@end
+
+/** <p>An SQLClientRouter splits reads and writes between a pool for a
+ * primary database server and pools for its (streaming) replicas.
+ * </p>
+ * <p>Queries sent to the router are performed using the replica with the
+ * fewest requests in progress (or, between equally busy replicas, the one
+ * whose recent queries have been quickest).  If a replica can't be
+ * reached, the query is performed using the primary instead, and the
+ * replica is not used again for a few seconds.<br />
+ * Statements and transactions which may modify the database are always
+ * sent to the primary.
+ * </p>
+ * <p>Since replicas lag behind the primary, a thread which has just
+ * written to the database might not see its own changes when it next
+ * reads from a replica.  To avoid that, set a stickiness window with
+ * -setStickiness: and for that many seconds after each write, queries
+ * from the same thread are performed using the primary.
+ * </p>
+ */
+@interface	SQLClientRouter : NSObject
+{
+  SQLClientPool		*_primary;	/** Pool for the primary server */
+  NSArray		*_replicas;	/** Pools for the replica servers */
+  NSUInteger		*_outstanding;	/** Requests running per replica */
+  NSTimeInterval	*_rtt;		/** Smoothed duration per replica */
+  NSTimeInterval	*_down;		/** Replica unusable until this time */
+  NSTimeInterval	*_backoff;	/** Current backoff per replica */
+  NSLock		*_lock;		/** Protects the counters */
+  NSString		*_stickyKey;	/** Thread dictionary key */
+  NSTimeInterval	_sticky;	/** Read-your-writes window */
+  uint64_t		_reads;		/** Count of queries */
+  uint64_t		_primaryReads;	/** Count of queries on primary */
+  uint64_t		_failovers;	/** Queries moved to primary */
+  uint64_t		_writes;	/** Count of statements executed */
+}
+
+/** Returns a batch transaction for the primary and notes a write
+ * (see -noteWrite).
+ */
+- (SQLTransaction*) batch: (BOOL)stopOnFailure;
+
+/** Performs a cached query (see [SQLClient(Caching)-cache:query:,...])
+ * using a replica (or the primary if the current thread wrote recently).
+ */
+- (NSMutableArray*) cache: (int)seconds query: (NSString*)stmt,...;
+
+/** Performs a cached query (see [SQLClient(Caching)-cache:query:with:])
+ * using a replica (or the primary if the current thread wrote recently).
+ */
+- (NSMutableArray*) cache: (int)seconds
+		    query: (NSString*)stmt
+		     with: (NSDictionary*)values;
+
+/** Executes a statement using the primary.
+ */
+- (NSInteger) execute: (NSString*)stmt,...;
+
+/** Executes a statement using the primary.
+ */
+- (NSInteger) execute: (NSString*)stmt with: (NSDictionary*)values;
+
+/** <init />
+ * Initialises the receiver to route requests between the primary pool
+ * and the array of replica pools (which may be empty).
+ */
+- (id) initWithPrimary: (SQLClientPool*)primary replicas: (NSArray*)replicas;
+
+/** Records that the current thread has written to the primary, so that
+ * its queries go to the primary for the stickiness window.  This is done
+ * automatically for statements executed through the receiver, and when
+ * a transaction or the write pool is obtained from it, but code writing
+ * to the primary by other means should call it explicitly.
+ */
+- (void) noteWrite;
+
+/** Returns the pool for the primary server.
+ */
+- (SQLClientPool*) primary;
+
+/** Performs a query using a replica (or the primary if the current thread
+ * wrote recently).
+ */
+- (NSMutableArray*) query: (NSString*)stmt,...;
+
+/** Performs a query using a replica (or the primary if the current thread
+ * wrote recently).
+ */
+- (NSMutableArray*) query: (NSString*)stmt with: (NSDictionary*)values;
+
+/** Returns the pool which the next query should use ... the least busy
+ * replica, or the primary if the current thread wrote recently.
+ * Use this for query methods the router does not provide itself.
+ */
+- (SQLClientPool*) readPool;
+
+/** Returns the pools for the replica servers.
+ */
+- (NSArray*) replicas;
+
+/** Sets the number of seconds after a write for which queries from the
+ * same thread are sent to the primary.  The default is zero (off).
+ */
+- (void) setStickiness: (NSTimeInterval)seconds;
+
+/** Executes a prepared statement using the primary.
+ */
+- (NSInteger) simpleExecute: (NSArray*)info;
+
+/** Performs a query using a replica (or the primary if the current thread
+ * wrote recently).
+ */
+- (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt;
+
+/** Returns a description of the routing counters and of the state of
+ * each replica.
+ */
+- (NSString*) status;
+
+/** Returns the value set by -setStickiness:
+ */
+- (NSTimeInterval) stickiness;
+
+/** Returns a transaction for the primary and notes a write
+ * (see -noteWrite).
+ */
+- (SQLTransaction*) transaction;
+
+/** Returns the pool for the primary and notes a write (see -noteWrite).
+ */
+- (SQLClientPool*) writePool;
 @end
 
 /**
@@ -2002,6 +2803,8 @@ SQLCLIENT_PRIVATE
   BOOL                  _stop;
   BOOL                  _reset;
   NSRecursiveLock       *_lock;
+  BOOL                  _bisect;
+  NSArray               *_updateCounts;
 }
 
 /**
@@ -2018,6 +2821,22 @@ SQLCLIENT_PRIVATE
  */
 - (void) add: (NSString*)stmt with: (NSDictionary*)values;
 
+/**
+ * Adds statements to insert the rows (arrays of values in the same order
+ * as the columns) into the table.  Rather than one statement per row,
+ * each statement is a multi-row INSERT ... VALUES (...),(...) holding
+ * as many rows as fit within a size budget (around 64KB of SQL text,
+ * or 500 rows, whichever is reached first).<br />
+ * The table and column names are used as given, so they must be quoted
+ * (see [SQLClient-quoteName:]) if necessary.<br />
+ * Returns the number of statements added.<br />
+ * See also [SQLClient(Convenience)-insert:into:columns:failures:] which
+ * isolates the rows which fail to insert.
+ */
+- (NSUInteger) addInsert: (NSArray*)rows
+		    into: (NSString*)table
+		 columns: (NSArray*)columns;
+
 /** Adds a prepared statement.
  */
 - (void) addPrepared: (NSArray*)statement;
@@ -2087,6 +2906,13 @@ SQLCLIENT_PRIVATE
  * subsidiary transactions may succeed or fail atomically depending
  * on their individual attributes.
  * </p>
+ * <p>If the -setBisectOnFailure: method has been used to turn on bisection,
+ * the retries are done within a single transaction, using savepoints to
+ * execute progressively smaller parts of the batch until the failing
+ * statements are found, and the statements which succeeded are then
+ * committed together.  This needs far fewer round trips to the server
+ * than retrying each statement on its own when there are few failures.
+ * </p>
  * <p>If the transaction was not created using [SQLClient(Convenience)-batch:],
  * then calling this method is equivalent to calling the -execute method.
  * </p>
@@ -2138,6 +2964,16 @@ SQLCLIENT_PRIVATE
  */
 - (void) reset;
 
+/** Configures a batch to isolate failing statements by bisection using
+ * savepoints within a single transaction, rather than by retrying each
+ * statement in a separate transaction
+ * (see -executeBatchReturningFailures:logExceptions:).<br />
+ * If the database server does not support savepoints, or the bisection
+ * fails for some other reason, the statements are retried individually.<br />
+ * Returns the previous setting.
+ */
+- (BOOL) setBisectOnFailure: (BOOL)aFlag;
+
 /** Configures the transaction to be reset automatically whenever it is
  * successfully executed.  Normally transaction execution leaves all the
  * statements in the transaction after execution.<br />
@@ -2163,6 +2999,15 @@ SQLCLIENT_PRIVATE
  * which has previously called the -lock method.
  */
 - (void) unlock;
+
+/** Returns the number of rows affected by each statement the last time
+ * the receiver was executed successfully (an array of NSNumber objects
+ * in the order the statements were added), or nil if the backend does
+ * not report them.  A count of -2 means that the statement succeeded
+ * but the number of rows is unknown.<br />
+ * The counts are discarded by -reset.
+ */
+- (NSArray*) updateCounts;
 @end
 
 
@@ -2277,6 +3122,37 @@ extern SQLLiteral * SQLClientMakeLiteral(NSString *aString);
  */
 extern SQLLiteral * SQLClientNewLiteral(const char *bytes, unsigned count);
 
+/** The type of a function used to decode a field value returned by the
+ * database server into an object.<br />
+ * The bytes argument is the (nul terminated) text of the value as
+ * provided by the server, length is the number of bytes excluding the
+ * nul terminator, and type is the server specific type of the field.<br />
+ * The function must return a new object (ownership passes to the caller)
+ * or nil if the value should be represented as [NSNull null].
+ */
+typedef id (*SQLClientDecoder)(const char *bytes, unsigned length,
+  unsigned type);
+
+/** Returns the decoder registered for the specified server type and field
+ * type, or null if there is none.
+ */
+extern SQLClientDecoder SQLClientGetDecoder(NSString *serverType,
+  unsigned type);
+
+/** Registers a function to decode values of the specified field type
+ * for a server type (the ServerType configuration of a client, eg
+ * Postgres, where the field type is the OID of the data type).<br />
+ * Decoders may be registered for types which would otherwise be returned
+ * as strings (eg numeric, uuid, json, inet or user defined enumerations)
+ * in order to produce native objects directly, and override the decoding
+ * of built in types.<br />
+ * Registering a null decoder removes any previous registration.<br />
+ * Decoders should be registered before queries are performed, as a
+ * backend looks up the decoder for each column once per query.
+ */
+extern void SQLClientSetDecoder(NSString *serverType, unsigned type,
+  SQLClientDecoder decoder);
+
 /** Creates and returns an autoreleased proxy to aString, recording the
  * fact that the programmer considers the string to be a valid literal
  * (ie one that doesn't need to be quoted when used as part of an SQL
@@ -2444,5 +3320,173 @@ extern NSString * SQLClientUnProxyLiteral(id aString);
 	       count: (unsigned int)count; 
 @end
 
+/* A helper for building a large array of records from an SQL query
+ * with minimal memory allocation overheads.<br />
+ * You create an instance of this class, and pass it as both the
+ * record and list class arguments of the low level SQLClient query.<br />
+ * The records produced by the query, along with any small string or
+ * numeric values within them (including the elements of array values
+ * other than [SQLPackedArray]), are allocated from large blocks of memory
+ * (an arena) owned by the content array rather than being individually
+ * allocated, and when the content array is deallocated the arena is
+ * returned to the system in one go.<br />
+ * The records in the content array are normal [SQLRecord] instances,
+ * and may safely be retained (and modified) independently of the array
+ * (in which case the arena is kept until they are deallocated), but you
+ * should only use this class for large result sets where the memory is
+ * likely to be released as a whole.<br />
+ * You may use the same instance for more than one query, but a second query
+ * will replace the content array produced by the first.<br />
+ * See [SQLClient-simpleQuery:recordType:listType:] also.<br />
+ * NB. When this class is used, the query will actually return the
+ * builder rather than an [NSMutableArray] of [SQLRecord] objects,
+ * so you must use the -content method to get the records.
+ */
+@interface SQLArenaBuilder : NSObject
+{
+  NSMutableArray	*content;
+  SQLRecordKeys		*keys;
+  NSUInteger		columns;
+  id			*names;
+  id			*last;
+  id			*copies;
+}
+
+/** No need to do anything ... the object will already have been added by
+ * the -newWithValues:keys:count: method.
+ */
+- (void) addObject: (id)anObject;
+
+/** When a container is supposed to be allocated, we just return the
+ * receiver (which will then quietly ignore -addObject: messages).
+ */
+- (id) alloc;
+
+/** Returns the content array for the receiver.
+ */
+- (NSMutableArray*) content;
+
+/** Creates a new content array (and arena) ... this method will be called
+ * automatically by the SQLClient object when it performs a query,
+ * so there is no need to call it at any other time.
+ */
+- (id) initWithCapacity: (NSUInteger)capacity;
+
+/** Makes a mutable copy of the content array (called when a caching
+ * query uses this helper to produce the cached collection).
+ */
+- (id) mutableCopyWithZone: (NSZone*)aZone;
+
+/** Creates a record in the arena and adds it to the content array.<br />
+ * The keys information is built once and shared by all the records
+ * produced by a query, and where consecutive records contain the same
+ * value in a field, the copy of that value in the arena is shared too.
+ */
+- (id) newWithValues: (id*)values
+		keys: (NSString**)keys
+	       count: (unsigned int)count; 
+
+/** Creates a record in the arena using the supplied keys information
+ * and adds it to the content array.
+ */
+- (id) newWithValues: (id*)values keys: (SQLRecordKeys*)keys;
+@end
+
+/** The SQLPackedArray class is used by backends to return numeric array
+ * values (eg a Postgres integer[] or double precision[] column) without
+ * creating an object for every element.<br />
+ * The element values are stored contiguously in an [NSData] object,
+ * as either long long or double values (see -objCType), along with the
+ * dimensions of the array, so that code which needs the numbers can
+ * access them directly using the -bytes method.<br />
+ * For compatibility with code which expects to get an array of objects,
+ * this is an [NSArray] subclass; the -objectAtIndex: method returns a
+ * literal string for each number in a one dimensional array, or a
+ * packed array for each element of the first dimension of a multi
+ * dimensional array.<br />
+ * The Postgres backend only returns packed arrays for clients configured
+ * with the PackedArrays option (see [SQLClient-initWithConfiguration:name:]).
+ */
+@interface SQLPackedArray : NSArray
+{
+  NSData	*data;		// The packed values
+  const char	*type;		// The encoding of each value
+  NSUInteger	offset;		// The index of the first value in data
+  NSUInteger	dimensions;	// The number of dimensions
+  NSUInteger	*sizes;		// The size of each dimension
+  NSUInteger	stride;		// Values per element of first dimension
+}
+
+/** Initialises the receiver with the packed values in d, which must be of
+ * the encoding t (either @encode(long long) or @encode(double)), and with
+ * count dimensions whose sizes are given in s.<br />
+ * The data must contain at least the number of values given by the product
+ * of the sizes of the dimensions.
+ */
+- (id) initWithData: (NSData*)d
+	   objCType: (const char*)t
+	 dimensions: (NSUInteger)count
+	      sizes: (const NSUInteger*)s;
+
+/** Returns a pointer to the first of the packed values in the receiver.
+ */
+- (const void*) bytes;
+
+/** Returns the number of dimensions of the receiver.
+ */
+- (NSUInteger) dimensions;
+
+/** Returns the encoding of the packed values in the receiver.
+ */
+- (const char*) objCType;
+
+/** Returns the size of the specified dimension of the receiver, or zero
+ * if the receiver does not have that many dimensions.
+ */
+- (NSUInteger) sizeOfDimension: (NSUInteger)dimension;
+
+/** Returns the total number of packed values in the receiver.
+ */
+- (NSUInteger) valueCount;
+@end
+
+/** The SQLBoundArray class is used to pass a list of values (eg a large
+ * set of identifiers) to the server as a single parameter of a statement
+ * or query rather than quoting every value into the SQL text.<br />
+ * Pass an instance as one of the arguments of the prepare, query and
+ * execute methods (eg
+ * <code>[db query: @"SELECT * FROM t WHERE id = ANY(", [SQLBoundArray
+ * boundArray: ids], @")", nil]</code>) and it is kept out of line like
+ * an [NSData] object.<br />
+ * The Postgres backend sends it as a single array parameter (in binary
+ * form if all the values are integers), so the statement text is the same
+ * whatever the number of values, and should use <code>= ANY(...)</code>.
+ * Other backends insert the values into the statement as a parenthesised
+ * list (as produced by [SQLClient(Quote)-quoteSet:]) which may be used
+ * with <code>IN</code>.
+ */
+@interface SQLBoundArray : NSObject
+{
+  NSArray	*values;
+}
+
+/** Returns an autoreleased instance containing the objects in the array
+ * or set supplied (which may not contain nested collections).
+ */
++ (SQLBoundArray*) boundArray: (id)arrayOrSet;
+
+/** Returns the number of values in the receiver.
+ */
+- (NSUInteger) count;
+
+/** Initialises the receiver with the objects in the array or set supplied.
+ */
+- (id) initWithValues: (id)arrayOrSet;
+
+/** Returns the values in the receiver.
+ */
+- (NSArray*) values;
+@end
+
 #endif
 
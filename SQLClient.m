@@ -39,6 +39,7 @@
 #import	<Foundation/NSKeyValueCoding.h>
 #import	<Foundation/NSLock.h>
 #import	<Foundation/NSHashTable.h>
+#import	<Foundation/NSIndexSet.h>
 #import	<Foundation/NSMapTable.h>
 #import	<Foundation/NSNotification.h>
 #import	<Foundation/NSNull.h>
@@ -50,16 +51,25 @@
 #import	<Foundation/NSString.h>
 #import	<Foundation/NSThread.h>
 #import	<Foundation/NSTimer.h>
+#import	<Foundation/NSTimeZone.h>
 #import	<Foundation/NSUserDefaults.h>
 #import	<Foundation/NSValue.h>
 
 #import	<Performance/GSCache.h>
 #import	<Performance/GSTicker.h>
+#if	defined(GNUSTEP_BASE_LIBRARY)
+#import	<GNUstepBase/Unicode.h>
+#endif
 
 #define SQLCLIENT_PRIVATE                       @public
 #define SQLCLIENT_COMPILE_TIME_QUOTE_CHECK      1
 
+#include	<ctype.h>
+#include	<errno.h>
 #include	<memory.h>
+#include	<poll.h>
+#include	<stdlib.h>
+#include	<string.h>
 
 #include	"SQLClient.h"
 
@@ -77,6 +87,7 @@ NSString * const SQLClientDidDisconnectNotification
 
 static unsigned int	classDebugging = 0;
 static NSTimeInterval	classDuration = -1;
+static NSUInteger	classHistory = 100;
 
 static NSNull	*null = nil;
 static NSArray	*queryModes = nil;
@@ -269,6 +280,388 @@ SQLClientNewLiteral(const char *bytes, unsigned count)
   return s;
 }
 
+/* Decoders registered by the application, stored in a map table (of
+ * type to function) for each server type.
+ */
+static NSMutableDictionary	*decoders = nil;
+static NSLock			*decodersLock = nil;
+
+SQLClientDecoder
+SQLClientGetDecoder(NSString *serverType, unsigned type)
+{
+  SQLClientDecoder	d = 0;
+
+  if (nil == decodersLock)
+    {
+      [SQLClient class];	// Force initialisation
+    }
+  [decodersLock lock];
+  if (nil != decoders)
+    {
+      NSMapTable	*t = [decoders objectForKey: serverType];
+
+      if (0 != t)
+	{
+	  d = (SQLClientDecoder)NSMapGet(t, (void*)(uintptr_t)type);
+	}
+    }
+  [decodersLock unlock];
+  return d;
+}
+
+void
+SQLClientSetDecoder(NSString *serverType, unsigned type,
+  SQLClientDecoder decoder)
+{
+  NSMapTable	*t;
+
+  if (nil == serverType)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Decoder set with nil server type"];
+    }
+  if (nil == decodersLock)
+    {
+      [SQLClient class];	// Force initialisation
+    }
+  [decodersLock lock];
+  if (nil == decoders)
+    {
+      decoders = [NSMutableDictionary new];
+    }
+  t = [decoders objectForKey: serverType];
+  if (0 == t)
+    {
+      t = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+	NSNonOwnedPointerMapValueCallBacks, 0);
+      [decoders setObject: t forKey: serverType];
+      [t release];
+    }
+  if (0 == decoder)
+    {
+      NSMapRemove(t, (void*)(uintptr_t)type);
+    }
+  else
+    {
+      NSMapInsert(t, (void*)(uintptr_t)type, (void*)decoder);
+    }
+  [decodersLock unlock];
+}
+
+/* Cache of time zones by offset from GMT, in quarter hours (which covers
+ * all offsets in current use), populated on demand.
+ */
+#define	ZONE_QUARTERS	(14 * 4)
+static NSTimeZone	*zonesByOffset[ZONE_QUARTERS * 2 + 1];
+static NSLock		*zonesLock = nil;
+
+static NSTimeZone *
+zoneForOffset(int seconds)
+{
+  NSTimeZone	*z;
+  int		q;
+
+  if (seconds % 900 != 0 || seconds / 900 < -ZONE_QUARTERS
+    || seconds / 900 > ZONE_QUARTERS)
+    {
+      return [NSTimeZone timeZoneForSecondsFromGMT: seconds];
+    }
+  q = ZONE_QUARTERS + seconds / 900;
+  if (nil == (z = zonesByOffset[q]))
+    {
+      if (nil == zonesLock)
+	{
+	  [SQLClient class];	// Force initialisation
+	}
+      [zonesLock lock];
+      if (nil == (z = zonesByOffset[q]))
+	{
+	  z = [[NSTimeZone timeZoneForSecondsFromGMT: seconds] retain];
+	  zonesByOffset[q] = z;
+	}
+      [zonesLock unlock];
+    }
+  return z;
+}
+
+/* Returns the number of days from 1970-01-01 to the specified date in
+ * the proleptic Gregorian calendar.
+ */
+static inline int64_t
+daysFromCivil(int year, int month, int day)
+{
+  int64_t	era;
+  int		yoe;
+  int		doy;
+  int		doe;
+
+  year -= (month <= 2) ? 1 : 0;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = (int)(year - era * 400);
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static inline BOOL
+digits(const char *b, unsigned *i, unsigned l, unsigned count, int *result)
+{
+  int	v = 0;
+
+  while (count-- > 0)
+    {
+      if (*i >= l || !isdigit(b[*i]))
+	{
+	  return NO;
+	}
+      v = v * 10 + b[(*i)++] - '0';
+    }
+  *result = v;
+  return YES;
+}
+
+/* Returns the offset from GMT of zone at the time t (seconds since the
+ * reference date).
+ */
+static int
+offsetAt(NSTimeZone *zone, NSTimeInterval t)
+{
+  NSDate	*when;
+  int		o;
+
+  when = [[NSDate alloc] initWithTimeIntervalSinceReferenceDate: t];
+  o = [zone secondsFromGMTForDate: when];
+  [when release];
+  return o;
+}
+
+NSDate *
+SQLClientNewDateFromBuffer(const char *b, unsigned l, NSTimeZone *zone)
+{
+  NSCalendarDate	*d;
+  NSTimeInterval	fraction = 0.0;
+  NSTimeInterval	t;
+  BOOL			hasOffset = NO;
+  int			offset = 0;
+  int			year;
+  int			month;
+  int			day;
+  int			hour = 0;
+  int			minute = 0;
+  int			second = 0;
+  unsigned		i = 0;
+
+  if (NO == digits(b, &i, l, 4, &year)) return nil;
+  if (i >= l || b[i++] != '-') return nil;
+  if (NO == digits(b, &i, l, 2, &month)) return nil;
+  if (month < 1 || month > 12) return nil;
+  if (i >= l || b[i++] != '-') return nil;
+  if (NO == digits(b, &i, l, 2, &day)) return nil;
+  if (day < 1 || day > 31) return nil;
+
+  if (i < l)
+    {
+      if (b[i] != ' ' && b[i] != 'T') return nil;
+      i++;
+      if (NO == digits(b, &i, l, 2, &hour)) return nil;
+      if (hour < 0 || hour > 23) return nil;
+      if (i >= l || b[i++] != ':') return nil;
+      if (NO == digits(b, &i, l, 2, &minute)) return nil;
+      if (minute < 0 || minute > 59) return nil;
+      if (i >= l || b[i++] != ':') return nil;
+      if (NO == digits(b, &i, l, 2, &second)) return nil;
+      if (second < 0 || second > 60) return nil;
+
+      if (i < l && '.' == b[i])
+	{
+	  NSTimeInterval	scale = 0.1;
+
+	  i++;
+	  if (i >= l || !isdigit(b[i])) return nil;
+	  while (i < l && isdigit(b[i]))
+	    {
+	      fraction += (b[i++] - '0') * scale;
+	      scale /= 10.0;
+	    }
+	}
+
+      if (i < l && ' ' == b[i])
+	{
+	  i++;
+	}
+      if (i < l && ('+' == b[i] || '-' == b[i]))
+	{
+	  char	sign = b[i++];
+	  int	tzhour;
+	  int	tzmin = 0;
+
+	  if (NO == digits(b, &i, l, 2, &tzhour)) return nil;
+	  if (tzhour < 0 || tzhour > 23) return nil;
+	  if (i < l && ':' == b[i])
+	    {
+	      i++;
+	    }
+	  if (i < l && isdigit(b[i]))
+	    {
+	      if (NO == digits(b, &i, l, 2, &tzmin)) return nil;
+	      if (tzmin < 0 || tzmin > 59) return nil;
+	    }
+	  offset = (tzhour * 60 + tzmin) * 60;
+	  if (i + 2 < l && ':' == b[i] && isdigit(b[i + 1]))
+	    {
+	      int	tzsec;
+
+	      /* Historic local mean times may have offsets in seconds.
+	       */
+	      i++;
+	      if (NO == digits(b, &i, l, 2, &tzsec)) return nil;
+	      offset += tzsec;
+	    }
+	  if ('-' == sign)
+	    {
+	      offset = -offset;
+	    }
+	  hasOffset = YES;
+	}
+      else if (i < l && 'Z' == b[i])
+	{
+	  i++;
+	  hasOffset = YES;
+	}
+    }
+
+  if (YES == hasOffset)
+    {
+      zone = zoneForOffset(offset);
+    }
+  else if (nil == zone)
+    {
+      zone = [NSTimeZone localTimeZone];
+    }
+
+  if (year <= 1)
+    {
+      static NSTimeInterval     p = 0.0;
+
+      if (0.0 == p)
+        {
+          p = [[NSDate distantPast] timeIntervalSinceReferenceDate];
+        }
+      t = p;
+    }
+  else if (year > 4000)
+    {
+      static NSTimeInterval     f = 0.0;
+
+      if (0.0 == f)
+        {
+          f = [[NSDate distantFuture] timeIntervalSinceReferenceDate];
+        }
+      t = f;
+    }
+  else
+    {
+      /* Calculate the time as if it were GMT, then adjust for the offset
+       * of the time zone.
+       */
+      t = (NSTimeInterval)(daysFromCivil(year, month, day) * 86400
+	+ hour * 3600 + minute * 60 + second) - NSTimeIntervalSince1970
+	+ fraction;
+      if (YES == hasOffset)
+	{
+	  t -= offset;
+	}
+      else
+	{
+	  int	o;
+
+	  /* The offset of a time zone may vary (daylight savings time)
+	   * so we need to check it at the adjusted time.
+	   */
+	  o = offsetAt(zone, t);
+	  if (0 != o)
+	    {
+	      o = offsetAt(zone, t - o);
+	    }
+	  t -= o;
+	}
+    }
+  d = [[NSCalendarDate alloc] initWithTimeIntervalSinceReferenceDate: t];
+  [d setTimeZone: zone];
+  [d setCalendarFormat: @"%Y-%m-%d %H:%M:%S %z"];
+  return d;
+}
+
+/* Makes a copy of a literal string in the specified zone (used to place
+ * small values in the memory arena of a result set).
+ */
+static SQLString *
+newLiteralInZone(SQLString *o, NSZone *z)
+{
+  SQLString     *s;
+  uint8_t       *p;
+
+  s = NSAllocateObject(SQLStringClass, o->byteLen+1, z);
+  s->utf8Bytes = p = ((uint8_t*)(void*)s) + SQLStringSize;
+  s->byteLen = o->byteLen;
+  memcpy(p, o->utf8Bytes, o->byteLen);
+  p[o->byteLen] = '\0';
+  s->charLen = o->charLen;
+  s->ascii = o->ascii;
+  s->latin1 = o->latin1;
+  return s;
+}
+
+/* Returns a new copy of v in the memory arena z if it is a small string,
+ * or an array (such as a Postgres text array) whose elements are copied
+ * into the arena in the same way.  Other values are simply retained.
+ */
+static id
+newValueInZone(id v, NSZone *z)
+{
+  if (object_getClass(v) == SQLStringClass)
+    {
+      if (((SQLString*)v)->byteLen <= 64)
+	{
+	  return newLiteralInZone((SQLString*)v, z);
+	}
+    }
+  else if (YES == [v isKindOfClass: NSStringClass])
+    {
+      if (NO == SQLClientIsLiteral(v) && [v length] <= 64)
+	{
+	  return [v copyWithZone: z];
+	}
+    }
+  else if (YES == [v isKindOfClass: NSArrayClass]
+    && NO == [v isKindOfClass: [SQLPackedArray class]])
+    {
+      NSUInteger	c = [(NSArray*)v count];
+      NSUInteger	i;
+      id		*objs;
+      id		a;
+
+      if (0 == c)
+	{
+	  return [[NSMutableArray allocWithZone: z] init];
+	}
+      objs = (id*)NSZoneMalloc(NSDefaultMallocZone(), c * sizeof(id));
+      [(NSArray*)v getObjects: objs];
+      for (i = 0; i < c; i++)
+	{
+	  objs[i] = newValueInZone(objs[i], z);
+	}
+      a = [[NSMutableArray allocWithZone: z] initWithObjects: objs count: c];
+      for (i = 0; i < c; i++)
+	{
+	  [objs[i] release];
+	}
+      NSZoneFree(NSDefaultMallocZone(), objs);
+      return a;
+    }
+  return [v retain];
+}
+
 SQLLiteral *
 SQLClientCopyLiteral(NSString *aString)
 {
@@ -417,6 +810,7 @@ quoteBigInteger(int64_t i)
 }
 
 @interface      SQLClientPool (Swallow)
+- (void) _countTimeout;
 - (BOOL) _swallowClient: (SQLClient*)client explicit: (BOOL)swallowed;
 @end
 @interface      SQLTransaction (Creation)
@@ -479,118 +873,613 @@ quoteBigInteger(int64_t i)
 }
 @end
 
-@implementation SQLRecordKeys
+/* Keys information is interned so that the records produced by repeated
+ * queries returning the same columns share a single SQLRecordKeys object
+ * rather than each query building its own.
+ * The intern table is keyed by a signature consisting of the UTF-8 column
+ * names, each terminated by a nul, and lookups build the signature on the
+ * stack so that finding existing keys does not allocate memory.
+ */
+typedef struct {
+  NSUInteger	hash;
+  NSUInteger	length;
+  const char	*bytes;
+} KeysSignature;
+
+/* Limit the size of the intern table so that applications generating
+ * arbitrary column names can't cause it to grow without bound.
+ */
+#define	MAX_INTERNED_KEYS	4096
 
-- (NSUInteger) count
-{
-  return count;
-}
+static NSMapTable	*keysTable = 0;
+static NSLock		*keysLock = nil;
 
-- (void) dealloc
+static NSUInteger
+sigHash(NSMapTable *t, const void *k)
 {
-  if (nil != order) [order release];
-  if (nil != map) [map release];
-  if (nil != low) [low release];
-  [super dealloc];
+  return ((KeysSignature*)k)->hash;
 }
 
-- (NSUInteger) indexForKey: (NSString*)key
+static BOOL
+sigEqual(NSMapTable *t, const void *k1, const void *k2)
 {
-  NSUInteger    c;
+  KeysSignature	*s1 = (KeysSignature*)k1;
+  KeysSignature	*s2 = (KeysSignature*)k2;
 
-  c = (NSUInteger)NSMapGet(map, key);
-  if (c > 0)
+  if (s1->hash == s2->hash && s1->length == s2->length
+    && memcmp(s1->bytes, s2->bytes, s1->length) == 0)
     {
-      return c - 1;
-    }
-  key = [key lowercaseString];
-  c = (NSUInteger)NSMapGet(low, key);
-  if (c > 0)
-    {
-      if (classDebugging > 0)
-        {
-          NSLog(@"[SQLRecordKeys-indexForKey:] lowercase '%@'", key);
-        }
-      return c - 1;
+      return YES;
     }
-  return NSNotFound;
+  return NO;
 }
 
-- (id) initWithKeys: (NSString**)keys count: (NSUInteger)c
+static void
+sigRelease(NSMapTable *t, void *k)
 {
-  if (nil != (self = [super init]))
-    {
-      count = c;
-      order = [[NSArray alloc] initWithObjects: keys count: c];
-      map = NSCreateMapTable(NSObjectMapKeyCallBacks,
-        NSIntegerMapValueCallBacks, count);
-      low = NSCreateMapTable(NSObjectMapKeyCallBacks,
-        NSIntegerMapValueCallBacks, count);
-      for (c = 1; c <= count; c++)
-        {
-          NSString      *k = keys[c-1];
-
-          NSMapInsert(map, (void*)k, (void*)c);
-          k = [k lowercaseString];
-          NSMapInsert(low, (void*)k, (void*)c);
-        }
-    }
-  return self;
+  NSZoneFree(NSDefaultMallocZone(), k);
 }
 
-- (NSArray*) order
+static const NSMapTableKeyCallBacks sigCallBacks = {
+  sigHash,
+  sigEqual,
+  0,
+  sigRelease,
+  0,
+  NSNotAPointerMapKey
+};
+
+/* Returns an interned keys object (retained) for the names supplied as
+ * UTF-8 strings.  If strings is not null, it contains the names as string
+ * objects to be used if a new keys object needs to be created.
+ */
+static SQLRecordKeys *
+newInternedKeys(const char **utf8, NSString **strings, NSUInteger count)
+{
+  NSUInteger	lengths[count];
+  NSUInteger	length = 0;
+  NSUInteger	hash = 2166136261U;
+  NSUInteger	i;
+
+  for (i = 0; i < count; i++)
+    {
+      lengths[i] = strlen(utf8[i]) + 1;
+      length += lengths[i];
+    }
+  {
+    char		bytes[length];
+    char		*ptr = bytes;
+    KeysSignature	sig;
+    SQLRecordKeys	*k;
+
+    for (i = 0; i < count; i++)
+      {
+	memcpy(ptr, utf8[i], lengths[i]);
+	ptr += lengths[i];
+      }
+    for (i = 0; i < length; i++)
+      {
+	hash = (hash ^ (uint8_t)bytes[i]) * 16777619U;
+      }
+    sig.hash = hash;
+    sig.length = length;
+    sig.bytes = bytes;
+
+    [keysLock lock];
+    k = [(SQLRecordKeys*)NSMapGet(keysTable, &sig) retain];
+    [keysLock unlock];
+    if (nil == k)
+      {
+	if (0 == strings)
+	  {
+	    NSString	*names[count];
+
+	    for (i = 0; i < count; i++)
+	      {
+		names[i] = [[NSString alloc] initWithUTF8String: utf8[i]];
+	      }
+	    k = [[SQLRecordKeys alloc] initWithKeys: names count: count];
+	    for (i = 0; i < count; i++)
+	      {
+		[names[i] release];
+	      }
+	  }
+	else
+	  {
+	    k = [[SQLRecordKeys alloc] initWithKeys: strings count: count];
+	  }
+	[keysLock lock];
+	if (NSCountMapTable(keysTable) < MAX_INTERNED_KEYS)
+	  {
+	    SQLRecordKeys	*o = (SQLRecordKeys*)NSMapGet(keysTable, &sig);
+
+	    if (nil == o)
+	      {
+		KeysSignature	*s;
+
+		/* Copy the signature (and its bytes) to the heap for
+		 * use as the table key.
+		 */
+		s = (KeysSignature*)NSZoneMalloc(NSDefaultMallocZone(),
+		  sizeof(KeysSignature) + length);
+		s->hash = hash;
+		s->length = length;
+		s->bytes = ((char*)s) + sizeof(KeysSignature);
+		memcpy((char*)s->bytes, bytes, length);
+		NSMapInsert(keysTable, s, k);
+	      }
+	    else
+	      {
+		/* Another thread interned the same keys while we were
+		 * building ours.
+		 */
+		[o retain];
+		[k release];
+		k = o;
+	      }
+	  }
+	[keysLock unlock];
+      }
+    return k;
+  }
+}
+
+/* The case insensitive lookup index of an SQLRecordKeys instance.
+ * Everything is allocated in a single block of memory, with the keys
+ * stored as arrays of folded (lowercase) characters along with the hash
+ * of those characters.  Lookups fold the key into a buffer on the stack
+ * so that finding a key never allocates memory.
+ * Narrow records (the common case) are searched linearly, while wider
+ * records use an open addressing hash table of indexes.
+ */
+#define	KEY_INDEX_LINEAR	8
+
+typedef struct {
+  NSUInteger	size;		// Total size of index in bytes
+  NSUInteger	mask;		// Hash table size - 1 (zero if linear)
+  NSUInteger	maxLength;	// Length of longest key
+  BOOL		ambiguous;	// Set if keys differ only in case
+  id		*keys;		// The original keys
+  NSUInteger	*hashes;	// Hash of each folded key
+  NSUInteger	*lengths;	// Length of each folded key
+  unichar	**chars;	// Characters of each folded key
+  NSUInteger	*slots;		// Hash table (index + 1, or zero if empty)
+} KeyIndex;
+
+/* Returns the lowercase form of a non-ASCII character using the Unicode
+ * case mapping (as -lowercaseString does) rather than the C library,
+ * whose mapping depends on the locale of the process.  A character whose
+ * lowercase form is not a single character is left unchanged.
+ */
+#if	defined(GNUSTEP_BASE_LIBRARY)
+static inline unichar
+foldChar(unichar u)
 {
-  return order;
+  return uni_tolower(u);
 }
+#else
+/* Without the GNUstep Unicode tables we build our own, a block of 256
+ * characters at a time as they are first needed, so that only the first
+ * use of each block has to create strings.
+ */
+static unichar	*foldBlocks[256];
 
-- (NSUInteger) sizeInBytesExcluding: (NSHashTable*)exclude
+static unichar
+foldChar(unichar u)
 {
-  NSUInteger    size = [super sizeInBytesExcluding: exclude];
+  unichar	*block;
 
-  if (size > 0)
+  block = __atomic_load_n(&foldBlocks[u >> 8], __ATOMIC_ACQUIRE);
+  if (0 == block)
     {
-      if (0 == bytes)
-        {
-          bytes = size;
-          bytes += [order sizeInBytesExcluding: exclude];
-          bytes += [map sizeInBytesExcluding: exclude];
-          bytes += [low sizeInBytesExcluding: exclude];
-        }
-      size = bytes;
-    }
-  return size;
-}
-
-@end
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      unichar		*b;
+      unsigned		i;
 
+      b = (unichar*)NSZoneMalloc(NSDefaultMallocZone(), 256 * sizeof(unichar));
+      for (i = 0; i < 256; i++)
+	{
+	  unichar	c = (unichar)((u & 0xff00) | i);
+	  NSString	*s = [[NSString alloc] initWithCharacters: &c length: 1];
+	  NSString	*l = [s lowercaseString];
 
-@interface	_ConcreteSQLRecord : SQLRecord
-{
-  SQLRecordKeys *keys;
-  NSUInteger	count;  // Must be last
+	  b[i] = ([l length] == 1) ? [l characterAtIndex: 0] : c;
+	  [s release];
+	}
+      [arp release];
+      if (YES == __atomic_compare_exchange_n(&foldBlocks[u >> 8], &block, b,
+	NO, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+	  block = b;
+	}
+      else
+	{
+	  NSZoneFree(NSDefaultMallocZone(), b);	// Built by another thread
+	}
+    }
+  return block[u & 0xff];
 }
-@end
+#endif
 
-@interface	CacheQuery : NSObject
+/* Convert characters to lowercase in place and return their hash.
+ */
+static inline NSUInteger
+foldKey(unichar *buf, NSUInteger length)
 {
-@public
-  SQLLiteral	*query;
-  id		recordType;
-  id		listType;
-  unsigned	lifetime;
+  NSUInteger	hash = 2166136261U;
+  NSUInteger	i;
+
+  for (i = 0; i < length; i++)
+    {
+      unichar	u = buf[i];
+
+      if (u < 128)
+	{
+	  if (u >= 'A' && u <= 'Z')
+	    {
+	      u += 'a' - 'A';
+	    }
+	}
+      else
+	{
+	  u = foldChar(u);
+	}
+      buf[i] = u;
+      hash = (hash ^ u) * 16777619U;
+    }
+  return hash;
 }
-@end
 
-@implementation	CacheQuery
-- (void) dealloc
+static KeyIndex *
+newKeyIndex(NSString **keys, NSUInteger count)
 {
-  [query release];
-  [super dealloc];
-}
-@end
+  KeyIndex	*ki;
+  NSUInteger	lengths[count];
+  NSUInteger	total = 0;
+  NSUInteger	slots = 0;
+  NSUInteger	size;
+  unichar	*ptr;
+  NSUInteger	i;
 
-static Class aClass = 0;
-static Class rClass = 0;
+  for (i = 0; i < count; i++)
+    {
+      lengths[i] = [keys[i] length];
+      total += lengths[i];
+    }
+  if (count > KEY_INDEX_LINEAR)
+    {
+      slots = 16;
+      while (slots < count * 2)
+	{
+	  slots *= 2;
+	}
+    }
+  size = sizeof(KeyIndex) + count * (sizeof(id) + 2 * sizeof(NSUInteger)
+    + sizeof(unichar*)) + slots * sizeof(NSUInteger)
+    + total * sizeof(unichar);
+  ki = (KeyIndex*)NSZoneCalloc(NSDefaultMallocZone(), 1, size);
+  ki->size = size;
+  ki->mask = (slots > 0) ? slots - 1 : 0;
+  ki->keys = (id*)&ki[1];
+  ki->hashes = (NSUInteger*)&ki->keys[count];
+  ki->lengths = &ki->hashes[count];
+  ki->chars = (unichar**)&ki->lengths[count];
+  ki->slots = (NSUInteger*)&ki->chars[count];
+  ptr = (unichar*)&ki->slots[slots];
+  for (i = 0; i < count; i++)
+    {
+      NSUInteger	length = lengths[i];
+      NSUInteger	j;
+
+      ki->keys[i] = keys[i];
+      ki->lengths[i] = length;
+      ki->chars[i] = ptr;
+      [keys[i] getCharacters: ptr range: NSMakeRange(0, length)];
+      ki->hashes[i] = foldKey(ptr, length);
+      ptr += length;
+      if (length > ki->maxLength)
+	{
+	  ki->maxLength = length;
+	}
+      for (j = 0; j < i; j++)
+	{
+	  if (ki->hashes[j] == ki->hashes[i] && ki->lengths[j] == length
+	    && memcmp(ki->chars[j], ki->chars[i], length * sizeof(unichar)) == 0)
+	    {
+	      ki->ambiguous = YES;
+	    }
+	}
+      if (slots > 0)
+	{
+	  NSUInteger	s = ki->hashes[i] & ki->mask;
+
+	  /* If keys differ only in case, the first one is found by a
+	   * case insensitive lookup, so we don't add the others.
+	   */
+	  while (ki->slots[s] > 0)
+	    {
+	      j = ki->slots[s] - 1;
+	      if (ki->hashes[j] == ki->hashes[i] && ki->lengths[j] == length
+		&& memcmp(ki->chars[j], ki->chars[i],
+		  length * sizeof(unichar)) == 0)
+		{
+		  break;
+		}
+	      s = (s + 1) & ki->mask;
+	    }
+	  if (0 == ki->slots[s])
+	    {
+	      ki->slots[s] = i + 1;
+	    }
+	}
+    }
+  return ki;
+}
+
+@implementation SQLRecordKeys
+
++ (void) initialize
+{
+  if (nil == keysLock)
+    {
+      keysLock = [NSLock new];
+      keysTable = NSCreateMapTable(sigCallBacks,
+	NSObjectMapValueCallBacks, 64);
+    }
+}
+
++ (SQLRecordKeys*) keysWithNames: (NSString**)names count: (NSUInteger)c
+{
+  const char	*utf8[c];
+  NSUInteger	i;
+
+  for (i = 0; i < c; i++)
+    {
+      utf8[i] = [names[i] UTF8String];
+    }
+  return [newInternedKeys(utf8, names, c) autorelease];
+}
+
++ (SQLRecordKeys*) keysWithUTF8Names: (const char**)names count: (NSUInteger)c
+{
+  return [newInternedKeys(names, 0, c) autorelease];
+}
+
+- (NSUInteger) count
+{
+  return count;
+}
+
+- (void) dealloc
+{
+  if (nil != order) [order release];
+  if (0 != index) NSZoneFree(NSDefaultMallocZone(), index);
+  [super dealloc];
+}
+
+- (NSUInteger) indexForKey: (NSString*)key
+{
+  KeyIndex	*ki = (KeyIndex*)index;
+  NSUInteger	length;
+  NSUInteger	pos;
+
+  /* Keys are very often the very same string objects used to build
+   * the record, so a pointer comparison is the cheapest check.
+   */
+  if (count <= KEY_INDEX_LINEAR)
+    {
+      for (pos = 0; pos < count; pos++)
+	{
+	  if (ki->keys[pos] == key)
+	    {
+	      return pos;
+	    }
+	}
+    }
+  length = [key length];
+  if (nil == key || length > ki->maxLength)
+    {
+      return NSNotFound;
+    }
+  if (YES == ki->ambiguous)
+    {
+      /* Some keys differ only in case, so an exact match must take
+       * precedence over a case insensitive one.
+       */
+      for (pos = 0; pos < count; pos++)
+	{
+	  if ([key isEqualToString: ki->keys[pos]])
+	    {
+	      return pos;
+	    }
+	}
+    }
+  {
+    unichar	buf[length > 0 ? length : 1];
+    NSUInteger	hash;
+    NSUInteger	i;
+
+    [key getCharacters: buf range: NSMakeRange(0, length)];
+    hash = foldKey(buf, length);
+    if (0 == ki->mask)
+      {
+	for (pos = 0; pos < count; pos++)
+	  {
+	    if (ki->hashes[pos] == hash && ki->lengths[pos] == length
+	      && memcmp(ki->chars[pos], buf, length * sizeof(unichar)) == 0)
+	      {
+		break;
+	      }
+	  }
+      }
+    else
+      {
+	pos = NSNotFound;
+	i = hash & ki->mask;
+	while (ki->slots[i] > 0)
+	  {
+	    NSUInteger	p = ki->slots[i] - 1;
+
+	    if (ki->hashes[p] == hash && ki->lengths[p] == length
+	      && memcmp(ki->chars[p], buf, length * sizeof(unichar)) == 0)
+	      {
+		pos = p;
+		break;
+	      }
+	    i = (i + 1) & ki->mask;
+	  }
+      }
+    if (pos < count)
+      {
+	if (classDebugging > 0 && NO == [key isEqualToString: ki->keys[pos]])
+	  {
+	    NSLog(@"[SQLRecordKeys-indexForKey:] lowercase '%@'", key);
+	  }
+	return pos;
+      }
+  }
+  return NSNotFound;
+}
+
+- (id) initWithKeys: (NSString**)keys count: (NSUInteger)c
+{
+  if (nil != (self = [super init]))
+    {
+      count = c;
+      order = [[NSArray alloc] initWithObjects: keys count: c];
+      index = newKeyIndex(keys, c);
+    }
+  return self;
+}
+
+- (NSArray*) order
+{
+  return order;
+}
+
+- (NSUInteger) sizeInBytesExcluding: (NSHashTable*)exclude
+{
+  NSUInteger    size = [super sizeInBytesExcluding: exclude];
+
+  if (size > 0)
+    {
+      if (0 == bytes)
+        {
+          bytes = size;
+          bytes += [order sizeInBytesExcluding: exclude];
+          bytes += ((KeyIndex*)index)->size;
+        }
+      size = bytes;
+    }
+  return size;
+}
+
+@end
+
+
+@interface	_ConcreteSQLRecord : SQLRecord
+{
+  SQLRecordKeys *keys;
+  NSUInteger	count;  // Must be last
+}
++ (id) newWithValues: (id*)v keys: (SQLRecordKeys*)k zone: (NSZone*)z;
+@end
+
+@interface	CacheQuery : NSObject
+{
+@public
+  id		query;		// Statement or SQLCacheKey
+  id		recordType;
+  id		listType;
+  unsigned	lifetime;
+}
+@end
+
+@implementation	CacheQuery
+- (void) dealloc
+{
+  [query release];
+  [super dealloc];
+}
+@end
+
+/* A query with out-of-line arguments is an array, but GNUstep uses the
+ * count of an array as its hash, so all such queries would collide in
+ * the query cache.  We therefore wrap them in one of these to be used
+ * as the cache key, with a hash of the array contents.
+ */
+@interface	SQLCacheKey : NSObject <NSCopying>
+{
+@public
+  NSArray	*info;
+  NSUInteger	hash;
+}
+- (id) initWithInfo: (NSArray*)a;
+@end
+
+@implementation	SQLCacheKey
+- (id) copyWithZone: (NSZone*)z
+{
+  return [self retain];
+}
+
+- (void) dealloc
+{
+  [info release];
+  [super dealloc];
+}
+
+- (NSUInteger) hash
+{
+  return hash;
+}
+
+- (id) initWithInfo: (NSArray*)a
+{
+  if (nil != (self = [super init]))
+    {
+      NSUInteger	count = [a count];
+      NSUInteger	index;
+
+      info = [a copy];
+      hash = 2166136261U;
+      for (index = 0; index < count; index++)
+	{
+	  hash = (hash ^ [[info objectAtIndex: index] hash]) * 16777619U;
+	}
+    }
+  return self;
+}
+
+- (BOOL) isEqual: (id)other
+{
+  if (other == self)
+    {
+      return YES;
+    }
+  if (NO == [other isKindOfClass: [SQLCacheKey class]]
+    || ((SQLCacheKey*)other)->hash != hash)
+    {
+      return NO;
+    }
+  return [info isEqual: ((SQLCacheKey*)other)->info];
+}
+@end
+
+/* Returns the key used to cache the result of a query.
+ */
+static inline id
+cacheKey(id query)
+{
+  if ([query isKindOfClass: NSArrayClass])
+    {
+      return [[[SQLCacheKey alloc] initWithInfo: query] autorelease];
+    }
+  return query;
+}
+
+static Class aClass = 0;
+static Class rClass = 0;
 
 @implementation	SQLRecord
 + (id) allocWithZone: (NSZone*)aZone
@@ -854,14 +1743,18 @@ static Class rClass = 0;
 @implementation	_ConcreteSQLRecord
 
 + (id) newWithValues: (id*)v keys: (SQLRecordKeys*)k
+{
+  return [self newWithValues: v keys: k zone: NSDefaultMallocZone()];
+}
+
++ (id) newWithValues: (id*)v keys: (SQLRecordKeys*)k zone: (NSZone*)z
 {
   id		        *ptr;
   _ConcreteSQLRecord	*r;
   NSUInteger	        c;
 
   c = [k count];
-  r = (_ConcreteSQLRecord*)NSAllocateObject(self,
-    c*sizeof(id), NSDefaultMallocZone());
+  r = (_ConcreteSQLRecord*)NSAllocateObject(self, c*sizeof(id), z);
   r->count = c;
   r->keys = [k retain];
   ptr = (id*)(((void*)&(r->count)) + sizeof(r->count));
@@ -882,12 +1775,9 @@ static Class rClass = 0;
 + (id) newWithValues: (id*)v keys: (NSString**)k count: (unsigned int)c
 {
   SQLRecordKeys         *o;
-  _ConcreteSQLRecord	*r;
 
-  o = [[SQLRecordKeys alloc] initWithKeys: k count: c];
-  r = [self newWithValues: v keys: o];
-  [o release];
-  return r;
+  o = [SQLRecordKeys keysWithNames: k count: c];
+  return [self newWithValues: v keys: o];
 }
 
 - (NSArray*) allKeys
@@ -1114,32 +2004,436 @@ NSString	*SQLEmptyException = @"SQLEmptyException";
  * field or index.
  */
 NSString	*SQLUniqueException = @"SQLUniqueException";
+/**
+ * Exception for when a statement was cancelled because it ran for longer
+ * than the timeout set for it.
+ */
+NSString	*SQLTimeoutException = @"SQLTimeoutException";
 
-@implementation	SQLClient (Logging)
+/* Returns a 64-bit (FNV-1a) hash of the text of an SQL statement, with
+ * the values of string and numeric literals left out, letters folded to
+ * lower case and each run of white space treated as a single space, so
+ * that statements differing only in the values they use have the same
+ * fingerprint.
+ */
+static uint64_t
+fingerprint(NSString *stmt)
+{
+  uint64_t	h = 0xcbf29ce484222325ULL;
+  NSUInteger	length = [stmt length];
+  NSUInteger	pos = 0;
+  unichar	buf[256];
+  BOOL		quoted = NO;
+  BOOL		number = NO;
+  BOOL		literal = NO;
+  BOOL		word = NO;
+  BOOL		space = NO;
+  BOOL		started = NO;
+
+#define	FPMIX(C)	(h = (h ^ (uint64_t)(C)) * 0x100000001b3ULL)
+  while (pos < length)
+    {
+      NSUInteger	count = length - pos;
+      NSUInteger	i;
+
+      if (count > 256)
+	{
+	  count = 256;
+	}
+      [stmt getCharacters: buf range: NSMakeRange(pos, count)];
+      pos += count;
+      for (i = 0; i < count; i++)
+	{
+	  unichar	c = buf[i];
 
-+ (unsigned int) debugging
-{
-  return classDebugging;
+	  if (YES == quoted)
+	    {
+	      if ('\'' == c)
+		{
+		  quoted = NO;
+		}
+	      continue;
+	    }
+	  if (YES == number)
+	    {
+	      if ((c >= '0' && c <= '9') || '.' == c)
+		{
+		  continue;
+		}
+	      number = NO;
+	    }
+	  if (c <= ' ')
+	    {
+	      space = started;
+	      word = NO;
+	      continue;
+	    }
+	  if ('\'' == c || (NO == word && c >= '0' && c <= '9'))
+	    {
+	      /* Start of a literal value ... which we represent as '?'
+	       * (once only for a quote doubled inside a string).
+	       */
+	      if ('\'' == c)
+		{
+		  quoted = YES;
+		}
+	      else
+		{
+		  number = YES;
+		}
+	      if (NO == literal)
+		{
+		  if (YES == space)
+		    {
+		      FPMIX(' ');
+		      space = NO;
+		    }
+		  FPMIX('?');
+		  literal = YES;
+		}
+	      started = YES;
+	      word = NO;
+	      continue;
+	    }
+	  if (YES == space)
+	    {
+	      FPMIX(' ');
+	      space = NO;
+	    }
+	  if (c >= 'A' && c <= 'Z')
+	    {
+	      c += 'a' - 'A';
+	    }
+	  word = ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+	    || '_' == c || c > 127) ? YES : NO;
+	  literal = NO;
+	  started = YES;
+	  FPMIX(c);
+	}
+    }
+#undef	FPMIX
+  return h;
 }
 
-+ (NSTimeInterval) durationLogging
+/* Information about one statement executed in a transaction.
+ */
+typedef struct {
+  uint64_t		fingerprint;	/* Fingerprint of the statement */
+  NSTimeInterval	duration;	/* How long the statement took */
+  NSInteger		rows;		/* Records affected */
+} SQLStatementInfo;
+
+/* The history of the statements in the current transaction of a client,
+ * used for logging slow transactions.  Only the most recent statements
+ * are kept (in a ring of fixed depth) along with totals and the text of
+ * the slowest statement, so the memory used does not grow with the
+ * length of the transaction.
+ */
+@interface	SQLClientHistory : NSObject
 {
-  return classDuration;
-}
+@public
+  NSUInteger		depth;		/* Capacity of the ring */
+  NSUInteger		count;		/* Count of statements recorded */
+  NSTimeInterval	total;		/* Total duration of statements */
+  NSTimeInterval	slowest;	/* Duration of the slowest statement */
+  id			slowText;	/* Text of the slowest statement */
+  SQLStatementInfo	*ring;
+}
+- (void) add: (id)statement
+ fingerprint: (uint64_t)fp
+    duration: (NSTimeInterval)d
+	rows: (NSInteger)rows;
+- (void) appendTo: (NSMutableString*)m;
+- (id) initWithDepth: (NSUInteger)d;
+- (void) removeAll;
+@end
 
-+ (void) setDebugging: (unsigned int)level
-{
-  classDebugging = level;
-}
+@implementation	SQLClientHistory
 
-+ (void) setDurationLogging: (NSTimeInterval)threshold
+- (void) add: (id)statement
+ fingerprint: (uint64_t)fp
+    duration: (NSTimeInterval)d
+	rows: (NSInteger)rows
 {
-  classDuration = threshold;
+  if (depth > 0)
+    {
+      SQLStatementInfo	*i = &ring[count % depth];
+
+      i->fingerprint = fp;
+      i->duration = d;
+      i->rows = rows;
+    }
+  if (0 == count || d > slowest)
+    {
+      ASSIGN(slowText, statement);
+      slowest = d;
+    }
+  total += d;
+  count++;
 }
 
-- (void) debug: (NSString*)fmt, ...
+- (void) appendTo: (NSMutableString*)m
 {
-  va_list	ap;
+  NSUInteger	kept = (count < depth) ? count : depth;
+  NSUInteger	pos;
+
+  [m appendFormat: @"  %"PRIuPTR" statement%s taking %g in total",
+    count, ((1 == count) ? "" : "s"), total];
+  if (count > 0)
+    {
+      [m appendFormat: @", slowest %g for %@;", slowest, slowText];
+    }
+  [m appendString: @"\n"];
+  if (count > kept)
+    {
+      [m appendFormat: @"  ... %"PRIuPTR" earlier statement%s not kept ...\n",
+	count - kept, ((1 == count - kept) ? "" : "s")];
+    }
+  for (pos = count - kept; pos < count; pos++)
+    {
+      SQLStatementInfo	*i = &ring[pos % depth];
+
+      [m appendFormat: @"  %016"PRIx64" duration %g affected %"PRIdPTR"\n",
+	i->fingerprint, i->duration, i->rows];
+    }
+}
+
+- (void) dealloc
+{
+  if (0 != ring)
+    {
+      NSZoneFree(NSDefaultMallocZone(), ring);
+    }
+  DESTROY(slowText);
+  [super dealloc];
+}
+
+- (id) initWithDepth: (NSUInteger)d
+{
+  if (nil != (self = [super init]))
+    {
+      depth = d;
+      if (depth > 0)
+	{
+	  ring = (SQLStatementInfo*)NSZoneMalloc(NSDefaultMallocZone(),
+	    depth * sizeof(SQLStatementInfo));
+	}
+    }
+  return self;
+}
+
+- (void) removeAll
+{
+  count = 0;
+  total = 0.0;
+  slowest = 0.0;
+  DESTROY(slowText);
+}
+
+@end
+
+/* The kinds of operation recorded for asynchronous duration logging.
+ */
+enum {
+  DurationStatement = 0,
+  DurationCommit,
+  DurationRollback,
+  DurationQuery
+};
+
+/* A record of an operation to be logged by the duration writer thread.
+ * The seq field is used to hand the record between the threads filling
+ * the ring and the writer thread without locking (a slot may be filled
+ * for position p when seq is p, and read when seq is p + 1).
+ */
+typedef struct {
+  NSUInteger		seq;		/* Position of slot in the ring */
+  NSTimeInterval	when;		/* When the operation ended */
+  NSTimeInterval	duration;	/* How long the operation took */
+  NSInteger		rows;		/* Records affected or produced */
+  uint64_t		fingerprint;	/* Fingerprint of the statement */
+  NSString		*client;	/* Name of the client (retained) */
+  id			text;		/* Statement(s) to log (retained) */
+  int			kind;		/* What sort of operation it was */
+} SQLDurationRecord;
+
+static SQLDurationRecord	*durationRing = 0;
+static NSUInteger		durationMask = 0;
+static NSUInteger		durationHead = 0;	/* Next to fill */
+static NSUInteger		durationTail = 0;	/* Next to write */
+static uint64_t			durationDropped = 0;
+static BOOL			durationAsync = NO;
+static BOOL			durationWriting = NO;
+static NSLock			*durationLock = nil;
+
+/* Adds a record to the ring for the writer thread to log, or counts it
+ * as dropped if the ring is full.  This may be called by any number of
+ * threads at once and never blocks.
+ */
+static void
+durationPush(SQLClient *c, int kind, id text, uint64_t fp,
+  NSTimeInterval d, NSInteger rows)
+{
+  NSUInteger	pos = __atomic_load_n(&durationHead, __ATOMIC_RELAXED);
+
+  for (;;)
+    {
+      SQLDurationRecord	*r = &durationRing[pos & durationMask];
+      NSUInteger	seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+      if (seq == pos)
+	{
+	  if (__atomic_compare_exchange_n(&durationHead, &pos, pos + 1, YES,
+	    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    {
+	      r->when = GSTickerTimeNow();
+	      r->duration = d;
+	      r->rows = rows;
+	      r->fingerprint = fp;
+	      r->client = [[c name] retain];
+	      r->text = [text retain];
+	      r->kind = kind;
+	      __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+	      return;
+	    }
+	}
+      else if ((NSInteger)(seq - pos) < 0)
+	{
+	  /* The slot has not yet been written out since it was last used,
+	   * so the ring is full.
+	   */
+	  __atomic_add_fetch(&durationDropped, 1, __ATOMIC_RELAXED);
+	  return;
+	}
+      else
+	{
+	  pos = __atomic_load_n(&durationHead, __ATOMIC_RELAXED);
+	}
+    }
+}
+
+/* Formats a record taken from the ring into a log message.
+ */
+static NSString *
+durationFormat(SQLDurationRecord *r)
+{
+  NSMutableString	*m;
+  const char		*plural = (1 == r->rows) ? "" : "s";
+
+  if (DurationCommit == r->kind || DurationRollback == r->kind)
+    {
+      m = [NSMutableString stringWithFormat:
+	@"Duration %g for transaction %@ ...\n", r->duration,
+	(DurationCommit == r->kind) ? @"commit" : @"rollback"];
+      [(SQLClientHistory*)r->text appendTo: m];
+      [m appendFormat: @"  affected %"PRIdPTR" record%s\n",
+	r->rows, plural];
+    }
+  else if (DurationQuery == r->kind)
+    {
+      m = [NSMutableString stringWithFormat:
+	@"Duration %g for query %@;  produced %"PRIdPTR" record%s",
+	r->duration, r->text, r->rows, plural];
+    }
+  else
+    {
+      m = [NSMutableString stringWithFormat:
+	@"Duration %g for statement %@; affected %"PRIdPTR" record%s",
+	r->duration, r->text, r->rows, plural];
+    }
+  [m appendFormat: @" [%@ at %@", r->client,
+    [NSDate dateWithTimeIntervalSinceReferenceDate: r->when]];
+  if (0 != r->fingerprint)
+    {
+      [m appendFormat: @" fingerprint %016"PRIx64, r->fingerprint];
+    }
+  [m appendString: @"]"];
+  return m;
+}
+
+@implementation	SQLClient (Logging)
+
++ (unsigned int) debugging
+{
+  return classDebugging;
+}
+
++ (NSUInteger) durationLogBuffer
+{
+  return (YES == durationAsync) ? durationMask + 1 : 0;
+}
+
++ (uint64_t) durationLogDropped
+{
+  return __atomic_load_n(&durationDropped, __ATOMIC_RELAXED);
+}
+
++ (NSTimeInterval) durationLogging
+{
+  return classDuration;
+}
+
++ (void) setDebugging: (unsigned int)level
+{
+  classDebugging = level;
+}
+
++ (void) setDurationLogBuffer: (NSUInteger)capacity
+{
+  [durationLock lock];
+  if (0 == capacity)
+    {
+      durationAsync = NO;
+    }
+  else
+    {
+      if (0 == durationRing)
+	{
+	  NSUInteger	size = 16;
+	  NSUInteger	i;
+
+	  while (size < capacity && size < 0x100000)
+	    {
+	      size *= 2;
+	    }
+	  durationRing = (SQLDurationRecord*)NSZoneCalloc(
+	    NSDefaultMallocZone(), size, sizeof(SQLDurationRecord));
+	  for (i = 0; i < size; i++)
+	    {
+	      durationRing[i].seq = i;
+	    }
+	  durationMask = size - 1;
+	}
+      durationAsync = YES;
+      if (NO == durationWriting)
+	{
+	  durationWriting = YES;
+	  [NSThread detachNewThreadSelector: @selector(_durationWriter:)
+				   toTarget: SQLClientClass
+				 withObject: nil];
+	}
+    }
+  [durationLock unlock];
+}
+
++ (void) setDurationLogging: (NSTimeInterval)threshold
+{
+  classDuration = threshold;
+}
+
++ (void) setStatementHistory: (NSUInteger)depth
+{
+  classHistory = depth;
+}
+
++ (NSUInteger) statementHistory
+{
+  return classHistory;
+}
+
+- (void) debug: (NSString*)fmt, ...
+{
+  va_list	ap;
 
   va_start(ap, fmt);
   NSLogv(fmt, ap);
@@ -1166,6 +2460,22 @@ NSString	*SQLUniqueException = @"SQLUniqueException";
   _duration = threshold;
 }
 
+- (void) setStatementHistory: (NSUInteger)depth
+{
+  [lock lock];
+  if (depth != ((SQLClientHistory*)_statements)->depth)
+    {
+      [_statements release];
+      _statements = [[SQLClientHistory alloc] initWithDepth: depth];
+    }
+  [lock unlock];
+}
+
+- (NSUInteger) statementHistory
+{
+  return ((SQLClientHistory*)_statements)->depth;
+}
+
 @end
 
 /* Containers for all instances.
@@ -1185,6 +2495,243 @@ static NSRecursiveLock	*clientsLock = nil;
  */
 static NSRecursiveLock	*cacheLock = nil;
 
+/* Additional per-client state, pointed to by the _extra ivar.
+ */
+typedef struct {
+  NSTimeInterval	timeout;	/* Default statement timeout */
+  NSTimeInterval	callTimeout;	/* Timeout for this call (if >= 0) */
+  NSTimeInterval	deadline;	/* Deadline of current statement */
+  BOOL			cancelled;	/* Statement cancelled by watchdog */
+  uint64_t		sequence;	/* Count of statements with deadlines */
+  uint64_t		expired;	/* Sequence of statement to cancel */
+  NSLock		*cancelLock;	/* Held while cancelling/stopping */
+  NSUInteger		refs;		/* Extra references (atomic) */
+  NSUInteger		idleIndex;	/* Position in idle heap */
+  NSTimeInterval	idleKey;	/* Idle time when positioned in heap */
+} SQLClientExtra;
+
+#define	EXTRA(C)	((SQLClientExtra*)((C)->_extra))
+
+/* The value of the refs field of a client which is being deallocated.
+ * Once set, the client can no longer be retained.
+ */
+#define	CLIENT_DYING	NSUIntegerMax
+
+/* Retains a client found in the registry (under clientsLock) unless it
+ * is already being deallocated, returning NO in that case.
+ */
+static inline BOOL
+retainLive(SQLClient *c)
+{
+  SQLClientExtra	*x = EXTRA(c);
+  NSUInteger		old = __atomic_load_n(&x->refs, __ATOMIC_RELAXED);
+
+  while (CLIENT_DYING != old)
+    {
+      if (__atomic_compare_exchange_n(&x->refs, &old, old + 1, NO,
+	__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+	  return YES;
+	}
+    }
+  return NO;
+}
+
+/* The connected clients, ordered as a binary heap by the time since which
+ * they have been idle, so that the longest idle can be found without
+ * scanning all clients.  The key of each entry is updated lazily; since
+ * the idle time of a client only ever increases, an entry found at the
+ * top of the heap has its key refreshed and is moved down if it was out
+ * of date.  Entries for clients whose connections were lost (rather than
+ * closed using -disconnect) are removed when found.
+ * Protected by clientsLock.
+ */
+static SQLClient	**idleHeap = 0;
+static NSUInteger	idleCount = 0;
+static NSUInteger	idleSize = 0;
+
+static inline NSTimeInterval
+idleSince(SQLClient *c)
+{
+  NSTimeInterval	when = c->_lastOperation;
+
+  if (when < c->_lastStart)
+    {
+      when = c->_lastStart;
+    }
+  return when;
+}
+
+static void
+idleSwap(NSUInteger a, NSUInteger b)
+{
+  SQLClient	*c = idleHeap[a];
+
+  idleHeap[a] = idleHeap[b];
+  idleHeap[b] = c;
+  EXTRA(idleHeap[a])->idleIndex = a;
+  EXTRA(idleHeap[b])->idleIndex = b;
+}
+
+static void
+idleUp(NSUInteger i)
+{
+  while (i > 0)
+    {
+      NSUInteger	p = (i - 1) / 2;
+
+      if (EXTRA(idleHeap[p])->idleKey <= EXTRA(idleHeap[i])->idleKey)
+	{
+	  break;
+	}
+      idleSwap(i, p);
+      i = p;
+    }
+}
+
+static void
+idleDown(NSUInteger i)
+{
+  for (;;)
+    {
+      NSUInteger	l = 2 * i + 1;
+      NSUInteger	r = l + 1;
+      NSUInteger	m = i;
+
+      if (l < idleCount
+	&& EXTRA(idleHeap[l])->idleKey < EXTRA(idleHeap[m])->idleKey)
+	{
+	  m = l;
+	}
+      if (r < idleCount
+	&& EXTRA(idleHeap[r])->idleKey < EXTRA(idleHeap[m])->idleKey)
+	{
+	  m = r;
+	}
+      if (m == i)
+	{
+	  break;
+	}
+      idleSwap(i, m);
+      i = m;
+    }
+}
+
+static void
+idleInsert(SQLClient *c)
+{
+  SQLClientExtra	*x = EXTRA(c);
+
+  if (NSNotFound != x->idleIndex)
+    {
+      return;
+    }
+  if (idleCount == idleSize)
+    {
+      idleSize = (0 == idleSize) ? 64 : idleSize * 2;
+      idleHeap = (SQLClient**)NSZoneRealloc(NSDefaultMallocZone(),
+	idleHeap, idleSize * sizeof(SQLClient*));
+    }
+  x->idleKey = idleSince(c);
+  x->idleIndex = idleCount;
+  idleHeap[idleCount++] = c;
+  idleUp(x->idleIndex);
+}
+
+static void
+idleRemove(SQLClient *c)
+{
+  SQLClientExtra	*x = EXTRA(c);
+  NSUInteger		i = x->idleIndex;
+
+  if (NSNotFound == i)
+    {
+      return;
+    }
+  x->idleIndex = NSNotFound;
+  if (i < --idleCount)
+    {
+      idleHeap[i] = idleHeap[idleCount];
+      EXTRA(idleHeap[i])->idleIndex = i;
+      if (i > 0 && EXTRA(idleHeap[i])->idleKey
+	< EXTRA(idleHeap[(i - 1) / 2])->idleKey)
+	{
+	  idleUp(i);
+	}
+      else
+	{
+	  idleDown(i);
+	}
+    }
+}
+
+/* Returns the longest idle connected client (leaving it in the heap).
+ */
+static SQLClient *
+idleTop()
+{
+  while (idleCount > 0)
+    {
+      SQLClient		*c = idleHeap[0];
+      NSTimeInterval	when;
+
+      if (NO == c->connected)
+	{
+	  idleRemove(c);
+	  continue;
+	}
+      when = idleSince(c);
+      if (when > EXTRA(c)->idleKey)
+	{
+	  EXTRA(c)->idleKey = when;
+	  idleDown(0);
+	  continue;
+	}
+      return c;
+    }
+  return nil;
+}
+
+/* Removes entries for clients whose connections have been lost, so that
+ * the number of entries is the number of connected clients.
+ */
+static void
+idleReconcile()
+{
+  NSUInteger	i = idleCount;
+
+  while (i-- > 0)
+    {
+      if (i < idleCount && NO == idleHeap[i]->connected)
+	{
+	  idleRemove(idleHeap[i]);
+	}
+    }
+}
+
+/* The watchdog thread cancels statements which have run past their
+ * deadlines.  The clients currently running a statement with a deadline
+ * are in watchdogClients, which is protected by watchdogCondition.
+ * A client is removed before its statement method returns, and the
+ * watchdog calls -backendCancel with the condition locked, so the
+ * client is always valid while the watchdog is using it.
+ */
+static NSCondition	*watchdogCondition = nil;
+static NSHashTable	*watchdogClients = 0;
+static BOOL		watchdogRunning = NO;
+
+/* Asynchronous operations for backends which can't perform them
+ * asynchronously are queued for a bounded set of worker threads, which
+ * are started on demand and exit after being idle for a while.  The
+ * queue and counters are protected by asyncCondition.
+ */
+#define	ASYNC_WORKERS_MAX	8
+#define	ASYNC_WORKER_IDLE	30.0
+static NSCondition	*asyncCondition = nil;
+static NSMutableArray	*asyncQueue = nil;
+static unsigned		asyncWorkers = 0;
+static unsigned		asyncIdle = 0;
+
 static NSString		*beginString = @"begin";
 static NSArray		*beginStatement = nil;
 static NSString		*commitString = @"commit";
@@ -1202,6 +2749,27 @@ static NSArray		*rollbackStatement = nil;
  */
 - (void) _configure: (NSNotification*)n;
 
+/** Internal method to wait for any delay needed between repeated failed
+ * connection attempts.  Returns NO without waiting if shouldWait is NO
+ * and the delay has not yet passed.
+ */
+- (BOOL) _connectDelay: (BOOL)shouldWait;
+
+/** Internal method to record the outcome of a connection attempt
+ * (restoring listens on a new connection).  Called with the lock held.
+ */
+- (void) _didConnect: (BOOL)ok;
+
+/** Internal method to insert the rows in the range using multi-row
+ * inserts, splitting any insert which fails in order to find and record
+ * the indexes of the failing rows.  Returns the number of rows inserted.
+ */
+- (NSUInteger) _insertRows: (NSArray*)rows
+		     range: (NSRange)r
+		    prefix: (NSString*)prefix
+		   columns: (NSUInteger)columns
+		  failures: (NSMutableIndexSet*)failures;
+
 /** Internal method to make the client instance lock available to
  * an associated SQLTransaction
  */
@@ -1211,11 +2779,34 @@ static NSArray		*rollbackStatement = nil;
  */
 - (void) _populateCache: (CacheQuery*)a;
 
+/** Internal method returning the argument to pass to -simpleQuery: for a
+ * query produced by one of the prepare methods ... the statement itself
+ * unless there are out-of-line arguments, in which case it's the whole
+ * array.  Shared with the pool and router classes.
+ */
++ (id) _queryArgument: (NSMutableArray*)info;
+
 /** Internal method called to record the 'main' thread in which automated
  * cache updates are to be performed.
  */
 - (void) _recordMainThread;
 
+/** Internal methods to set the deadline of a statement about to be
+ * executed and to clear it when the statement has ended.  The second
+ * method returns YES if the statement was cancelled by the watchdog.
+ */
+- (void) _startDeadline;
+- (BOOL) _stopDeadline;
+
+/** Internal method run by the watchdog thread.
+ */
++ (void) _watchdog: (id)ignored;
+
+/** Internal method run by the thread writing out asynchronous duration
+ * logs.
+ */
++ (void) _durationWriter: (id)ignored;
+
 /*
  * Called at one second intervals to ensure that our current timestamp
  * is reasonably accurate.
@@ -1224,6 +2815,20 @@ static NSArray		*rollbackStatement = nil;
 
 @end
 
+@interface	SQLAsyncOperation (Private)
+- (void) _deliver;
+- (id) _initWithClient: (SQLClient*)client
+		  pool: (SQLClientPool*)pool
+	     statement: (SQLLitArg*)stmt
+		 query: (BOOL)isQuery
+		thread: (NSThread*)thread
+	    completion: (id)completion;
+- (void) _run;
+- (void) _setClient: (SQLClient*)client;
+- (void) _start;
++ (void) _worker: (id)ignored;
+@end
+
 @interface	SQLClient (GSCacheDelegate)
 - (BOOL) shouldKeepItem: (id)anObject
 		withKey: (id)aKey
@@ -1237,18 +2842,212 @@ static NSTimeInterval   abandonAfter = 0.0;
 static unsigned int	maxConnections = 8;
 static int	        poolConnections = 0;
 
-+ (NSArray*) allClients
+/* Circuit breakers for connection attempts, one per database name, shared
+ * by all the clients (including those in pools) using that database.
+ * Entries are never removed, so a breaker found in the map may be used
+ * for as long as breakersLock is held.
+ */
+typedef struct {
+  NSUInteger		failures;	/* Consecutive failures while closed */
+  NSUInteger		opens;		/* Consecutive times opened */
+  NSTimeInterval	retryAt;	/* When a probe is permitted */
+  NSTimeInterval	probeUntil;	/* When an unfinished probe expires */
+  void			*probe;		/* Client making a probe attempt */
+  uint64_t		rejected;	/* Attempts failed fast while open */
+  BOOL			open;
+} SQLClientBreaker;
+
+static NSMapTable	*breakers = 0;
+static NSLock		*breakersLock = nil;
+static unsigned int	breakerFailures = 3;
+static NSTimeInterval	breakerMaxDelay = 30.0;
+
+/* State of the (xorshift) generator used to jitter backoff delays,
+ * seeded per process so that different processes do not back off in
+ * step.  Protected by breakersLock.
+ */
+static uint32_t		breakerSeed = 0;
+
+/* The longest a probe may take before another client is permitted to
+ * probe in its place.
+ */
+#define	BREAKER_PROBE_LIMIT	60.0
+
+/* Returns the breaker for the database used by the client (creating it
+ * if necessary) or a null pointer if the breaker is disabled or the
+ * client has no database.  Must be called with breakersLock held.
+ */
+static SQLClientBreaker *
+breakerFor(SQLClient *c)
 {
-  NSMutableArray	*a;
-  NSHashEnumerator	e;
-  id                    o;
+  SQLClientBreaker	*b;
 
-  [clientsLock lock];
-  a = [NSMutableArray arrayWithCapacity: NSCountHashTable(clientsHash)];
-  e = NSEnumerateHashTable(clientsHash);
-  while (nil != (o = (id)NSNextHashEnumeratorItem(&e)))
+  if (0 == breakerFailures || nil == c->_database)
     {
-      [a addObject: o];
+      return 0;
+    }
+  b = (SQLClientBreaker*)NSMapGet(breakers, c->_database);
+  if (0 == b)
+    {
+      b = (SQLClientBreaker*)NSZoneCalloc(NSDefaultMallocZone(),
+	1, sizeof(SQLClientBreaker));
+      NSMapInsert(breakers, [[c->_database copy] autorelease], b);
+    }
+  return b;
+}
+
+/* Opens the breaker, backing off exponentially with the number of times
+ * it has opened in succession.  The delay is jittered to between half
+ * and all of the backoff so that clients in different processes do not
+ * probe the server in step.
+ */
+static void
+breakerTrip(SQLClientBreaker *b, NSString *database)
+{
+  NSTimeInterval	delay;
+
+  if (b->opens < 31)
+    {
+      b->opens++;
+    }
+  delay = (NSTimeInterval)(1 << (b->opens - 1));
+  if (delay > breakerMaxDelay)
+    {
+      delay = breakerMaxDelay;
+    }
+  breakerSeed ^= breakerSeed << 13;
+  breakerSeed ^= breakerSeed >> 17;
+  breakerSeed ^= breakerSeed << 5;
+  delay *= 0.5 + (breakerSeed % 1000) / 2000.0;
+  b->open = YES;
+  b->failures = 0;
+  b->probe = 0;
+  b->retryAt = GSTickerTimeNow() + delay;
+  NSLog(@"Circuit breaker for '%@' opened for %g seconds", database, delay);
+}
+
+/* Returns YES if the client may attempt to connect.  While the breaker
+ * is open this returns NO (failing fast) until the backoff period has
+ * passed, after which the first caller becomes the probe.  The probe
+ * may be admitted again (eg when a non-blocking connection attempt
+ * falls back to a blocking one).
+ */
+static BOOL
+breakerAdmit(SQLClient *c)
+{
+  SQLClientBreaker	*b;
+  BOOL			ok = YES;
+
+  [breakersLock lock];
+  b = breakerFor(c);
+  if (0 != b && YES == b->open)
+    {
+      NSTimeInterval	now = GSTickerTimeNow();
+
+      if ((void*)c == b->probe && now < b->probeUntil)
+	{
+	  ok = YES;
+	}
+      else if (now < b->retryAt
+	|| (0 != b->probe && now < b->probeUntil))
+	{
+	  b->rejected++;
+	  ok = NO;
+	}
+      else
+	{
+	  b->probe = (void*)c;
+	  b->probeUntil = now + BREAKER_PROBE_LIMIT;
+	}
+    }
+  [breakersLock unlock];
+  return ok;
+}
+
+/* Records the outcome of a connection attempt by the client.
+ */
+static void
+breakerRecord(SQLClient *c, BOOL ok)
+{
+  SQLClientBreaker	*b;
+
+  [breakersLock lock];
+  b = breakerFor(c);
+  if (0 != b)
+    {
+      if (YES == ok)
+	{
+	  if (YES == b->open)
+	    {
+	      NSLog(@"Circuit breaker for '%@' closed", c->_database);
+	    }
+	  b->open = NO;
+	  b->failures = 0;
+	  b->opens = 0;
+	  b->probe = 0;
+	}
+      else if (YES == b->open)
+	{
+	  /* Only the failure of a probe affects an open breaker; other
+	   * attempts were started before it opened.
+	   */
+	  if ((void*)c == b->probe)
+	    {
+	      breakerTrip(b, c->_database);
+	    }
+	}
+      else if (++b->failures >= breakerFailures)
+	{
+	  breakerTrip(b, c->_database);
+	}
+    }
+  [breakersLock unlock];
+}
+
+/* Returns the time the client should wait before a connection attempt
+ * might be permitted by the breaker.
+ */
+static NSTimeInterval
+breakerWait(SQLClient *c)
+{
+  SQLClientBreaker	*b;
+  NSTimeInterval	wait = 0.0;
+
+  [breakersLock lock];
+  b = breakerFor(c);
+  if (0 != b && YES == b->open)
+    {
+      NSTimeInterval	now = GSTickerTimeNow();
+
+      if (now < b->retryAt)
+	{
+	  wait = b->retryAt - now;
+	}
+      else if (0 != b->probe && now < b->probeUntil)
+	{
+	  wait = 0.1;
+	}
+    }
+  [breakersLock unlock];
+  return wait;
+}
+
++ (NSArray*) allClients
+{
+  NSMutableArray	*a;
+  NSHashEnumerator	e;
+  id                    o;
+
+  [clientsLock lock];
+  a = [NSMutableArray arrayWithCapacity: NSCountHashTable(clientsHash)];
+  e = NSEnumerateHashTable(clientsHash);
+  while (nil != (o = (id)NSNextHashEnumeratorItem(&e)))
+    {
+      if (YES == retainLive(o))
+        {
+          [a addObject: o];
+          [o autorelease];
+        }
     }
   NSEndHashTableEnumeration(&e);
   [clientsLock unlock];
@@ -1294,6 +3093,215 @@ static int	        poolConnections = 0;
   return o;
 }
 
+/* Records the outcome of a connection attempt made by +connectClients:
+ * then unlocks the client (which must have been locked for the attempt).
+ */
+static void
+connectEnded(SQLClient *c, BOOL ok)
+{
+  NS_DURING
+    {
+      [c _didConnect: ok];
+    }
+  NS_HANDLER
+    {
+      c->_lastOperation = GSTickerTimeNow();
+      c->_connectFails++;
+      breakerRecord(c, NO);
+      NSLog(@"Problem connecting %@: %@", [c name], localException);
+    }
+  NS_ENDHANDLER
+  [c->lock unlock];
+  if (YES == c->connected)
+    {
+      [[NSNotificationCenter defaultCenter]
+	postNotificationName: SQLClientDidConnectNotification
+		      object: c];
+    }
+}
+
++ (NSUInteger) connectClients: (NSArray*)clients
+{
+  NSUInteger		count = [clients count];
+  NSUInteger		active = 0;
+  NSUInteger		done = 0;
+  NSMutableArray	*blocking;
+  SQLClient		**waiting;
+  struct pollfd		*fds;
+  NSTimeInterval	end;
+  NSUInteger		i;
+
+  if (0 == count)
+    {
+      return 0;
+    }
+  blocking = [NSMutableArray arrayWithCapacity: count];
+  waiting = (SQLClient**)NSZoneMalloc(NSDefaultMallocZone(),
+    count * sizeof(SQLClient*));
+  fds = (struct pollfd*)NSZoneMalloc(NSDefaultMallocZone(),
+    count * sizeof(struct pollfd));
+
+  /* Start all the connection attempts.
+   */
+  for (i = 0; i < count; i++)
+    {
+      SQLClient			*c = [clients objectAtIndex: i];
+      SQLClientConnectState	state;
+      int			fd = -1;
+
+      if (YES == c->connected)
+	{
+	  continue;
+	}
+      [c->lock lock];
+      if (YES == c->connected || NO == [c _connectDelay: NO]
+	|| NO == breakerAdmit(c))
+	{
+	  [c->lock unlock];
+	  continue;
+	}
+      c->_lastStart = GSTickerTimeNow();
+      NS_DURING
+	{
+	  state = [c backendConnectStart: &fd];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Problem connecting %@: %@", [c name], localException);
+	  state = SQLClientConnectFailed;
+	}
+      NS_ENDHANDLER
+      if (SQLClientConnectBlocking == state)
+	{
+	  [c->lock unlock];
+	  [blocking addObject: c];
+	}
+      else if (SQLClientConnectReading == state
+	|| SQLClientConnectWriting == state)
+	{
+	  waiting[active] = c;
+	  fds[active].fd = fd;
+	  fds[active].events
+	    = (SQLClientConnectReading == state) ? POLLIN : POLLOUT;
+	  fds[active].revents = 0;
+	  active++;
+	}
+      else
+	{
+	  connectEnded(c, (SQLClientConnectDone == state) ? YES : NO);
+	}
+    }
+
+  /* Now perform the handshakes of all the connections together, until
+   * they are complete or we run out of time.
+   */
+  end = GSTickerTimeNow() + ((abandonAfter > 30.0) ? abandonAfter : 30.0);
+  while (active > 0)
+    {
+      NSTimeInterval	now = GSTickerTimeNow();
+
+      if (now >= end)
+	{
+	  break;
+	}
+      if (poll(fds, active, (int)((end - now) * 1000.0) + 1) < 0)
+	{
+	  if (EINTR == errno)
+	    {
+	      continue;
+	    }
+	  NSLog(@"Problem waiting for connections: %s", strerror(errno));
+	  break;
+	}
+      i = active;
+      while (i-- > 0)
+	{
+	  SQLClient		*c = waiting[i];
+	  SQLClientConnectState	state;
+	  int			fd = fds[i].fd;
+
+	  if (0 == fds[i].revents)
+	    {
+	      continue;
+	    }
+	  NS_DURING
+	    {
+	      state = [c backendConnectPoll: &fd];
+	    }
+	  NS_HANDLER
+	    {
+	      NSLog(@"Problem connecting %@: %@", [c name], localException);
+	      state = SQLClientConnectFailed;
+	    }
+	  NS_ENDHANDLER
+	  if (SQLClientConnectReading == state
+	    || SQLClientConnectWriting == state)
+	    {
+	      fds[i].fd = fd;
+	      fds[i].events
+		= (SQLClientConnectReading == state) ? POLLIN : POLLOUT;
+	      fds[i].revents = 0;
+	    }
+	  else
+	    {
+	      connectEnded(c, (SQLClientConnectDone == state) ? YES : NO);
+	      active--;
+	      waiting[i] = waiting[active];
+	      fds[i] = fds[active];
+	    }
+	}
+    }
+
+  /* Abandon any attempts which did not complete in time.
+   */
+  while (active > 0)
+    {
+      SQLClient	*c = waiting[--active];
+
+      [c debug: @"Abandoned connection attempt for %@ after %g seconds",
+	[c name], GSTickerTimeNow() - c->_lastStart];
+      NS_DURING
+	{
+	  [c backendDisconnect];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Problem disconnecting %@: %@", [c name], localException);
+	}
+      NS_ENDHANDLER
+      connectEnded(c, NO);
+    }
+  NSZoneFree(NSDefaultMallocZone(), fds);
+  NSZoneFree(NSDefaultMallocZone(), waiting);
+
+  /* Backends which can't connect without blocking are done one by one.
+   */
+  count = [blocking count];
+  for (i = 0; i < count; i++)
+    {
+      NS_DURING
+	{
+	  [[blocking objectAtIndex: i] tryConnect];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Problem connecting %@: %@",
+	    [[blocking objectAtIndex: i] name], localException);
+	}
+      NS_ENDHANDLER
+    }
+
+  count = [clients count];
+  for (i = 0; i < count; i++)
+    {
+      if (YES == [[clients objectAtIndex: i] connected])
+	{
+	  done++;
+	}
+    }
+  return done;
+}
+
 + (SQLClient*) existingClient: (NSString*)reference
 {
   SQLClient	*existing;
@@ -1310,7 +3318,17 @@ static int	        poolConnections = 0;
 
   [clientsLock lock];
   existing = (SQLClient*)NSMapGet(clientsMap, reference);
-  [[existing retain] autorelease];
+  if (nil != existing)
+    {
+      if (YES == retainLive(existing))
+        {
+          [existing autorelease];
+        }
+      else
+        {
+          existing = nil;	// Being deallocated
+        }
+    }
   [clientsLock unlock];
   return existing;
 }
@@ -1346,10 +3364,27 @@ static int	        poolConnections = 0;
       if (0 == clientsHash)
         {
           cacheLock = [NSRecursiveLock new];
+          decodersLock = [NSLock new];
+          zonesLock = [NSLock new];
           clientsHash = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
           clientsMap = NSCreateMapTable(NSObjectMapKeyCallBacks,
             NSNonRetainedObjectMapValueCallBacks, 0);
           clientsLock = [NSRecursiveLock new];
+          breakers = NSCreateMapTable(NSObjectMapKeyCallBacks,
+            NSNonOwnedPointerMapValueCallBacks, 0);
+          breakersLock = [NSLock new];
+          breakerSeed = (uint32_t)(uint64_t)(GSTickerTimeNow() * 1000.0)
+	    ^ (uint32_t)[[NSProcessInfo processInfo] processIdentifier];
+          if (0 == breakerSeed)
+            {
+              breakerSeed = 1;	// Xorshift state must not be zero
+            }
+          watchdogCondition = [NSCondition new];
+          asyncCondition = [NSCondition new];
+          asyncQueue = [NSMutableArray new];
+          durationLock = [NSLock new];
+          watchdogClients
+            = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
           beginStatement = [[NSArray arrayWithObject: beginString] retain];
           commitStatement = [[NSArray arrayWithObject: commitString] retain];
           rollbackStatement
@@ -1374,61 +3409,41 @@ static int	        poolConnections = 0;
 
 + (void) purgeConnections: (NSDate*)since
 {
-  NSHashEnumerator	e;
-  NSMutableArray        *a = nil;
   SQLClient		*o;
-  unsigned int		connectionCount = 0;
-  NSTimeInterval	t;
-
-  t = (nil == since) ? 0.0 : [since timeIntervalSinceReferenceDate];
+  NSUInteger		limit;
 
-  /* Find clients we may want to disconnect.
-   */
-  [clientsLock lock];
-  e = NSEnumerateHashTable(clientsHash);
-  while (nil != (o = (SQLClient*)NSNextHashEnumeratorItem(&e)))
+  if (nil != since)
     {
-      if (YES == o->connected)
+      NSMutableArray	*a = nil;
+      NSTimeInterval	t = [since timeIntervalSinceReferenceDate];
+
+      /* Find clients we may want to disconnect ... those at the top of
+       * the idle heap which have been idle since before the date.
+       */
+      [clientsLock lock];
+      while (nil != (o = idleTop()) && idleSince(o) < t)
         {
-          connectionCount++;
-          if (since != nil)
+          idleRemove(o);
+          if (YES == retainLive(o))
             {
-              NSTimeInterval	when = o->_lastOperation;
-
-              if (when < o->_lastStart)
-                {
-                  when = o->_lastStart;
-                }
-              if (when < t)
+              if (nil == a)
                 {
-                  if (nil == a)
-                    {
-                      a = [NSMutableArray array];
-                    }
-                  [a addObject: o];
+                  a = [NSMutableArray array];
                 }
+              [a addObject: o];
+              [o autorelease];
             }
         }
-    }
-  NSEndHashTableEnumeration(&e);
-  [clientsLock unlock];
+      [clientsLock unlock];
 
-  /* Disconnect any clients idle too long
-   */
-  while ([a count] > 0)
-    {
-      o = [a lastObject];
-      if ([o->lock tryLock])
+      /* Disconnect any clients idle too long
+       */
+      while ([a count] > 0)
         {
-	  if (YES == o->connected)
+          o = [a lastObject];
+          if ([o->lock tryLock])
             {
-              NSTimeInterval	when = o->_lastOperation;
-
-              if (when < o->_lastStart)
-                {
-                  when = o->_lastStart;
-                }
-              if (when < t)
+              if (YES == o->connected && idleSince(o) < t)
                 {
                   NS_DURING
                     {
@@ -1440,53 +3455,52 @@ static int	        poolConnections = 0;
                     }
                   NS_ENDHANDLER
                 }
+              [o->lock unlock];
             }
-          if (NO == o->connected)
+          if (YES == o->connected)
             {
-              connectionCount--;
+              /* In use (or became active again), so it goes back in
+               * the heap.
+               */
+              [clientsLock lock];
+              idleInsert(o);
+              [clientsLock unlock];
             }
-          [o->lock unlock];
+          [a removeLastObject];
         }
-      [a removeLastObject];
     }
 
-  while (connectionCount >= (maxConnections + poolConnections))
+  /* Now make sure there is a free slot for a new connection, closing
+   * the longest idle connections if necessary.
+   */
+  [clientsLock lock];
+  limit = maxConnections + poolConnections;
+  if (idleCount >= limit)
     {
-      SQLClient		*other = nil;
-      NSTimeInterval	oldest = 0.0;
-  
-      connectionCount = 0;
-      [clientsLock lock];
-      e = NSEnumerateHashTable(clientsHash);
-      while (nil != (o = (SQLClient*)NSNextHashEnumeratorItem(&e)))
-	{
-	  if (YES == o->connected)
-	    {
-	      NSTimeInterval	when = o->_lastOperation;
-
-              if (when < o->_lastStart)
-                {
-                  when = o->_lastStart;
-                }
-	      connectionCount++;
-	      if (oldest == 0.0 || when < oldest)
-		{
-		  oldest = when;
-		  ASSIGN(other, o);
-		}
-	    }
-	}
-      NSEndHashTableEnumeration(&e);
+      idleReconcile();
+    }
+  while (idleCount >= limit && nil != (o = idleTop()))
+    {
+      idleRemove(o);
+      if (NO == retainLive(o))
+        {
+          continue;
+        }
       [clientsLock unlock];
-      connectionCount--;
-      if ([other debugging] > 0)
+      if ([o debugging] > 0)
 	{
-	  [other debug:
+	  [o debug:
 	    @"Force disconnect of '%@' because max connections (%u) reached",
-	    other, maxConnections]; 
+	    o, maxConnections]; 
 	}
-      [AUTORELEASE(other) disconnect];
+      [AUTORELEASE(o) disconnect];
+      [clientsLock lock];
+      if (YES == o->connected)
+        {
+          idleInsert(o);
+        }
     }
+  [clientsLock unlock];
 }
 
 + (void) setAbandonFailedConnectionsAfter: (NSTimeInterval)delay
@@ -1494,6 +3508,15 @@ static int	        poolConnections = 0;
   abandonAfter = delay;
 }
 
++ (void) setCircuitBreaker: (unsigned int)failures
+		  maxDelay: (NSTimeInterval)maxDelay
+{
+  [breakersLock lock];
+  breakerFailures = failures;
+  breakerMaxDelay = (maxDelay > 1.0) ? maxDelay : 1.0;
+  [breakersLock unlock];
+}
+
 + (void) setMaxConnections: (unsigned int)c
 {
   if (c > 0)
@@ -1564,6 +3587,43 @@ static int	        poolConnections = 0;
   return SQLClientProxyLiteral(sql);
 }
 
+- (NSString*) circuitBreaker
+{
+  SQLClientBreaker	*b;
+  NSString		*str;
+
+  [breakersLock lock];
+  b = breakerFor(self);
+  if (0 == b)
+    {
+      str = @"disabled";
+    }
+  else if (NO == b->open)
+    {
+      str = [NSString stringWithFormat:
+	@"closed (%"PRIuPTR" failures), %"PRIu64" rejected",
+	b->failures, b->rejected];
+    }
+  else
+    {
+      NSTimeInterval	wait = b->retryAt - GSTickerTimeNow();
+
+      if (wait > 0.0)
+	{
+	  str = [NSString stringWithFormat:
+	    @"open (retry in %g), %"PRIu64" rejected", wait, b->rejected];
+	}
+      else
+	{
+	  str = [NSString stringWithFormat:
+	    @"half-open (%@), %"PRIu64" rejected",
+	    (0 == b->probe) ? @"awaiting probe" : @"probing", b->rejected];
+	}
+    }
+  [breakersLock unlock];
+  return str;
+}
+
 - (NSString*) clientName
 {
   NSString      *s;
@@ -1597,12 +3657,12 @@ static int	        poolConnections = 0;
   NS_DURING
     {
       [self simpleExecute: commitStatement];
-      [_statements removeAllObjects];
+      [_statements removeAll];
       [lock unlock];		// Locked by -begin
     }
   NS_HANDLER
     {
-      [_statements removeAllObjects];
+      [_statements removeAll];
       [lock unlock];		// Locked by -begin
       [localException raise];
     }
@@ -1623,10 +3683,23 @@ static int	        poolConnections = 0;
       end = [NSDate timeIntervalSinceReferenceDate] + abandonAfter;
       while (NO == connected && [NSDate timeIntervalSinceReferenceDate] < end)
 	{
-          [self tryConnect];
-	}
-    }
-  return connected;
+	  NSTimeInterval	wait = breakerWait(self);
+
+	  if (wait > 0.0)
+	    {
+	      NSTimeInterval	left;
+
+	      /* The breaker is open, so there is no point trying until
+	       * it permits another attempt.
+	       */
+	      left = end - [NSDate timeIntervalSinceReferenceDate];
+	      [NSThread sleepForTimeInterval: (wait < left) ? wait : left];
+	      continue;
+	    }
+          [self tryConnect];
+	}
+    }
+  return connected;
 }
 
 - (BOOL) connected
@@ -1650,6 +3723,10 @@ static int	        poolConnections = 0;
     {
       NSMapRemove(clientsMap, (void*)_name);
     }
+  if (0 != _extra)
+    {
+      idleRemove(self);
+    }
   [clientsLock unlock];
   nc = [NSNotificationCenter defaultCenter];
   [nc removeObserver: self];
@@ -1687,6 +3764,12 @@ static int	        poolConnections = 0;
       _observers = 0;
     }
   [_names release]; _names = 0;
+  if (0 != _extra)
+    {
+      [EXTRA(self)->cancelLock release];
+      NSZoneFree(NSDefaultMallocZone(), _extra);
+      _extra = 0;
+    }
   [super dealloc];
 }
 
@@ -1707,6 +3790,7 @@ static int	        poolConnections = 0;
       [s appendFormat: @"  Committed   - %"PRIu64"\n", _committed];
       [s appendFormat: @"  Transaction - %@\n",
         _inTransaction ? @"yes" : @"no"];
+      [s appendFormat: @"  Breaker     - %@\n", [self circuitBreaker]];
     }
   NS_HANDLER
     {
@@ -1748,6 +3832,9 @@ static int	        poolConnections = 0;
 	    }
 	  NS_ENDHANDLER
 	}
+      [clientsLock lock];
+      idleRemove(self);
+      [clientsLock unlock];
       [lock unlock];
       nc = [NSNotificationCenter defaultCenter];
       [nc postNotificationName: SQLClientDidDisconnectNotification
@@ -1823,14 +3910,22 @@ static int	        poolConnections = 0;
   else
     {
       existing = (SQLClient*)NSMapGet(clientsMap, reference);
+      if (nil != existing && NO == retainLive(existing))
+        {
+          existing = nil;	// Being deallocated
+        }
     }
   if (nil == existing)
     {
       lock = [NSRecursiveLock new];	// Ensure thread-safety.
+      _extra = NSZoneCalloc(NSDefaultMallocZone(), 1, sizeof(SQLClientExtra));
+      EXTRA(self)->callTimeout = -1.0;
+      EXTRA(self)->idleIndex = NSNotFound;
+      EXTRA(self)->cancelLock = [NSLock new];
       [self setDebugging: [[self class] debugging]];
       [self setDurationLogging: [[self class] durationLogging]];
       [self setName: reference];	// Set name and store in cache.
-      _statements = [NSMutableArray new];
+      _statements = [[SQLClientHistory alloc] initWithDepth: classHistory];
 
       if ([conf isKindOfClass: [NSUserDefaults class]] == YES)
 	{
@@ -1853,7 +3948,7 @@ static int	        poolConnections = 0;
   else
     {
       [self release];
-      self = [existing retain];
+      self = existing;		// Retained above
 
       if ([conf isKindOfClass: [NSUserDefaults class]] == NO)
         {
@@ -2014,7 +4109,8 @@ static int	        poolConnections = 0;
       while (tmp != nil)
         {
           index++;
-          if ([tmp isKindOfClass: [NSData class]] == YES)
+          if ([tmp isKindOfClass: [NSData class]] == YES
+            || [tmp isKindOfClass: [SQLBoundArray class]] == YES)
             {
               [ma addObject: tmp];
               tmp = @"'?'''?'";	// Marker.
@@ -2198,7 +4294,8 @@ static int	        poolConnections = 0;
 	    }
 	  else
             {
-              if ([o isKindOfClass: [NSData class]] == YES)
+              if ([o isKindOfClass: [NSData class]] == YES
+                || [o isKindOfClass: [SQLBoundArray class]] == YES)
                 {
                   [ma addObject: o];
                   v = @"'?'''?'";
@@ -2281,13 +4378,13 @@ static int	        poolConnections = 0;
 {
   va_list		ap;
   NSMutableArray	*result = nil;
-  SQLLiteral            *query;
+  id		query;
 
   /*
    * First check validity and concatenate parts of the query.
    */
   va_start (ap, stmt);
-  query = [[self prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [self prepare: stmt args: ap]];
   va_end (ap);
 
   result = [self simpleQuery: query];
@@ -2298,9 +4395,9 @@ static int	        poolConnections = 0;
 - (NSMutableArray*) query: (NSString*)stmt with: (NSDictionary*)values
 {
   NSMutableArray	*result = nil;
-  SQLLiteral            *query;
+  id		query;
 
-  query = [[self prepare: stmt with: values] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [self prepare: stmt with: values]];
 
   result = [self simpleQuery: query];
 
@@ -2572,37 +4669,88 @@ static int	        poolConnections = 0;
 
 - (oneway void) release
 {
-  /* We lock the table while checking, to prevent another thread
-   * from grabbing this object while we are checking it.
+  SQLClientExtra	*x = EXTRA(self);
+  NSUInteger		old;
+
+  if (0 == x)
+    {
+      [super release];	// Not initialised
+      return;
+    }
+
+  /* The reference count is maintained atomically in the extra data, so
+   * that we can decide whether this is the last reference without
+   * locking anything (and without the object ever reaching a zero count
+   * from which it would have to be resurrected).
    */
-  [clientsLock lock];
-  if (nil != _pool && [self retainCount] == 1)
-    {
-      /* This is the only reference to a client associated with
-       * a connection pool we put this client back to the pool.
-       *
-       * That being the case, we know that this thread 'owns'
-       * the client and it's not going to be deallocated and not
-       * going to have the _pool iinstance variable changed, so it
-       * is safe to unlock clientsLock before returning the client
-       * to the pool.  This avoids a possible deadlock when a pool
-       * is being purged.
-       *
-       * wl 2019-05-01: The original implementation was calling this code
-       * when NSDecrementExtraRefCountWasZero returns YES, but
-       * this does not work with newer versions of the GNUstep
-       * Objective-C runtime nor with recent versions of Apple's
-       * Objective-C runtime, which both don't handle resurrection
-       * gracefully for objects whose retain count has become zero.
-       */
-      [clientsLock unlock];
-      [_pool _swallowClient: self explicit: NO];
+  old = __atomic_load_n(&x->refs, __ATOMIC_RELAXED);
+  for (;;)
+    {
+      if (CLIENT_DYING == old)
+        {
+          return;	// Already being deallocated
+        }
+      if (0 == old)
+        {
+          if (nil != _pool)
+            {
+              /* This is the only reference to a client associated with
+               * a connection pool, so we put this client back in the
+               * pool (which owns it) rather than deallocating it.
+               * A concurrent registry lookup may retain the client at
+               * this point, but that just adds a reference to a client
+               * which the pool still owns.
+               */
+              [_pool _swallowClient: self explicit: NO];
+              return;
+            }
+          if (__atomic_compare_exchange_n(&x->refs, &old, CLIENT_DYING, NO,
+            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            {
+              [self dealloc];
+              return;
+            }
+        }
+      else if (__atomic_compare_exchange_n(&x->refs, &old, old - 1, NO,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+          return;
+        }
     }
-  else
+}
+
+- (id) retain
+{
+  SQLClientExtra	*x = EXTRA(self);
+  NSUInteger		old;
+
+  if (0 == x)
     {
-      [super release];
-      [clientsLock unlock];
+      return [super retain];
+    }
+  old = __atomic_load_n(&x->refs, __ATOMIC_RELAXED);
+  while (CLIENT_DYING != old)
+    {
+      if (__atomic_compare_exchange_n(&x->refs, &old, old + 1, NO,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+          break;
+        }
+    }
+  return self;
+}
+
+- (NSUInteger) retainCount
+{
+  SQLClientExtra	*x = EXTRA(self);
+  NSUInteger		refs;
+
+  if (0 == x)
+    {
+      return [super retainCount];
     }
+  refs = __atomic_load_n(&x->refs, __ATOMIC_RELAXED);
+  return (CLIENT_DYING == refs) ? 0 : refs + 1;
 }
 
 - (SQLClientPool*) pool
@@ -2634,12 +4782,12 @@ static int	        poolConnections = 0;
         {
           [self simpleExecute: rollbackStatement];
         }
-      [_statements removeAllObjects];
+      [_statements removeAll];
       [lock unlock];		// Locked by -begin
     }
   NS_HANDLER
     {
-      [_statements removeAllObjects];
+      [_statements removeAll];
       [lock unlock];		// Locked by -begin
       [localException raise];
     }
@@ -2768,6 +4916,11 @@ static int	        poolConnections = 0;
   _shouldTrim = (YES == aFlag) ? YES : NO;
 }
 
+- (void) setStatementTimeout: (NSTimeInterval)seconds
+{
+  EXTRA(self)->timeout = (seconds > 0.0) ? seconds : 0.0;
+}
+
 - (void) setUser: (NSString*)s
 {
   [lock lock];
@@ -2845,22 +4998,62 @@ static int	        poolConnections = 0;
       NS_DURING
         {
 	  _lastStart = GSTickerTimeNow();
+	  [self _startDeadline];
           result = [self backendExecute: info];
+	  [self _stopDeadline];
           _lastOperation = GSTickerTimeNow();
-          [_statements addObject: statement];
           if (_duration >= 0)
             {
               NSTimeInterval	d;
+              uint64_t		fp = 0;
 
               d = _lastOperation - _lastStart;
+              if (YES == _inTransaction || YES == isCommit || YES == isRollback)
+                {
+                  /* Keep a record of the statement for logging if the
+                   * transaction turns out to be slow.
+                   */
+                  fp = fingerprint(statement);
+                  [_statements add: statement
+                       fingerprint: fp
+                          duration: d
+                              rows: result];
+                }
               if (d >= _duration)
                 {
 		  NSMutableString	*m;
 
-                  if (isCommit || isRollback)
+                  if (YES == durationAsync)
                     {
-                      NSEnumerator      *e = [_statements objectEnumerator];
+                      if (isCommit || isRollback)
+                        {
+                          SQLClientHistory	*h = _statements;
 
+                          /* Hand the history of the transaction over to
+                           * the writer thread rather than formatting it
+                           * while we hold the lock.
+                           */
+                          _statements = [[SQLClientHistory alloc]
+                            initWithDepth: h->depth];
+                          durationPush(self,
+                            isCommit ? DurationCommit : DurationRollback,
+                            h, 0, d, result);
+                          [h release];
+                        }
+                      else
+                        {
+                          if (0 == fp)
+                            {
+                              fp = fingerprint(statement);
+                            }
+                          durationPush(self, DurationStatement,
+                            ([self debugging] > 1) ? (id)info : (id)statement,
+                            fp, d, result);
+                        }
+                      m = nil;
+                    }
+                  else if (isCommit || isRollback)
+                    {
                       if (isCommit)
                         {
                           m = [NSMutableString stringWithFormat:
@@ -2871,10 +5064,7 @@ static int	        poolConnections = 0;
                           m = [NSMutableString stringWithFormat:
                             @"Duration %g for transaction rollback ...\n", d];
                         }
-                      while ((statement = [e nextObject]) != nil)
-                        {
-                          [m appendFormat: @"  %@;\n", statement];
-                        }
+                      [_statements appendTo: m];
 		      [m appendFormat: @"  affected %"PRIdPTR" record%s\n",
 			result, ((1 == result) ? "" : "s")];
                     }
@@ -2901,32 +5091,45 @@ static int	        poolConnections = 0;
             }
           if (_inTransaction == NO)
             {
-              [_statements removeAllObjects];
+              [_statements removeAll];
 	      _committed++;
             }
         }
       NS_HANDLER
         {
+          BOOL	timedOut = [self _stopDeadline];
+
           result = -1;
           if (NO == _inTransaction)
             {
-              [_statements removeAllObjects];
-              if ([[localException name] isEqual: SQLConnectionException])
+              [_statements removeAll];
+              if (NO == timedOut
+                && [[localException name] isEqual: SQLConnectionException])
                 {
                   /* A connection failure while not in a transaction ...
-                   * we can and should retry.
+                   * we can and should retry, as long as we can reconnect
+                   * (we fail at once if the circuit breaker is open).
                    */
-                  done = NO;
-                  if (nil != debug)
+                  if (YES == [self connect])
                     {
-                      NSLog(@"Will retry after: %@", localException);
+                      done = NO;
+                      if (nil != debug)
+                        {
+                          NSLog(@"Will retry after: %@", localException);
+                        }
                     }
-		  [self connect];
                 }
             }
           if (done)
             {
               [lock unlock];
+              if (YES == timedOut)
+                {
+                  [NSException raise: SQLTimeoutException
+                    format: @"Timed out after %g running statement %@ (%@)",
+                    GSTickerTimeNow() - _lastStart, statement,
+                    [localException reason]];
+                }
               [localException raise];
             }
         }
@@ -2940,6 +5143,31 @@ static int	        poolConnections = 0;
   return result;
 }
 
+- (NSInteger) simpleExecute: (id)info timeout: (NSTimeInterval)seconds
+{
+  SQLClientExtra	*x = EXTRA(self);
+  NSTimeInterval	old;
+  NSInteger		result;
+
+  [lock lock];
+  old = x->callTimeout;
+  x->callTimeout = (seconds > 0.0) ? seconds : 0.0;
+  NS_DURING
+    {
+      result = [self simpleExecute: info];
+    }
+  NS_HANDLER
+    {
+      x->callTimeout = old;
+      [lock unlock];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+  x->callTimeout = old;
+  [lock unlock];
+  return result;
+}
+
 - (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
 {
   return [self simpleQuery: stmt recordType: rClass listType: aClass];
@@ -2951,8 +5179,18 @@ static int	        poolConnections = 0;
 {
   NSMutableArray	*result = nil;
   NSString              *debug = nil;
+  NSArray               *info = nil;
   BOOL                  done = NO;
 
+  if ([stmt isKindOfClass: NSArrayClass] == YES)
+    {
+      info = (NSArray*)stmt;
+      stmt = [info objectAtIndex: 0];
+      if ([info count] < 2)
+        {
+          info = nil;
+        }
+    }
   if (rtype == 0) rtype = rClass;
   if (ltype == 0) ltype = aClass;
   [lock lock];
@@ -2969,7 +5207,20 @@ static int	        poolConnections = 0;
       NS_DURING
         {
           _lastStart = GSTickerTimeNow();
-          result = [self backendQuery: stmt recordType: rtype listType: ltype];
+	  [self _startDeadline];
+          if (nil == info)
+            {
+              result = [self backendQuery: stmt
+                               recordType: rtype
+                                 listType: ltype];
+            }
+          else
+            {
+              result = [self backendQueryPrepared: info
+                                       recordType: rtype
+                                         listType: ltype];
+            }
+	  [self _stopDeadline];
           _lastOperation = GSTickerTimeNow();
           if (_duration >= 0)
             {
@@ -2980,9 +5231,18 @@ static int	        poolConnections = 0;
                 {
 		  NSUInteger	count = [result count];
 
-                  debug = [NSString stringWithFormat:
-                    @"Duration %g for query %@;  produced %"PRIuPTR" record%s",
-		    d, stmt, count, ((1 == count) ? "" : "s")];
+                  if (YES == durationAsync)
+                    {
+                      durationPush(self, DurationQuery, stmt,
+                        fingerprint(stmt), d, count);
+                    }
+                  else
+                    {
+                      debug = [NSString stringWithFormat:
+                        @"Duration %g for query %@;  produced %"PRIuPTR
+                        @" record%s",
+                        d, stmt, count, ((1 == count) ? "" : "s")];
+                    }
                 }
             }
           if (_inTransaction == NO)
@@ -2992,24 +5252,37 @@ static int	        poolConnections = 0;
         }
       NS_HANDLER
         {
+          BOOL	timedOut = [self _stopDeadline];
+
           if (NO == _inTransaction)
             {
-              if ([[localException name] isEqual: SQLConnectionException])
+              if (NO == timedOut
+                && [[localException name] isEqual: SQLConnectionException])
                 {
                   /* A connection failure while not in a transaction ...
-                   * we can and should retry.
+                   * we can and should retry, as long as we can reconnect
+                   * (we fail at once if the circuit breaker is open).
                    */
-                  done = NO;
-                  if (nil != debug)
+                  if (YES == [self connect])
                     {
-                      NSLog(@"Will retry after: %@", localException);
+                      done = NO;
+                      if (nil != debug)
+                        {
+                          NSLog(@"Will retry after: %@", localException);
+                        }
                     }
-		  [self connect];
                 }
             }
           if (done)
             {
               [lock unlock];
+              if (YES == timedOut)
+                {
+                  [NSException raise: SQLTimeoutException
+                    format: @"Timed out after %g running query %@ (%@)",
+                    GSTickerTimeNow() - _lastStart, stmt,
+                    [localException reason]];
+                }
               [localException raise];
             }
         }
@@ -3023,98 +5296,55 @@ static int	        poolConnections = 0;
   return result;
 }
 
+- (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
+			timeout: (NSTimeInterval)seconds
+{
+  SQLClientExtra	*x = EXTRA(self);
+  NSTimeInterval	old;
+  NSMutableArray	*result;
+
+  [lock lock];
+  old = x->callTimeout;
+  x->callTimeout = (seconds > 0.0) ? seconds : 0.0;
+  NS_DURING
+    {
+      result = [self simpleQuery: stmt];
+    }
+  NS_HANDLER
+    {
+      x->callTimeout = old;
+      [lock unlock];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+  x->callTimeout = old;
+  [lock unlock];
+  return result;
+}
+
+- (NSTimeInterval) statementTimeout
+{
+  return EXTRA(self)->timeout;
+}
+
 - (BOOL) tryConnect
 {
   if (NO == connected)
     {
       [lock lock];
-      if (NO == connected)
+      if (NO == connected && YES == breakerAdmit(self))
 	{
 	  NS_DURING
 	    {
-	      NSTimeInterval	_lastListen = 0.0;
-
-              if (_connectFails > 1)
-                {
-                  NSTimeInterval	delay;
-                  NSTimeInterval	elapsed;
-
-                  /* If we have repeated connection failures, we enforce a
-                   * delay of up to 30 seconds between connection attempts
-                   * to avoid overloading the system with too frequent
-                   * connection attempts.
-                   */
-                  delay = (_connectFails < 30) ? _connectFails : 30;
-                  elapsed = GSTickerTimeNow() - _lastOperation;
-                  if (elapsed < delay)
-                    {
-                      [NSThread sleepForTimeInterval: delay - elapsed];
-                    }
-                }
-
+	      [self _connectDelay: YES];
 	      _lastStart = GSTickerTimeNow();
-	      if (YES == [self backendConnect])
-                {
-                  /* On establishing a new connection, we must restore any
-                   * listen instructions in the backend.
-                   */
-                  if (nil != _names)
-                    {
-                      NSEnumerator  *e;
-                      NSString      *n;
-
-		      _lastListen = GSTickerTimeNow();
-                      e = [_names objectEnumerator];
-                      while (nil != (n = [e nextObject]))
-                        {
-                          [self backendListen: [self quoteName: n]];
-                        }
-                    }
-                  _lastConnect = GSTickerTimeNow();
-                  _connectFails = 0;
-                }
-              else
-                {
-                  _lastOperation = GSTickerTimeNow();
-                  _connectFails++;
-                }
-
-	      if (_duration >= 0)
-		{
-		  NSTimeInterval	d;
-		  NSString		*s;
-
-		  if (0 == _connectFails)
-		    {
-		      s = @"success";
-		      d = _lastConnect - _lastStart;
-		    }
-		  else
-		    {
-		      s = @"failure";
-		      d = _lastOperation - _lastStart;
-		    }
-
-		  if (d >= _duration)
-		    {
-		      if (_lastListen > 0.0)
-			{
-			  [self debug: @"Duration %g for connection (%@)"
-			    @", of which %g adding observers.",
-			    d, s, _lastOperation - _lastListen];
-			}
-		      else
-			{
-			  [self debug: @"Duration %g for connection (%@).",
-			    d, s];
-			}
-		    }
-		}
+	      [self _didConnect: [self backendConnect]];
 	    }
 	  NS_HANDLER
 	    {
 	      _lastOperation = GSTickerTimeNow();
 	      _connectFails++;
+	      breakerRecord(self, NO);
 	      [lock unlock];
 	      [localException raise];
 	    }
@@ -3147,6 +5377,25 @@ static int	        poolConnections = 0;
 
 @implementation	SQLClient (Subclass)
 
++ (SQLClient*) registeredClient: (void*)client
+{
+  SQLClient	*c;
+
+  [clientsLock lock];
+  c = (SQLClient*)NSHashGet(clientsHash, client);
+  if (nil != c && NO == retainLive(c))
+    {
+      c = nil;
+    }
+  [clientsLock unlock];
+  return [c autorelease];
+}
+
+- (void) backendCancel
+{
+  return;
+}
+
 - (BOOL) backendConnect
 {
   [NSException raise: NSInternalInconsistencyException
@@ -3155,6 +5404,16 @@ static int	        poolConnections = 0;
   return NO;
 }
 
+- (SQLClientConnectState) backendConnectPoll: (int*)descriptor
+{
+  return SQLClientConnectFailed;
+}
+
+- (SQLClientConnectState) backendConnectStart: (int*)descriptor
+{
+  return SQLClientConnectBlocking;
+}
+
 - (void) backendDisconnect
 {
   [NSException raise: NSInternalInconsistencyException
@@ -3170,6 +5429,12 @@ static int	        poolConnections = 0;
   return -1;
 }
 
+- (BOOL) backendIsValid
+{
+  [self query: @"SELECT 1", nil];
+  return YES;
+}
+
 - (void) backendListen: (NSString*)name
 {
   return;
@@ -3193,11 +5458,42 @@ static int	        poolConnections = 0;
   return nil;
 }
 
+- (NSMutableArray*) backendQueryPrepared: (NSArray*)info
+			      recordType: (id)rtype
+				listType: (id)ltype
+{
+  NSString	*stmt;
+
+  info = [self inlineBoundArrays: info];
+  stmt = SQLClientUnProxyLiteral([info objectAtIndex: 0]);
+  if ([info count] > 1)
+    {
+      const char	*statement = [stmt UTF8String];
+      unsigned		length = strlen(statement);
+
+      statement = [self insertBLOBs: info
+		      intoStatement: statement
+			     length: length
+			 withMarker: "'?'''?'"
+			     length: 7
+			     giving: &length];
+      stmt = [[[NSString alloc] initWithBytes: statement
+				       length: length
+				     encoding: NSUTF8StringEncoding]
+	autorelease];
+    }
+  return [self backendQuery: stmt recordType: rtype listType: ltype];
+}
+
+- (BOOL) backendStartAsync: (SQLAsyncOperation*)op
+{
+  return NO;
+}
+
 - (void) backendUnlisten: (NSString*)name
 {
   return;
 }
-
 - (unsigned) copyEscapedBLOB: (NSData*)blob into: (void*)buf
 {
   [NSException raise: NSInternalInconsistencyException
@@ -3263,6 +5559,61 @@ static int	        poolConnections = 0;
   return statement;
 }
 
+- (NSArray*) inlineBoundArrays: (NSArray*)info
+{
+  NSUInteger		count = [info count];
+  NSMutableArray	*ma;
+  NSMutableString	*s;
+  NSUInteger		pos = 0;
+  NSUInteger		i;
+
+  for (i = 1; i < count; i++)
+    {
+      if ([[info objectAtIndex: i] isKindOfClass: [SQLBoundArray class]])
+	{
+	  break;
+	}
+    }
+  if (i == count)
+    {
+      return info;	// Nothing to do
+    }
+
+  s = [NSMutableString stringWithString:
+    SQLClientUnProxyLiteral([info objectAtIndex: 0])];
+  ma = [NSMutableArray arrayWithCapacity: count];
+  [ma addObject: s];
+  for (i = 1; i < count; i++)
+    {
+      id	o = [info objectAtIndex: i];
+      NSRange	r;
+
+      r = [s rangeOfString: @"'?'''?'"
+		   options: NSLiteralSearch
+		     range: NSMakeRange(pos, [s length] - pos)];
+      if (0 == r.length)
+	{
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"Missing marker for argument %"PRIuPTR
+	    @" of %@", i, s];
+	}
+      if ([o isKindOfClass: [SQLBoundArray class]])
+	{
+	  NSString	*q = [self quoteSet: [(SQLBoundArray*)o values]];
+
+	  [s replaceCharactersInRange: r withString: q];
+	  pos = r.location + [q length];
+	}
+      else
+	{
+	  [ma addObject: o];
+	  pos = NSMaxRange(r);
+	}
+    }
+  [ma replaceObjectAtIndex: 0 withObject: SQLClientProxyLiteral(s)];
+  return ma;
+}
+
 - (unsigned) lengthOfEscapedBLOB: (NSData*)blob
 {
   [NSException raise: NSInternalInconsistencyException
@@ -3272,6 +5623,93 @@ static int	        poolConnections = 0;
 }
 @end
 
+/* The maximum (approximate) size in bytes of the text of a multi-row insert
+ * built by -insert:into:columns:failures: or -addInsert:into:columns:, and
+ * the maximum number of rows in one (older SQLite versions limit a VALUES
+ * list to 500 rows).
+ */
+#define	INSERT_BUDGET	65536
+#define	INSERT_ROWS	500
+
+static NSString *
+insertPrefix(NSString *table, NSArray *columns)
+{
+  return [NSString stringWithFormat: @"INSERT INTO %@ (%@) VALUES ",
+    table, [columns componentsJoinedByString: @","]];
+}
+
+/* Builds a prepared multi-row insert for as many of the rows in range as
+ * fit within the budget (always at least one), setting range->length to
+ * the number of rows used.  BLOBs are passed out-of-line and are counted
+ * at twice their size to allow for escaping.
+ */
+static NSMutableArray *
+insertInfo(id db, NSString *prefix, NSArray *rows, NSUInteger columns,
+  NSRange *range)
+{
+  NSMutableArray	*info = [NSMutableArray arrayWithCapacity: 1];
+  NSMutableArray	*blobs = [NSMutableArray arrayWithCapacity: 4];
+  NSMutableString	*m = [NSMutableString stringWithCapacity: 4096];
+  NSMutableString	*v = [NSMutableString stringWithCapacity: 256];
+  NSUInteger		size = [prefix length];
+  NSUInteger		max = range->length;
+  NSUInteger		used = 0;
+
+  if (max > INSERT_ROWS)
+    {
+      max = INSERT_ROWS;
+    }
+  [m appendString: prefix];
+  while (used < max)
+    {
+      NSArray		*row = [rows objectAtIndex: range->location + used];
+      NSUInteger	rowSize = 0;
+      NSUInteger	i;
+
+      if ([row count] != columns)
+	{
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"Row %"PRIuPTR" has %"PRIuPTR
+	    @" values but %"PRIuPTR" columns were given",
+	    range->location + used, [row count], columns];
+	}
+      [blobs removeAllObjects];
+      [v setString: (used > 0) ? @",(" : @"("];
+      for (i = 0; i < columns; i++)
+	{
+	  id	q = [db quote: [row objectAtIndex: i]];
+
+	  if (i > 0)
+	    {
+	      [v appendString: @","];
+	    }
+	  if ([q isKindOfClass: [NSData class]])
+	    {
+	      [v appendString: @"'?'''?'"];
+	      [blobs addObject: q];
+	      rowSize += [(NSData*)q length] * 2;
+	    }
+	  else
+	    {
+	      [v appendString: q];
+	    }
+	}
+      [v appendString: @")"];
+      rowSize += [v length];
+      if (used > 0 && size + rowSize > INSERT_BUDGET)
+	{
+	  break;
+	}
+      [m appendString: v];
+      [info addObjectsFromArray: blobs];
+      size += rowSize;
+      used++;
+    }
+  range->length = used;
+  [info insertObject: SQLClientProxyLiteral(m) atIndex: 0];
+  return info;
+}
+
 @implementation	SQLClient (Private)
 
 - (void) _configure: (NSNotification*)n
@@ -3423,10 +5861,20 @@ static int	        poolConnections = 0;
         }
       [self setPassword: s];
 
-      if (nil == d && [o isKindOfClass: [NSDictionary class]])
-	{
-	  d = (NSDictionary*)o;
-	}
+      s = [d objectForKey: @"StatementTimeout"];
+      if (nil == s)
+        {
+          s = [o objectForKey: @"StatementTimeout"];
+        }
+      if ([s respondsToSelector: @selector(doubleValue)])
+        {
+          [self setStatementTimeout: [s doubleValue]];
+        }
+
+      if (nil == d && [o isKindOfClass: [NSDictionary class]])
+	{
+	  d = (NSDictionary*)o;
+	}
       [self setOptions: d];
     }
   NS_HANDLER
@@ -3438,6 +5886,170 @@ static int	        poolConnections = 0;
   [lock unlock];
 }
 
+- (BOOL) _connectDelay: (BOOL)shouldWait
+{
+  if (_connectFails > 1)
+    {
+      NSTimeInterval	delay;
+      NSTimeInterval	elapsed;
+
+      /* If we have repeated connection failures, we enforce a
+       * delay of up to 30 seconds between connection attempts
+       * to avoid overloading the system with too frequent
+       * connection attempts.
+       */
+      delay = (_connectFails < 30) ? _connectFails : 30;
+      elapsed = GSTickerTimeNow() - _lastOperation;
+      if (elapsed < delay)
+	{
+	  if (NO == shouldWait)
+	    {
+	      return NO;
+	    }
+	  [NSThread sleepForTimeInterval: delay - elapsed];
+	}
+    }
+  return YES;
+}
+
+- (void) _didConnect: (BOOL)ok
+{
+  NSTimeInterval	_lastListen = 0.0;
+
+  if (YES == ok)
+    {
+      /* On establishing a new connection, we must restore any
+       * listen instructions in the backend.
+       */
+      if (nil != _names)
+	{
+	  NSEnumerator  *e;
+	  NSString      *n;
+
+	  _lastListen = GSTickerTimeNow();
+	  e = [_names objectEnumerator];
+	  while (nil != (n = [e nextObject]))
+	    {
+	      [self backendListen: [self quoteName: n]];
+	    }
+	}
+      _lastConnect = GSTickerTimeNow();
+      _connectFails = 0;
+      [clientsLock lock];
+      idleInsert(self);
+      [clientsLock unlock];
+    }
+  else
+    {
+      _lastOperation = GSTickerTimeNow();
+      _connectFails++;
+    }
+
+  if (_duration >= 0)
+    {
+      NSTimeInterval	d;
+      NSString		*s;
+
+      if (0 == _connectFails)
+	{
+	  s = @"success";
+	  d = _lastConnect - _lastStart;
+	}
+      else
+	{
+	  s = @"failure";
+	  d = _lastOperation - _lastStart;
+	}
+
+      if (d >= _duration)
+	{
+	  if (_lastListen > 0.0)
+	    {
+	      [self debug: @"Duration %g for connection (%@)"
+		@", of which %g adding observers.",
+		d, s, _lastOperation - _lastListen];
+	    }
+	  else
+	    {
+	      [self debug: @"Duration %g for connection (%@).",
+		d, s];
+	    }
+	}
+    }
+  breakerRecord(self, ok);
+}
+
+- (NSUInteger) _insertRows: (NSArray*)rows
+		     range: (NSRange)r
+		    prefix: (NSString*)prefix
+		   columns: (NSUInteger)columns
+		  failures: (NSMutableIndexSet*)failures
+{
+  NSUInteger	inserted = 0;
+  NSUInteger	end = NSMaxRange(r);
+
+  while (r.location < end)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      NSRange		chunk = NSMakeRange(r.location, end - r.location);
+      NSArray		*info;
+      BOOL		failed = NO;
+
+      info = insertInfo(self, prefix, rows, columns, &chunk);
+      NS_DURING
+	{
+	  [self simpleExecute: info];
+	}
+      NS_HANDLER
+	{
+	  NSString	*n = [localException name];
+
+	  /* Inside a transaction a failure may have aborted the whole
+	   * transaction, and connection problems or timeouts are not
+	   * caused by the rows, so we can't isolate the failure.
+	   */
+	  if (YES == _inTransaction
+	    || YES == [n isEqual: SQLConnectionException]
+	    || YES == [n isEqual: SQLTimeoutException])
+	    {
+	      [localException retain];
+	      [arp release];
+	      [localException autorelease];
+	      [localException raise];
+	    }
+	  failed = YES;
+	}
+      NS_ENDHANDLER
+      if (NO == failed)
+	{
+	  inserted += chunk.length;
+	}
+      else if (1 == chunk.length)
+	{
+	  [failures addIndex: chunk.location];
+	}
+      else
+	{
+	  NSUInteger	half = chunk.length / 2;
+
+	  inserted += [self _insertRows: rows
+				  range: NSMakeRange(chunk.location, half)
+				 prefix: prefix
+				columns: columns
+			       failures: failures];
+	  inserted += [self _insertRows: rows
+				  range: NSMakeRange(chunk.location + half,
+				    chunk.length - half)
+				 prefix: prefix
+				columns: columns
+			       failures: failures];
+	}
+      r.location = NSMaxRange(chunk);
+      [arp release];
+    }
+  return inserted;
+}
+
 - (NSRecursiveLock*) _lock
 {
   return lock;
@@ -3446,9 +6058,14 @@ static int	        poolConnections = 0;
 - (void) _populateCache: (CacheQuery*)a
 {
   GSCache	*cache;
+  id		query = a->query;
   id		result;
 
-  result = [self simpleQuery: a->query
+  if ([query isKindOfClass: [SQLCacheKey class]])
+    {
+      query = ((SQLCacheKey*)query)->info;
+    }
+  result = [self simpleQuery: query
                   recordType: a->recordType
                     listType: a->listType];
   cache = [self cache];
@@ -3457,15 +6074,229 @@ static int	        poolConnections = 0;
 	  lifetime: a->lifetime];
 }
 
++ (id) _queryArgument: (NSMutableArray*)info
+{
+  return ([info count] > 1) ? (id)info : [info objectAtIndex: 0];
+}
+
 - (void) _recordMainThread
 {
   mainThread = [NSThread currentThread];
 }
 
+- (void) _startDeadline
+{
+  SQLClientExtra	*x = EXTRA(self);
+  NSTimeInterval	t;
+
+  t = (x->callTimeout >= 0.0) ? x->callTimeout : x->timeout;
+  if (t > 0.0)
+    {
+      [watchdogCondition lock];
+      x->deadline = _lastStart + t;
+      x->cancelled = NO;
+      NSHashInsert(watchdogClients, (void*)self);
+      if (NO == watchdogRunning)
+        {
+          watchdogRunning = YES;
+          [NSThread detachNewThreadSelector: @selector(_watchdog:)
+                                   toTarget: SQLClientClass
+                                 withObject: nil];
+        }
+      [watchdogCondition signal];
+      [watchdogCondition unlock];
+    }
+}
+
+- (BOOL) _stopDeadline
+{
+  SQLClientExtra	*x = EXTRA(self);
+  BOOL			cancelled = NO;
+
+  if (x->deadline > 0.0)
+    {
+      /* Taking the cancel lock means that any cancel the watchdog is
+       * sending is for this statement, and incrementing the sequence
+       * stops the watchdog from cancelling a later statement in error.
+       */
+      [x->cancelLock lock];
+      [watchdogCondition lock];
+      NSHashRemove(watchdogClients, (void*)self);
+      cancelled = x->cancelled;
+      x->deadline = 0.0;
+      x->cancelled = NO;
+      x->sequence++;
+      [watchdogCondition unlock];
+      [x->cancelLock unlock];
+      if (YES == cancelled && nil != _pool)
+        {
+          [_pool _countTimeout];
+        }
+    }
+  return cancelled;
+}
+
 + (void) _tick: (NSTimer*)t
 {
   (void) GSTickerTimeNow();
 }
+
++ (void) _durationWriter: (id)ignored
+{
+  uint64_t	reported = 0;
+
+  for (;;)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      NSUInteger	written = 0;
+      uint64_t		dropped;
+
+      for (;;)
+	{
+	  SQLDurationRecord	*r = &durationRing[durationTail & durationMask];
+	  NSString		*m;
+
+	  if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != durationTail + 1)
+	    {
+	      break;		// Nothing more in the ring
+	    }
+	  NS_DURING
+	    {
+	      m = durationFormat(r);
+	      NSLog(@"%@", m);
+	    }
+	  NS_HANDLER
+	    {
+	      NSLog(@"Problem writing duration log: %@", localException);
+	    }
+	  NS_ENDHANDLER
+	  DESTROY(r->client);
+	  DESTROY(r->text);
+	  __atomic_store_n(&r->seq, durationTail + durationMask + 1,
+	    __ATOMIC_RELEASE);
+	  durationTail++;
+	  written++;
+	}
+      dropped = __atomic_load_n(&durationDropped, __ATOMIC_RELAXED);
+      if (dropped > reported)
+	{
+	  NSLog(@"Duration logging dropped %"PRIu64" record%s (%"PRIu64
+	    " in total) because the buffer of %"PRIuPTR" was full",
+	    dropped - reported, ((dropped - reported == 1) ? "" : "s"),
+	    dropped, durationMask + 1);
+	  reported = dropped;
+	}
+      [arp release];
+      if (0 == written)
+	{
+	  /* Once asynchronous logging is turned off and everything has
+	   * been written, the thread can end.
+	   */
+	  [durationLock lock];
+	  if (NO == durationAsync
+	    && __atomic_load_n(&durationRing[durationTail & durationMask].seq,
+	      __ATOMIC_ACQUIRE) != durationTail + 1)
+	    {
+	      durationWriting = NO;
+	      [durationLock unlock];
+	      return;
+	    }
+	  [durationLock unlock];
+	  [NSThread sleepForTimeInterval: 0.1];
+	}
+    }
+}
+
++ (void) _watchdog: (id)ignored
+{
+  NSMutableArray	*expired = [NSMutableArray new];
+
+  [watchdogCondition lock];
+  for (;;)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      NSTimeInterval	now = GSTickerTimeNow();
+      NSTimeInterval	next = 0.0;
+      NSHashEnumerator	e;
+      SQLClient		*c;
+      NSUInteger	index;
+
+      e = NSEnumerateHashTable(watchdogClients);
+      while (nil != (c = (SQLClient*)NSNextHashEnumeratorItem(&e)))
+        {
+          SQLClientExtra	*x = EXTRA(c);
+
+          if (YES == x->cancelled)
+            {
+              continue;		// Already cancelled
+            }
+          if (x->deadline <= now)
+            {
+              x->cancelled = YES;
+              x->expired = x->sequence;
+              if (YES == retainLive(c))
+                {
+                  [expired addObject: c];
+                  [c release];
+                }
+            }
+          else if (0.0 == next || x->deadline < next)
+            {
+              next = x->deadline;
+            }
+        }
+      NSEndHashTableEnumeration(&e);
+
+      /* Cancelling talks to the database server, so we must not hold
+       * the lock while doing it (which would also stop other clients
+       * from starting or stopping their deadlines).  Instead we hold the
+       * cancel lock of the client and only cancel if the statement which
+       * expired is still the one in progress.
+       */
+      if ([expired count] > 0)
+        {
+          [watchdogCondition unlock];
+          for (index = 0; index < [expired count]; index++)
+            {
+              SQLClientExtra	*x;
+
+              c = [expired objectAtIndex: index];
+              x = EXTRA(c);
+              [x->cancelLock lock];
+              if (x->sequence == x->expired)
+                {
+                  NS_DURING
+                    {
+                      [c debug: @"Cancelling statement on %@ after %g",
+                        [c name], now - c->_lastStart];
+                      [c backendCancel];
+                    }
+                  NS_HANDLER
+                    {
+                      NSLog(@"Problem cancelling statement on %@: %@",
+                        [c name], localException);
+                    }
+                  NS_ENDHANDLER
+                }
+              [x->cancelLock unlock];
+            }
+          [expired removeAllObjects];
+          [watchdogCondition lock];
+          [arp release];
+          continue;		// Deadlines may have changed meanwhile
+        }
+      if (0.0 == next)
+        {
+          [watchdogCondition wait];
+        }
+      else
+        {
+          [watchdogCondition waitUntilDate:
+            [NSDate dateWithTimeIntervalSinceReferenceDate: next]];
+        }
+      [arp release];
+    }
+}
 @end
 
 @implementation	SQLClient (GSCacheDelegate)
@@ -3569,15 +6400,27 @@ static int	        poolConnections = 0;
   return [SQLClient columns: records];
 }
 
+- (NSUInteger) insert: (NSArray*)rows
+		 into: (NSString*)table
+	      columns: (NSArray*)columns
+	     failures: (NSMutableIndexSet*)failures
+{
+  return [self _insertRows: rows
+		     range: NSMakeRange(0, [rows count])
+		    prefix: insertPrefix(table, columns)
+		   columns: [columns count]
+		  failures: failures];
+}
+
 - (SQLRecord*) queryRecord: (NSString*)stmt, ...
 {
   va_list	ap;
   NSArray	*result = nil;
   SQLRecord	*record;
-  SQLLiteral    *query;
+  id		query;
 
   va_start (ap, stmt);
-  query = [[self prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [self prepare: stmt args: ap]];
   va_end (ap);
 
   result = [self simpleQuery: query];
@@ -3601,10 +6444,10 @@ static int	        poolConnections = 0;
   va_list	ap;
   NSArray	*result = nil;
   SQLRecord	*record;
-  SQLLiteral    *query;
+  id		query;
 
   va_start (ap, stmt);
-  query = [[self prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [self prepare: stmt args: ap]];
   va_end (ap);
 
   result = [self simpleQuery: query];
@@ -3695,7 +6538,9 @@ static int	        poolConnections = 0;
 
 - (NSMutableArray*) cacheCheckSimpleQuery: (NSString*)stmt
 {
-  NSMutableArray        *result = [[self cache] objectForKey: stmt];
+  NSMutableArray        *result;
+
+  result = [[self cache] objectForKey: cacheKey(stmt)];
 
   if (result != nil)
     {
@@ -3708,10 +6553,10 @@ static int	        poolConnections = 0;
 		    query: (NSString*)stmt,...
 {
   va_list	ap;
-  SQLLiteral    *query;
+  id		query;
 
   va_start (ap, stmt);
-  query = [[self prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [self prepare: stmt args: ap]];
   va_end (ap);
 
   return [self cache: seconds simpleQuery: query];
@@ -3721,9 +6566,9 @@ static int	        poolConnections = 0;
 		    query: (NSString*)stmt
 		     with: (NSDictionary*)values
 {
-  SQLLiteral    *query;
+  id		query;
 
-  query = [[self prepare: stmt with: values] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [self prepare: stmt with: values]];
   return [self cache: seconds simpleQuery: query];
 }
 
@@ -3744,6 +6589,7 @@ static int	        poolConnections = 0;
   NSMutableArray	*result;
   NSMutableDictionary	*md;
   GSCache		*c;
+  id			key = cacheKey(stmt);
   id			toCache;
   BOOL			cacheHit;
 
@@ -3764,7 +6610,7 @@ static int	        poolConnections = 0;
     }
   else
     {
-      result = [c objectForKey: stmt];
+      result = [c objectForKey: key];
     }
 
   if (result == nil)
@@ -3773,7 +6619,7 @@ static int	        poolConnections = 0;
 
       cacheHit = NO;
       a = [CacheQuery new];
-      a->query = [stmt copy];
+      a->query = [key copy];
       a->recordType = rtype;
       a->listType = ltype;
       a->lifetime = seconds;
@@ -3793,7 +6639,7 @@ static int	        poolConnections = 0;
 			      waitUntilDone: YES
 				      modes: queryModes];
 	}
-      result = [c objectForKey: stmt];
+      result = [c objectForKey: key];
     }
   else
     {
@@ -3803,14 +6649,14 @@ static int	        poolConnections = 0;
   if (seconds == 0)
     {
       // We have been told to remove the existing cached item.
-      [c setObject: nil forKey: stmt lifetime: seconds];
+      [c setObject: nil forKey: key lifetime: seconds];
       toCache = nil;
     }
 
   if (toCache != nil)
     {
       // We have a newly retrieved object ... cache it.
-      [c setObject: toCache forKey: stmt lifetime: seconds];
+      [c setObject: toCache forKey: key lifetime: seconds];
     }
 
   if (result != nil)
@@ -3956,67 +6802,304 @@ static int	        poolConnections = 0;
     }
 }
 
-- (void) addPrepared: (NSArray*)statement
+/* Adds the statement or transaction o to the failures transaction.
+ */
+- (void) _addFailure: (id)o to: (SQLTransaction*)failures
 {
-  [_lock lock];
-  [_info addObject: statement];
-  _count++;
-  [_lock unlock];
+  if ([o isKindOfClass: NSArrayClass] == YES)
+    {
+      [failures addPrepared: o];
+    }
+  else
+    {
+      [failures append: (SQLTransaction*)o];
+    }
 }
 
-- (void) _countLength: (unsigned*)length andArgs: (unsigned*)args
-{
-  unsigned      count = [_info count];
-  unsigned      index;
+/* Executes the items in range r of the receiver inside a savepoint in
+ * the current transaction of db.  If that fails, the savepoint is rolled
+ * back and the range is split in two to find the items which fail, so
+ * a batch of n items with k failures needs O(k log n) round trips.
+ * Failing items (and those not run because the receiver stops on the
+ * first failure) are added to failures.
+ * Returns the number of statements which succeeded.
+ */
+- (unsigned) _bisect: (NSRange)r
+		  db: (SQLClient*)db
+	    failures: (SQLTransaction*)failures
+		 log: (BOOL)log
+	     stopped: (BOOL*)stopped
+{
+  NSMutableArray	*info;
+  NSMutableString	*sql;
+  unsigned		total = 0;
+  unsigned		done;
+  NSUInteger		i;
+  BOOL			failed = NO;
+  id			o;
+
+  if (YES == *stopped)
+    {
+      for (i = r.location; i < NSMaxRange(r); i++)
+        {
+          [self _addFailure: [_info objectAtIndex: i] to: failures];
+        }
+      return 0;
+    }
 
-  for (index = 0; index < count; index++)
+  info = [NSMutableArray arrayWithCapacity: r.length + 1];
+  sql = [NSMutableString stringWithCapacity: 1024];
+  [info addObject: SQLClientProxyLiteral(sql)];
+  [sql appendString: @"savepoint sqlclient_batch;"];
+  for (i = r.location; i < NSMaxRange(r); i++)
     {
-      id        o = [_info objectAtIndex: index];
-
+      o = [_info objectAtIndex: i];
       if ([o isKindOfClass: NSArrayClass] == YES)
         {
           unsigned      c = [(NSArray*)o count];
 
           if (c > 0)
             {
-              length += [[(NSArray*)o objectAtIndex: 0] length] + 1;
-              args += c - 1;
+              unsigned  j;
+
+              [sql appendString: [(NSArray*)o objectAtIndex: 0]];
+              [sql appendString: @";"];
+              for (j = 1; j < c; j++)
+                {
+                  [info addObject: [(NSArray*)o objectAtIndex: j]];
+                }
             }
+          total++;
         }
       else
         {
-          [(SQLTransaction*)o _countLength: length andArgs: args];
+          [(SQLTransaction*)o _addSQL: sql andArgs: info];
+          total += [(SQLTransaction*)o totalCount];
         }
     }
-}
+  [sql appendString: @"release savepoint sqlclient_batch;"];
 
-- (void) add: (NSString*)stmt,...
-{
-  va_list               ap;
-  NSMutableArray        *p;
+  NS_DURING
+    {
+      [db simpleExecute: info];
+    }
+  NS_HANDLER
+    {
+      if ([[localException name] isEqual: SQLConnectionException])
+        {
+          [localException raise];	// Can't recover from this
+        }
+      if (1 == r.length && (log == YES || [db debugging] > 0))
+        {
+          [db debug: @"Failure of %"PRIuPTR" executing batch %@: %@",
+            r.location, self, localException];
+        }
+      failed = YES;
+    }
+  NS_ENDHANDLER
+  if (NO == failed)
+    {
+      return total;
+    }
 
-  va_start (ap, stmt);
-  p = [_owner prepare: stmt args: ap];
-  va_end (ap);
-  [self addPrepared: p];
-}
+  [db simpleExecute:
+    @"rollback to savepoint sqlclient_batch;"
+    @"release savepoint sqlclient_batch"];
+  if (r.length > 1)
+    {
+      NSUInteger	half = r.length / 2;
 
-- (void) add: (NSString*)stmt with: (NSDictionary*)values
-{
-  NSMutableArray        *p;
+      done = [self _bisect: NSMakeRange(r.location, half)
+			db: db
+		  failures: failures
+		       log: log
+		   stopped: stopped];
+      done += [self _bisect: NSMakeRange(r.location + half, r.length - half)
+			 db: db
+		   failures: failures
+			log: log
+		    stopped: stopped];
+      return done;
+    }
 
-  p = [_owner prepare: stmt with: values];
-  [self addPrepared: p];
+  o = [_info objectAtIndex: r.location];
+  if ([o isKindOfClass: NSArrayClass] == NO
+    && YES == ((SQLTransaction*)o)->_batch
+    && [(SQLTransaction*)o count] > 0)
+    {
+      SQLTransaction	*t = (SQLTransaction*)o;
+      BOOL		subStopped = NO;
+
+      /* A subsidiary batch may partially succeed.
+       */
+      done = [t _bisect: NSMakeRange(0, [t->_info count])
+		     db: db
+	       failures: failures
+		    log: log
+		stopped: &subStopped];
+    }
+  else
+    {
+      [self _addFailure: o to: failures];
+      done = 0;
+    }
+  if (done < total && YES == _stop)
+    {
+      *stopped = YES;
+    }
+  return done;
 }
 
-- (void) append: (SQLTransaction*)other
+/* Isolates the failures in a batch using savepoints within a single
+ * transaction, then commits the statements which succeeded.
+ * Returns NO (having rolled back) if this was not possible, in which
+ * case the caller should retry the statements individually.
+ */
+- (BOOL) _bisectUsing: (SQLClient*)db
+	     failures: (SQLTransaction*)failures
+		  log: (BOOL)log
+	     executed: (unsigned*)executed
 {
-  if (nil == other)
+  SQLTransaction	*found;
+  unsigned		done = 0;
+  BOOL			stopped = NO;
+  BOOL			ok = NO;
+
+  if (YES == [db isInTransaction])
     {
-      return;
+      return NO;
     }
-  NSAssert(other != self, NSInvalidArgumentException);
-  NSAssert([other isKindOfClass: [SQLTransaction class]],
+  found = [_owner transaction];
+  NS_DURING
+    {
+      [db begin];
+      done = [self _bisect: NSMakeRange(0, [_info count])
+			db: db
+		  failures: found
+		       log: log
+		   stopped: &stopped];
+      [db commit];
+      ok = YES;
+    }
+  NS_HANDLER
+    {
+      if (log == YES || [db debugging] > 0)
+        {
+          [db debug: @"Failure bisecting batch %@: %@", self, localException];
+        }
+      if (YES == [db isInTransaction])
+        {
+          NS_DURING
+            {
+              [db rollback];
+            }
+          NS_HANDLER
+            {
+              [db disconnect];
+              NSLog(@"Disconnected due to failed rollback after bisection");
+            }
+          NS_ENDHANDLER
+        }
+    }
+  NS_ENDHANDLER
+  if (YES == ok)
+    {
+      if (nil != failures)
+        {
+          NSUInteger	count = [found->_info count];
+          NSUInteger	i;
+
+          for (i = 0; i < count; i++)
+            {
+              [self _addFailure: [found->_info objectAtIndex: i]
+                             to: failures];
+            }
+        }
+      *executed = done;
+    }
+  return ok;
+}
+
+- (NSUInteger) addInsert: (NSArray*)rows
+		    into: (NSString*)table
+		 columns: (NSArray*)columns
+{
+  NSString	*prefix = insertPrefix(table, columns);
+  NSUInteger	count = [rows count];
+  NSUInteger	added = 0;
+  NSRange	r = NSMakeRange(0, count);
+
+  while (r.location < count)
+    {
+      r.length = count - r.location;
+      [self addPrepared: insertInfo(_owner, prefix, rows, [columns count], &r)];
+      r.location += r.length;
+      added++;
+    }
+  return added;
+}
+
+- (void) addPrepared: (NSArray*)statement
+{
+  [_lock lock];
+  [_info addObject: statement];
+  _count++;
+  [_lock unlock];
+}
+
+- (void) _countLength: (unsigned*)length andArgs: (unsigned*)args
+{
+  unsigned      count = [_info count];
+  unsigned      index;
+
+  for (index = 0; index < count; index++)
+    {
+      id        o = [_info objectAtIndex: index];
+
+      if ([o isKindOfClass: NSArrayClass] == YES)
+        {
+          unsigned      c = [(NSArray*)o count];
+
+          if (c > 0)
+            {
+              length += [[(NSArray*)o objectAtIndex: 0] length] + 1;
+              args += c - 1;
+            }
+        }
+      else
+        {
+          [(SQLTransaction*)o _countLength: length andArgs: args];
+        }
+    }
+}
+
+- (void) add: (NSString*)stmt,...
+{
+  va_list               ap;
+  NSMutableArray        *p;
+
+  va_start (ap, stmt);
+  p = [_owner prepare: stmt args: ap];
+  va_end (ap);
+  [self addPrepared: p];
+}
+
+- (void) add: (NSString*)stmt with: (NSDictionary*)values
+{
+  NSMutableArray        *p;
+
+  p = [_owner prepare: stmt with: values];
+  [self addPrepared: p];
+}
+
+- (void) append: (SQLTransaction*)other
+{
+  if (nil == other)
+    {
+      return;
+    }
+  NSAssert(other != self, NSInvalidArgumentException);
+  NSAssert([other isKindOfClass: [SQLTransaction class]],
     NSInvalidArgumentException);
   [other lock];
   [_lock lock];
@@ -4088,6 +7171,7 @@ static int	        poolConnections = 0;
   [_owner release]; _owner = nil;
   [_info release]; _info = nil;
   [_lock release]; _lock = nil;
+  [_updateCounts release]; _updateCounts = nil;
   [super dealloc];
 }
 
@@ -4248,7 +7332,16 @@ static int	        poolConnections = 0;
                   [db debug: @"Initial failure executing batch %@: %@",
                     self, localException];
                 }
-              if (_batch == YES)
+              if (_batch == YES && YES == _bisect
+                && YES == [self _bisectUsing: db
+                                    failures: failures
+                                         log: log
+                                    executed: &executed])
+                {
+                  /* Failures isolated using savepoints.
+                   */
+                }
+              else if (_batch == YES)
                 {
                   SQLTransaction	*wrapper = nil;
                   NSUInteger  		count = [_info count];
@@ -4431,7 +7524,19 @@ static int	        poolConnections = 0;
   [_lock lock];
   [_info removeAllObjects];
   _count = 0;
+  DESTROY(_updateCounts);
+  [_lock unlock];
+}
+
+- (BOOL) setBisectOnFailure: (BOOL)aFlag
+{
+  BOOL  old;
+
+  [_lock lock];
+  old = _bisect;
+  _bisect = (aFlag ? YES : NO);
   [_lock unlock];
+  return old;
 }
 
 - (BOOL) setResetOnExecute: (BOOL)aFlag
@@ -4483,6 +7588,16 @@ static int	        poolConnections = 0;
 {
   [_lock unlock];
 }
+
+- (NSArray*) updateCounts
+{
+  NSArray	*a;
+
+  [_lock lock];
+  a = [[_updateCounts retain] autorelease];
+  [_lock unlock];
+  return a;
+}
 @end
 
 
@@ -4679,6 +7794,282 @@ validName(NSString *name)
 }
 @end
 
+
+@implementation	SQLAsyncOperation
+
+- (SQLClient*) client
+{
+  return _client;
+}
+
+- (void) completeWithRecords: (NSMutableArray*)records
+		       count: (NSInteger)count
+		       error: (NSException*)error
+{
+  NSThread	*thread;
+
+  ASSIGN(_records, records);
+  ASSIGN(_error, error);
+  _count = (nil == error) ? count : -1;
+  if (nil != _pool)
+    {
+      /* The client is no longer in use, so make it available to
+       * other operations before calling the completion block.
+       */
+      [_pool swallowClient: _client];
+      DESTROY(_client);
+      DESTROY(_pool);
+    }
+  thread = _thread;
+  if (nil == thread)
+    {
+      [self _deliver];
+    }
+  else
+    {
+      if (YES == [thread isFinished])
+	{
+	  thread = [NSThread mainThread];
+	}
+      [self performSelector: @selector(_deliver)
+		   onThread: thread
+		 withObject: nil
+	      waitUntilDone: NO];
+    }
+}
+
+- (void) dealloc
+{
+  RELEASE(_client);
+  RELEASE(_pool);
+  RELEASE(_statement);
+  RELEASE(_thread);
+  RELEASE(_completion);
+  RELEASE(_records);
+  RELEASE(_error);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat: @"%@ %@ %@",
+    [super description], (YES == _query ? @"query" : @"execute"), _statement];
+}
+
+- (BOOL) isQuery
+{
+  return _query;
+}
+
+- (SQLLiteral*) statement
+{
+  return _statement;
+}
+@end
+
+@implementation	SQLAsyncOperation (Private)
+
+- (void) _deliver
+{
+  NS_DURING
+    {
+      if (YES == _query)
+	{
+	  CALL_BLOCK(((SQLClientQueryCompletion)_completion), _records, _error);
+	}
+      else
+	{
+	  CALL_BLOCK(((SQLClientExecuteCompletion)_completion), _count, _error);
+	}
+    }
+  NS_HANDLER
+    {
+      NSLog(@"Problem in completion of %@: %@", self, localException);
+    }
+  NS_ENDHANDLER
+}
+
+- (id) _initWithClient: (SQLClient*)client
+		  pool: (SQLClientPool*)pool
+	     statement: (SQLLitArg*)stmt
+		 query: (BOOL)isQuery
+		thread: (NSThread*)thread
+	    completion: (id)completion
+{
+  if (nil != (self = [super init]))
+    {
+      if ([stmt length] == 0)
+	{
+	  DESTROY(self);
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"Asynchronous operation with empty statement"];
+	}
+      _client = [client retain];
+      _pool = [pool retain];
+      _statement = (SQLLiteral*)[stmt copy];
+      _query = isQuery;
+      _thread = [thread retain];
+      _completion = [completion copy];
+    }
+  return self;
+}
+
+/* Perform the operation synchronously (in a worker thread) for a
+ * backend which does not support asynchronous operation.
+ */
+- (void) _run
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableArray	*records = nil;
+  NSInteger		count = -1;
+  NSException		*error = nil;
+
+  NS_DURING
+    {
+      if (YES == _query)
+	{
+	  records = [_client simpleQuery: _statement];
+	}
+      else
+	{
+	  count = [_client simpleExecute: [NSArray arrayWithObject: _statement]];
+	}
+    }
+  NS_HANDLER
+    {
+      error = localException;
+    }
+  NS_ENDHANDLER
+  [self completeWithRecords: records count: count error: error];
+  [arp release];
+}
+
+- (void) _setClient: (SQLClient*)client
+{
+  ASSIGN(_client, client);
+}
+
+/* Ask the backend to start the operation, queueing it for a worker
+ * thread if the backend can't do it asynchronously.  A new worker is
+ * started only if there are more queued operations than idle workers.
+ */
+- (void) _start
+{
+  BOOL	started = NO;
+
+  NS_DURING
+    {
+      started = [_client backendStartAsync: self];
+    }
+  NS_HANDLER
+    {
+      [self completeWithRecords: nil count: -1 error: localException];
+      started = YES;
+    }
+  NS_ENDHANDLER
+  if (NO == started)
+    {
+      [asyncCondition lock];
+      [asyncQueue addObject: self];
+      if ([asyncQueue count] > asyncIdle && asyncWorkers < ASYNC_WORKERS_MAX)
+	{
+	  asyncWorkers++;
+	  [NSThread detachNewThreadSelector: @selector(_worker:)
+				   toTarget: [SQLAsyncOperation class]
+				 withObject: nil];
+	}
+      [asyncCondition signal];
+      [asyncCondition unlock];
+    }
+}
+
++ (void) _worker: (id)ignored
+{
+  [asyncCondition lock];
+  for (;;)
+    {
+      NSAutoreleasePool		*arp = [NSAutoreleasePool new];
+      SQLAsyncOperation		*op;
+
+      while (0 == [asyncQueue count])
+	{
+	  BOOL	signalled;
+
+	  asyncIdle++;
+	  signalled = [asyncCondition waitUntilDate:
+	    [NSDate dateWithTimeIntervalSinceNow: ASYNC_WORKER_IDLE]];
+	  asyncIdle--;
+	  if (NO == signalled && 0 == [asyncQueue count])
+	    {
+	      asyncWorkers--;
+	      [asyncCondition unlock];
+	      [arp release];
+	      return;
+	    }
+	}
+      op = [[asyncQueue objectAtIndex: 0] retain];
+      [asyncQueue removeObjectAtIndex: 0];
+      [asyncCondition unlock];
+      [op _run];
+      [op release];
+      [arp release];
+      [asyncCondition lock];
+    }
+}
+@end
+
+@implementation	SQLClient (Asynchronous)
+
+- (void) execute: (SQLLitArg*)stmt
+      completion: (SQLClientExecuteCompletion)completion
+{
+  [self execute: stmt
+	 thread: [NSThread currentThread]
+     completion: completion];
+}
+
+- (void) execute: (SQLLitArg*)stmt
+	  thread: (NSThread*)thread
+      completion: (SQLClientExecuteCompletion)completion
+{
+  SQLAsyncOperation	*op;
+
+  op = [[SQLAsyncOperation alloc] _initWithClient: self
+					     pool: nil
+					statement: stmt
+					    query: NO
+					   thread: thread
+				       completion: (id)completion];
+  [op _start];
+  [op release];
+}
+
+- (void) query: (SQLLitArg*)stmt
+    completion: (SQLClientQueryCompletion)completion
+{
+  [self query: stmt
+       thread: [NSThread currentThread]
+   completion: completion];
+}
+
+- (void) query: (SQLLitArg*)stmt
+	thread: (NSThread*)thread
+    completion: (SQLClientQueryCompletion)completion
+{
+  SQLAsyncOperation	*op;
+
+  op = [[SQLAsyncOperation alloc] _initWithClient: self
+					     pool: nil
+					statement: stmt
+					    query: YES
+					   thread: thread
+				       completion: (id)completion];
+  [op _start];
+  [op release];
+}
+
+@end
+
 
 
 @implementation SQLDictionaryBuilder
@@ -4817,6 +8208,573 @@ validName(NSString *name)
 }
 @end
 
+/* The array used to hold the records produced by an SQLArenaBuilder.
+ * The records (and small values within them) are allocated from a
+ * non-freeable zone owned by the array, so building the result set
+ * does not need a malloc() per object and the memory of the whole
+ * set is returned to the system in one go when the last object in
+ * the zone has been deallocated.
+ */
+@interface	_SQLArenaArray : NSMutableArray
+{
+@public
+  NSZone	*arena;
+  id		*items;
+  NSUInteger	count;
+  NSUInteger	capacity;
+}
+@end
+
+@implementation	_SQLArenaArray
+
+- (void) addObject: (id)anObject
+{
+  [self insertObject: anObject atIndex: count];
+}
+
+- (NSUInteger) count
+{
+  return count;
+}
+
+- (void) dealloc
+{
+  NSUInteger	pos;
+
+  for (pos = 0; pos < count; pos++)
+    {
+      [items[pos] release];
+    }
+  if (0 != items)
+    {
+      NSZoneFree(NSDefaultMallocZone(), items);
+    }
+  if (0 != arena)
+    {
+      /* A non-freeable zone is only actually destroyed once every object
+       * allocated from it has been deallocated, so records which have been
+       * retained elsewhere remain valid after we are gone.
+       */
+      NSRecycleZone(arena);
+    }
+  [super dealloc];
+}
+
+- (id) init
+{
+  return [self initWithCapacity: 0];
+}
+
+- (id) initWithCapacity: (NSUInteger)c
+{
+  /* NB. We must not call the superclass initialiser as the abstract
+   * NSMutableArray implementation would call this method again.
+   */
+  if (c < 8)
+    {
+      c = 8;
+    }
+  capacity = c;
+  items = (id*)NSZoneMalloc(NSDefaultMallocZone(), capacity * sizeof(id));
+  arena = NSCreateZone(65536, 65536, NO);
+  return self;
+}
+
+- (void) insertObject: (id)anObject atIndex: (NSUInteger)index
+{
+  if (nil == anObject)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Attempt to insert nil object"];
+    }
+  if (index > count)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Array index too large"];
+    }
+  if (count == capacity)
+    {
+      capacity += (capacity / 2);
+      items = (id*)NSZoneRealloc(NSDefaultMallocZone(), items,
+	capacity * sizeof(id));
+    }
+  if (index < count)
+    {
+      memmove(&items[index + 1], &items[index], (count - index) * sizeof(id));
+    }
+  items[index] = [anObject retain];
+  count++;
+}
+
+- (id) objectAtIndex: (NSUInteger)index
+{
+  if (index >= count)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Array index too large"];
+    }
+  return items[index];
+}
+
+- (void) removeLastObject
+{
+  if (0 == count)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Attempt to remove from empty array"];
+    }
+  [items[--count] release];
+}
+
+- (void) removeObjectAtIndex: (NSUInteger)index
+{
+  id	o;
+
+  if (index >= count)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Array index too large"];
+    }
+  o = items[index];
+  count--;
+  if (index < count)
+    {
+      memmove(&items[index], &items[index + 1], (count - index) * sizeof(id));
+    }
+  [o release];
+}
+
+- (void) replaceObjectAtIndex: (NSUInteger)index withObject: (id)anObject
+{
+  id	o;
+
+  if (nil == anObject)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Attempt to replace with nil object"];
+    }
+  if (index >= count)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Array index too large"];
+    }
+  o = items[index];
+  items[index] = [anObject retain];
+  [o release];
+}
+
+@end
+
+@interface	SQLArenaBuilder (Private)
+- (void) _reset: (NSUInteger)c;
+@end
+
+@implementation SQLArenaBuilder
+- (void) addObject: (id)anObject
+{
+  return;
+}
+
+- (id) alloc
+{
+  return [self retain];
+}
+
+- (NSMutableArray*) content
+{
+  return content;
+}
+
+- (NSUInteger) count
+{
+  return [content count];
+}
+
+- (void) dealloc
+{
+  [self _reset: 0];
+  [content release];
+  [super dealloc];
+}
+
+- (id) initWithCapacity: (NSUInteger)capacity
+{
+  if (nil != (self = [super init]))
+    {
+      [self _reset: 0];
+      DESTROY(content);
+      content = [[_SQLArenaArray alloc] initWithCapacity: capacity];
+    }
+  return self;
+}
+
+- (id) mutableCopyWithZone: (NSZone*)aZone
+{
+  return [content mutableCopyWithZone: aZone];
+}
+
+- (id) newWithValues: (id*)values
+		keys: (NSString**)k
+	       count: (unsigned int)c
+{
+  NSUInteger	pos;
+
+  /* The same key names are passed for every record in a query, so we
+   * only need to build a new keys object if the names have changed.
+   */
+  pos = (nil == keys || [keys count] != c) ? 0 : c;
+  while (pos > 0 && k[pos - 1] == names[pos - 1])
+    {
+      pos--;
+    }
+  if (nil == keys || pos > 0)
+    {
+      [self _reset: c];
+      keys = [[SQLRecordKeys keysWithNames: k count: c] retain];
+      memcpy(names, k, c * sizeof(id));
+    }
+  return [self newWithValues: values keys: keys];
+}
+
+- (id) newWithValues: (id*)values keys: (SQLRecordKeys*)k
+{
+  NSZone	*z = ((_SQLArenaArray*)content)->arena;
+  NSUInteger	c = [k count];
+  id		vals[c];
+  id		record;
+  NSUInteger	pos;
+
+  if (k != keys)
+    {
+      [self _reset: c];
+      keys = [k retain];
+      [[keys order] getObjects: names];
+    }
+  for (pos = 0; pos < c; pos++)
+    {
+      id	v = values[pos];
+
+      if (v == last[pos])
+	{
+	  /* Same object as in the previous record, so we can share the copy
+	   * we made for that.
+	   */
+	  vals[pos] = copies[pos];
+	  continue;
+	}
+      [last[pos] release];
+      last[pos] = [v retain];
+      [copies[pos] release];
+      if (nil == v)
+	{
+	  v = [null retain];
+	}
+      else
+	{
+	  v = newValueInZone(v, z);
+	}
+      vals[pos] = copies[pos] = v;
+    }
+  record = [rClass newWithValues: vals keys: k zone: z];
+  [content addObject: record];
+  return record;
+}
+
+/* Discard cached keys and value copies, and prepare buffers for records
+ * with c fields.
+ */
+- (void) _reset: (NSUInteger)c
+{
+  NSUInteger	pos;
+
+  for (pos = 0; pos < columns; pos++)
+    {
+      [last[pos] release];
+      [copies[pos] release];
+    }
+  DESTROY(keys);
+  if (0 != names)
+    {
+      NSZoneFree(NSDefaultMallocZone(), names);
+      names = 0;
+    }
+  columns = c;
+  if (c > 0)
+    {
+      names = (id*)NSZoneCalloc(NSDefaultMallocZone(), c * 3, sizeof(id));
+      last = names + c;
+      copies = last + c;
+    }
+  else
+    {
+      last = copies = 0;
+    }
+}
+@end
+
+@implementation SQLPackedArray
+
+- (const void*) bytes
+{
+  const char	*b = (const char*)[data bytes];
+
+  if ('d' == *type)
+    {
+      return b + offset * sizeof(double);
+    }
+  return b + offset * sizeof(long long);
+}
+
+- (id) copyWithZone: (NSZone*)z
+{
+  return [self retain];
+}
+
+- (NSUInteger) count
+{
+  return (0 == dimensions) ? 0 : sizes[0];
+}
+
+- (void) dealloc
+{
+  DESTROY(data);
+  if (0 != sizes)
+    {
+      NSZoneFree(NSDefaultMallocZone(), sizes);
+      sizes = 0;
+    }
+  [super dealloc];
+}
+
+- (NSUInteger) dimensions
+{
+  return dimensions;
+}
+
+- (id) init
+{
+  return [self initWithData: nil
+		   objCType: @encode(long long)
+		 dimensions: 0
+		      sizes: 0];
+}
+
+- (id) initWithData: (NSData*)d
+	   objCType: (const char*)t
+	 dimensions: (NSUInteger)count
+	      sizes: (const NSUInteger*)s
+{
+  NSUInteger	total = 1;
+  NSUInteger	i;
+
+  if (strcmp(t, @encode(long long)) == 0)
+    {
+      type = @encode(long long);
+    }
+  else if (strcmp(t, @encode(double)) == 0)
+    {
+      type = @encode(double);
+    }
+  else
+    {
+      DESTROY(self);
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Unsupported packed array type '%s'", t];
+    }
+  for (i = 0; i < count; i++)
+    {
+      total *= s[i];
+    }
+  if (0 == count)
+    {
+      total = 0;
+    }
+  if ([d length] < total * (('d' == *type) ? sizeof(double)
+    : sizeof(long long)))
+    {
+      DESTROY(self);
+      [NSException raise: NSInvalidArgumentException
+		  format: @"Packed array data too short for dimensions"];
+    }
+  ASSIGN(data, d);
+  dimensions = count;
+  if (count > 0)
+    {
+      sizes = (NSUInteger*)NSZoneMalloc(NSDefaultMallocZone(),
+	count * sizeof(NSUInteger));
+      memcpy(sizes, s, count * sizeof(NSUInteger));
+      stride = (0 == sizes[0]) ? 0 : total / sizes[0];
+    }
+  return self;
+}
+
+- (id) objectAtIndex: (NSUInteger)index
+{
+  if (index >= [self count])
+    {
+      [NSException raise: NSRangeException
+		  format: @"Array index too large"];
+    }
+  if (dimensions > 1)
+    {
+      SQLPackedArray	*a;
+
+      /* Return a sub-array sharing the packed data of the receiver.
+       */
+      a = [[SQLPackedArray alloc] initWithData: data
+				      objCType: type
+				    dimensions: dimensions - 1
+					 sizes: sizes + 1];
+      a->offset = offset + index * stride;
+      return [a autorelease];
+    }
+  else
+    {
+      char	buf[32];
+      int	len;
+
+      if ('d' == *type)
+	{
+	  double	d = ((const double*)[self bytes])[index];
+
+	  /* Use the shortest representation which reads back the same.
+	   */
+	  len = snprintf(buf, sizeof(buf), "%.15g", d);
+	  if (strtod(buf, 0) != d)
+	    {
+	      len = snprintf(buf, sizeof(buf), "%.17g", d);
+	    }
+	}
+      else
+	{
+	  len = snprintf(buf, sizeof(buf), "%lld",
+	    ((const long long*)[self bytes])[index]);
+	}
+      return [SQLClientNewLiteral(buf, (unsigned)len) autorelease];
+    }
+}
+
+- (const char*) objCType
+{
+  return type;
+}
+
+- (NSUInteger) sizeInBytesExcluding: (NSHashTable*)exclude
+{
+  static NSUInteger     (*imp)(id,SEL,id) = 0;
+  NSUInteger            size;
+
+  /* We use the NSObject implementation to get the memory used, since
+   * the NSArray one would create an object for every value.
+   */
+  if (0 == imp)
+    {
+      imp = (NSUInteger(*)(id,SEL,id))
+        [NSObject instanceMethodForSelector: _cmd];
+    }
+  size = (*imp)(self, _cmd, exclude);
+  if (size > 0)
+    {
+      size += dimensions * sizeof(NSUInteger);
+      size += [data sizeInBytesExcluding: exclude];
+    }
+  return size;
+}
+
+- (NSUInteger) sizeOfDimension: (NSUInteger)dimension
+{
+  return (dimension < dimensions) ? sizes[dimension] : 0;
+}
+
+- (NSUInteger) valueCount
+{
+  return (0 == dimensions) ? 0 : stride * sizes[0];
+}
+@end
+
+@implementation SQLBoundArray
+
++ (SQLBoundArray*) boundArray: (id)arrayOrSet
+{
+  return [[[self alloc] initWithValues: arrayOrSet] autorelease];
+}
+
+- (NSUInteger) count
+{
+  return [values count];
+}
+
+- (void) dealloc
+{
+  [values release];
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat: @"%@ %@",
+    [super description], values];
+}
+
+- (NSUInteger) hash
+{
+  NSUInteger	count = [values count];
+  NSUInteger	hash = 2166136261U;
+  NSUInteger	index;
+
+  /* -[NSArray hash] is just the count in GNUstep, so we combine the
+   * hashes of the values so that bound arrays can be used in cache keys.
+   */
+  for (index = 0; index < count; index++)
+    {
+      hash = (hash ^ [[values objectAtIndex: index] hash]) * 16777619U;
+    }
+  return hash;
+}
+
+- (id) initWithValues: (id)arrayOrSet
+{
+  if (nil != (self = [super init]))
+    {
+      if ([arrayOrSet isKindOfClass: NSArrayClass])
+	{
+	  values = [arrayOrSet copy];
+	}
+      else if ([arrayOrSet isKindOfClass: NSSetClass])
+	{
+	  values = [[arrayOrSet allObjects] retain];
+	}
+      else
+	{
+	  [self release];
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"[SQLBoundArray-initWithValues:] argument"
+	    @" is not an array or set"];
+	}
+    }
+  return self;
+}
+
+- (BOOL) isEqual: (id)other
+{
+  if (other == self)
+    {
+      return YES;
+    }
+  if ([other isKindOfClass: [SQLBoundArray class]] == NO)
+    {
+      return NO;
+    }
+  return [values isEqual: ((SQLBoundArray*)other)->values];
+}
+
+- (NSArray*) values
+{
+  return values;
+}
+
+@end
+
 @implementation	SQLClientPool (Adjust)
 
 + (void) _adjustPoolConnections: (int)n
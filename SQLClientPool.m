@@ -35,17 +35,47 @@
 #import	<Foundation/NSString.h>
 #import	<Foundation/NSThread.h>
 #import	<Foundation/NSUserDefaults.h>
+#import	<Foundation/NSValue.h>
 
 #import	<Performance/GSCache.h>
+#import	<Performance/GSTicker.h>
+
+#include	<string.h>
+
 #import	"SQLClient.h"
 
+/* How often (in seconds) adaptive sizing checks the pool statistics.
+ */
+#define	ADAPT_INTERVAL	10.0
+
 struct _SQLClientPoolItem {
     SQLClient           *c;     /** The clients of the pool. */
     NSThread            *o;     /** The thread owning the client */
     NSUInteger          u;      /** Count of client usage. */
     NSTimeInterval      t;      /** When client was removed from pool. */
+    int                 p;      /** Priority class of user (or -1). */
+};
+
+struct _SQLClientPoolClass {
+    int                 reserve;        /** Clients reserved for the class */
+    int                 share;          /** Maximum percentage of the pool */
+    uint64_t            immediate;      /** Immediate client provisions */
+    uint64_t            delayed;        /** Count of delayed provisions */
+    uint64_t            failed;         /** Count of timed out provisions */
+    NSTimeInterval      longest;        /** Longest delay */
+    NSTimeInterval      delayWaits;     /** Time waiting for provisions */
+    NSTimeInterval      failWaits;      /** Time waiting for timeouts */
+};
+
+struct _SQLClientPoolWaiter {
+    NSInteger           ticket;         /** Identifies the waiting request */
+    int                 priority;       /** Priority class of the request */
+    NSTimeInterval      end;            /** When the request times out */
 };
 
+static NSString *priorityNames[SQLClientPriorityCount]
+  = { @"High", @"Normal", @"Low" };
+
 @interface      SQLClient(Pool)
 - (void) _clearPool: (SQLClientPool*)p;
 @end
@@ -64,17 +94,79 @@ struct _SQLClientPoolItem {
 @end
 
 @interface SQLClientPool (Private)
+- (void) _adapt;
+- (void) _dequeue: (NSInteger)ticket;
+- (NSInteger) _enqueue: (int)priority until: (NSTimeInterval)end;
+- (void) _health: (id)ignored;
+- (SQLClient*) _leased;
 - (void) _lock;
+- (NSInteger) _next;
+- (SQLClient*) _provide;
 - (NSString*) _rc: (SQLClient*)o;
+- (void) _release: (NSArray*)clients;
+- (NSMutableArray*) _reserve: (BOOL)connected
+			idle: (NSTimeInterval)age
+		       limit: (int)limit;
+- (void) _resize: (int)size reason: (NSString*)reason;
+- (void) _startAsync: (SQLAsyncOperation*)op;
+- (void) _startPendingAsync;
+- (void) _swallow: (SQLClient*)client;
 - (void) _unlock;
 @end
 
+/* An instance of this class records a client leased to a thread by the
+ * -lease method, and returns the client to the pool when deallocated
+ * (as the autorelease pool containing it is emptied).
+ */
+@interface	SQLClientLease : NSObject
+{
+@public
+  SQLClientPool	*pool;
+  SQLClient	*client;
+  NSString	*key;
+}
+@end
+
+@implementation	SQLClientLease
+
+- (void) dealloc
+{
+  NSMutableDictionary	*d = [[NSThread currentThread] threadDictionary];
+
+  if ([[d objectForKey: key] nonretainedObjectValue] == self)
+    {
+      [d removeObjectForKey: key];
+    }
+  [pool swallowClient: client];
+  DESTROY(client);
+  DESTROY(pool);
+  DESTROY(key);
+  [super dealloc];
+}
+
+@end
+
+@interface	SQLAsyncOperation (Private)
+- (id) _initWithClient: (SQLClient*)client
+		  pool: (SQLClientPool*)pool
+	     statement: (SQLLitArg*)stmt
+		 query: (BOOL)isQuery
+		thread: (NSThread*)thread
+	    completion: (id)completion;
+- (void) _setClient: (SQLClient*)client;
+- (void) _start;
+@end
+
 @interface      SQLTransaction (Creation)
 + (SQLTransaction*) _transactionUsing: (id)clientOrPool
                                 batch: (BOOL)isBatched
                                  stop: (BOOL)stopOnFailure;
 @end
 
+@interface	SQLClient (Private)
++ (id) _queryArgument: (NSMutableArray*)info;
+@end
+
 @implementation	SQLClientPool
 
 #if     defined(GNUSTEP)
@@ -89,13 +181,18 @@ static Class      cls = Nil;
 }
 #endif
 
+- (NSTimeInterval) adaptiveTarget
+{
+  return _adaptTarget;
+}
+
 - (int) availableConnections
 {
   int   available;
   int   index;
 
   [self _lock];
-  available = index = _max;
+  available = index = _size;
   while (index-- > 0)
     {
       if (_items[index].u > 0)
@@ -164,6 +261,11 @@ static Class      cls = Nil;
   DESTROY(_lock);
   DESTROY(_config);
   DESTROY(_name);
+  DESTROY(_asyncPending);
+  DESTROY(_leaseKey);
+  DESTROY(_priorityKey);
+  free(_classes);
+  free(_waiters);
   [SQLClientPool _adjustPoolConnections: -count];
   [super dealloc];
 }
@@ -173,6 +275,11 @@ static Class      cls = Nil;
   return [NSString stringWithFormat: @"%@ '%@'", [super description], _name];
 }
 
+- (int) effectiveConnections
+{
+  return _size;
+}
+
 - (id) initWithConfiguration: (NSDictionary*)config
 			name: (NSString*)reference
                          max: (int)maxConnections
@@ -180,6 +287,8 @@ static Class      cls = Nil;
 {
   if (nil != (self = [super init]))
     {
+      int       index;
+
       if (nil == config)
         {
           config = (NSDictionary*)[NSUserDefaults standardUserDefaults];
@@ -194,12 +303,43 @@ static Class      cls = Nil;
             }
         }
       ASSIGNCOPY(_name, reference);
+      _leaseKey = [[NSString alloc] initWithFormat:
+        @"SQLClientPool-%p", self];
+      _priorityKey = [[NSString alloc] initWithFormat:
+        @"SQLClientPoolPriority-%p", self];
+      _classes = calloc(SQLClientPriorityCount, sizeof(SQLClientPoolClass));
+      for (index = 0; index < SQLClientPriorityCount; index++)
+        {
+          _classes[index].share = 100;
+        }
+      _ticket = 1;
       _lock = [[NSConditionLock alloc] initWithCondition: 0];
       [self setMax: maxConnections min: minConnections];
     }
   return self;
 }
 
+- (SQLClient*) lease
+{
+  SQLClient     *client = [self _leased];
+
+  if (nil == client)
+    {
+      SQLClientLease    *l;
+
+      client = [self provideClient];
+      l = [SQLClientLease new];
+      l->pool = [self retain];
+      l->client = [client retain];
+      l->key = [_leaseKey retain];
+      [[[NSThread currentThread] threadDictionary]
+        setObject: [NSValue valueWithNonretainedObject: l]
+           forKey: _leaseKey];
+      [l autorelease];
+    }
+  return client;
+}
+
 - (NSString*) longDescription
 {
   NSMutableString	*s = [[NSMutableString new] autorelease];
@@ -212,6 +352,11 @@ static Class      cls = Nil;
   return s;
 }
 
+- (NSTimeInterval) healthCheck
+{
+  return _healthInterval;
+}
+
 - (int) maxConnections
 {
   return _max;
@@ -227,6 +372,24 @@ static Class      cls = Nil;
   return  _name;
 }
 
+- (int) priorityReserve: (SQLClientPriority)priority
+{
+  if ((int)priority < 0 || priority >= SQLClientPriorityCount)
+    {
+      return 0;
+    }
+  return _classes[priority].reserve;
+}
+
+- (int) priorityShare: (SQLClientPriority)priority
+{
+  if ((int)priority < 0 || priority >= SQLClientPriorityCount)
+    {
+      return 0;
+    }
+  return _classes[priority].share;
+}
+
 - (SQLClient*) provideClient
 {
   return [self provideClientBeforeDate: nil exclusive: NO];
@@ -238,66 +401,77 @@ static Class      cls = Nil;
 }
 
 - (SQLClient*) provideClientBeforeDate: (NSDate*)when exclusive: (BOOL)isLocal
+{
+  return [self provideClientBeforeDate: when
+                             exclusive: isLocal
+                              priority: [self threadPriority]];
+}
+
+- (SQLClient*) provideClientBeforeDate: (NSDate*)when
+			     exclusive: (BOOL)isLocal
+			      priority: (SQLClientPriority)priority
 {
   NSThread              *thread = [NSThread currentThread];
   NSTimeInterval        start = [NSDate timeIntervalSinceReferenceDate];
   NSTimeInterval        now = start;
+  NSTimeInterval        end;
+  SQLClientPoolClass    *pc;
   SQLClient             *client = nil;
+  NSInteger             ticket;
   int                   preferred = -1;
   int                   found = -1;
-  int                   cond = 0;
   int                   index;
 
+  if ((int)priority < 0 || priority >= SQLClientPriorityCount)
+    {
+      priority = SQLClientPriorityNormal;
+    }
+  pc = &_classes[priority];
+
+  /* If we haven't been given a timeout, we should wait for a client
+   * indefinitely ... so we set the timeout to be in the distant future.
+   */
+  if (nil == when)
+    {
+      static NSDate     *future = nil;
+
+      if (nil == future)
+        {
+          future = RETAIN([NSDate distantFuture]);
+        }
+      when = future;
+    }
+  end = [when timeIntervalSinceReferenceDate];
+
+  [_lock lock];
+
   /* If this is a request for a non-exclusive connection, we can simply
-   * check to see if there's already such a connection available.
+   * check to see if there's already such a connection in use by the
+   * current thread (this does not take another client from the pool,
+   * so the request need not wait its turn).
    */
   if (NO == isLocal)
     {
-      [_lock lock];
       for (index = 0; index < _max; index++)
         {
           if (_items[index].o == thread && _items[index].u < NSNotFound
             && NO == [_items[index].c isInTransaction])
             {
-              preferred = index;        // Ignore any other connected client
+              found = index;
               break;
             }
-          if (nil == _items[index].o && 0 == _items[index].u)
-            {
-              if (preferred < 0 && YES == [_items[index].c connected])
-                {
-                  preferred = index;
-                }
-              else
-                {
-                  found = index;
-                }
-            }
-        }
-      if (preferred >= 0)
-        {
-          found = preferred;    // Prefer a connected client.
         }
       if (found >= 0)
         {
+          /* We have already provided this client, so we must retain it
+           * before we autorelease it, to keep retain counts  in sync.
+           */
           _items[found].t = now;
-          if (0 == _items[found].u++)
-            {
-              ASSIGN(_items[found].o, thread);
-              client = [_items[found].c autorelease];
-            }
-          else
-            {
-              /* We have already provided this client, so we must retain it
-               * before we autorelease it, to keep retain counts  in sync.
-               */
-              client = [[_items[found].c retain] autorelease];
-            }
+          _items[found].u++;
+          client = [[_items[found].c retain] autorelease];
           _immediate++;
-        }
-      [self _unlock];
-      if (nil != client)
-        {
+          pc->immediate++;
+          [self _unlock];
           if (_debugging > 2)
             {
               NSLog(@"%@ provides %p%@",
@@ -307,33 +481,22 @@ static Class      cls = Nil;
         }
     }
 
-  /* If we haven't been given a timeout, we should wait for a client
-   * indefinitely ... so we set the timeout to be in the distant future.
-   */
-  if (nil == when)
-    {
-      static NSDate     *future = nil;
-
-      if (nil == future)
-        {
-          future = RETAIN([NSDate distantFuture]);
-        }
-      when = future;
-    }
-
-  /* We want to log stuff if we don't get a client quickly.
-   * Ideally we get the lock straight away,
-   * but if not we want to log every ten seconds (and possibly
-   * when we begin waiting).
+  /* Join the queue of requests waiting for a client.  Whenever the pool
+   * is unlocked, the lock condition is set to the ticket of the first
+   * request in the queue which may be given a client, so we get the lock
+   * with our ticket as the condition when it is our turn.
    */
-  if (YES == [_lock tryLockWhenCondition: 1])
+  ticket = [self _enqueue: priority until: end];
+  if (ticket == [self _next])
     {
       _immediate++;
+      pc->immediate++;
     }
   else
     {
-      NSTimeInterval    end = [when timeIntervalSinceReferenceDate];
       NSTimeInterval    dif = 0.0;
+      NSTimeInterval    slice = 10.0;
+      NSTimeInterval    logAt = start + 10.0;
       NSDate            *until;
       BOOL              locked;
 
@@ -341,44 +504,84 @@ static Class      cls = Nil;
         {
           NSLog(@"%@ has no clients available", self);
         }
+      [self _unlock];
+
+      /* We want to log stuff if we don't get a client quickly,
+       * so we log every ten seconds while we wait.  With adaptive
+       * sizing we also wake often enough to grow the pool as soon as
+       * we have waited longer than the target.
+       */
+      if (_adaptTarget > 0.0 && _adaptTarget < slice)
+        {
+          slice = _adaptTarget;
+        }
       until = [[NSDate alloc]
-        initWithTimeIntervalSinceReferenceDate: now + 10.0];
+        initWithTimeIntervalSinceReferenceDate: now + slice];
       locked = NO;
       while (NO == locked && now < end)
         {
-          if (now >= end)
-            {
-              /* End date is passed ... try to get the lock immediately.
-               */
-              locked = [_lock tryLockWhenCondition: 1];
-            }
-          else if ([when earlierDate: until] == until)
+          if ([when earlierDate: until] == until)
             { 
-              locked = [_lock lockWhenCondition: 1 beforeDate: until];
+              locked = [_lock lockWhenCondition: ticket beforeDate: until];
             }
           else
             { 
-              locked = [_lock lockWhenCondition: 1 beforeDate: when];
+              locked = [_lock lockWhenCondition: ticket beforeDate: when];
             }
           now = [NSDate timeIntervalSinceReferenceDate];
           dif = now - start;
           if (NO == locked && now < end)
             {
-              if (_debugging > 0 || dif > 30.0
-                || (_duration >= 0.0 && dif > _duration))
+              if (now >= logAt && (_debugging > 0 || dif > 30.0
+                || (_duration >= 0.0 && dif > _duration)))
                 {
                   NSLog(@"%@ still waiting after %g seconds:\n%@",
                     self, dif, [self status]);
+                  logAt = now + 10.0;
+                }
+              if (_adaptTarget > 0.0 && dif > _adaptTarget)
+                {
+                  /* No client has been returned to the pool for so long
+                   * that we can't wait for the next regular check.
+                   */
+                  [_lock lock];
+                  if (_size < _max)
+                    {
+                      [self _resize: _size + (_size + 3) / 4
+                             reason: [NSString stringWithFormat:
+                        @"provision waiting for %g seconds", dif]];
+                    }
+                  [self _unlock];
                 }
               [until release];
-              until = [[NSDate alloc] initWithTimeIntervalSinceNow: 10.0];
+              until = [[NSDate alloc] initWithTimeIntervalSinceNow: slice];
             }
         }
       [until release];
+      if (NO == locked)
+        {
+          /* Our time is up, but it may have become our turn just now,
+           * so we check once more before giving up.
+           */
+          [_lock lock];
+          if (ticket == [self _next])
+            {
+              locked = YES;
+            }
+          else
+            {
+              [self _dequeue: ticket];
+              [self _unlock];
+            }
+        }
       if (dif > _longest)
         {
           _longest = dif;
         }
+      if (dif > pc->longest)
+        {
+          pc->longest = dif;
+        }
       if (NO == locked)
         {
           if (_debugging > 0 || dif > 30.0
@@ -389,6 +592,8 @@ static Class      cls = Nil;
             }
           _failed++;
           _failWaits += dif;
+          pc->failed++;
+          pc->failWaits += dif;
           return nil;
         }
       if (_debugging > 0 || (_duration >= 0.0 && dif > _duration))
@@ -398,38 +603,25 @@ static Class      cls = Nil;
         }
       _delayed++;
       _delayWaits += dif;
+      pc->delayed++;
+      pc->delayWaits += dif;
     }
+  [self _dequeue: ticket];
 
-  for (index = 0; index < _max && 0 == cond; index++)
+  found = -1;
+  for (index = 0; index < _size; index++)
     {
       if (0 == _items[index].u)
         {
-          if (preferred >= 0 || found >= 0)
-            {
-              /* There's at least one more client available to be
-               * provided, so we want to re-lock with condition 1.
-               */
-              cond = 1;
-            }
           if (preferred < 0 && YES == [_items[index].c connected])
             {
               preferred = index;
             }
-          else
+          else if (found < 0)
             {
               found = index;
             }
         }
-      else if (NO == isLocal
-        && _items[index].o == thread
-        && _items[index].u < NSNotFound
-        && NO == [_items[index].c isInTransaction])
-        {
-          /* We are allowed to re-use connections in the current thread,
-           * so if we have found one, treat it as the preferred choice.
-           */
-          preferred = index;
-        }
     }
 
   /* We prefer to use a client which is already connected, so we
@@ -448,6 +640,7 @@ static Class      cls = Nil;
       _items[found].u++;
     }
   _items[found].t = now;
+  _items[found].p = priority;
   ASSIGN(_items[found].o, thread);
   [self _unlock];
   client = [_items[found].c autorelease];
@@ -466,14 +659,39 @@ static Class      cls = Nil;
 - (void) purge
 {
   BOOL  more = YES;
+  int   index;
 
   [self _lock];
 
+  /* Connections beyond the adaptive size of the pool are not wanted,
+   * so we close them as soon as they are idle.
+   */
+  for (index = _size; index < _max; index++)
+    {
+      if (0 == _items[index].u && YES == [_items[index].c connected])
+        {
+          if (_debugging > 2)
+            {
+              NSLog(@"%@ purge found %p beyond size %d",
+                self, _items[index].c, _size);
+            }
+          NS_DURING
+            {
+              [_items[index].c disconnect];
+            }
+          NS_HANDLER
+            {
+              NSLog(@"Error disconnecting client in pool: %@",
+                localException);
+            }
+          NS_ENDHANDLER
+        }
+    }
+
   while (YES == more)
     {
       SQLClient *found = nil;
       int       connected = 0;
-      int       index;
 
       more = NO;
       for (index = 0; index < _max; index++)
@@ -521,6 +739,32 @@ static Class      cls = Nil;
   [self _unlock];
 }
 
+- (void) setAdaptiveTarget: (NSTimeInterval)seconds
+{
+  [self _lock];
+  if (seconds > 0.0)
+    {
+      if (0.0 == _adaptTarget)
+        {
+          _adaptWhen = GSTickerTimeNow();
+          _adaptImmediate = _immediate;
+          _adaptDelayed = _delayed;
+          _adaptFailed = _failed;
+          _adaptWaits = _delayWaits;
+          _adaptPeak = 0;
+          _adaptTarget = seconds;
+          [self _resize: _min reason: @"adaptive sizing started"];
+        }
+      _adaptTarget = seconds;
+    }
+  else if (_adaptTarget > 0.0)
+    {
+      _adaptTarget = 0.0;
+      [self _resize: _max reason: @"adaptive sizing stopped"];
+    }
+  [self _unlock];
+}
+
 - (void) setCache: (GSCache*)aCache
 {
   int   index;
@@ -580,6 +824,26 @@ static Class      cls = Nil;
   [self _unlock];
 }
 
+- (void) setHealthCheck: (NSTimeInterval)interval
+{
+  BOOL  start = NO;
+
+  [self _lock];
+  _healthInterval = (interval > 0.0) ? interval : 0.0;
+  if (_healthInterval > 0.0 && NO == _healthRunning)
+    {
+      _healthRunning = YES;
+      start = YES;
+    }
+  [self _unlock];
+  if (YES == start)
+    {
+      [NSThread detachNewThreadSelector: @selector(_health:)
+                               toTarget: self
+                             withObject: nil];
+    }
+}
+
 - (void) setMax: (int)maxConnections min: (int)minConnections
 {
   int   old;
@@ -619,6 +883,7 @@ static Class      cls = Nil;
           _items[index].o = nil;
           _items[index].t = 0.0;
           _items[index].u = 0;
+          _items[index].p = -1;
           _items[index].c = [[SQLClient alloc] initWithConfiguration: _config
                                                                 name: _name
                                                                 pool: self];
@@ -638,6 +903,18 @@ static Class      cls = Nil;
       [SQLClientPool _adjustPoolConnections: _max - old];
     }
   _min = minConnections;
+  if (0.0 == _adaptTarget)
+    {
+      _size = _max;
+    }
+  else if (_size > _max)
+    {
+      [self _resize: _max reason: @"maximum size changed"];
+    }
+  else if (_size < _min)
+    {
+      [self _resize: _min reason: @"minimum size changed"];
+    }
   [self _unlock];
 }
 
@@ -659,11 +936,63 @@ static Class      cls = Nil;
   _purgeAll = allSeconds;
 }
 
+- (void) setReserve: (int)reserve
+	      share: (int)percent
+	forPriority: (SQLClientPriority)priority
+{
+  if ((int)priority < 0 || priority >= SQLClientPriorityCount)
+    {
+      [NSException raise: NSInvalidArgumentException
+                  format: @"[%@-%@] bad priority class %d",
+        NSStringFromClass([self class]), NSStringFromSelector(_cmd),
+        (int)priority];
+    }
+  if (reserve < 0) reserve = 0;
+  if (percent < 1) percent = 1;
+  if (percent > 100) percent = 100;
+
+  /* Unlocking lets any waiting request which may now have a client
+   * know that it is its turn.
+   */
+  [self _lock];
+  _classes[priority].reserve = reserve;
+  _classes[priority].share = percent;
+  [self _unlock];
+}
+
+- (void) setStatementTimeout: (NSTimeInterval)seconds
+{
+  int   index;
+
+  [self _lock];
+  for (index = 0; index < _max; index++)
+    {
+      [_items[index].c setStatementTimeout: seconds];
+    }
+  [self _unlock];
+}
+
+- (void) setThreadPriority: (SQLClientPriority)priority
+{
+  NSMutableDictionary   *d = [[NSThread currentThread] threadDictionary];
+
+  if (SQLClientPriorityNormal == priority)
+    {
+      [d removeObjectForKey: _priorityKey];
+    }
+  else
+    {
+      [d setObject: [NSNumber numberWithInt: (int)priority]
+            forKey: _priorityKey];
+    }
+}
+
 - (NSString*) statistics
 {
-  NSString      *s;
+  NSMutableString       *s;
+  int                   index;
 
-  s = [NSString stringWithFormat:
+  s = [NSMutableString stringWithFormat:
     @"  Immediate provisions:   %llu\n"
     @"  Delayed provisions:     %llu\n"
     @"  Timed out provisions:   %llu\n"
@@ -671,7 +1000,9 @@ static Class      cls = Nil;
     @"  Average delay:          %g\n"
     @"  Average timeout:        %g\n"
     @"  Average over all:       %g\n"
-    @"  Committed transactions: %"PRIu64"\n",
+    @"  Committed transactions: %"PRIu64"\n"
+    @"  Statement timeouts:     %llu\n"
+    @"  Failed health checks:   %llu\n",
     (unsigned long long)_immediate,
     (unsigned long long)_delayed,
     (unsigned long long)_failed,
@@ -681,7 +1012,33 @@ static Class      cls = Nil;
     (_immediate + _delayed + _failed) > 0
       ? (_failWaits + _delayWaits) / (_immediate + _delayed + _failed)
       : 0.0,
-    [self committed]];
+    [self committed],
+    (unsigned long long)_timeouts,
+    (unsigned long long)_unhealthy];
+  if (_adaptTarget > 0.0)
+    {
+      [s appendFormat:
+        @"  Adaptive size:          %d (grown %llu, shrunk %llu)\n",
+        _size, (unsigned long long)_grown, (unsigned long long)_shrunk];
+    }
+  for (index = 0; index < SQLClientPriorityCount; index++)
+    {
+      SQLClientPoolClass        *pc = &_classes[index];
+
+      if (pc->immediate + pc->delayed + pc->failed > 0)
+        {
+          [s appendFormat: @"  %@ priority (reserve %d, share %d%%):\n"
+            @"    immediate %llu, delayed %llu (average %g, slowest %g),"
+            @" timed out %llu (average %g)\n",
+            priorityNames[index], pc->reserve, pc->share,
+            (unsigned long long)pc->immediate,
+            (unsigned long long)pc->delayed,
+            (pc->delayed > 0) ? pc->delayWaits / pc->delayed : 0.0,
+            pc->longest,
+            (unsigned long long)pc->failed,
+            (pc->failed > 0) ? pc->failWaits / pc->failed : 0.0];
+        }
+    }
   return s;
 }
 
@@ -690,7 +1047,6 @@ static Class      cls = Nil;
   NSMutableArray        *idleInfo = nil;
   NSMutableArray        *liveInfo = nil;
   NSMutableString       *retainInfo = nil;
-  unsigned int          cond = 0;
   unsigned int          free = 0;
   unsigned int          dead = 0;
   unsigned int          idle = 0;
@@ -783,10 +1139,6 @@ static Class      cls = Nil;
         {
           BOOL  connected = [_items[index].c connected];
 
-          /* The client is not in use and can be provided by the pool,
-           * so we must therefore re-lock with condition 1.
-           */
-          cond = 1;
           if (_debugging > 0)
             {
               if (nil == retainInfo)
@@ -818,6 +1170,16 @@ static Class      cls = Nil;
   s = [NSMutableString stringWithFormat: @" size min: %u, max: %u\n"
     @"  live:%u, used:%u, idle:%u, free:%u, dead:%u\n",
     _min, _max, live, used, idle, free, dead];
+  if (_adaptTarget > 0.0)
+    {
+      [s appendFormat: @"  adaptive size: %d (target wait %g)\n",
+        _size, _adaptTarget];
+    }
+  if (_max > 0)
+    {
+      [s appendFormat: @"  circuit breaker: %@\n",
+        [_items[0].c circuitBreaker]];
+    }
 
   if (liveInfo)
     {
@@ -837,10 +1199,17 @@ static Class      cls = Nil;
     {
       [s appendString: retainInfo];
     }
-  [_lock unlockWithCondition: cond];
+  [self _unlock];
   return s;
 }
 
+- (void) _countTimeout
+{
+  [self _lock];
+  _timeouts++;
+  [self _unlock];
+}
+
 - (BOOL) _swallowClient: (SQLClient*)client explicit: (BOOL)swallowed
 {
   BOOL  found = NO;
@@ -885,7 +1254,7 @@ static Class      cls = Nil;
                    * caused by deallocation.
                    */
                   _items[index].u = 0;
-                  NSIncrementExtraRefCount(client);
+                  [client retain];
                 }
               else
                 {
@@ -919,6 +1288,13 @@ static Class      cls = Nil;
         }
     }
 
+  /* Now that a client is available, start any asynchronous operation
+   * which was waiting for one.
+   */
+  if (YES == found && nil != _asyncPending)
+    {
+      [self _startPendingAsync];
+    }
   return found;
 }
 
@@ -951,6 +1327,14 @@ static Class      cls = Nil;
   [self _unlock];
 }
 
+- (SQLClientPriority) threadPriority
+{
+  NSNumber      *n;
+
+  n = [[[NSThread currentThread] threadDictionary] objectForKey: _priorityKey];
+  return (nil == n) ? SQLClientPriorityNormal : [n intValue];
+}
+
 - (SQLTransaction*) transaction
 {
   return [SQLTransaction _transactionUsing: self
@@ -958,19 +1342,331 @@ static Class      cls = Nil;
                                       stop: NO];
 }
 
-@end
-
-@implementation SQLClientPool (Private)
-
-- (void) _lock
+- (int) warmUp
 {
-  [_lock lock];
-}
+  NSMutableArray        *clients = nil;
+  NSUInteger            done = 0;
+  int                   connected = 0;
+  int                   index;
 
-- (NSString*) _rc: (SQLClient*)o
-{
-#if     defined(GNUSTEP)
-  if (_debugging > 3)
+  [self _lock];
+  for (index = 0; index < _max; index++)
+    {
+      if (YES == [_items[index].c connected])
+        {
+          connected++;
+        }
+    }
+  if (connected < _min)
+    {
+      clients = [self _reserve: NO idle: 0.0 limit: _min - connected];
+    }
+  [self _unlock];
+  if ([clients count] > 0)
+    {
+      done = [SQLClient connectClients: clients];
+      [self _release: clients];
+      if (_debugging > 0)
+        {
+          NSLog(@"%@ warm up connected %"PRIuPTR" of %"PRIuPTR,
+            self, done, [clients count]);
+        }
+    }
+  return (int)done;
+}
+
+@end
+
+@implementation SQLClientPool (Private)
+
+/* Called with the lock held to check the provisions made since the last
+ * check and grow or shrink the effective size of the pool accordingly.
+ */
+- (void) _adapt
+{
+  NSTimeInterval        now = GSTickerTimeNow();
+  uint64_t              immediate;
+  uint64_t              delayed;
+  uint64_t              failed;
+  NSTimeInterval        waits;
+  int                   peak;
+
+  if (now - _adaptWhen < ADAPT_INTERVAL)
+    {
+      return;
+    }
+  immediate = _immediate - _adaptImmediate;
+  delayed = _delayed - _adaptDelayed;
+  failed = _failed - _adaptFailed;
+  waits = _delayWaits - _adaptWaits;
+  peak = _adaptPeak;
+
+  _adaptWhen = now;
+  _adaptImmediate = _immediate;
+  _adaptDelayed = _delayed;
+  _adaptFailed = _failed;
+  _adaptWaits = _delayWaits;
+  _adaptPeak = 0;
+
+  if (failed > 0 || (delayed > 0 && (waits / delayed > _adaptTarget
+    || (delayed * 20 > immediate + delayed))))
+    {
+      NSString  *reason;
+
+      reason = [NSString stringWithFormat:
+        @"%llu of %llu provisions delayed (average %g seconds)"
+        @" and %llu timed out",
+        (unsigned long long)delayed,
+        (unsigned long long)(immediate + delayed + failed),
+        (delayed > 0) ? waits / delayed : 0.0,
+        (unsigned long long)failed];
+      if (_size < _max)
+        {
+          [self _resize: _size + (_size + 3) / 4 reason: reason];
+        }
+      else if (_debugging > 0)
+        {
+          NSLog(@"%@ adaptive size stays at maximum %d: %@",
+            self, _size, reason);
+        }
+    }
+  else if (0 == delayed + failed && peak < _size && _size > _min)
+    {
+      [self _resize: _size - 1 reason: [NSString stringWithFormat:
+        @"no delays and at most %d clients in use", peak]];
+    }
+}
+
+/* Called with the lock held to remove a request from the queue of
+ * those waiting for a client.
+ */
+- (void) _dequeue: (NSInteger)ticket
+{
+  int   index;
+
+  for (index = 0; index < _waiting; index++)
+    {
+      if (_waiters[index].ticket == ticket)
+        {
+          _waiting--;
+          memmove(&_waiters[index], &_waiters[index + 1],
+            (_waiting - index) * sizeof(SQLClientPoolWaiter));
+          break;
+        }
+    }
+}
+
+/* Called with the lock held to add a request to the queue of those
+ * waiting for a client, returning the ticket identifying the request.
+ * The queue is kept in order of priority and then of the time at which
+ * each request will time out (requests which are otherwise equal are
+ * served in the order they arrived).
+ */
+- (NSInteger) _enqueue: (int)priority until: (NSTimeInterval)end
+{
+  int   index;
+
+  if (_waiting == _waitersSize)
+    {
+      _waitersSize = (0 == _waitersSize) ? 8 : _waitersSize * 2;
+      _waiters = realloc(_waiters,
+        _waitersSize * sizeof(SQLClientPoolWaiter));
+    }
+  index = _waiting++;
+  while (index > 0 && (_waiters[index - 1].priority > priority
+    || (_waiters[index - 1].priority == priority
+      && _waiters[index - 1].end > end)))
+    {
+      _waiters[index] = _waiters[index - 1];
+      index--;
+    }
+  _waiters[index].ticket = ++_ticket;
+  _waiters[index].priority = priority;
+  _waiters[index].end = end;
+  return _waiters[index].ticket;
+}
+
+/* Runs in a thread of its own, performing health checks until they
+ * are turned off.
+ */
+- (void) _health: (id)ignored
+{
+  for (;;)
+    {
+      NSAutoreleasePool *arp = [NSAutoreleasePool new];
+      NSMutableArray    *clients;
+      NSTimeInterval    interval;
+      NSUInteger        count;
+      NSUInteger        index;
+
+      [self _lock];
+      interval = _healthInterval;
+      if (interval <= 0.0)
+        {
+          _healthRunning = NO;
+          [self _unlock];
+          [arp release];
+          return;
+        }
+      [self _unlock];
+
+      NS_DURING
+        {
+          /* Close excess idle connections before checking those left.
+           */
+          [self purge];
+          [self _lock];
+          clients = [self _reserve: YES idle: interval limit: _max];
+          [self _unlock];
+          count = [clients count];
+          for (index = 0; index < count; index++)
+            {
+              SQLClient *client = [clients objectAtIndex: index];
+              BOOL      failed = NO;
+
+              NS_DURING
+                {
+                  if (NO == [client backendIsValid])
+                    {
+                      NSLog(@"%@ health check failed for %@",
+                        self, [client name]);
+                      failed = YES;
+                    }
+                }
+              NS_HANDLER
+                {
+                  NSLog(@"%@ health check failed for %@: %@",
+                    self, [client name], localException);
+                  failed = YES;
+                }
+              NS_ENDHANDLER
+              if (YES == failed)
+                {
+                  [self _lock];
+                  _unhealthy++;
+                  [self _unlock];
+                  [client disconnect];
+                }
+            }
+          if (count > 0)
+            {
+              [self _release: clients];
+            }
+          [self warmUp];
+        }
+      NS_HANDLER
+        {
+          NSLog(@"%@ problem in health check: %@", self, localException);
+        }
+      NS_ENDHANDLER
+      [arp release];
+      [NSThread sleepForTimeInterval: interval];
+    }
+}
+
+/* Returns the client leased to the current thread (or nil).
+ */
+- (SQLClient*) _leased
+{
+  SQLClientLease	*l;
+
+  l = [[[[NSThread currentThread] threadDictionary] objectForKey: _leaseKey]
+    nonretainedObjectValue];
+  return (nil == l) ? nil : l->client;
+}
+
+- (void) _lock
+{
+  [_lock lock];
+}
+
+/* Called with the lock held to return the ticket of the first request
+ * in the queue which may be given a client, or zero if there is none.
+ * A request may only have a client if its class is using fewer than
+ * its share of the pool and there are enough unused clients to leave
+ * the unused reservations of the other classes intact.
+ */
+- (NSInteger) _next
+{
+  int   used[SQLClientPriorityCount];
+  int   free = 0;
+  int   index;
+  int   p;
+
+  if (0 == _waiting)
+    {
+      return 0;
+    }
+  for (p = 0; p < SQLClientPriorityCount; p++)
+    {
+      used[p] = 0;
+    }
+  for (index = 0; index < _max; index++)
+    {
+      if (_items[index].u > 0)
+        {
+          if (_items[index].p >= 0)
+            {
+              used[_items[index].p]++;
+            }
+        }
+      else if (index < _size)
+        {
+          free++;
+        }
+    }
+  if (0 == free)
+    {
+      return 0;
+    }
+  for (index = 0; index < _waiting; index++)
+    {
+      int       priority = _waiters[index].priority;
+      int       limit = _size * _classes[priority].share / 100;
+      int       available = free;
+
+      if (limit < 1)
+        {
+          limit = 1;
+        }
+      if (used[priority] >= limit)
+        {
+          continue;
+        }
+      for (p = 0; p < SQLClientPriorityCount; p++)
+        {
+          if (p != priority && used[p] < _classes[p].reserve)
+            {
+              available -= _classes[p].reserve - used[p];
+            }
+        }
+      if (available > 0)
+        {
+          return _waiters[index].ticket;
+        }
+    }
+  return 0;
+}
+
+/* Provides the client for a convenience method ... the client leased to
+ * the current thread if there is one (and it is not being used for a
+ * transaction), otherwise a client from the pool.
+ */
+- (SQLClient*) _provide
+{
+  SQLClient	*client = [self _leased];
+
+  if (nil == client || YES == [client isInTransaction])
+    {
+      client = [self provideClient];
+    }
+  return client;
+}
+
+- (NSString*) _rc: (SQLClient*)o
+{
+#if     defined(GNUSTEP)
+  if (_debugging > 3)
     {
       NSUInteger        rc;
       NSUInteger        ac;
@@ -1012,11 +1708,191 @@ static Class      cls = Nil;
   return @"";
 }
 
+/* Returns clients reserved by -_reserve:idle:limit: to the pool.
+ */
+- (void) _release: (NSArray*)clients
+{
+  NSUInteger    count = [clients count];
+  NSUInteger    i;
+  int           index;
+
+  [self _lock];
+  for (i = 0; i < count; i++)
+    {
+      SQLClient *client = [clients objectAtIndex: i];
+
+      for (index = 0; index < _max; index++)
+        {
+          if (client == _items[index].c)
+            {
+              _items[index].u = 0;
+              DESTROY(_items[index].o);
+              break;
+            }
+        }
+    }
+  [self _unlock];
+  if (nil != _asyncPending)
+    {
+      [self _startPendingAsync];
+    }
+}
+
+/* Called with the lock held to reserve up to limit unused clients for
+ * internal use (connected clients idle for at least age, or unconnected
+ * clients), marking them as provided exclusively to the current thread
+ * without transferring ownership.  Return them using -_release:
+ */
+- (NSMutableArray*) _reserve: (BOOL)connected
+			idle: (NSTimeInterval)age
+		       limit: (int)limit
+{
+  NSMutableArray        *clients = [NSMutableArray arrayWithCapacity: limit];
+  NSThread              *thread = [NSThread currentThread];
+  int                   index;
+
+  for (index = 0; index < _size && limit > 0; index++)
+    {
+      SQLClient *client = _items[index].c;
+
+      if (0 == _items[index].u && connected == [client connected])
+        {
+          if (YES == connected
+            && -[[client lastOperation] timeIntervalSinceNow] < age)
+            {
+              continue;
+            }
+          _items[index].u = NSNotFound;
+          _items[index].p = -1;
+          ASSIGN(_items[index].o, thread);
+          [clients addObject: client];
+          limit--;
+        }
+    }
+  return clients;
+}
+
+/* Start the operation using a client from the pool if one is available,
+ * otherwise queue it to be started when a client is returned.
+ */
+- (void) _startAsync: (SQLAsyncOperation*)op
+{
+  SQLClient	*db = nil;
+
+  if ([self availableConnections] > 0)
+    {
+      db = [self provideClientBeforeDate: [NSDate date] exclusive: YES];
+    }
+  if (nil == db)
+    {
+      [self _lock];
+      if (nil == _asyncPending)
+        {
+          _asyncPending = [NSMutableArray new];
+        }
+      [_asyncPending addObject: op];
+      [self _unlock];
+
+      /* A client may have been returned while we were queueing.
+       */
+      if ([self availableConnections] > 0)
+        {
+          [self _startPendingAsync];
+        }
+      return;
+    }
+  [op _setClient: db];
+  [op _start];
+}
+
+- (void) _startPendingAsync
+{
+  SQLAsyncOperation	*op = nil;
+
+  [self _lock];
+  if ([_asyncPending count] > 0)
+    {
+      op = [[_asyncPending objectAtIndex: 0] retain];
+      [_asyncPending removeObjectAtIndex: 0];
+    }
+  [self _unlock];
+  if (nil != op)
+    {
+      [self _startAsync: op];
+      [op release];
+    }
+}
+
+/* Called with the lock held to change the effective size of the pool
+ * (within the configured limits), logging the change.
+ */
+- (void) _resize: (int)size reason: (NSString*)reason
+{
+  if (size > _max)
+    {
+      size = _max;
+    }
+  if (size < _min)
+    {
+      size = _min;
+    }
+  if (size != _size)
+    {
+      NSLog(@"%@ adaptive size changed from %d to %d: %@",
+        self, _size, size, reason);
+      if (size > _size)
+        {
+          _grown++;
+        }
+      else
+        {
+          _shrunk++;
+        }
+      _size = size;
+    }
+}
+
+/* Returns a client obtained using -_provide to the pool, unless it is
+ * the client leased to the current thread.
+ */
+- (void) _swallow: (SQLClient*)client
+{
+  if (client != [self _leased])
+    {
+      [self swallowClient: client];
+    }
+}
+
 - (void) _unlock
 {
   int   index;
+  int   used;
 
-  for (index = 0; index < _max; index++)
+  if (_adaptTarget > 0.0)
+    {
+      used = 0;
+      for (index = 0; index < _max; index++)
+        {
+          if (_items[index].u > 0)
+            {
+              used++;
+            }
+        }
+      if (used > _adaptPeak)
+        {
+          _adaptPeak = used;
+        }
+      [self _adapt];
+    }
+  if (_waiting > 0)
+    {
+      /* Let the first waiting request which may be given a client know
+       * that it is its turn (or make everyone wait if there is none).
+       */
+      [_lock unlockWithCondition: [self _next]];
+      return;
+    }
+  for (index = 0; index < _size; index++)
     {
       /* Check to see if this client is free to be taken from the pool.
        */
@@ -1031,6 +1907,57 @@ static Class      cls = Nil;
 
 @end
 
+@implementation SQLClientPool (Asynchronous)
+
+- (void) execute: (SQLLitArg*)stmt
+      completion: (SQLClientExecuteCompletion)completion
+{
+  [self execute: stmt
+         thread: [NSThread currentThread]
+     completion: completion];
+}
+
+- (void) execute: (SQLLitArg*)stmt
+	  thread: (NSThread*)thread
+      completion: (SQLClientExecuteCompletion)completion
+{
+  SQLAsyncOperation	*op;
+
+  op = [[SQLAsyncOperation alloc] _initWithClient: nil
+                                             pool: self
+                                        statement: stmt
+                                            query: NO
+                                           thread: thread
+                                       completion: (id)completion];
+  [self _startAsync: op];
+  [op release];
+}
+
+- (void) query: (SQLLitArg*)stmt
+    completion: (SQLClientQueryCompletion)completion
+{
+  [self query: stmt
+       thread: [NSThread currentThread]
+   completion: completion];
+}
+
+- (void) query: (SQLLitArg*)stmt
+	thread: (NSThread*)thread
+    completion: (SQLClientQueryCompletion)completion
+{
+  SQLAsyncOperation	*op;
+
+  op = [[SQLAsyncOperation alloc] _initWithClient: nil
+                                             pool: self
+                                        statement: stmt
+                                            query: YES
+                                           thread: thread
+                                       completion: (id)completion];
+  [self _startAsync: op];
+  [op release];
+}
+@end
+
 @implementation SQLClientPool (ConvenienceMethods)
 
 - (SQLLiteral*) buildQuery: (NSString*)stmt, ...
@@ -1059,13 +1986,7 @@ static Class      cls = Nil;
 
 - (NSMutableArray*) cacheCheckSimpleQuery: (NSString*)stmt
 {
-  NSMutableArray        *result = [[_items[0].c cache] objectForKey: stmt];
-
-  if (result != nil)
-    {
-      result = [[result mutableCopy] autorelease];
-    }
-  return result;
+  return [_items[0].c cacheCheckSimpleQuery: stmt];
 }
 
 - (NSMutableArray*) cache: (int)seconds
@@ -1073,21 +1994,21 @@ static Class      cls = Nil;
 {
   SQLClient             *db;
   NSMutableArray        *result;
-  SQLLiteral            *query;
+  id                    query;
   va_list	        ap;
 
   va_start (ap, stmt);
-  query = [[_items[0].c prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [_items[0].c prepare: stmt args: ap]];
   va_end (ap);
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db cache: seconds simpleQuery: query];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1098,14 +2019,14 @@ static Class      cls = Nil;
   SQLClient             *db;
   NSMutableArray        *result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db cache: seconds query: stmt with: values];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1114,14 +2035,14 @@ static Class      cls = Nil;
   SQLClient             *db;
   NSMutableArray        *result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db cache: seconds simpleQuery: stmt];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1133,17 +2054,17 @@ static Class      cls = Nil;
   SQLClient             *db;
   NSMutableArray        *result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db cache: seconds
            simpleQuery: stmt
             recordType: rtype
               listType: ltype];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1162,14 +2083,14 @@ static Class      cls = Nil;
   va_start (ap, stmt);
   info = [_items[0].c prepare: stmt args: ap];
   va_end (ap);
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleExecute: info];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1178,14 +2099,33 @@ static Class      cls = Nil;
   SQLClient     *db;
   NSInteger     result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db execute: stmt with: values];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
+  return result;
+}
+
+- (NSUInteger) insert: (NSArray*)rows
+		 into: (NSString*)table
+	      columns: (NSArray*)columns
+	     failures: (NSMutableIndexSet*)failures
+{
+  SQLClient     *db;
+  NSUInteger    result;
+
+  db = [self _provide];
+  NS_DURING
+    result = [db insert: rows into: table columns: columns failures: failures];
+  NS_HANDLER
+    [self _swallow: db];
+    [localException raise];
+  NS_ENDHANDLER
+  [self _swallow: db];
   return result;
 }
 
@@ -1220,24 +2160,24 @@ static Class      cls = Nil;
 {
   SQLClient             *db;
   NSMutableArray	*result;
-  SQLLiteral            *query;
+  id                    query;
   va_list		ap;
 
   /*
    * First check validity and concatenate parts of the query.
    */
   va_start (ap, stmt);
-  query = [[_items[0].c prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [_items[0].c prepare: stmt args: ap]];
   va_end (ap);
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleQuery: query];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
 
   return result;
 }
@@ -1247,14 +2187,14 @@ static Class      cls = Nil;
   SQLClient             *db;
   NSMutableArray        *result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db query: stmt with: values];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1263,21 +2203,21 @@ static Class      cls = Nil;
   SQLClient     *db;
   NSArray	*result;
   SQLRecord	*record;
-  SQLLiteral    *query;
+  id            query;
   va_list	ap;
 
   va_start (ap, stmt);
-  query = [[_items[0].c prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [_items[0].c prepare: stmt args: ap]];
   va_end (ap);
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleQuery: query];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
 
   if ([result count] > 1)
     {
@@ -1298,21 +2238,21 @@ static Class      cls = Nil;
   SQLClient     *db;
   NSArray	*result;
   SQLRecord	*record;
-  SQLLiteral    *query;
+  id            query;
   va_list	ap;
 
   va_start (ap, stmt);
-  query = [[_items[0].c prepare: stmt args: ap] objectAtIndex: 0];
+  query = [SQLClient _queryArgument: [_items[0].c prepare: stmt args: ap]];
   va_end (ap);
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleQuery: query];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
 
   if ([result count] > 1)
     {
@@ -1419,14 +2359,30 @@ static Class      cls = Nil;
   SQLClient     *db;
   NSInteger     result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleExecute: info];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
+    [localException raise];
+  NS_ENDHANDLER
+  [self _swallow: db];
+  return result;
+}
+
+- (NSInteger) simpleExecute: (NSArray*)info timeout: (NSTimeInterval)seconds
+{
+  SQLClient     *db;
+  NSInteger     result;
+
+  db = [self _provide];
+  NS_DURING
+    result = [db simpleExecute: info timeout: seconds];
+  NS_HANDLER
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1435,14 +2391,14 @@ static Class      cls = Nil;
   SQLClient             *db;
   NSMutableArray        *result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleQuery: stmt];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -1453,16 +2409,33 @@ static Class      cls = Nil;
   SQLClient             *db;
   NSMutableArray        *result;
 
-  db = [self provideClient];
+  db = [self _provide];
   NS_DURING
     result = [db simpleQuery: stmt
                   recordType: rtype
                     listType: ltype];
   NS_HANDLER
-    [self swallowClient: db];
+    [self _swallow: db];
+    [localException raise];
+  NS_ENDHANDLER
+  [self _swallow: db];
+  return result;
+}
+
+- (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
+			timeout: (NSTimeInterval)seconds
+{
+  SQLClient             *db;
+  NSMutableArray        *result;
+
+  db = [self _provide];
+  NS_DURING
+    result = [db simpleQuery: stmt timeout: seconds];
+  NS_HANDLER
+    [self _swallow: db];
     [localException raise];
   NS_ENDHANDLER
-  [self swallowClient: db];
+  [self _swallow: db];
   return result;
 }
 
@@ -0,0 +1,473 @@
+/* -*-objc-*- */
+
+/** Implementation of SQLClientRouter for GNUStep
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the SQLClient Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */
+
+#import	<Foundation/NSArray.h>
+#import	<Foundation/NSAutoreleasePool.h>
+#import	<Foundation/NSDictionary.h>
+#import	<Foundation/NSException.h>
+#import	<Foundation/NSLock.h>
+#import	<Foundation/NSString.h>
+#import	<Foundation/NSThread.h>
+#import	<Foundation/NSValue.h>
+
+#import	<Performance/GSTicker.h>
+
+#import	"SQLClient.h"
+
+/* The initial and maximum periods (in seconds) for which a replica which
+ * could not be reached is left unused.
+ */
+#define	REPLICA_BACKOFF		1.0
+#define	REPLICA_BACKOFF_MAX	30.0
+
+@interface	SQLClient (Private)
++ (id) _queryArgument: (NSMutableArray*)info;
+@end
+
+@interface	SQLClientRouter (Private)
+- (NSUInteger) _choose;
+- (void) _done: (NSUInteger)index
+	 start: (NSTimeInterval)start
+	failed: (NSException*)error;
+- (BOOL) _isSticky;
+- (NSMutableArray*) _read: (id)query cache: (int)seconds;
+- (NSInteger) _write: (NSArray*)info;
+@end
+
+@implementation	SQLClientRouter
+
+- (SQLTransaction*) batch: (BOOL)stopOnFailure
+{
+  [self noteWrite];
+  return [_primary batch: stopOnFailure];
+}
+
+- (NSMutableArray*) cache: (int)seconds query: (NSString*)stmt, ...
+{
+  NSMutableArray	*info;
+  va_list		ap;
+
+  va_start (ap, stmt);
+  info = [_primary prepare: stmt args: ap];
+  va_end (ap);
+  return [self _read: [SQLClient _queryArgument: info] cache: seconds];
+}
+
+- (NSMutableArray*) cache: (int)seconds
+		    query: (NSString*)stmt
+		     with: (NSDictionary*)values
+{
+  NSMutableArray	*info = [_primary prepare: stmt with: values];
+
+  return [self _read: [SQLClient _queryArgument: info] cache: seconds];
+}
+
+- (void) dealloc
+{
+  DESTROY(_primary);
+  DESTROY(_replicas);
+  DESTROY(_lock);
+  DESTROY(_stickyKey);
+  if (0 != _outstanding)
+    {
+      NSZoneFree(NSDefaultMallocZone(), _outstanding);
+      _outstanding = 0;
+    }
+  if (0 != _rtt)
+    {
+      NSZoneFree(NSDefaultMallocZone(), _rtt);
+      _rtt = 0;
+    }
+  if (0 != _down)
+    {
+      NSZoneFree(NSDefaultMallocZone(), _down);
+      _down = 0;
+    }
+  if (0 != _backoff)
+    {
+      NSZoneFree(NSDefaultMallocZone(), _backoff);
+      _backoff = 0;
+    }
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat: @"%@ primary: %@ replicas: %"PRIuPTR,
+    [super description], [_primary name], [_replicas count]];
+}
+
+- (NSInteger) execute: (NSString*)stmt, ...
+{
+  NSMutableArray	*info;
+  va_list		ap;
+
+  va_start (ap, stmt);
+  info = [_primary prepare: stmt args: ap];
+  va_end (ap);
+  return [self _write: info];
+}
+
+- (NSInteger) execute: (NSString*)stmt with: (NSDictionary*)values
+{
+  return [self _write: [_primary prepare: stmt with: values]];
+}
+
+- (id) init
+{
+  return [self initWithPrimary: nil replicas: nil];
+}
+
+- (id) initWithPrimary: (SQLClientPool*)primary replicas: (NSArray*)replicas
+{
+  if (nil == primary)
+    {
+      DESTROY(self);
+      [NSException raise: NSInvalidArgumentException
+		  format: @"SQLClientRouter needs a primary pool"];
+    }
+  if (nil != (self = [super init]))
+    {
+      NSUInteger	count = [replicas count];
+
+      _primary = [primary retain];
+      _replicas = [[NSArray alloc] initWithArray: replicas];
+      _lock = [NSLock new];
+      _stickyKey = [[NSString alloc] initWithFormat:
+	@"SQLClientRouter-%p", self];
+      if (count > 0)
+	{
+	  _outstanding = (NSUInteger*)NSZoneCalloc(NSDefaultMallocZone(),
+	    count, sizeof(NSUInteger));
+	  _rtt = (NSTimeInterval*)NSZoneCalloc(NSDefaultMallocZone(),
+	    count, sizeof(NSTimeInterval));
+	  _down = (NSTimeInterval*)NSZoneCalloc(NSDefaultMallocZone(),
+	    count, sizeof(NSTimeInterval));
+	  _backoff = (NSTimeInterval*)NSZoneCalloc(NSDefaultMallocZone(),
+	    count, sizeof(NSTimeInterval));
+	}
+    }
+  return self;
+}
+
+- (void) noteWrite
+{
+  if (_sticky > 0.0)
+    {
+      [[[NSThread currentThread] threadDictionary]
+	setObject: [NSNumber numberWithDouble: GSTickerTimeNow()]
+	   forKey: _stickyKey];
+    }
+}
+
+- (SQLClientPool*) primary
+{
+  return _primary;
+}
+
+- (NSMutableArray*) query: (NSString*)stmt, ...
+{
+  NSMutableArray	*info;
+  va_list		ap;
+
+  va_start (ap, stmt);
+  info = [_primary prepare: stmt args: ap];
+  va_end (ap);
+  return [self _read: [SQLClient _queryArgument: info] cache: -1];
+}
+
+- (NSMutableArray*) query: (NSString*)stmt with: (NSDictionary*)values
+{
+  NSMutableArray	*info = [_primary prepare: stmt with: values];
+
+  return [self _read: [SQLClient _queryArgument: info] cache: -1];
+}
+
+- (SQLClientPool*) readPool
+{
+  NSUInteger	index = [self _choose];
+
+  if (NSNotFound == index)
+    {
+      return _primary;
+    }
+  /* The caller does its own requests, so we don't count this one as
+   * outstanding.
+   */
+  [_lock lock];
+  _outstanding[index]--;
+  [_lock unlock];
+  return [_replicas objectAtIndex: index];
+}
+
+- (NSArray*) replicas
+{
+  return _replicas;
+}
+
+- (void) setStickiness: (NSTimeInterval)seconds
+{
+  _sticky = (seconds > 0.0) ? seconds : 0.0;
+}
+
+- (NSInteger) simpleExecute: (NSArray*)info
+{
+  return [self _write: info];
+}
+
+- (NSMutableArray*) simpleQuery: (SQLLitArg*)stmt
+{
+  return [self _read: stmt cache: -1];
+}
+
+- (NSString*) status
+{
+  NSMutableString	*s;
+  NSUInteger		count = [_replicas count];
+  NSTimeInterval	now = GSTickerTimeNow();
+  NSUInteger		i;
+
+  s = [NSMutableString stringWithFormat: @"Router %p primary '%@'"
+    @" (stickiness %g)\n  Reads %"PRIu64" (on primary %"PRIu64
+    @", failed over %"PRIu64"), writes %"PRIu64"\n",
+    self, [_primary name], _sticky, _reads, _primaryReads, _failovers,
+    _writes];
+  [_lock lock];
+  for (i = 0; i < count; i++)
+    {
+      [s appendFormat: @"  Replica '%@' outstanding %"PRIuPTR
+	@" duration %g", [[_replicas objectAtIndex: i] name],
+	_outstanding[i], _rtt[i]];
+      if (_down[i] > now)
+	{
+	  [s appendFormat: @" (down for %g)", _down[i] - now];
+	}
+      [s appendString: @"\n"];
+    }
+  [_lock unlock];
+  return s;
+}
+
+- (NSTimeInterval) stickiness
+{
+  return _sticky;
+}
+
+- (SQLTransaction*) transaction
+{
+  [self noteWrite];
+  return [_primary transaction];
+}
+
+- (SQLClientPool*) writePool
+{
+  [self noteWrite];
+  return _primary;
+}
+
+@end
+
+@implementation	SQLClientRouter (Private)
+
+/* Returns the index of the replica to use for a read and counts the read
+ * as outstanding on that replica, or returns NSNotFound if the primary
+ * should be used.  We pick the replica with fewest outstanding requests,
+ * using the shortest recent duration to choose between equals, and
+ * skipping any replica which recently could not be reached.
+ */
+- (NSUInteger) _choose
+{
+  NSUInteger	count = [_replicas count];
+  NSUInteger	best = NSNotFound;
+  NSUInteger	i;
+
+  if (count > 0 && NO == [self _isSticky])
+    {
+      NSTimeInterval	now = GSTickerTimeNow();
+
+      [_lock lock];
+      for (i = 0; i < count; i++)
+	{
+	  if (_down[i] > now)
+	    {
+	      continue;
+	    }
+	  if (NSNotFound == best
+	    || _outstanding[i] < _outstanding[best]
+	    || (_outstanding[i] == _outstanding[best]
+	      && _rtt[i] < _rtt[best]))
+	    {
+	      best = i;
+	    }
+	}
+      if (NSNotFound != best)
+	{
+	  _outstanding[best]++;
+	  _reads++;
+	  [_lock unlock];
+	  return best;
+	}
+      [_lock unlock];
+    }
+  [_lock lock];
+  _reads++;
+  _primaryReads++;
+  [_lock unlock];
+  return NSNotFound;
+}
+
+/* Records the end of a request on a replica.  A successful request
+ * updates the smoothed duration of requests on that replica.  A failure
+ * to reach the replica marks it as down for a backoff period (doubling
+ * on each consecutive failure), while other errors are ignored since
+ * they say nothing about the speed of the replica.
+ */
+- (void) _done: (NSUInteger)index
+	 start: (NSTimeInterval)start
+	failed: (NSException*)error
+{
+  if (NSNotFound != index)
+    {
+      NSTimeInterval	now = GSTickerTimeNow();
+      NSTimeInterval	d = now - start;
+
+      [_lock lock];
+      _outstanding[index]--;
+      if (nil == error)
+	{
+	  _backoff[index] = 0.0;
+	  if (0.0 == _rtt[index])
+	    {
+	      _rtt[index] = d;
+	    }
+	  else
+	    {
+	      _rtt[index] = _rtt[index] * 0.8 + d * 0.2;
+	    }
+	}
+      else if (YES == [[error name] isEqual: SQLConnectionException])
+	{
+	  if (0.0 == _backoff[index])
+	    {
+	      _backoff[index] = REPLICA_BACKOFF;
+	    }
+	  else if (_backoff[index] < REPLICA_BACKOFF_MAX)
+	    {
+	      _backoff[index] *= 2.0;
+	      if (_backoff[index] > REPLICA_BACKOFF_MAX)
+		{
+		  _backoff[index] = REPLICA_BACKOFF_MAX;
+		}
+	    }
+	  _down[index] = now + _backoff[index];
+	}
+      [_lock unlock];
+    }
+}
+
+/* Returns YES if the current thread wrote to the primary recently enough
+ * that it must read from the primary in order to see its own changes.
+ */
+- (BOOL) _isSticky
+{
+  NSNumber	*n;
+
+  if (0.0 == _sticky)
+    {
+      return NO;
+    }
+  n = [[[NSThread currentThread] threadDictionary] objectForKey: _stickyKey];
+  if (nil != n && GSTickerTimeNow() - [n doubleValue] < _sticky)
+    {
+      return YES;
+    }
+  return NO;
+}
+
+- (NSMutableArray*) _read: (id)query cache: (int)seconds
+{
+  NSUInteger		index = [self _choose];
+  SQLClientPool		*pool;
+  NSTimeInterval	start = GSTickerTimeNow();
+  NSMutableArray	*result = nil;
+  BOOL			failover = NO;
+
+  if (NSNotFound == index)
+    {
+      pool = _primary;
+    }
+  else
+    {
+      pool = [_replicas objectAtIndex: index];
+    }
+  NS_DURING
+    {
+      if (seconds < 0)
+	{
+	  result = [pool simpleQuery: query];
+	}
+      else
+	{
+	  result = [pool cache: seconds simpleQuery: query];
+	}
+    }
+  NS_HANDLER
+    {
+      [self _done: index start: start failed: localException];
+      if (NSNotFound == index
+	|| NO == [[localException name] isEqual: SQLConnectionException])
+	{
+	  [localException raise];
+	}
+      failover = YES;
+    }
+  NS_ENDHANDLER
+  if (YES == failover)
+    {
+      /* The replica could not be reached, so the primary is used instead.
+       */
+      [_lock lock];
+      _failovers++;
+      [_lock unlock];
+      if (seconds < 0)
+	{
+	  return [_primary simpleQuery: query];
+	}
+      return [_primary cache: seconds simpleQuery: query];
+    }
+  [self _done: index start: start failed: nil];
+  return result;
+}
+
+- (NSInteger) _write: (NSArray*)info
+{
+  NSInteger	result = [_primary simpleExecute: info];
+
+  [_lock lock];
+  _writes++;
+  [_lock unlock];
+  [self noteWrite];
+  return result;
+}
+
+@end
+
@@ -53,6 +53,29 @@
 
 @implementation	SQLClientSQLite
 
+/* Protects the database handle of each client, which may be used
+ * by the watchdog thread while the client is locked by another thread.
+ */
+static NSLock	*cancelLock = nil;
+
++ (void) initialize
+{
+  if (nil == cancelLock)
+    {
+      cancelLock = [NSLock new];
+    }
+}
+
+- (void) backendCancel
+{
+  [cancelLock lock];
+  if (connected == YES && extra != 0)
+    {
+      sqlite3_interrupt((sqlite3 *)extra);
+    }
+  [cancelLock unlock];
+}
+
 /* use [self database] as path to database file */
 - (BOOL) backendConnect
 {
@@ -114,8 +137,10 @@
 	    {
 	      [self debug: @"Disconnecting client %@", [self clientName]];
 	    }
+	  [cancelLock lock];
 	  sqlite3_close((sqlite3 *)extra);
 	  extra = 0;
+	  [cancelLock unlock];
 	  if ([self debugging] > 0)
 	    {
 	      [self debug: @"Disconnected client %@", [self clientName]];
@@ -137,6 +162,7 @@
   NSString	        *stmt;
   NSAutoreleasePool     *arp = [NSAutoreleasePool new];
 
+  info = [self inlineBoundArrays: info];
   stmt = [info objectAtIndex: 0];
   if ([stmt length] == 0)
     {
@@ -242,14 +268,21 @@
       if ((result = sqlite3_step(prepared)) == SQLITE_ROW)
         {
 	  int		columns = sqlite3_column_count(prepared);
+	  const char	*names[columns];
 	  NSString	*keys[columns];
+	  SQLRecordKeys	*k = nil;
+	  BOOL		first = YES;
 	  int		i;
 
 	  for (i = 0; i < columns; i++)
 	    {
-	      keys[i] = [NSString stringWithUTF8String: 
-		sqlite3_column_name(prepared, i)];
+	      names[i] = sqlite3_column_name(prepared, i);
 	    }
+	  /* Use the shared keys for this set of columns so that we don't
+	   * need to create new key strings for every query.
+	   */
+	  [[[SQLRecordKeys keysWithUTF8Names: names count: columns] order]
+	    getObjects: keys];
 
           do
 	    {
@@ -289,9 +322,27 @@
 		    }
 		}
 
-	      record = [rtype newWithValues: values
-				       keys: keys
-				      count: columns];
+	      if (nil == k)
+		{
+		  /* We don't have keys information, so use the
+		   * constructor where we list keys and, if the
+		   * resulting record provides keys information
+		   * on the first record, we save it for later.
+		   */
+		  record = [rtype newWithValues: values
+					   keys: keys
+					  count: columns];
+		  if (YES == first
+		    && [record respondsToSelector: @selector(keys)])
+		    {
+		      k = [record keys];
+		    }
+		  first = NO;
+		}
+	      else
+		{
+		  record = [rtype newWithValues: values keys: k];
+		}
 	      [records addObject: record];
 	      [record release];
 	    }
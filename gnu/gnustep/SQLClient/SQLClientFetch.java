@@ -0,0 +1,112 @@
+/** Helper class for the SQLClient JDBC bundle
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the SQLClient Library.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+   
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+   
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+   */ 
+
+package gnu.gnustep.SQLClient;
+
+import java.io.ByteArrayOutputStream;
+import java.sql.ResultSet;
+import java.sql.SQLException;
+import java.util.Arrays;
+
+/**
+ * Reads rows from a ResultSet in batches so that the native code in the
+ * JDBC bundle can decode a whole batch after a single call into Java,
+ * rather than making several JNI calls for each value.
+ */
+public final class SQLClientFetch
+{
+  public static final int TEXT = 0;
+  public static final int BOOLEAN = 1;
+  public static final int BINARY = 2;
+
+  private SQLClientFetch()
+  {
+  }
+
+  /**
+   * Reads up to max rows from the result set.  The kinds array gives
+   * the way to read each column: TEXT using getString(), BOOLEAN using
+   * getBoolean() (producing the text "Y" or "N") or BINARY using getBytes().
+   * <p>
+   * Returns an array of three objects: an int[] holding the length of
+   * each value (row by row, or -1 for a NULL), a char[] holding all the
+   * text values, and a byte[] holding all the binary values.
+   * Fewer than max rows means the result set has been exhausted.
+   */
+  public static Object[] fetch(ResultSet rs, int[] kinds, int max)
+    throws SQLException
+  {
+    int				columns = kinds.length;
+    int[]			lengths = new int[max * columns];
+    StringBuilder		text = new StringBuilder(max * columns * 8);
+    ByteArrayOutputStream	data = new ByteArrayOutputStream();
+    int				cell = 0;
+    int				rows = 0;
+    char[]			chars;
+
+    while (rows < max && rs.next())
+      {
+	for (int i = 0; i < columns; i++)
+	  {
+	    int	length = -1;
+
+	    if (BINARY == kinds[i])
+	      {
+		byte[]	b = rs.getBytes(i + 1);
+
+		if (null != b)
+		  {
+		    data.write(b, 0, b.length);
+		    length = b.length;
+		  }
+	      }
+	    else if (BOOLEAN == kinds[i])
+	      {
+		boolean	b = rs.getBoolean(i + 1);
+
+		if (false == rs.wasNull())
+		  {
+		    text.append(b ? 'Y' : 'N');
+		    length = 1;
+		  }
+	      }
+	    else
+	      {
+		String	s = rs.getString(i + 1);
+
+		if (null != s)
+		  {
+		    text.append(s);
+		    length = s.length();
+		  }
+	      }
+	    lengths[cell++] = length;
+	  }
+	rows++;
+      }
+    if (rows < max)
+      {
+	lengths = Arrays.copyOf(lengths, cell);
+      }
+    chars = new char[text.length()];
+    text.getChars(0, chars.length, chars, 0);
+    return new Object[] { lengths, chars, data.toByteArray() };
+  }
+}
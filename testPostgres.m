@@ -62,6 +62,7 @@ main()
 	  @"postgres", @"User",
 	  @"postgres", @"Password",
 	  @"Postgres", @"ServerType",
+	  @"YES", @"PackedArrays",
 	  nil],
 	@"test",
 	nil],
@@ -385,6 +386,77 @@ main()
       records = [db cache: 1 query: @"select * from xxx order by id", nil];
       NSCAssert([r0 lastObject] != [records lastObject], @"Lifetime failed");
 
+      {
+        SQLArenaBuilder *ab = [[SQLArenaBuilder new] autorelease];
+        NSMutableArray  *a;
+
+        [db simpleQuery: @"select * from xxx order by id"
+             recordType: ab
+               listType: ab];
+        a = [ab content];
+        NSCAssert([a count] == [records count], @"Arena count failed");
+        NSCAssert([[a lastObject] isEqual: [records lastObject]],
+          @"Arena content failed");
+      }
+
+      {
+        SQLPackedArray  *pa;
+
+        pa = [[db query: @"select '{{1,2,3},{4,5,6}}'::int[] as p", nil]
+          lastObject];
+        pa = [(SQLRecord*)pa objectForKey: @"p"];
+        NSCAssert([pa isKindOfClass: [SQLPackedArray class]],
+          @"Packed array class failed");
+        NSCAssert([pa dimensions] == 2 && [pa valueCount] == 6
+          && [pa sizeOfDimension: 1] == 3, @"Packed array shape failed");
+        NSCAssert(((const long long*)[pa bytes])[5] == 6,
+          @"Packed array content failed");
+        NSCAssert([[[pa objectAtIndex: 1] objectAtIndex: 0] isEqual: @"4"],
+          @"Packed array element failed");
+      }
+
+      {
+        SQLBoundArray   *odd;
+        SQLBoundArray   *even;
+        SQLBoundArray   *keys;
+        NSMutableArray  *a;
+
+        odd = [SQLBoundArray boundArray: [NSArray arrayWithObjects:
+          [NSNumber numberWithInt: 1], [NSNumber numberWithInt: 3], nil]];
+        even = [SQLBoundArray boundArray: [NSArray arrayWithObjects:
+          [NSNumber numberWithInt: 2], nil]];
+        keys = [SQLBoundArray boundArray: [NSArray arrayWithObjects:
+          @"hello", @"absent", oddChars, nil]];
+
+        a = [db query: @"select id from xxx where id = ANY(", odd,
+          @") order by id", nil];
+        NSCAssert([a count] == 2
+          && [[[a objectAtIndex: 0] objectForKey: @"id"] intValue] == 1
+          && [[[a objectAtIndex: 1] objectForKey: @"id"] intValue] == 3,
+          @"Bound integer array failed");
+        a = [db query: @"select id from xxx where k = ANY(", keys,
+          @") order by id", nil];
+        NSCAssert([a count] == 2
+          && [[[a objectAtIndex: 0] objectForKey: @"id"] intValue] == 2
+          && [[[a objectAtIndex: 1] objectForKey: @"id"] intValue] == 3,
+          @"Bound text array failed");
+
+        /* Cached queries with the same text but different arrays must
+         * not share a cache entry.
+         */
+        r0 = [db cache: 10 query: @"select id from xxx where id = ANY(",
+          odd, @") order by id", nil];
+        r1 = [db cache: 10 query: @"select id from xxx where id = ANY(",
+          even, @") order by id", nil];
+        NSCAssert([r0 count] == 2 && [r1 count] == 1
+          && [[[r1 lastObject] objectForKey: @"id"] intValue] == 2,
+          @"Cached bound arrays were confused");
+        a = [db cache: 10 query: @"select id from xxx where id = ANY(",
+          [SQLBoundArray boundArray: [odd values]], @") order by id", nil];
+        NSCAssert([a lastObject] == [r0 lastObject],
+          @"Cached bound array was not found");
+      }
+
       db = [[[SQLClient alloc] initWithConfiguration: nil
                                                 name: @"test"] autorelease];
       [db addObserver: l 
@@ -508,6 +580,45 @@ main()
       NSCAssert([d2 timeIntervalSinceReferenceDate]
         == [[NSDate distantFuture] timeIntervalSinceReferenceDate],
         NSInternalInconsistencyException);
+
+#if	defined(__BLOCKS__)
+      /* Two asynchronous queries on the same client must both succeed,
+       * and the second must not be sent until the first has completed.
+       */
+      {
+	__block int	done = 0;
+	__block int	failed = 0;
+	NSDate		*limit;
+
+	[db query: @"SELECT 1 AS n, pg_sleep(0.5)"
+       completion: ^(NSMutableArray *rows, NSException *e)
+	  {
+	    if (nil != e || 1 != [rows count] || 0 != done)
+	      {
+		NSLog(@"First concurrent query failed: %@ %@", rows, e);
+		failed++;
+	      }
+	    done++;
+	  }];
+	[db query: @"SELECT 2 AS n"
+       completion: ^(NSMutableArray *rows, NSException *e)
+	  {
+	    if (nil != e || 1 != [rows count] || 1 != done)
+	      {
+		NSLog(@"Second concurrent query failed: %@ %@", rows, e);
+		failed++;
+	      }
+	    done++;
+	  }];
+	limit = [NSDate dateWithTimeIntervalSinceNow: 10.0];
+	while (done < 2 && [limit timeIntervalSinceNow] > 0.0)
+	  {
+	    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+	      beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+	  }
+	NSCAssert(2 == done && 0 == failed, NSInternalInconsistencyException);
+      }
+#endif
     }
 
   NSLog(@"Pool stats:\n%@", [sp statistics]);
@@ -26,6 +26,619 @@
 #import	<Foundation/Foundation.h>
 #import	"SQLClient.h"
 
+/* Parses the timestamp str in zone and checks that the result is the
+ * expected number of seconds since the reference date.
+ */
+static void
+checkDate(const char *str, NSTimeZone *zone, NSTimeInterval expected)
+{
+  NSDate	*d;
+
+  d = SQLClientNewDateFromBuffer(str, strlen(str), zone);
+  if (nil == d)
+    {
+      NSLog(@"Date '%s' was not parsed", str);
+    }
+  else if ([d timeIntervalSinceReferenceDate] != expected)
+    {
+      NSLog(@"Date '%s' parsed as %@ (%g) but expected %g",
+	str, d, [d timeIntervalSinceReferenceDate], expected);
+    }
+  [d release];
+}
+
+static void
+testDates()
+{
+  NSTimeZone	*london = [NSTimeZone timeZoneWithName: @"Europe/London"];
+  NSDate	*d;
+
+  /* Explicit offsets and 'Z' override the supplied zone.
+   */
+  checkDate("2001-01-01 00:00:00Z", london, 0.0);
+  checkDate("2001-01-01T00:00:00Z", nil, 0.0);
+  checkDate("2001-01-01 00:00:00+01", london, -3600.0);
+  checkDate("2001-01-01 00:00:00-0130", london, 5400.0);
+  checkDate("2001-01-01 00:00:00 +05:30", nil, -19800.0);
+  checkDate("2001-01-01 00:00:00.25+00", nil, 0.25);
+  d = SQLClientNewDateFromBuffer("2001-01-01 00:00:00+01", 22, nil);
+  if ([[(NSCalendarDate*)d timeZone] secondsFromGMT] != 3600)
+    {
+      NSLog(@"Date with offset has zone %@", [(NSCalendarDate*)d timeZone]);
+    }
+  [d release];
+
+  /* Without an offset the zone is used, and its offset depends on
+   * daylight savings time (in 2021 London changed from GMT to BST at
+   * 01:00 GMT on 28th March and back at 01:00 GMT on 31st October).
+   */
+  checkDate("2021-03-28 00:30:00", london, 638584200.0);
+  checkDate("2021-03-28 02:30:00", london, 638584200.0 + 3600.0);
+  checkDate("2021-10-31 00:30:00", london, 657333000.0 - 3600.0);
+  checkDate("2021-10-31 02:30:00", london, 657333000.0 + 7200.0);
+  checkDate("2021-07-01 12:00:00", london, 646833600.0 - 3600.0);
+
+  /* Very early or late years are the distant past or future.
+   */
+  checkDate("0001-01-01 00:00:00", nil,
+    [[NSDate distantPast] timeIntervalSinceReferenceDate]);
+  checkDate("0000-12-31", london,
+    [[NSDate distantPast] timeIntervalSinceReferenceDate]);
+  checkDate("4001-01-01 00:00:00+00", nil,
+    [[NSDate distantFuture] timeIntervalSinceReferenceDate]);
+  checkDate("9999-12-31", nil,
+    [[NSDate distantFuture] timeIntervalSinceReferenceDate]);
+
+  /* Malformed values are rejected.
+   */
+  if (nil != SQLClientNewDateFromBuffer("2001-13-01", 10, nil)
+    || nil != SQLClientNewDateFromBuffer("2001-01-01 25:00:00", 19, nil))
+    {
+      NSLog(@"Invalid date was parsed");
+    }
+}
+
+/* Used to ask a router for its read pool from another thread.
+ */
+@interface	RouterProbe : NSObject
+{
+@public
+  SQLClientRouter	*router;
+  SQLClientPool		*pool;
+  volatile BOOL		done;
+}
+- (void) probe: (id)ignored;
+@end
+
+@implementation	RouterProbe
+- (void) probe: (id)ignored
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+
+  pool = [router readPool];
+  done = YES;
+  [arp release];
+}
+@end
+
+static SQLClientPool *
+readPoolInOtherThread(SQLClientRouter *router)
+{
+  RouterProbe	*p = [[RouterProbe new] autorelease];
+
+  p->router = router;
+  [NSThread detachNewThreadSelector: @selector(probe:)
+			   toTarget: p
+			 withObject: nil];
+  while (NO == p->done)
+    {
+      [NSThread sleepForTimeInterval: 0.01];
+    }
+  return p->pool;
+}
+
+/* Returns the name recorded in the 'who' table of the database the
+ * router read from.
+ */
+static NSString *
+readName(SQLClientRouter *router)
+{
+  return [[[router query: @"select name from who", nil] lastObject]
+    objectForKey: @"name"];
+}
+
+static void
+testRouter()
+{
+  SQLClientPool		*primary;
+  SQLClientPool		*replicaA;
+  SQLClientPool		*replicaB;
+  SQLClientPool		*broken;
+  SQLClientRouter	*router;
+  NSEnumerator		*e;
+  SQLClientPool		*p;
+  NSString		*n;
+
+  primary = [[[SQLClientPool alloc] initWithConfiguration: nil
+    name: @"primary" max: 2 min: 1] autorelease];
+  replicaA = [[[SQLClientPool alloc] initWithConfiguration: nil
+    name: @"replicaA" max: 2 min: 1] autorelease];
+  replicaB = [[[SQLClientPool alloc] initWithConfiguration: nil
+    name: @"replicaB" max: 2 min: 1] autorelease];
+  broken = [[[SQLClientPool alloc] initWithConfiguration: nil
+    name: @"broken" max: 1 min: 1] autorelease];
+
+  e = [[NSArray arrayWithObjects: primary, replicaA, replicaB, nil]
+    objectEnumerator];
+  while (nil != (p = [e nextObject]))
+    {
+      NS_DURING
+	[p execute: @"drop table who", nil];
+      NS_HANDLER
+      NS_ENDHANDLER
+      [p execute: @"create table who (name char(10))", nil];
+      [p execute: @"insert into who (name) values (",
+	[p quote: [p name]], @")", nil];
+    }
+
+  /* Reads go to the least busy replica, idle replicas being chosen in
+   * order, while writes always go to the primary.
+   */
+  router = [[[SQLClientRouter alloc] initWithPrimary: primary
+    replicas: [NSArray arrayWithObjects: replicaA, replicaB, nil]]
+    autorelease];
+  if ([router readPool] != replicaA)
+    {
+      NSLog(@"Router did not choose the first idle replica");
+    }
+  n = readName(router);
+  if (NO == [n isEqual: @"replicaA"])
+    {
+      NSLog(@"Router read '%@' rather than from replicaA", n);
+    }
+  n = readName(router);
+  if (NO == [n isEqual: @"replicaA"] && NO == [n isEqual: @"replicaB"])
+    {
+      NSLog(@"Router read '%@' rather than from a replica", n);
+    }
+  [router execute: @"update who set name = 'written'", nil];
+  if (NO == [[primary queryString: @"select name from who", nil]
+    isEqual: @"written"])
+    {
+      NSLog(@"Router write did not go to the primary");
+    }
+
+  /* With stickiness, the thread which wrote reads from the primary
+   * until the window has passed, while other threads use replicas.
+   */
+  [router setStickiness: 1.0];
+  [router execute: @"update who set name = 'primary'", nil];
+  if ([router readPool] != primary)
+    {
+      NSLog(@"Router did not stick to the primary after a write");
+    }
+  p = readPoolInOtherThread(router);
+  if (p != replicaA && p != replicaB)
+    {
+      NSLog(@"Router stuck another thread to the primary");
+    }
+  [NSThread sleepForTimeInterval: 1.1];
+  p = [router readPool];
+  if (p != replicaA && p != replicaB)
+    {
+      NSLog(@"Router stuck to the primary after the window");
+    }
+  [router setStickiness: 0.0];
+
+  /* A replica which can't be reached fails over to the primary and is
+   * then left unused for a backoff period which doubles (from one second)
+   * on each consecutive failure.
+   */
+  router = [[[SQLClientRouter alloc] initWithPrimary: primary
+    replicas: [NSArray arrayWithObject: broken]] autorelease];
+  n = readName(router);
+  if (NO == [n isEqual: @"primary"])
+    {
+      NSLog(@"Router failover read '%@' rather than from primary", n);
+    }
+  if ([[router status] rangeOfString: @"failed over 1"].length == 0
+    || [[router status] rangeOfString: @"down for"].length == 0)
+    {
+      NSLog(@"Router failover not recorded in %@", [router status]);
+    }
+  if ([router readPool] != primary)
+    {
+      NSLog(@"Router used a replica during its backoff");
+    }
+  [NSThread sleepForTimeInterval: 1.1];
+  if ([router readPool] != broken)
+    {
+      NSLog(@"Router did not retry a replica after its backoff");
+    }
+  n = readName(router);
+  if (NO == [n isEqual: @"primary"])
+    {
+      NSLog(@"Router second failover read '%@' rather than primary", n);
+    }
+  [NSThread sleepForTimeInterval: 1.1];
+  if ([router readPool] != primary)
+    {
+      NSLog(@"Router backoff did not double after a second failure");
+    }
+  [NSThread sleepForTimeInterval: 1.0];
+  if ([router readPool] != broken)
+    {
+      NSLog(@"Router did not retry a replica after a doubled backoff");
+    }
+
+  e = [[NSArray arrayWithObjects: primary, replicaA, replicaB, nil]
+    objectEnumerator];
+  while (nil != (p = [e nextObject]))
+    {
+      [p execute: @"drop table who", nil];
+    }
+}
+
+/* Returns a copy of the UTF-8 string, so that key lookups can't succeed
+ * by comparing pointers.
+ */
+static NSString *
+key(const char *utf8)
+{
+  return [[[NSString alloc] initWithUTF8String: utf8] autorelease];
+}
+
+static void
+testKeys()
+{
+  NSString	*names[12];
+  SQLRecordKeys	*keys;
+  NSUInteger	c;
+
+  names[0] = @"Name";
+  names[1] = key("\xc3\x89T\xc3\x89");	// E acute, T, E acute
+  names[2] = key("\xce\x91\xce\x92\xce\x93");	// Greek capitals
+  names[3] = @"";
+  names[4] = @"name";
+  for (c = 5; c < 12; c++)
+    {
+      names[c] = [NSString stringWithFormat: @"Column%u", (unsigned)c];
+    }
+
+  /* Check both small key sets (searched linearly) and larger ones
+   * (which use a hash table).
+   */
+  for (c = 5; c <= 12; c += 7)
+    {
+      keys = [SQLRecordKeys keysWithNames: names count: c];
+      if ([keys indexForKey: key("\xc3\xa9t\xc3\xa9")] != 1	// lowercase
+	|| [keys indexForKey: key("\xc3\xa9T\xc3\x89")] != 1)	// mixed case
+	{
+	  NSLog(@"Keys (%u) Latin-1 case insensitive lookup failed",
+	    (unsigned)c);
+	}
+      if ([keys indexForKey: key("\xce\xb1\xce\xb2\xce\xb3")] != 2)
+	{
+	  NSLog(@"Keys (%u) Greek case insensitive lookup failed",
+	    (unsigned)c);
+	}
+      if ([keys indexForKey: key("\xc3\xa9t")] != NSNotFound
+	|| [keys indexForKey: key("ete")] != NSNotFound)
+	{
+	  NSLog(@"Keys (%u) matched a different non-ASCII key", (unsigned)c);
+	}
+      if ([keys indexForKey: key("")] != 3)
+	{
+	  NSLog(@"Keys (%u) empty key lookup failed", (unsigned)c);
+	}
+      if ([keys indexForKey: nil] != NSNotFound)
+	{
+	  NSLog(@"Keys (%u) nil key was found", (unsigned)c);
+	}
+      if ([keys indexForKey: key("name")] != 4
+	|| [keys indexForKey: key("Name")] != 0
+	|| [keys indexForKey: key("NAME")] != 0)
+	{
+	  NSLog(@"Keys (%u) exact match not preferred", (unsigned)c);
+	}
+    }
+  keys = [SQLRecordKeys keysWithNames: names count: 3];
+  if ([keys indexForKey: key("")] != NSNotFound)
+    {
+      NSLog(@"Keys without an empty key matched an empty key");
+    }
+}
+
+/* Used to look clients up in the registry from another thread while
+ * they are being created and deallocated.
+ */
+@interface	ClientProbe : NSObject
+{
+@public
+  volatile BOOL		stop;
+  volatile BOOL		done;
+  unsigned		found;
+}
+- (void) probe: (id)ignored;
+@end
+
+@implementation	ClientProbe
+- (void) probe: (id)ignored
+{
+  while (NO == stop)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      NSEnumerator	*e;
+      SQLClient		*c;
+
+      e = [[SQLClient allClients] objectEnumerator];
+      while (nil != (c = [e nextObject]))
+	{
+	  if ([[c name] length] > 0)
+	    {
+	      found++;
+	    }
+	}
+      c = [SQLClient existingClient: @"lifetime1"];
+      if (nil != c && NO == [[c name] isEqual: @"lifetime1"])
+	{
+	  NSLog(@"Existing client has the wrong name: %@", [c name]);
+	}
+      [arp release];
+    }
+  done = YES;
+}
+@end
+
+static void
+testLifetime()
+{
+  ClientProbe	*p = [[ClientProbe new] autorelease];
+  SQLClientPool	*pool;
+  SQLClient	*c[3];
+  unsigned	max = [SQLClient maxConnections];
+  unsigned	i;
+
+  /* Clients looked up in other threads while their last reference is
+   * released must be either found alive (and kept alive) or not at all.
+   */
+  [NSThread detachNewThreadSelector: @selector(probe:)
+			   toTarget: p
+			 withObject: nil];
+  for (i = 0; i < 2000; i++)
+    {
+      SQLClient	*o;
+
+      o = [[SQLClient alloc] initWithConfiguration: nil name: @"lifetime1"];
+      if (NO == [[o name] isEqual: @"lifetime1"])
+	{
+	  NSLog(@"New client has the wrong name: %@", [o name]);
+	}
+      [o release];
+    }
+  p->stop = YES;
+  while (NO == p->done)
+    {
+      [NSThread sleepForTimeInterval: 0.01];
+    }
+  if (nil != [SQLClient existingClient: @"lifetime1"])
+    {
+      NSLog(@"Released client is still registered");
+    }
+
+  /* Releasing the last reference to a pooled client returns it to the
+   * pool rather than deallocating it.
+   */
+  pool = [[[SQLClientPool alloc] initWithConfiguration: nil
+    name: @"lifetime0" max: 1 min: 1] autorelease];
+  {
+    NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+
+    c[0] = [[pool provideClient] retain];
+    [arp release];
+  }
+  if ([pool availableConnections] != 0)
+    {
+      NSLog(@"Pool client in use is available");
+    }
+  [c[0] release];
+  if ([pool availableConnections] != 1)
+    {
+      NSLog(@"Pool client was not returned by its final release");
+    }
+  {
+    NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+
+    if ([pool provideClient] != c[0])
+      {
+	NSLog(@"Pool client was not reused after its final release");
+      }
+    [arp release];
+  }
+
+  /* When the connection limit is reached, connecting a client closes the
+   * connection which has been idle for longest.
+   */
+  [SQLClient setMaxConnections: 2];
+  for (i = 0; i < 3; i++)
+    {
+      NSString	*n = [NSString stringWithFormat: @"lifetime%u", i + 1];
+
+      c[i] = [[SQLClient alloc] initWithConfiguration: nil name: n];
+      [c[i] queryString: @"select 1", nil];
+      [NSThread sleepForTimeInterval: 0.01];
+    }
+  if (YES == [c[0] connected])
+    {
+      NSLog(@"Longest idle client not disconnected at the limit");
+    }
+  if (NO == [c[1] connected] || NO == [c[2] connected])
+    {
+      NSLog(@"Recently used client disconnected at the limit");
+    }
+  for (i = 0; i < 3; i++)
+    {
+      [c[i] release];
+    }
+  [SQLClient setMaxConnections: max];
+}
+
+/* Requests a client of the given priority from pool, waiting for up to
+ * wait seconds, and checks whether one was provided as expected and
+ * (if not) that the request waited for the whole period.
+ */
+static SQLClient *
+request(SQLClientPool *pool, SQLClientPriority priority,
+  NSTimeInterval wait, BOOL expected, NSString *what)
+{
+  NSDate	*start = [NSDate date];
+  SQLClient	*c;
+  NSTimeInterval	elapsed;
+
+  c = [pool provideClientBeforeDate:
+    [NSDate dateWithTimeIntervalSinceNow: wait]
+			  exclusive: YES
+			   priority: priority];
+  elapsed = [[NSDate date] timeIntervalSinceDate: start];
+  if ((nil != c) != expected)
+    {
+      NSLog(@"Priority %@ %@ a client (status %@)",
+	what, (nil == c) ? @"did not get" : @"got", [pool status]);
+    }
+  if (nil == c && (elapsed < wait - 0.05 || elapsed > wait + 1.0))
+    {
+      NSLog(@"Priority %@ timed out after %g rather than %g",
+	what, elapsed, wait);
+    }
+  return c;
+}
+
+static void
+testPriority()
+{
+  SQLClientPool	*pool;
+  SQLClient	*low[2];
+  SQLClient	*normal;
+  SQLClient	*high;
+  SQLClient	*c;
+
+  /* A pool of four clients with one reserved for high priority requests
+   * and low priority requests limited to half of the pool.
+   */
+  pool = [[[SQLClientPool alloc] initWithConfiguration: nil
+    name: @"priority" max: 4 min: 1] autorelease];
+  [pool setReserve: 1 share: 100 forPriority: SQLClientPriorityHigh];
+  [pool setReserve: 0 share: 50 forPriority: SQLClientPriorityLow];
+
+  low[0] = request(pool, SQLClientPriorityLow, 0.2, YES, @"first low");
+  low[1] = request(pool, SQLClientPriorityLow, 0.2, YES, @"second low");
+  c = request(pool, SQLClientPriorityLow, 0.3, NO, @"low beyond share");
+  normal = request(pool, SQLClientPriorityNormal, 0.2, YES, @"normal");
+  c = request(pool, SQLClientPriorityNormal, 0.3, NO, @"normal reserve");
+  high = request(pool, SQLClientPriorityHigh, 0.2, YES, @"reserved high");
+  c = request(pool, SQLClientPriorityHigh, 0.3, NO, @"high when full");
+
+  /* The requests which timed out must have left the queue, so a client
+   * returned to the pool is available to a new request at once.
+   */
+  [pool swallowClient: low[0]];
+  low[0] = request(pool, SQLClientPriorityLow, 0.2, YES, @"low after return");
+  [pool swallowClient: low[0]];
+  [pool swallowClient: low[1]];
+  [pool swallowClient: normal];
+  [pool swallowClient: high];
+  if ([pool availableConnections] != 4)
+    {
+      NSLog(@"Priority pool has %d clients available after returns: %@",
+	[pool availableConnections], [pool status]);
+    }
+}
+
+/* Executes a batch of sixteen inserts in which the statements at the
+ * indexes in bad violate the primary key, and checks that bisection
+ * reports exactly those statements as failures.
+ */
+static void
+checkBisect(SQLClient *db, NSIndexSet *bad)
+{
+  SQLTransaction	*t = [db batch: NO];
+  SQLTransaction	*f = [db transaction];
+  NSString		*m;
+  unsigned		i;
+  unsigned		n;
+
+  [db execute: @"delete from bisect", nil];
+  [t setBisectOnFailure: YES];
+  for (i = 0; i < 16; i++)
+    {
+      if ([bad containsIndex: i])
+	{
+	  [t add: @"insert into bisect (id, note) values (100, ",
+	    [db quote: [NSString stringWithFormat: @"bad%u", i]], @")", nil];
+	}
+      else
+	{
+	  [t add: @"insert into bisect (id, note) values (",
+	    [NSNumber numberWithUnsignedInt: (i == 0 ? 100 : i)], @", ",
+	    [db quote: [NSString stringWithFormat: @"good%u", i]], @")", nil];
+	}
+    }
+  n = [t executeBatchReturningFailures: f logExceptions: NO];
+  if (n != 16 - [bad count] || [f totalCount] != [bad count])
+    {
+      NSLog(@"Bisect %@ succeeded %u and failed %u", bad, n, [f totalCount]);
+    }
+  for (i = 0; i < [f count]; i++)
+    {
+      NSString	*d = [[f transactionAtIndex: i] description];
+      NSUInteger	index = [bad firstIndex];
+      unsigned		j;
+
+      for (j = 0; j < i; j++)
+	{
+	  index = [bad indexGreaterThanIndex: index];
+	}
+      m = [NSString stringWithFormat: @"'bad%u'", (unsigned)index];
+      if ([d rangeOfString: m].length == 0)
+	{
+	  NSLog(@"Bisect %@ reported %@ as failure %u", bad, d, i);
+	}
+    }
+  if (NO == [[db queryString: @"select count(*) from bisect", nil]
+    isEqual: [NSString stringWithFormat: @"%u", n]])
+    {
+      NSLog(@"Bisect %@ did not keep the successful statements", bad);
+    }
+}
+
+static void
+testBisect(SQLClient *db)
+{
+  NSMutableIndexSet	*bad = [NSMutableIndexSet indexSet];
+
+  NS_DURING
+    [db execute: @"drop table bisect", nil];
+  NS_HANDLER
+  NS_ENDHANDLER
+  [db execute: @"create table bisect (id int primary key, note char(10))",
+    nil];
+
+  /* A single failure in the middle of the batch.
+   */
+  [bad addIndex: 11];
+  checkBisect(db, bad);
+
+  /* Failures next to the first statement (which inserts the key that
+   * the failing ones duplicate) and at the end of the batch.
+   */
+  [bad removeAllIndexes];
+  [bad addIndex: 1];
+  [bad addIndex: 15];
+  checkBisect(db, bad);
+
+  [db execute: @"drop table bisect", nil];
+}
+
 int
 main()
 {
@@ -37,6 +650,8 @@ main()
   unsigned char		dbuf[256];
   unsigned int		i;
   NSData		*data;
+  NSMutableArray	*rows;
+  NSMutableIndexSet	*failures;
 
   defs = [NSUserDefaults standardUserDefaults];
   [defs registerDefaults:
@@ -49,11 +664,62 @@ main()
 	  @"SQLite", @"ServerType",
 	  nil],
 	@"test",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"router-primary", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"primary",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"router-replicaA", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"replicaA",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"router-replicaB", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"replicaB",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"/nonexistent/router-broken", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"broken",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"priority", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"priority",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"lifetime0", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"lifetime0",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"lifetime1", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"lifetime1",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"lifetime2", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"lifetime2",
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  @"lifetime3", @"Database",
+	  @"SQLite", @"ServerType",
+	  nil],
+	@"lifetime3",
 	nil],
       @"SQLClientReferences",
       nil]
     ];
 
+  testDates();
+  testKeys();
+  testRouter();
+  testLifetime();
+  testPriority();
+
   for (i = 0; i < 256; i++)
     {
       dbuf[i] = i;
@@ -100,6 +766,33 @@ main()
     nil];
 
   records = [db query: @"select * from xxx", nil];
+
+  rows = [NSMutableArray array];
+  for (i = 0; i < 600; i++)
+    {
+      [rows addObject: [NSArray arrayWithObjects:
+	[NSString stringWithFormat: @"bulk%u", i],
+	@"B",
+	[NSNumber numberWithInt: i],
+	data,
+	nil]];
+    }
+  failures = [NSMutableIndexSet indexSet];
+  if ([db insert: rows
+	    into: @"xxx"
+	 columns: [NSArray arrayWithObjects: @"k", @"char1", @"intval", @"b", nil]
+	failures: failures] != 600 || [failures count] > 0)
+    {
+      NSLog(@"Bulk insert failed for %@", failures);
+    }
+  if (![[db queryString: @"select count(*) from xxx where char1 = 'B'", nil]
+    isEqual: @"600"])
+    {
+      NSLog(@"Bulk insert did not produce 600 records");
+    }
+
+  testBisect(db);
+
   [db execute: @"drop table xxx", nil];
 
   if ([records count] != 2)